@@ -0,0 +1,50 @@
+#ifndef BASE_ALIGNED_ALLOCATOR_H
+#define BASE_ALIGNED_ALLOCATOR_H
+
+#include <cstdint>
+#include <cstddef>
+#include <new>
+
+namespace base
+{
+
+// cache line size, enough for any SSE/AVX/AVX-512 load
+constexpr std::size_t default_memory_align = 64;
+
+template<typename T, std::size_t Align = default_memory_align>
+struct aligned_allocator_t
+{
+    static_assert((Align & (Align - 1)) == 0, "Align must be a power of two");
+
+    using value_type = T;
+
+    template<typename U>
+    struct rebind { using other = aligned_allocator_t<U, Align>; };
+
+    aligned_allocator_t() noexcept = default;
+
+    template<typename U>
+    aligned_allocator_t(const aligned_allocator_t<U, Align>&) noexcept {}
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(::operator new(n * sizeof(T)
+                                              , std::align_val_t(Align)));
+    }
+
+    void deallocate(T* p, std::size_t) noexcept
+    {
+        ::operator delete(p
+                          , std::align_val_t(Align));
+    }
+
+    template<typename U>
+    bool operator ==(const aligned_allocator_t<U, Align>&) const noexcept { return true; }
+
+    template<typename U>
+    bool operator !=(const aligned_allocator_t<U, Align>&) const noexcept { return false; }
+};
+
+}
+
+#endif // BASE_ALIGNED_ALLOCATOR_H
@@ -0,0 +1,132 @@
+#ifndef BASE_LRU_CACHE_H
+#define BASE_LRU_CACHE_H
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <map>
+#include <utility>
+
+namespace base
+{
+
+// Bounded map that drops the least recently used entries once the summed
+// cost of the entries is over the capacity. The newest entry is always
+// kept, so the reference returned by insert() stays valid until the next
+// insert(). Not thread safe.
+template<typename Key, typename Value, typename Compare = std::less<Key>>
+class lru_cache
+{
+    struct entry_t
+    {
+        Key         key;
+        Value       value;
+        std::size_t cost;
+    };
+
+    using entry_list_t = std::list<entry_t>;
+    using entry_index_t = std::map<Key, typename entry_list_t::iterator, Compare>;
+
+    entry_list_t    m_entries;      // front - most recently used
+    entry_index_t   m_index;
+    std::size_t     m_capacity;
+    std::size_t     m_cost;
+
+    void shrink()
+    {
+        while (m_cost > m_capacity
+               && m_entries.size() > 1)
+        {
+            auto& entry = m_entries.back();
+            m_cost -= entry.cost;
+            m_index.erase(entry.key);
+            m_entries.pop_back();
+        }
+    }
+
+public:
+    lru_cache(std::size_t capacity)
+        : m_capacity(capacity)
+        , m_cost(0)
+    {
+
+    }
+
+    // nullptr on a miss, a hit becomes the most recently used entry
+    Value* find(const Key& key)
+    {
+        auto it = m_index.find(key);
+        if (it == m_index.end())
+        {
+            return nullptr;
+        }
+
+        m_entries.splice(m_entries.begin()
+                         , m_entries
+                         , it->second);
+
+        return &it->second->value;
+    }
+
+    Value& insert(const Key& key
+                  , Value value
+                  , std::size_t cost = 1)
+    {
+        erase(key);
+
+        m_entries.push_front({ key, std::move(value), cost });
+        m_index.emplace(key, m_entries.begin());
+        m_cost += cost;
+
+        shrink();
+
+        return m_entries.front().value;
+    }
+
+    bool erase(const Key& key)
+    {
+        auto it = m_index.find(key);
+        if (it == m_index.end())
+        {
+            return false;
+        }
+
+        m_cost -= it->second->cost;
+        m_entries.erase(it->second);
+        m_index.erase(it);
+
+        return true;
+    }
+
+    void clear()
+    {
+        m_entries.clear();
+        m_index.clear();
+        m_cost = 0;
+    }
+
+    void set_capacity(std::size_t capacity)
+    {
+        m_capacity = capacity;
+        shrink();
+    }
+
+    std::size_t capacity() const
+    {
+        return m_capacity;
+    }
+
+    std::size_t cost() const
+    {
+        return m_cost;
+    }
+
+    std::size_t size() const
+    {
+        return m_entries.size();
+    }
+};
+
+}
+
+#endif // BASE_LRU_CACHE_H
@@ -0,0 +1,984 @@
+#include "shm_transport.h"
+
+#include <atomic>
+#include <algorithm>
+#include <climits>
+#include <cerrno>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+
+namespace base
+{
+
+const std::uint32_t shm_magic = 0x4d485346;     // "FSHM"
+const std::uint32_t shm_version = 2;
+const std::size_t shm_page_size = 4096;
+const std::size_t shm_line_size = 64;
+const std::uint32_t shm_max_readers = 63;                   // a bit each in shm_slot_t::readers
+const std::uint64_t shm_write_lock = 1ull << shm_max_readers;
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "shared atomics have to be lock-free");
+static_assert(std::atomic<std::int32_t>::is_always_lock_free, "shared atomics have to be lock-free");
+
+// the memfd layout: header, descriptor ring, slot headers with the frame
+// info, page aligned frame data
+struct shm_layout_t
+{
+    std::uint32_t   slot_count;
+    std::uint32_t   ring_size;
+    std::uint64_t   slot_size;
+    std::uint64_t   meta_size;
+    std::uint64_t   slot_stride;
+    std::uint64_t   ring_offset;
+    std::uint64_t   slots_offset;
+    std::uint64_t   data_offset;
+    std::uint64_t   total_size;
+};
+
+struct alignas(64) shm_header_t
+{
+    std::uint32_t   magic;
+    std::uint32_t   version;
+    shm_layout_t    layout;
+
+    alignas(64) std::atomic<std::uint64_t>  write_index;    // frames published
+    alignas(64) std::atomic<std::uint32_t>  wake_word;      // futex of the waiting sources
+    std::atomic<std::uint32_t>              waiters;
+    std::atomic<std::uint32_t>              closed;
+
+    // pid of the process of every open source, 0 - free; the sink takes
+    // back the frames of a source whose process is gone
+    alignas(64) std::atomic<std::int32_t>   readers[shm_max_readers];
+};
+
+// seqlock: sequence is 0 while the descriptor is rewritten
+struct alignas(64) shm_descriptor_t
+{
+    std::atomic<std::uint64_t>  sequence;   // write index + 1 of the frame
+    std::atomic<std::uint32_t>  slot;
+    std::atomic<std::uint32_t>  meta_size;
+    std::atomic<std::uint64_t>  size;
+};
+
+struct alignas(64) shm_slot_t
+{
+    std::atomic<std::uint64_t>  readers;    // bit per source holding the frame, shm_write_lock - the sink writes it
+    std::atomic<std::uint64_t>  sequence;   // of the frame in the slot
+};
+
+static std::size_t align_size(std::size_t size
+                              , std::size_t align)
+{
+    return (size + align - 1) / align * align;
+}
+
+// the source trusts no offset of the shared header: every region has to
+// lie inside the mapping, in the order the sink lays them out
+static bool is_valid_layout(const shm_layout_t& layout
+                            , std::size_t mapped_size)
+{
+    auto fits = [](std::uint64_t offset
+                   , std::uint64_t count
+                   , std::uint64_t size
+                   , std::uint64_t end)
+    {
+        return offset <= end
+                && size > 0
+                && count <= (end - offset) / size;
+    };
+
+    return layout.total_size <= mapped_size
+            && layout.slot_count > 0
+            && layout.ring_size > 0
+            && layout.slot_size > 0
+            && layout.slot_stride >= sizeof(shm_slot_t)
+            && layout.meta_size <= layout.slot_stride - sizeof(shm_slot_t)
+            && layout.slot_stride % alignof(shm_slot_t) == 0
+            && layout.ring_offset >= sizeof(shm_header_t)
+            && layout.ring_offset % alignof(shm_descriptor_t) == 0
+            && layout.slots_offset % alignof(shm_slot_t) == 0
+            && fits(layout.ring_offset, layout.ring_size, sizeof(shm_descriptor_t), layout.slots_offset)
+            && fits(layout.slots_offset, layout.slot_count, layout.slot_stride, layout.data_offset)
+            && fits(layout.data_offset, layout.slot_count, layout.slot_size, layout.total_size);
+}
+
+static bool is_process_alive(std::int32_t pid)
+{
+    return ::kill(pid, 0) == 0
+            || errno != ESRCH;
+}
+
+static void futex_wake(std::atomic<std::uint32_t>& word)
+{
+    ::syscall(SYS_futex, &word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+static void futex_wait(std::atomic<std::uint32_t>& word
+                       , std::uint32_t value
+                       , std::uint32_t timeout)
+{
+    struct timespec ts = { static_cast<time_t>(timeout / 1000), static_cast<long>(timeout % 1000) * 1000000 };
+
+    ::syscall(SYS_futex, &word, FUTEX_WAIT, value, &ts, nullptr, 0);
+}
+
+// the layout is a private copy, checked once: the other process can not
+// move the regions under the accessors
+struct shm_mapping_t
+{
+    std::int32_t    fd;
+    std::uint8_t*   memory;
+    std::size_t     size;
+    shm_layout_t    layout;
+
+    shm_mapping_t(std::int32_t fd
+                  , void* memory
+                  , std::size_t size)
+        : fd(fd)
+        , memory(static_cast<std::uint8_t*>(memory))
+        , size(size)
+        , layout()
+    {
+
+    }
+
+    ~shm_mapping_t()
+    {
+        ::munmap(memory, size);
+        ::close(fd);
+    }
+
+    shm_header_t& header() const
+    {
+        return *reinterpret_cast<shm_header_t*>(memory);
+    }
+
+    shm_descriptor_t& descriptor(std::uint64_t index) const
+    {
+        return reinterpret_cast<shm_descriptor_t*>(memory + layout.ring_offset)[index % layout.ring_size];
+    }
+
+    shm_slot_t& slot(std::uint32_t index) const
+    {
+        return *reinterpret_cast<shm_slot_t*>(memory + layout.slots_offset + index * layout.slot_stride);
+    }
+
+    std::uint8_t* meta(std::uint32_t index) const
+    {
+        return reinterpret_cast<std::uint8_t*>(&slot(index)) + sizeof(shm_slot_t);
+    }
+
+    std::uint8_t* data(std::uint32_t index) const
+    {
+        return memory + layout.data_offset + index * layout.slot_size;
+    }
+};
+
+typedef std::shared_ptr<shm_mapping_t> shm_mapping_ptr_t;
+
+// the reader entry of a source, shared with its frames: the entry is free
+// for another source only when the source and all its frames are gone
+struct shm_reader_lease_t
+{
+    shm_mapping_ptr_t   mapping;
+    std::uint32_t       index;
+
+    shm_reader_lease_t(const shm_mapping_ptr_t& mapping
+                       , std::uint32_t index)
+        : mapping(mapping)
+        , index(index)
+    {
+
+    }
+
+    ~shm_reader_lease_t()
+    {
+        mapping->header().readers[index].store(0, std::memory_order_release);
+    }
+
+    std::uint64_t bit() const
+    {
+        return 1ull << index;
+    }
+};
+
+typedef std::shared_ptr<shm_reader_lease_t> shm_reader_lease_ptr_t;
+
+shm_config_t::shm_config_t(std::size_t slots
+                           , std::size_t slot_size
+                           , std::size_t meta_size)
+    : slots(slots)
+    , slot_size(slot_size)
+    , meta_size(meta_size)
+{
+
+}
+
+shm_frame_t::shm_frame_t()
+    : m_slot(nullptr)
+    , m_data(nullptr)
+    , m_size(0)
+    , m_meta(nullptr)
+    , m_meta_size(0)
+    , m_sequence(0)
+{
+
+}
+
+shm_frame_t::~shm_frame_t()
+{
+    release();
+}
+
+shm_frame_t::shm_frame_t(shm_frame_t &&frame)
+    : shm_frame_t()
+{
+    *this = std::move(frame);
+}
+
+shm_frame_t &shm_frame_t::operator=(shm_frame_t &&frame)
+{
+    if (this != &frame)
+    {
+        release();
+
+        m_lease = std::move(frame.m_lease);
+        m_slot = frame.m_slot;
+        m_data = frame.m_data;
+        m_size = frame.m_size;
+        m_meta = frame.m_meta;
+        m_meta_size = frame.m_meta_size;
+        m_sequence = frame.m_sequence;
+
+        frame.m_slot = nullptr;
+        frame.release();
+    }
+
+    return *this;
+}
+
+const uint8_t *shm_frame_t::data() const
+{
+    return m_data;
+}
+
+std::size_t shm_frame_t::size() const
+{
+    return m_size;
+}
+
+const void *shm_frame_t::meta() const
+{
+    return m_meta;
+}
+
+std::size_t shm_frame_t::meta_size() const
+{
+    return m_meta_size;
+}
+
+uint64_t shm_frame_t::sequence() const
+{
+    return m_sequence;
+}
+
+bool shm_frame_t::is_valid() const
+{
+    return m_slot != nullptr;
+}
+
+void shm_frame_t::release()
+{
+    if (m_slot != nullptr)
+    {
+        static_cast<shm_slot_t*>(m_slot)->readers.fetch_and(~m_lease->bit()
+                                                            , std::memory_order_release);
+    }
+
+    m_lease.reset();
+    m_slot = nullptr;
+    m_data = nullptr;
+    m_size = 0;
+    m_meta = nullptr;
+    m_meta_size = 0;
+    m_sequence = 0;
+}
+
+struct shm_sink_context_t
+{
+    shm_config_t        m_config;
+    shm_mapping_ptr_t   m_mapping;
+    std::int32_t        m_slot;         // acquired, -1 - none
+    std::uint32_t       m_next_slot;
+    shm_stats_t         m_stats;
+
+    shm_sink_context_t(const shm_config_t& config)
+        : m_config(config)
+        , m_slot(-1)
+        , m_next_slot(0)
+    {
+
+    }
+
+    ~shm_sink_context_t()
+    {
+        close();
+    }
+
+    bool open(const std::string& name)
+    {
+        close();
+
+        if (m_config.slots == 0
+                || m_config.slot_size == 0)
+        {
+            return false;
+        }
+
+        auto slot_count = m_config.slots;
+        auto ring_size = slot_count * 2;
+        auto slot_size = align_size(m_config.slot_size, shm_page_size);
+        auto slot_stride = align_size(sizeof(shm_slot_t) + m_config.meta_size, shm_line_size);
+
+        auto ring_offset = align_size(sizeof(shm_header_t), shm_line_size);
+        auto slots_offset = ring_offset + ring_size * sizeof(shm_descriptor_t);
+        auto data_offset = align_size(slots_offset + slot_count * slot_stride, shm_page_size);
+        auto total_size = data_offset + slot_count * slot_size;
+
+        auto fd = ::memfd_create(name.c_str(), MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        if (::ftruncate(fd, total_size) != 0)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        // the sources can rely on the size of the mapping
+        ::fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+
+        auto memory = ::mmap(nullptr, total_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (memory == MAP_FAILED)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        m_mapping = std::make_shared<shm_mapping_t>(fd
+                                                    , memory
+                                                    , total_size);
+
+        // the memfd is zero filled, atomics start at zero
+        auto& header = m_mapping->header();
+        auto& layout = m_mapping->layout;
+
+        layout.slot_count = slot_count;
+        layout.ring_size = ring_size;
+        layout.slot_size = slot_size;
+        layout.meta_size = m_config.meta_size;
+        layout.slot_stride = slot_stride;
+        layout.ring_offset = ring_offset;
+        layout.slots_offset = slots_offset;
+        layout.data_offset = data_offset;
+        layout.total_size = total_size;
+
+        header.layout = layout;
+        header.version = shm_version;
+
+        std::atomic_thread_fence(std::memory_order_release);
+        header.magic = shm_magic;
+
+        m_slot = -1;
+        m_next_slot = 0;
+        m_stats = shm_stats_t();
+
+        return true;
+    }
+
+    bool close()
+    {
+        if (m_mapping != nullptr)
+        {
+            auto& header = m_mapping->header();
+
+            if (m_slot >= 0)
+            {
+                m_mapping->slot(m_slot).readers.store(0, std::memory_order_release);
+                m_slot = -1;
+            }
+
+            header.closed.store(1);
+            header.wake_word.fetch_add(1);
+            futex_wake(header.wake_word);
+
+            m_mapping.reset();
+            return true;
+        }
+
+        return false;
+    }
+
+    bool lock_free_slot()
+    {
+        auto slot_count = m_mapping->layout.slot_count;
+
+        for (std::uint32_t i = 0; i < slot_count; i++)
+        {
+            auto index = (m_next_slot + i) % slot_count;
+            std::uint64_t readers = 0;
+
+            if (m_mapping->slot(index).readers.compare_exchange_strong(readers
+                                                                        , shm_write_lock
+                                                                        , std::memory_order_acquire))
+            {
+                m_slot = index;
+                m_next_slot = index + 1;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // drops the frames held by the sources of dead processes, the count of
+    // the reclaimed sources
+    std::size_t reclaim_readers()
+    {
+        auto& header = m_mapping->header();
+        std::uint64_t dead_readers = 0;
+
+        for (std::uint32_t i = 0; i < shm_max_readers; i++)
+        {
+            auto pid = header.readers[i].load(std::memory_order_acquire);
+
+            if (pid != 0
+                    && !is_process_alive(pid)
+                    && header.readers[i].compare_exchange_strong(pid, 0))
+            {
+                dead_readers |= 1ull << i;
+            }
+        }
+
+        if (dead_readers != 0)
+        {
+            for (std::uint32_t i = 0; i < m_mapping->layout.slot_count; i++)
+            {
+                m_mapping->slot(i).readers.fetch_and(~dead_readers
+                                                     , std::memory_order_release);
+            }
+        }
+
+        return __builtin_popcountll(dead_readers);
+    }
+
+    void* acquire(std::size_t size)
+    {
+        if (m_mapping == nullptr
+                || size > m_mapping->layout.slot_size)
+        {
+            return nullptr;
+        }
+
+        if (m_slot >= 0)
+        {
+            return m_mapping->data(m_slot);
+        }
+
+        // every slot is held: a crashed source may hold some of them
+        if (lock_free_slot()
+                || (reclaim_readers() > 0
+                    && lock_free_slot()))
+        {
+            return m_mapping->data(m_slot);
+        }
+
+        m_stats.dropped++;
+        return nullptr;
+    }
+
+    bool commit(const void* meta
+                , std::size_t meta_size
+                , std::size_t size)
+    {
+        if (m_mapping == nullptr
+                || m_slot < 0)
+        {
+            return false;
+        }
+
+        auto& header = m_mapping->header();
+        auto& slot = m_mapping->slot(m_slot);
+
+        if (meta_size > m_mapping->layout.meta_size
+                || size > m_mapping->layout.slot_size)
+        {
+            slot.readers.store(0, std::memory_order_release);
+            m_slot = -1;
+            return false;
+        }
+
+        auto index = header.write_index.load(std::memory_order_relaxed);
+
+        std::memcpy(m_mapping->meta(m_slot), meta, meta_size);
+        slot.sequence.store(index + 1, std::memory_order_relaxed);
+        slot.readers.store(0, std::memory_order_release);
+
+        auto& descriptor = m_mapping->descriptor(index);
+
+        descriptor.sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        descriptor.slot.store(m_slot, std::memory_order_relaxed);
+        descriptor.meta_size.store(meta_size, std::memory_order_relaxed);
+        descriptor.size.store(size, std::memory_order_relaxed);
+        descriptor.sequence.store(index + 1, std::memory_order_release);
+
+        header.write_index.store(index + 1, std::memory_order_release);
+
+        // the syscall only when a source sleeps
+        header.wake_word.fetch_add(1);
+        if (header.waiters.load() > 0)
+        {
+            futex_wake(header.wake_word);
+        }
+
+        m_slot = -1;
+        m_stats.frames++;
+        m_stats.bytes += size;
+
+        return true;
+    }
+
+    bool push(const void* meta
+              , std::size_t meta_size
+              , const void* data
+              , std::size_t size)
+    {
+        if (auto buffer = acquire(size))
+        {
+            std::memcpy(buffer, data, size);
+            return commit(meta
+                          , meta_size
+                          , size);
+        }
+
+        return false;
+    }
+};
+
+struct shm_source_context_t
+{
+    shm_mapping_ptr_t       m_mapping;
+    shm_reader_lease_ptr_t  m_lease;
+    std::uint64_t           m_read_index;
+    shm_stats_t             m_stats;
+
+    shm_source_context_t()
+        : m_read_index(0)
+    {
+
+    }
+
+    bool open(std::int32_t fd)
+    {
+        close();
+
+        struct stat st = {};
+
+        if (fd < 0
+                || ::fstat(fd, &st) != 0
+                || static_cast<std::size_t>(st.st_size) < sizeof(shm_header_t))
+        {
+            return false;
+        }
+
+        auto own_fd = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if (own_fd < 0)
+        {
+            return false;
+        }
+
+        auto memory = ::mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, own_fd, 0);
+        if (memory == MAP_FAILED)
+        {
+            ::close(own_fd);
+            return false;
+        }
+
+        auto mapping = std::make_shared<shm_mapping_t>(own_fd
+                                                       , memory
+                                                       , st.st_size);
+
+        auto& header = mapping->header();
+
+        if (header.magic != shm_magic)
+        {
+            return false;
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        mapping->layout = header.layout;
+
+        if (header.version != shm_version
+                || !is_valid_layout(mapping->layout
+                                    , mapping->size))
+        {
+            return false;
+        }
+
+        auto lease = claim_reader(mapping);
+        if (lease == nullptr)
+        {
+            return false;
+        }
+
+        m_mapping = std::move(mapping);
+        m_lease = std::move(lease);
+        m_read_index = m_mapping->header().write_index.load(std::memory_order_acquire);
+        m_stats = shm_stats_t();
+
+        return true;
+    }
+
+    static shm_reader_lease_ptr_t claim_reader(const shm_mapping_ptr_t& mapping)
+    {
+        auto& header = mapping->header();
+        std::int32_t pid = ::getpid();
+
+        for (std::uint32_t i = 0; i < shm_max_readers; i++)
+        {
+            std::int32_t free_pid = 0;
+
+            if (header.readers[i].compare_exchange_strong(free_pid, pid))
+            {
+                return std::make_shared<shm_reader_lease_t>(mapping
+                                                            , i);
+            }
+        }
+
+        return nullptr;
+    }
+
+    // the reader entry stays taken while a popped frame is alive
+    bool close()
+    {
+        if (m_mapping != nullptr)
+        {
+            m_lease.reset();
+            m_mapping.reset();
+            return true;
+        }
+
+        return false;
+    }
+
+    // takes the frame at the read index, false if it was overwritten
+    bool take_frame(shm_frame_t& frame)
+    {
+        auto sequence = m_read_index + 1;
+        auto& descriptor = m_mapping->descriptor(m_read_index);
+
+        if (descriptor.sequence.load(std::memory_order_acquire) != sequence)
+        {
+            return false;
+        }
+
+        auto slot_index = descriptor.slot.load(std::memory_order_relaxed);
+        auto meta_size = descriptor.meta_size.load(std::memory_order_relaxed);
+        auto size = descriptor.size.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        const auto& layout = m_mapping->layout;
+
+        if (descriptor.sequence.load(std::memory_order_relaxed) != sequence
+                || slot_index >= layout.slot_count
+                || meta_size > layout.meta_size
+                || size > layout.slot_size)
+        {
+            return false;
+        }
+
+        auto& slot = m_mapping->slot(slot_index);
+        auto bit = m_lease->bit();
+        auto readers = slot.readers.load(std::memory_order_relaxed);
+
+        do
+        {
+            if ((readers & shm_write_lock) != 0)
+            {
+                return false;
+            }
+        }
+        while (!slot.readers.compare_exchange_weak(readers
+                                                   , readers | bit
+                                                   , std::memory_order_acquire));
+
+        // the slot may carry a newer frame already
+        if (slot.sequence.load(std::memory_order_acquire) != sequence)
+        {
+            slot.readers.fetch_and(~bit, std::memory_order_release);
+            return false;
+        }
+
+        frame.release();
+        frame.m_lease = m_lease;
+        frame.m_slot = &slot;
+        frame.m_data = m_mapping->data(slot_index);
+        frame.m_size = size;
+        frame.m_meta = m_mapping->meta(slot_index);
+        frame.m_meta_size = meta_size;
+        frame.m_sequence = sequence;
+
+        return true;
+    }
+
+    bool pop(shm_frame_t& frame
+             , std::uint32_t timeout)
+    {
+        if (m_mapping == nullptr)
+        {
+            return false;
+        }
+
+        auto& header = m_mapping->header();
+
+        while (true)
+        {
+            auto wake_word = header.wake_word.load();
+            auto write_index = header.write_index.load(std::memory_order_acquire);
+
+            while (m_read_index < write_index)
+            {
+                auto ring_size = m_mapping->layout.ring_size;
+
+                // lapped, the oldest descriptors are gone
+                if (write_index - m_read_index > ring_size)
+                {
+                    m_stats.dropped += write_index - ring_size - m_read_index;
+                    m_read_index = write_index - ring_size;
+                }
+
+                auto is_taken = take_frame(frame);
+
+                m_read_index++;
+
+                if (is_taken)
+                {
+                    m_stats.frames++;
+                    m_stats.bytes += frame.size();
+                    return true;
+                }
+
+                m_stats.dropped++;
+            }
+
+            if (header.closed.load() != 0
+                    || timeout == 0)
+            {
+                return false;
+            }
+
+            header.waiters.fetch_add(1);
+
+            if (header.write_index.load(std::memory_order_acquire) == m_read_index)
+            {
+                futex_wait(header.wake_word
+                           , wake_word
+                           , timeout);
+            }
+
+            header.waiters.fetch_sub(1);
+
+            if (header.write_index.load(std::memory_order_acquire) == m_read_index)
+            {
+                return false;
+            }
+        }
+    }
+
+    bool is_closed() const
+    {
+        return m_mapping == nullptr
+                || m_mapping->header().closed.load() != 0;
+    }
+};
+//------------------------------------------------------------------------------
+void shm_sink_context_deleter_t::operator()(shm_sink_context_t *shm_sink_context_ptr)
+{
+    delete shm_sink_context_ptr;
+}
+
+void shm_source_context_deleter_t::operator()(shm_source_context_t *shm_source_context_ptr)
+{
+    delete shm_source_context_ptr;
+}
+//------------------------------------------------------------------------------
+shm_sink::shm_sink(const shm_config_t &config)
+    : m_shm_sink_context(new shm_sink_context_t(config))
+{
+
+}
+
+bool shm_sink::open(const std::string &name)
+{
+    return m_shm_sink_context->open(name);
+}
+
+bool shm_sink::close()
+{
+    return m_shm_sink_context->close();
+}
+
+bool shm_sink::is_opened() const
+{
+    return m_shm_sink_context->m_mapping != nullptr;
+}
+
+int32_t shm_sink::fd() const
+{
+    return m_shm_sink_context->m_mapping != nullptr
+            ? m_shm_sink_context->m_mapping->fd
+            : -1;
+}
+
+void *shm_sink::acquire(std::size_t size)
+{
+    return m_shm_sink_context->acquire(size);
+}
+
+bool shm_sink::commit(const void *meta
+                      , std::size_t meta_size
+                      , std::size_t size)
+{
+    return m_shm_sink_context->commit(meta
+                                      , meta_size
+                                      , size);
+}
+
+bool shm_sink::push(const void *meta
+                    , std::size_t meta_size
+                    , const void *data
+                    , std::size_t size)
+{
+    return m_shm_sink_context->push(meta
+                                    , meta_size
+                                    , data
+                                    , size);
+}
+
+const shm_config_t &shm_sink::config() const
+{
+    return m_shm_sink_context->m_config;
+}
+
+shm_stats_t shm_sink::stats() const
+{
+    return m_shm_sink_context->m_stats;
+}
+
+shm_source::shm_source()
+    : m_shm_source_context(new shm_source_context_t())
+{
+
+}
+
+bool shm_source::open(int32_t fd)
+{
+    return m_shm_source_context->open(fd);
+}
+
+bool shm_source::close()
+{
+    return m_shm_source_context->close();
+}
+
+bool shm_source::is_opened() const
+{
+    return m_shm_source_context->m_mapping != nullptr;
+}
+
+bool shm_source::pop(shm_frame_t &frame
+                     , uint32_t timeout)
+{
+    return m_shm_source_context->pop(frame
+                                     , timeout);
+}
+
+bool shm_source::is_closed() const
+{
+    return m_shm_source_context->is_closed();
+}
+
+shm_stats_t shm_source::stats() const
+{
+    return m_shm_source_context->m_stats;
+}
+
+bool shm_send_fd(int32_t socket
+                 , int32_t fd)
+{
+    char control[CMSG_SPACE(sizeof(fd))] = {};
+    char byte = 0;
+
+    struct iovec iov = { &byte, sizeof(byte) };
+    struct msghdr message = {};
+
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    auto cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fd));
+    std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(fd));
+
+    return ::sendmsg(socket, &message, MSG_NOSIGNAL) == sizeof(byte);
+}
+
+int32_t shm_receive_fd(int32_t socket)
+{
+    char control[CMSG_SPACE(sizeof(std::int32_t))] = {};
+    char byte = 0;
+
+    struct iovec iov = { &byte, sizeof(byte) };
+    struct msghdr message = {};
+
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    if (::recvmsg(socket, &message, MSG_CMSG_CLOEXEC) <= 0)
+    {
+        return -1;
+    }
+
+    auto cmsg = CMSG_FIRSTHDR(&message);
+    if (cmsg == nullptr
+            || cmsg->cmsg_level != SOL_SOCKET
+            || cmsg->cmsg_type != SCM_RIGHTS)
+    {
+        return -1;
+    }
+
+    std::int32_t fd = -1;
+    std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+
+    return fd;
+}
+
+}
@@ -0,0 +1,227 @@
+#ifndef BASE_SHM_TRANSPORT_H
+#define BASE_SHM_TRANSPORT_H
+
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace base
+{
+
+struct shm_sink_context_t;
+struct shm_sink_context_deleter_t { void operator()(shm_sink_context_t* shm_sink_context_ptr); };
+
+typedef std::unique_ptr<shm_sink_context_t, shm_sink_context_deleter_t> shm_sink_context_ptr_t;
+
+struct shm_source_context_t;
+struct shm_source_context_deleter_t { void operator()(shm_source_context_t* shm_source_context_ptr); };
+
+typedef std::unique_ptr<shm_source_context_t, shm_source_context_deleter_t> shm_source_context_ptr_t;
+
+struct shm_reader_lease_t;
+
+const std::size_t default_shm_slots = 8;
+const std::size_t default_shm_slot_size = 3840 * 2160 * 4;     // a 4K BGRA frame
+const std::size_t default_shm_meta_size = 256;
+
+struct shm_config_t
+{
+    std::size_t     slots;          // frames that may be in flight at once
+    std::size_t     slot_size;      // max frame data
+    std::size_t     meta_size;      // max frame info
+
+    shm_config_t(std::size_t slots = default_shm_slots
+                 , std::size_t slot_size = default_shm_slot_size
+                 , std::size_t meta_size = default_shm_meta_size);
+};
+
+struct shm_stats_t
+{
+    std::size_t     frames = 0;
+    std::size_t     bytes = 0;
+    std::size_t     dropped = 0;    // sink: no free slot, source: overwritten before it was read
+};
+
+// a received frame, its slot is not reused while the frame is alive
+class shm_frame_t
+{
+    std::shared_ptr<shm_reader_lease_t> m_lease;
+    void*                           m_slot;
+    const std::uint8_t*             m_data;
+    std::size_t                     m_size;
+    const void*                     m_meta;
+    std::size_t                     m_meta_size;
+    std::uint64_t                   m_sequence;
+
+    friend struct shm_source_context_t;
+
+public:
+    shm_frame_t();
+    ~shm_frame_t();
+
+    shm_frame_t(shm_frame_t&& frame);
+    shm_frame_t& operator=(shm_frame_t&& frame);
+
+    shm_frame_t(const shm_frame_t&) = delete;
+    shm_frame_t& operator=(const shm_frame_t&) = delete;
+
+    const std::uint8_t* data() const;
+    std::size_t size() const;
+    const void* meta() const;
+    std::size_t meta_size() const;
+    std::uint64_t sequence() const;
+
+    bool is_valid() const;
+    void release();
+};
+
+// Producer side of a frame channel in a memfd: a slab of frame slots and a
+// ring of frame descriptors, both lock-free. The fd is handed to the other
+// process (shm_send_fd over a unix socket); one sink feeds any number of
+// sources, a slow source loses the oldest frames instead of stalling the
+// sink. Frames are written in place with acquire/commit or copied by push.
+// Up to 63 sources may be open at once; when every slot is held, the sink
+// takes back the frames of sources whose process has died.
+class shm_sink
+{
+    shm_sink_context_ptr_t  m_shm_sink_context;
+
+public:
+    shm_sink(const shm_config_t& config = shm_config_t());
+
+    bool open(const std::string& name);
+    bool close();
+    bool is_opened() const;
+
+    std::int32_t fd() const;
+
+    // the data of the next frame, nullptr if every slot is still read
+    void* acquire(std::size_t size);
+    bool commit(const void* meta
+                , std::size_t meta_size
+                , std::size_t size);
+
+    bool push(const void* meta
+              , std::size_t meta_size
+              , const void* data
+              , std::size_t size);
+
+    const shm_config_t& config() const;
+    shm_stats_t stats() const;
+};
+
+class shm_source
+{
+    shm_source_context_ptr_t    m_shm_source_context;
+
+public:
+    shm_source();
+
+    // the fd is duplicated, frames published from now on are received;
+    // false on a segment of another layout or with no free reader entry
+    bool open(std::int32_t fd);
+    bool close();
+    bool is_opened() const;
+
+    // waits up to timeout ms, false on timeout or when the sink is closed
+    bool pop(shm_frame_t& frame
+             , std::uint32_t timeout = 0);
+
+    bool is_closed() const;
+    shm_stats_t stats() const;
+};
+
+bool shm_send_fd(std::int32_t socket
+                 , std::int32_t fd);
+std::int32_t shm_receive_fd(std::int32_t socket);
+
+// adapts a frame type with a trivially copyable info to the channel:
+//   info_t, info(frame), data(frame), size(frame), assign(frame, info, data, size)
+template<typename Frame>
+struct shm_frame_traits_t;
+
+template<typename Frame>
+class shm_frame_sink : public shm_sink
+{
+    using traits_t = shm_frame_traits_t<Frame>;
+
+public:
+    using info_t = typename traits_t::info_t;
+
+    static_assert(std::is_trivially_copyable<info_t>::value, "frame info is copied as bytes");
+
+    using shm_sink::shm_sink;
+
+    bool push_frame(const Frame& frame)
+    {
+        auto info = traits_t::info(frame);
+        return push(&info
+                    , sizeof(info)
+                    , traits_t::data(frame)
+                    , traits_t::size(frame));
+    }
+
+    // a frame written into acquire(size)
+    bool commit_frame(const info_t& info
+                      , std::size_t size)
+    {
+        return commit(&info
+                      , sizeof(info)
+                      , size);
+    }
+};
+
+template<typename Frame>
+class shm_frame_source : public shm_source
+{
+    using traits_t = shm_frame_traits_t<Frame>;
+
+public:
+    using info_t = typename traits_t::info_t;
+
+    static_assert(std::is_trivially_copyable<info_t>::value, "frame info is copied as bytes");
+
+    // the data is copied into the frame
+    bool pop_frame(Frame& frame
+                   , std::uint32_t timeout = 0)
+    {
+        info_t info;
+        shm_frame_t shm_frame;
+
+        if (pop_frame(info
+                      , shm_frame
+                      , timeout))
+        {
+            traits_t::assign(frame
+                             , info
+                             , shm_frame.data()
+                             , shm_frame.size());
+            return true;
+        }
+
+        return false;
+    }
+
+    // no copy, the data stays in place while shm_frame is alive
+    bool pop_frame(info_t& info
+                   , shm_frame_t& shm_frame
+                   , std::uint32_t timeout = 0)
+    {
+        if (pop(shm_frame
+                , timeout)
+                && shm_frame.meta_size() == sizeof(info_t))
+        {
+            std::memcpy(&info, shm_frame.meta(), sizeof(info_t));
+            return true;
+        }
+
+        shm_frame.release();
+        return false;
+    }
+};
+
+}
+
+#endif // BASE_SHM_TRANSPORT_H
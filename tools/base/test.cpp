@@ -0,0 +1,256 @@
+#include "test.h"
+#include "shm_transport.h"
+
+#include <iostream>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace base
+{
+
+static bool check(bool result
+                  , const char* name)
+{
+    if (!result)
+    {
+        std::cout << "shm transport: " << name << " failed" << std::endl;
+    }
+
+    return result;
+}
+
+static void fill_frame(std::uint8_t* data
+                       , std::size_t size
+                       , std::uint32_t frame)
+{
+    for (std::size_t i = 0; i < size; i++)
+    {
+        data[i] = static_cast<std::uint8_t>(i * 31 + frame);
+    }
+}
+
+static bool is_frame(const shm_frame_t& shm_frame
+                     , std::size_t size
+                     , std::uint32_t frame)
+{
+    std::vector<std::uint8_t> expected(size);
+    fill_frame(expected.data(), size, frame);
+
+    return shm_frame.is_valid()
+            && shm_frame.size() == size
+            && shm_frame.meta_size() == sizeof(frame)
+            && std::memcmp(shm_frame.meta(), &frame, sizeof(frame)) == 0
+            && std::memcmp(shm_frame.data(), expected.data(), size) == 0;
+}
+
+static bool push_frame(shm_sink& sink
+                       , std::size_t size
+                       , std::uint32_t frame)
+{
+    auto data = static_cast<std::uint8_t*>(sink.acquire(size));
+    if (data == nullptr)
+    {
+        return false;
+    }
+
+    fill_frame(data, size, frame);
+    return sink.commit(&frame
+                       , sizeof(frame)
+                       , size);
+}
+
+void test_shm_acquire_commit()
+{
+    // an odd size, the data does not fill the page of the slot
+    const std::size_t size = 4099;
+
+    shm_sink sink(shm_config_t(4, size, 16));
+    shm_source source;
+    shm_frame_t frame;
+
+    check(sink.open("test_shm")
+          && source.open(sink.fd()), "open");
+
+    check(!source.pop(frame), "pop of an empty channel");
+    check(push_frame(sink, size, 1)
+          && source.pop(frame)
+          && is_frame(frame, size, 1), "acquire/commit/take");
+    // the slots are rounded up to pages
+    check(sink.acquire(size * 4) == nullptr, "acquire over the slot size");
+
+    std::uint8_t meta[17] = {};
+    check(sink.acquire(size) != nullptr
+          && !sink.commit(meta, sizeof(meta), size), "commit over the meta size");
+
+    // the rejected commit freed its slot
+    frame.release();
+    check(push_frame(sink, size, 2)
+          && source.pop(frame)
+          && is_frame(frame, size, 2), "acquire after a rejected commit");
+}
+
+void test_shm_wraparound()
+{
+    const std::size_t slots = 4;
+    const std::size_t size = 100;
+
+    shm_sink sink(shm_config_t(slots, size, 16));
+    shm_source source;
+    shm_frame_t frame;
+
+    check(sink.open("test_shm")
+          && source.open(sink.fd()), "open");
+
+    // the descriptor ring (2 x slots) wraps many times
+    bool result = true;
+    for (std::uint32_t i = 0; i < slots * 10; i++)
+    {
+        result &= push_frame(sink, size, i)
+                && source.pop(frame)
+                && is_frame(frame, size, i)
+                && frame.sequence() == i + 1;
+    }
+
+    check(result, "wraparound in step");
+
+    // a lapped source skips to the frames that still exist, each of them is
+    // intact or dropped
+    frame.release();
+    for (std::uint32_t i = 0; i < slots * 5; i++)
+    {
+        push_frame(sink, size, 1000 + i);
+    }
+
+    std::uint64_t last_sequence = 0;
+    std::size_t frames = 0;
+    result = true;
+
+    while (source.pop(frame))
+    {
+        auto index = *static_cast<const std::uint32_t*>(frame.meta());
+        result &= is_frame(frame, size, index)
+                && frame.sequence() > last_sequence;
+        last_sequence = frame.sequence();
+        frames++;
+    }
+
+    check(result
+          && frames > 0
+          && frames <= slots * 2
+          && source.stats().dropped > 0, "lapped source");
+}
+
+void test_shm_reader_crash()
+{
+    const std::size_t slots = 4;
+    const std::size_t size = 100;
+
+    shm_sink sink(shm_config_t(slots, size, 16));
+
+    std::int32_t ready[2] = { -1, -1 };
+    std::int32_t held[2] = { -1, -1 };
+
+    if (!check(sink.open("test_shm")
+               && ::pipe(ready) == 0
+               && ::pipe(held) == 0, "open"))
+    {
+        return;
+    }
+
+    auto pid = ::fork();
+
+    if (pid == 0)
+    {
+        // the source takes every slot and dies holding them
+        shm_source source;
+        std::vector<shm_frame_t> frames(slots);
+        char byte = source.open(sink.fd());
+
+        if (::write(ready[1], &byte, 1) == 1)
+        {
+            for (auto& frame : frames)
+            {
+                source.pop(frame, 1000);
+            }
+
+            byte = 1;
+            if (::write(held[1], &byte, 1) == 1)
+            {
+                ::_exit(0);
+            }
+        }
+
+        ::_exit(1);
+    }
+
+    char byte = 0;
+    auto is_opened = ::read(ready[0], &byte, 1) == 1 && byte != 0;
+
+    for (std::uint32_t i = 0; i < slots && is_opened; i++)
+    {
+        push_frame(sink, size, i);
+    }
+
+    auto is_held = is_opened
+            && ::read(held[0], &byte, 1) == 1;
+
+    check(is_held
+          && sink.acquire(size) == nullptr, "slots held by a live source");
+
+    std::int32_t status = 0;
+    ::waitpid(pid, &status, 0);
+
+    check(is_held
+          && push_frame(sink, size, slots), "slots of a crashed source");
+
+    for (auto fd : { ready[0], ready[1], held[0], held[1] })
+    {
+        ::close(fd);
+    }
+}
+
+void test_shm_malformed()
+{
+    shm_sink sink(shm_config_t(2, 4096, 16));
+    shm_source source;
+
+    check(sink.open("test_shm"), "open");
+
+    // a valid header in a segment cut short
+    auto fd = ::memfd_create("test_shm_truncated", MFD_CLOEXEC);
+    auto header = ::mmap(nullptr, 4096, PROT_READ, MAP_SHARED, sink.fd(), 0);
+
+    check(fd >= 0
+          && header != MAP_FAILED
+          && ::write(fd, header, 4096) == 4096
+          && !source.open(fd), "truncated segment");
+
+    // the magic and version of the sink followed by garbage offsets
+    std::vector<std::uint8_t> garbage(4096, 0xff);
+    std::memcpy(garbage.data(), header, 8);
+
+    check(::ftruncate(fd, 0) == 0
+          && ::pwrite(fd, garbage.data(), garbage.size(), 0) == static_cast<ssize_t>(garbage.size())
+          && ::ftruncate(fd, 64 * 1024) == 0
+          && !source.open(fd), "malformed header");
+
+    if (header != MAP_FAILED)
+    {
+        ::munmap(header, 4096);
+    }
+
+    ::close(fd);
+}
+
+void test()
+{
+    test_shm_acquire_commit();
+    test_shm_wraparound();
+    test_shm_reader_crash();
+    test_shm_malformed();
+}
+
+}
@@ -0,0 +1,11 @@
+#ifndef BASE_TEST_H
+#define BASE_TEST_H
+
+namespace base
+{
+
+void test();
+
+}
+
+#endif // BASE_TEST_H
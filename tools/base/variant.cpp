@@ -416,11 +416,4 @@ bool variant::is_empty() const
             || m_storage.empty();
 }
 
-
-void test()
-{
-    return;
-}
-
-
 }
@@ -0,0 +1,223 @@
+#include "worker_pool.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <queue>
+#include <algorithm>
+
+namespace base
+{
+
+struct worker_pool_context_t
+{
+    struct batch_t
+    {
+        const indexed_task_t&       task;
+        std::size_t                 tasks;
+        std::atomic<std::size_t>    next_index;
+        std::atomic<std::size_t>    done;
+
+        batch_t(const indexed_task_t& task
+                , std::size_t tasks)
+            : task(task)
+            , tasks(tasks)
+            , next_index(0)
+            , done(0)
+        {
+
+        }
+
+        bool execute_next()
+        {
+            auto index = next_index.fetch_add(1, std::memory_order_relaxed);
+            if (index < tasks)
+            {
+                task(index);
+                done.fetch_add(1, std::memory_order_acq_rel);
+                return true;
+            }
+
+            return false;
+        }
+
+        bool is_done() const
+        {
+            return done.load(std::memory_order_acquire) >= tasks;
+        }
+    };
+
+    std::mutex                  m_mutex;
+    std::condition_variable     m_signal;
+    std::condition_variable     m_done_signal;
+    std::queue<task_t>          m_tasks;
+    std::vector<std::thread>    m_threads;
+    bool                        m_running;
+
+    worker_pool_context_t(std::size_t threads)
+        : m_running(true)
+    {
+        if (threads == 0)
+        {
+            threads = worker_pool::hardware_threads();
+        }
+
+        for (std::size_t i = 0; i < threads; i++)
+        {
+            m_threads.emplace_back(&worker_pool_context_t::worker_proc
+                                   , this);
+        }
+    }
+
+    ~worker_pool_context_t()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_running = false;
+        }
+
+        m_signal.notify_all();
+
+        for (auto& t : m_threads)
+        {
+            if (t.joinable())
+            {
+                t.join();
+            }
+        }
+    }
+
+    void worker_proc()
+    {
+        while (true)
+        {
+            task_t task;
+
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_signal.wait(lock, [&] { return !m_running || !m_tasks.empty(); });
+
+                if (m_tasks.empty())
+                {
+                    break;
+                }
+
+                task = std::move(m_tasks.front());
+                m_tasks.pop();
+            }
+
+            task();
+        }
+    }
+
+    bool post(task_t&& task)
+    {
+        if (task != nullptr)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_running)
+                {
+                    return false;
+                }
+                m_tasks.emplace(std::move(task));
+            }
+
+            m_signal.notify_one();
+            return true;
+        }
+
+        return false;
+    }
+
+    void run(std::size_t tasks
+             , const indexed_task_t& task)
+    {
+        if (tasks == 0)
+        {
+            return;
+        }
+
+        if (tasks == 1
+                || m_threads.empty())
+        {
+            for (std::size_t i = 0; i < tasks; i++)
+            {
+                task(i);
+            }
+            return;
+        }
+
+        auto batch = std::make_shared<batch_t>(task
+                                               , tasks);
+
+        auto helpers = std::min(tasks - 1, m_threads.size());
+
+        for (std::size_t i = 0; i < helpers; i++)
+        {
+            post([this, batch]
+            {
+                while (batch->execute_next());
+
+                if (batch->is_done())
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_done_signal.notify_all();
+                }
+            });
+        }
+
+        while (batch->execute_next());
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done_signal.wait(lock, [&] { return batch->is_done(); });
+    }
+};
+//------------------------------------------------------------------------------
+void worker_pool_context_deleter_t::operator()(worker_pool_context_t *worker_pool_context_ptr)
+{
+    delete worker_pool_context_ptr;
+}
+//------------------------------------------------------------------------------
+std::size_t worker_pool::hardware_threads()
+{
+    auto threads = std::thread::hardware_concurrency();
+    return threads > 0
+            ? threads
+            : 1;
+}
+
+worker_pool &worker_pool::shared_pool()
+{
+    static worker_pool pool(hardware_threads() > 1
+                            ? hardware_threads() - 1
+                            : 1);
+    return pool;
+}
+
+worker_pool::worker_pool(std::size_t threads)
+    : m_worker_pool_context(new worker_pool_context_t(threads))
+{
+
+}
+
+std::size_t worker_pool::size() const
+{
+    return m_worker_pool_context->m_threads.size();
+}
+
+bool worker_pool::post(task_t &&task)
+{
+    return m_worker_pool_context->post(std::move(task));
+}
+
+void worker_pool::run(std::size_t tasks
+                      , const indexed_task_t& task)
+{
+    m_worker_pool_context->run(tasks
+                               , task);
+}
+
+}
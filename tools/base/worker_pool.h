@@ -0,0 +1,42 @@
+#ifndef BASE_WORKER_POOL_H
+#define BASE_WORKER_POOL_H
+
+#include <functional>
+#include <memory>
+#include <cstdint>
+
+namespace base
+{
+
+struct worker_pool_context_t;
+struct worker_pool_context_deleter_t { void operator()(worker_pool_context_t* worker_pool_context_ptr); };
+
+typedef std::unique_ptr<worker_pool_context_t, worker_pool_context_deleter_t> worker_pool_context_ptr_t;
+
+using task_t = std::function<void()>;
+using indexed_task_t = std::function<void(std::size_t task_index)>;
+
+class worker_pool
+{
+    worker_pool_context_ptr_t   m_worker_pool_context;
+
+public:
+    static std::size_t hardware_threads();
+    static worker_pool& shared_pool();
+
+    // threads == 0 means one worker per hardware thread
+    worker_pool(std::size_t threads = 0);
+
+    std::size_t size() const;
+
+    bool post(task_t&& task);
+
+    // runs task(0) .. task(tasks - 1) and returns when all of them are done,
+    // the calling thread takes part in the execution
+    void run(std::size_t tasks
+             , const indexed_task_t& task);
+};
+
+}
+
+#endif // BASE_WORKER_POOL_H
@@ -0,0 +1,391 @@
+#include "libav_audio_analyzer.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace ffmpeg
+{
+
+namespace
+{
+
+struct level_accumulator_t
+{
+    double          square_sum = 0.0;       // in full scale units
+    double          peak = 0.0;
+    std::size_t     samples = 0;
+    std::size_t     crossings = 0;
+    std::size_t     pairs = 0;
+};
+
+// sign changes between x[i] and x[i + stride], the stride is the channel
+// count for interleaved data, so all channels are counted in one pass
+template<typename T>
+std::size_t count_crossings(const T* data
+                            , std::size_t from
+                            , std::size_t count
+                            , std::size_t stride)
+{
+    std::size_t crossings = 0;
+
+    for (auto i = from; i + stride < count; i++)
+    {
+        crossings += (data[i] < 0) != (data[i + stride] < 0);
+    }
+
+    return crossings;
+}
+
+template<typename T>
+void measure_scalar(const T* data
+                    , std::size_t count
+                    , std::size_t stride
+                    , double offset
+                    , double scale
+                    , level_accumulator_t& accumulator)
+{
+    double square_sum = 0.0;
+    double peak = 0.0;
+    std::size_t crossings = 0;
+
+    for (std::size_t i = 0; i < count; i++)
+    {
+        auto value = (static_cast<double>(data[i]) - offset) * scale;
+        square_sum += value * value;
+        peak = std::max(peak, std::abs(value));
+
+        if (i + stride < count)
+        {
+            auto next = static_cast<double>(data[i + stride]) - offset;
+            crossings += (value < 0.0) != (next < 0.0);
+        }
+    }
+
+    accumulator.square_sum += square_sum;
+    accumulator.peak = std::max(accumulator.peak, peak);
+    accumulator.crossings += crossings;
+}
+
+void measure_pcm16(const std::int16_t* data
+                   , std::size_t count
+                   , std::size_t stride
+                   , level_accumulator_t& accumulator)
+{
+    std::size_t i = 0;
+    std::uint64_t square_sum = 0;
+    std::int32_t peak = 0;
+    std::size_t crossings = 0;
+
+#if defined(__SSE2__)
+    const auto zero = _mm_setzero_si128();
+    auto peak_v = zero;
+    auto sum_v = zero;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        auto x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        // saturated |x|, so the pair sums of madd stay below 2^31
+        auto a = _mm_max_epi16(x, _mm_subs_epi16(zero, x));
+        auto sq = _mm_madd_epi16(a, a);
+
+        peak_v = _mm_max_epi16(peak_v, a);
+        sum_v = _mm_add_epi64(sum_v, _mm_unpacklo_epi32(sq, zero));
+        sum_v = _mm_add_epi64(sum_v, _mm_unpackhi_epi32(sq, zero));
+    }
+
+    alignas(16) std::int16_t peaks[8];
+    alignas(16) std::uint64_t sums[2];
+    _mm_store_si128(reinterpret_cast<__m128i*>(peaks), peak_v);
+    _mm_store_si128(reinterpret_cast<__m128i*>(sums), sum_v);
+
+    peak = *std::max_element(peaks, peaks + 8);
+    square_sum = sums[0] + sums[1];
+
+    std::size_t j = 0;
+    for (; j + stride + 8 <= count; j += 8)
+    {
+        auto x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + j));
+        auto y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + j + stride));
+        // two mask bits per crossing
+        auto mask = _mm_movemask_epi8(_mm_srai_epi16(_mm_xor_si128(x, y), 15));
+        crossings += __builtin_popcount(mask) / 2;
+    }
+
+    crossings += count_crossings(data, j, count, stride);
+#else
+    crossings += count_crossings(data, 0, count, stride);
+#endif
+
+    for (; i < count; i++)
+    {
+        std::int32_t value = data[i];
+        square_sum += value * value;
+        peak = std::max(peak, std::abs(value));
+    }
+
+    const double scale = 1.0 / 32768.0;
+
+    accumulator.square_sum += static_cast<double>(square_sum) * scale * scale;
+    accumulator.peak = std::max(accumulator.peak, peak * scale);
+    accumulator.crossings += crossings;
+}
+
+void measure_float(const float* data
+                   , std::size_t count
+                   , std::size_t stride
+                   , level_accumulator_t& accumulator)
+{
+    std::size_t i = 0;
+    double square_sum = 0.0;
+    float peak = 0.0f;
+    std::size_t crossings = 0;
+
+#if defined(__SSE2__)
+    const auto abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    auto peak_v = _mm_setzero_ps();
+    auto sum_lo = _mm_setzero_pd();
+    auto sum_hi = _mm_setzero_pd();
+
+    for (; i + 4 <= count; i += 4)
+    {
+        auto x = _mm_loadu_ps(data + i);
+        auto sq = _mm_mul_ps(x, x);
+
+        peak_v = _mm_max_ps(peak_v, _mm_and_ps(x, abs_mask));
+        sum_lo = _mm_add_pd(sum_lo, _mm_cvtps_pd(sq));
+        sum_hi = _mm_add_pd(sum_hi, _mm_cvtps_pd(_mm_movehl_ps(sq, sq)));
+    }
+
+    alignas(16) float peaks[4];
+    alignas(16) double sums[2];
+    _mm_store_ps(peaks, peak_v);
+    _mm_store_pd(sums, _mm_add_pd(sum_lo, sum_hi));
+
+    peak = *std::max_element(peaks, peaks + 4);
+    square_sum = sums[0] + sums[1];
+
+    // compared with zero rather than by sign bit, as count_crossings does,
+    // so -0.0 and +0.0 are on the same side
+    const auto zero = _mm_setzero_ps();
+    std::size_t j = 0;
+    for (; j + stride + 4 <= count; j += 4)
+    {
+        auto x = _mm_cmplt_ps(_mm_loadu_ps(data + j), zero);
+        auto y = _mm_cmplt_ps(_mm_loadu_ps(data + j + stride), zero);
+        crossings += __builtin_popcount(_mm_movemask_ps(_mm_xor_ps(x, y)));
+    }
+
+    crossings += count_crossings(data, j, count, stride);
+#else
+    crossings += count_crossings(data, 0, count, stride);
+#endif
+
+    for (; i < count; i++)
+    {
+        square_sum += static_cast<double>(data[i]) * data[i];
+        peak = std::max(peak, std::abs(data[i]));
+    }
+
+    accumulator.square_sum += square_sum;
+    accumulator.peak = std::max<double>(accumulator.peak, peak);
+    accumulator.crossings += crossings;
+}
+
+// one plane or one interleaved buffer
+void measure_block(sample_format_t sample_format
+                   , const void* data
+                   , std::size_t count
+                   , std::size_t stride
+                   , level_accumulator_t& accumulator)
+{
+    if (sample_format == sample_format_pcm16
+            || sample_format == sample_format_pcm16p)
+    {
+        measure_pcm16(static_cast<const std::int16_t*>(data), count, stride, accumulator);
+    }
+    else if (sample_format == sample_format_float32
+             || sample_format == sample_format_float32p)
+    {
+        measure_float(static_cast<const float*>(data), count, stride, accumulator);
+    }
+    else if (sample_format == sample_format_pcm8
+             || sample_format == sample_format_pcm8p)
+    {
+        measure_scalar(static_cast<const std::uint8_t*>(data), count, stride, 128.0, 1.0 / 128.0, accumulator);
+    }
+    else if (sample_format == sample_format_pcm32
+             || sample_format == sample_format_pcm32p)
+    {
+        measure_scalar(static_cast<const std::int32_t*>(data), count, stride, 0.0, 1.0 / 2147483648.0, accumulator);
+    }
+    else
+    {
+        measure_scalar(static_cast<const double*>(data), count, stride, 0.0, 1.0, accumulator);
+    }
+
+    accumulator.samples += count;
+    accumulator.pairs += count > stride
+            ? count - stride
+            : 0;
+}
+
+}
+
+vad_config_t::vad_config_t(float threshold
+                           , float margin
+                           , float max_zcr
+                           , float floor_rise
+                           , uint32_t hangover)
+    : threshold(threshold)
+    , margin(margin)
+    , max_zcr(max_zcr)
+    , floor_rise(floor_rise)
+    , hangover(hangover)
+{
+
+}
+
+bool libav_audio_analyzer::is_supported(const audio_info_t &audio_info)
+{
+    static const sample_format_t formats[] =
+    {
+        sample_format_pcm8, sample_format_pcm16, sample_format_pcm32, sample_format_float32, sample_format_float64,
+        sample_format_pcm8p, sample_format_pcm16p, sample_format_pcm32p, sample_format_float32p, sample_format_float64p
+    };
+
+    return audio_info.channels > 0
+            && std::find(std::begin(formats)
+                         , std::end(formats)
+                         , audio_info.sample_format) != std::end(formats);
+}
+
+bool libav_audio_analyzer::measure(const audio_info_t &audio_info
+                                   , const void *data
+                                   , std::size_t size
+                                   , audio_level_t &audio_level)
+{
+    if (data == nullptr
+            || !is_supported(audio_info))
+    {
+        return false;
+    }
+
+    auto bytes_per_sample = audio_info.bps() / 8;
+    auto frames = size / audio_info.sample_size();
+
+    if (frames == 0)
+    {
+        return false;
+    }
+
+    level_accumulator_t accumulator;
+
+    if (audio_info.is_planar())
+    {
+        for (std::uint32_t c = 0; c < audio_info.channels; c++)
+        {
+            measure_block(audio_info.sample_format
+                          , static_cast<const std::uint8_t*>(data) + c * frames * bytes_per_sample
+                          , frames
+                          , 1
+                          , accumulator);
+        }
+    }
+    else
+    {
+        measure_block(audio_info.sample_format
+                      , data
+                      , frames * audio_info.channels
+                      , audio_info.channels
+                      , accumulator);
+    }
+
+    audio_level.peak = static_cast<float>(std::min(accumulator.peak, 1.0));
+    audio_level.rms = static_cast<float>(std::sqrt(accumulator.square_sum / accumulator.samples));
+    audio_level.dbfs = audio_level.rms > 0.0f
+            ? std::max(min_audio_level, 20.0f * std::log10(audio_level.rms))
+            : min_audio_level;
+    audio_level.level = static_cast<std::uint8_t>(std::min(127.0f, std::max(0.0f, std::round(-audio_level.dbfs))));
+    audio_level.zcr = accumulator.pairs > 0
+            ? static_cast<float>(accumulator.crossings) / accumulator.pairs
+            : 0.0f;
+    audio_level.voice = false;
+
+    return true;
+}
+
+libav_audio_analyzer::libav_audio_analyzer(const audio_info_t &audio_info
+                                           , const vad_config_t &vad_config)
+    : m_audio_info(audio_info)
+    , m_vad_config(vad_config)
+{
+    reset();
+}
+
+bool libav_audio_analyzer::analyze(const void *data
+                                   , std::size_t size
+                                   , audio_level_t &audio_level)
+{
+    if (!measure(m_audio_info
+                 , data
+                 , size
+                 , audio_level))
+    {
+        return false;
+    }
+
+    std::int64_t samples = size / m_audio_info.sample_size();
+    auto duration = static_cast<float>(samples) / std::max(m_audio_info.sample_rate, 1u);
+
+    // the floor drops at once and rises slowly, so speech does not lift it
+    if (!m_has_floor
+            || audio_level.dbfs < m_noise_floor)
+    {
+        m_noise_floor = audio_level.dbfs;
+        m_has_floor = true;
+    }
+    else
+    {
+        m_noise_floor = std::min(audio_level.dbfs
+                                 , m_noise_floor + m_vad_config.floor_rise * duration);
+    }
+
+    auto level = audio_level.dbfs - std::max(m_noise_floor, m_vad_config.threshold - m_vad_config.margin);
+    auto is_voice = audio_level.dbfs > m_vad_config.threshold
+            && level > m_vad_config.margin
+            && (audio_level.zcr < m_vad_config.max_zcr
+                || level > 2.0f * m_vad_config.margin);
+
+    if (is_voice)
+    {
+        m_hangover_left = static_cast<std::int64_t>(m_vad_config.hangover) * m_audio_info.sample_rate / 1000;
+    }
+    else
+    {
+        m_hangover_left = std::max<std::int64_t>(m_hangover_left - samples, 0);
+    }
+
+    audio_level.voice = is_voice
+            || m_hangover_left > 0;
+
+    return true;
+}
+
+float libav_audio_analyzer::noise_floor() const
+{
+    return m_noise_floor;
+}
+
+void libav_audio_analyzer::reset()
+{
+    m_noise_floor = min_audio_level;
+    m_hangover_left = 0;
+    m_has_floor = false;
+}
+
+}
@@ -0,0 +1,69 @@
+#ifndef FFMPEG_LIBAV_AUDIO_ANALYZER_H
+#define FFMPEG_LIBAV_AUDIO_ANALYZER_H
+
+#include "libav_base.h"
+
+namespace ffmpeg
+{
+
+const float min_audio_level = -127.0f;      // dBFS of digital silence
+
+struct audio_level_t
+{
+    float           peak = 0.0f;            // of full scale
+    float           rms = 0.0f;             // of full scale
+    float           dbfs = min_audio_level;
+    std::uint8_t    level = 127;            // RFC 6464, -dBov
+    float           zcr = 0.0f;             // zero crossings per sample
+    bool            voice = false;
+};
+
+struct vad_config_t
+{
+    float           threshold;              // dBFS, quieter frames are never voice
+    float           margin;                 // dB above the noise floor
+    float           max_zcr;                // noise-like frames near the floor are rejected
+    float           floor_rise;             // dB/s, noise floor adaptation upwards
+    std::uint32_t   hangover;               // ms the voice state holds after the last voice frame
+
+    vad_config_t(float threshold = -50.0f
+                 , float margin = 9.0f
+                 , float max_zcr = 0.3f
+                 , float floor_rise = 1.0f
+                 , std::uint32_t hangover = 200);
+};
+
+// Level metering and energy/ZCR voice activity detection for one audio
+// stream. Frames are measured in place (SSE2 for pcm16 and float32),
+// planar buffers hold the planes one after another. Nothing allocates,
+// one call is one analysis window, usually 10 or 20 ms.
+class libav_audio_analyzer
+{
+    audio_info_t    m_audio_info;
+    vad_config_t    m_vad_config;
+    float           m_noise_floor;
+    std::int64_t    m_hangover_left;        // in samples
+    bool            m_has_floor;
+
+public:
+    static bool is_supported(const audio_info_t& audio_info);
+    static bool measure(const audio_info_t& audio_info
+                        , const void* data
+                        , std::size_t size
+                        , audio_level_t& audio_level);
+
+    libav_audio_analyzer(const audio_info_t& audio_info
+                         , const vad_config_t& vad_config = vad_config_t());
+
+    // measure plus the voice decision
+    bool analyze(const void* data
+                 , std::size_t size
+                 , audio_level_t& audio_level);
+
+    float noise_floor() const;
+    void reset();
+};
+
+}
+
+#endif // FFMPEG_LIBAV_AUDIO_ANALYZER_H
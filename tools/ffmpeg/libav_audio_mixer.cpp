@@ -0,0 +1,572 @@
+#include "libav_audio_mixer.h"
+#include "libav_resampler.h"
+
+#define WBS_MODULE_NAME "ff:mixer"
+#include "tools/base/logger_base.h"
+
+#include <mutex>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace ffmpeg
+{
+
+namespace
+{
+
+using sample_buffer_t = std::vector<float, base::aligned_allocator_t<float>>;
+
+// dst += src * gain
+void accumulate(float* dst
+                , const float* src
+                , float gain
+                , std::size_t count)
+{
+    std::size_t i = 0;
+
+#if defined(__SSE2__)
+    auto g = _mm_set1_ps(gain);
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i)
+                                          , _mm_mul_ps(_mm_loadu_ps(src + i), g)));
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        dst[i] += src[i] * gain;
+    }
+}
+
+// dst = total - src * gain
+void subtract(float* dst
+              , const float* total
+              , const float* src
+              , float gain
+              , std::size_t count)
+{
+    std::size_t i = 0;
+
+#if defined(__SSE2__)
+    auto g = _mm_set1_ps(gain);
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_ps(dst + i, _mm_sub_ps(_mm_loadu_ps(total + i)
+                                          , _mm_mul_ps(_mm_loadu_ps(src + i), g)));
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        dst[i] = total[i] - src[i] * gain;
+    }
+}
+
+void float_to_pcm16(std::int16_t* dst
+                    , const float* src
+                    , std::size_t count)
+{
+    std::size_t i = 0;
+
+#if defined(__SSE2__)
+    auto scale = _mm_set1_ps(32767.0f);
+    for (; i + 8 <= count; i += 8)
+    {
+        // packs saturates to the int16 range
+        auto lo = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i), scale));
+        auto hi = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + i + 4), scale));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(lo, hi));
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        auto value = src[i] * 32767.0f;
+        dst[i] = value >= 32767.0f
+                ? 32767
+                : (value <= -32768.0f ? -32768 : static_cast<std::int16_t>(value < 0.0f ? value - 0.5f : value + 0.5f));
+    }
+}
+
+void float_to_float(float* dst
+                    , const float* src
+                    , std::size_t count)
+{
+    std::size_t i = 0;
+
+#if defined(__SSE2__)
+    auto max_value = _mm_set1_ps(1.0f);
+    auto min_value = _mm_set1_ps(-1.0f);
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_ps(dst + i, _mm_max_ps(_mm_min_ps(_mm_loadu_ps(src + i), max_value), min_value));
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        dst[i] = std::max(-1.0f, std::min(1.0f, src[i]));
+    }
+}
+
+}
+
+struct libav_audio_mixer_context_t
+{
+    struct mixer_input_t
+    {
+        audio_info_t        input_format;
+        float               gain;
+        libav_resampler     resampler;
+        media_data_t        resample_buffer;
+        sample_buffer_t     samples;            // interleaved, samples[0] is at the mixer clock
+        std::size_t         filled;             // in sample frames
+        std::int64_t        anchor_timestamp;
+        std::int64_t        anchor_position;
+        std::int64_t        next_position;
+
+        mixer_input_t(const audio_info_t& input_format
+                      , float gain)
+            : input_format(input_format)
+            , gain(gain)
+            , filled(0)
+            , anchor_timestamp(-1)
+            , anchor_position(0)
+            , next_position(-1)
+        {
+
+        }
+    };
+
+    using input_map_t = std::map<mixer_input_id_t, mixer_input_t>;
+
+    audio_info_t        m_output_format;
+    audio_info_t        m_mix_format;           // float, rate and layout of the output
+    std::size_t         m_frame_samples;
+    std::size_t         m_max_delay;            // in sample frames
+    input_map_t         m_inputs;
+    sample_buffer_t     m_total;
+    sample_buffer_t     m_minus;
+    std::int64_t        m_clock;
+    mutable std::mutex  m_mutex;
+
+    libav_audio_mixer_context_t(const audio_info_t& output_format
+                                , std::size_t frame_duration
+                                , std::size_t max_delay)
+        : m_output_format(output_format)
+        , m_mix_format(output_format.sample_rate
+                       , output_format.channels
+                       , sample_format_float32)
+        , m_frame_samples(output_format.sample_rate * frame_duration / 1000)
+        , m_max_delay(output_format.sample_rate * max_delay / 1000)
+        , m_clock(0)
+    {
+        if (m_output_format.sample_format != sample_format_pcm16
+                && m_output_format.sample_format != sample_format_float32)
+        {
+            LOG_E << "Unsupported mixer output format " << m_output_format.format_name() LOG_END;
+            m_frame_samples = 0;
+        }
+
+        m_total.resize(m_frame_samples * m_output_format.channels);
+        m_minus.resize(m_frame_samples * m_output_format.channels);
+    }
+
+    bool add_input(mixer_input_id_t input_id
+                   , const audio_info_t& input_format
+                   , float gain)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_frame_samples == 0
+                || m_inputs.find(input_id) != m_inputs.end())
+        {
+            return false;
+        }
+
+        auto& input = m_inputs.emplace(std::piecewise_construct
+                                       , std::forward_as_tuple(input_id)
+                                       , std::forward_as_tuple(input_format
+                                                               , gain)).first->second;
+
+        if (!input.resampler.open(input_format
+                                  , m_mix_format))
+        {
+            LOG_E << "Mixer input #" << input_id << " has unsupported format " << input_format.format_name() LOG_END;
+            m_inputs.erase(input_id);
+            return false;
+        }
+
+        input.samples.reserve((m_max_delay + m_frame_samples) * m_output_format.channels);
+
+        return true;
+    }
+
+    bool remove_input(mixer_input_id_t input_id)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_inputs.erase(input_id) > 0;
+    }
+
+    bool set_gain(mixer_input_id_t input_id
+                  , float gain)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto it = m_inputs.find(input_id);
+        if (it != m_inputs.end())
+        {
+            it->second.gain = gain;
+            return true;
+        }
+
+        return false;
+    }
+
+    std::size_t inputs() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_inputs.size();
+    }
+
+    std::int64_t position(mixer_input_t& input
+                          , std::int64_t timestamp)
+    {
+        if (timestamp < 0)
+        {
+            return std::max(input.next_position
+                            , m_clock);
+        }
+
+        if (input.anchor_timestamp < 0)
+        {
+            input.anchor_timestamp = timestamp;
+            input.anchor_position = std::max(input.next_position
+                                             , m_clock);
+        }
+
+        return input.anchor_position
+                + (timestamp - input.anchor_timestamp) * m_output_format.sample_rate / input.input_format.sample_rate;
+    }
+
+    bool push(mixer_input_id_t input_id
+              , const void* data
+              , std::size_t size
+              , std::int64_t timestamp)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto it = m_inputs.find(input_id);
+        if (it == m_inputs.end()
+                || data == nullptr)
+        {
+            return false;
+        }
+
+        auto& input = it->second;
+        auto channels = m_output_format.channels;
+
+        if (input.resampler.resample(data
+                                     , size
+                                     , input.resample_buffer) == 0)
+        {
+            // the resampler holds the first samples back for its filter delay
+            return true;
+        }
+
+        auto src = reinterpret_cast<const float*>(input.resample_buffer.data());
+        std::int64_t count = input.resample_buffer.size() / m_mix_format.sample_size();
+
+        auto pos = position(input
+                            , timestamp);
+
+        if (timestamp >= 0
+                && pos - m_clock > static_cast<std::int64_t>(m_max_delay))
+        {
+            // the input clock ran away from ours, start over at the current position
+            LOG_W << "Mixer input #" << input_id << " is " << pos - m_clock << " samples ahead, resync" LOG_END;
+
+            input.anchor_timestamp = timestamp;
+            input.anchor_position = m_clock;
+            pos = m_clock;
+        }
+
+        input.next_position = pos + count;
+
+        if (pos < m_clock)
+        {
+            // late samples are dropped
+            auto late = std::min(m_clock - pos, count);
+            src += late * channels;
+            count -= late;
+            pos += late;
+        }
+
+        std::size_t offset = pos - m_clock;
+        std::size_t end = std::min<std::size_t>(offset + count
+                                                , m_max_delay + m_frame_samples);
+
+        if (timestamp < 0)
+        {
+            // appended samples past the buffer are dropped, the next chunk
+            // follows the last kept one and the buffered ones stay in place
+            input.next_position = m_clock + std::max(end, offset);
+        }
+
+        if (end <= offset)
+        {
+            return true;
+        }
+
+        if (input.samples.size() < end * channels)
+        {
+            input.samples.resize(end * channels, 0.0f);
+        }
+
+        if (offset > input.filled)
+        {
+            // gap in the input, it plays silence
+            std::fill(input.samples.begin() + input.filled * channels
+                      , input.samples.begin() + offset * channels
+                      , 0.0f);
+        }
+
+        std::memcpy(input.samples.data() + offset * channels
+                    , src
+                    , (end - offset) * channels * sizeof(float));
+
+        input.filled = std::max(input.filled, end);
+
+        return true;
+    }
+
+    void convert(media_data_t& output
+                 , const float* samples
+                 , std::size_t count)
+    {
+        output.resize(count * m_output_format.bps() / 8);
+
+        if (m_output_format.sample_format == sample_format_pcm16)
+        {
+            float_to_pcm16(reinterpret_cast<std::int16_t*>(output.data())
+                           , samples
+                           , count);
+        }
+        else
+        {
+            float_to_float(reinterpret_cast<float*>(output.data())
+                           , samples
+                           , count);
+        }
+    }
+
+    static const float* input_samples(const mixer_input_t& input
+                                      , std::size_t count)
+    {
+        return input.filled > 0
+                && input.samples.size() >= count
+                ? input.samples.data()
+                : nullptr;
+    }
+
+    bool mix(media_data_t& mix_data
+             , mix_minus_list_t* mix_minus)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_frame_samples == 0)
+        {
+            return false;
+        }
+
+        auto count = m_frame_samples * m_output_format.channels;
+
+        for (auto& it : m_inputs)
+        {
+            auto& input = it.second;
+
+            // an underrun plays silence for the missing tail
+            if (input.filled < m_frame_samples)
+            {
+                if (input.samples.size() < count)
+                {
+                    input.samples.resize(count);
+                }
+
+                std::fill(input.samples.begin() + input.filled * m_output_format.channels
+                          , input.samples.begin() + count
+                          , 0.0f);
+            }
+        }
+
+        std::fill(m_total.begin(), m_total.end(), 0.0f);
+
+        for (const auto& it : m_inputs)
+        {
+            if (auto samples = input_samples(it.second, count))
+            {
+                accumulate(m_total.data()
+                           , samples
+                           , it.second.gain
+                           , count);
+            }
+        }
+
+        convert(mix_data
+                , m_total.data()
+                , count);
+
+        if (mix_minus != nullptr)
+        {
+            for (const auto& it : m_inputs)
+            {
+                auto& minus_data = (*mix_minus)[it.first];
+
+                if (auto samples = input_samples(it.second, count))
+                {
+                    subtract(m_minus.data()
+                             , m_total.data()
+                             , samples
+                             , it.second.gain
+                             , count);
+
+                    convert(minus_data
+                            , m_minus.data()
+                            , count);
+                }
+                else
+                {
+                    convert(minus_data
+                            , m_total.data()
+                            , count);
+                }
+            }
+        }
+
+        for (auto& it : m_inputs)
+        {
+            auto& input = it.second;
+
+            if (input.filled > m_frame_samples)
+            {
+                std::memmove(input.samples.data()
+                             , input.samples.data() + count
+                             , (input.filled - m_frame_samples) * m_output_format.channels * sizeof(float));
+                input.filled -= m_frame_samples;
+            }
+            else
+            {
+                input.filled = 0;
+            }
+        }
+
+        m_clock += m_frame_samples;
+
+        return true;
+    }
+
+    void reset()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        for (auto& it : m_inputs)
+        {
+            auto& input = it.second;
+
+            input.resampler.open(input.input_format
+                                 , m_mix_format);
+            input.filled = 0;
+            input.anchor_timestamp = -1;
+            input.next_position = -1;
+        }
+
+        m_clock = 0;
+    }
+};
+//------------------------------------------------------------------------------
+void libav_audio_mixer_context_deleter_t::operator()(libav_audio_mixer_context_t *libav_audio_mixer_context_ptr)
+{
+    delete libav_audio_mixer_context_ptr;
+}
+//------------------------------------------------------------------------------
+libav_audio_mixer::libav_audio_mixer(const audio_info_t &output_format
+                                     , std::size_t frame_duration
+                                     , std::size_t max_delay)
+    : m_mixer_context(new libav_audio_mixer_context_t(output_format
+                                                      , frame_duration
+                                                      , max_delay))
+{
+
+}
+
+const audio_info_t &libav_audio_mixer::output_format() const
+{
+    return m_mixer_context->m_output_format;
+}
+
+std::size_t libav_audio_mixer::frame_samples() const
+{
+    return m_mixer_context->m_frame_samples;
+}
+
+bool libav_audio_mixer::add_input(mixer_input_id_t input_id
+                                  , const audio_info_t &input_format
+                                  , float gain)
+{
+    return m_mixer_context->add_input(input_id
+                                      , input_format
+                                      , gain);
+}
+
+bool libav_audio_mixer::remove_input(mixer_input_id_t input_id)
+{
+    return m_mixer_context->remove_input(input_id);
+}
+
+bool libav_audio_mixer::set_gain(mixer_input_id_t input_id
+                                 , float gain)
+{
+    return m_mixer_context->set_gain(input_id
+                                     , gain);
+}
+
+std::size_t libav_audio_mixer::inputs() const
+{
+    return m_mixer_context->inputs();
+}
+
+bool libav_audio_mixer::push(mixer_input_id_t input_id
+                             , const void *data
+                             , std::size_t size
+                             , std::int64_t timestamp)
+{
+    return m_mixer_context->push(input_id
+                                 , data
+                                 , size
+                                 , timestamp);
+}
+
+bool libav_audio_mixer::mix(media_data_t &mix_data
+                            , mix_minus_list_t *mix_minus)
+{
+    return m_mixer_context->mix(mix_data
+                                , mix_minus);
+}
+
+std::int64_t libav_audio_mixer::clock() const
+{
+    std::lock_guard<std::mutex> lock(m_mixer_context->m_mutex);
+    return m_mixer_context->m_clock;
+}
+
+void libav_audio_mixer::reset()
+{
+    m_mixer_context->reset();
+}
+
+}
@@ -0,0 +1,67 @@
+#ifndef FFMPEG_LIBAV_AUDIO_MIXER_H
+#define FFMPEG_LIBAV_AUDIO_MIXER_H
+
+#include "libav_base.h"
+
+namespace ffmpeg
+{
+
+struct libav_audio_mixer_context_t;
+struct libav_audio_mixer_context_deleter_t { void operator()(libav_audio_mixer_context_t* libav_audio_mixer_context_ptr); };
+
+typedef std::unique_ptr<libav_audio_mixer_context_t, libav_audio_mixer_context_deleter_t> libav_audio_mixer_context_ptr_t;
+
+using mixer_input_id_t = std::int32_t;
+using mix_minus_list_t = std::map<mixer_input_id_t, media_data_t>;
+
+const std::size_t default_mixer_frame_duration = 20;   // ms
+const std::size_t default_mixer_max_delay = 500;       // ms
+
+// Mixes N PCM inputs into one output of a fixed format. Every input is
+// resampled into float samples of the output rate and layout and placed on
+// the common output clock by its timestamp. A mix step takes one frame of
+// the clock, sums the inputs with their gains in float and converts the sum
+// to the output format (pcm16 with saturation or float32, interleaved).
+// Mix-minus outputs (the mix without the own input) reuse the same sum.
+class libav_audio_mixer
+{
+    libav_audio_mixer_context_ptr_t     m_mixer_context;
+
+public:
+    libav_audio_mixer(const audio_info_t& output_format
+                      , std::size_t frame_duration = default_mixer_frame_duration
+                      , std::size_t max_delay = default_mixer_max_delay);
+
+    const audio_info_t& output_format() const;
+    std::size_t frame_samples() const;
+
+    bool add_input(mixer_input_id_t input_id
+                   , const audio_info_t& input_format
+                   , float gain = 1.0f);
+    bool remove_input(mixer_input_id_t input_id);
+    bool set_gain(mixer_input_id_t input_id
+                  , float gain);
+    std::size_t inputs() const;
+
+    // timestamp is the position of the first sample in input samples,
+    // -1 appends the chunk right after the previous one. Late samples and
+    // appended samples more than max_delay ahead are dropped, a timestamped
+    // input that far ahead is resynced to the clock. False for an unknown
+    // input or no data.
+    bool push(mixer_input_id_t input_id
+              , const void* data
+              , std::size_t size
+              , std::int64_t timestamp = -1);
+
+    // mixes the next frame of the common clock, the output buffers keep
+    // their capacity between calls
+    bool mix(media_data_t& mix_data
+             , mix_minus_list_t* mix_minus = nullptr);
+
+    std::int64_t clock() const;
+    void reset();
+};
+
+}
+
+#endif // FFMPEG_LIBAV_AUDIO_MIXER_H
@@ -67,6 +67,7 @@ const pixel_format_t pixel_format_nv12 = static_cast<pixel_format_t>(AV_PIX_FMT_
 const pixel_format_t pixel_format_nv21 = static_cast<pixel_format_t>(AV_PIX_FMT_NV21);
 const pixel_format_t pixel_format_yuv420p = static_cast<pixel_format_t>(AV_PIX_FMT_YUV420P);
 const pixel_format_t pixel_format_yuv422p = static_cast<pixel_format_t>(AV_PIX_FMT_YUV422P);
+const pixel_format_t pixel_format_yuyv422 = static_cast<pixel_format_t>(AV_PIX_FMT_YUYV422);
 
 const sample_format_t sample_format_none = static_cast<sample_format_t>(AV_SAMPLE_FMT_NONE);
 const sample_format_t sample_format_pcm8 = static_cast<sample_format_t>(AV_SAMPLE_FMT_U8);
@@ -437,7 +438,8 @@ plane_list_t video_info_t::split_planes(pixel_format_t pixel_format
 
 bool video_info_t::blackout(pixel_format_t pixel_format
                             , const frame_size_t &size
-                            , void *slices[])
+                            , void *slices[]
+                            , std::int32_t align)
 {
     std::int32_t    linesizes[max_planes] = {};
 
@@ -445,10 +447,14 @@ bool video_info_t::blackout(pixel_format_t pixel_format
                                 , static_cast<AVPixelFormat>(pixel_format)
                                 , size.width) >= 0)
     {
-        ptrdiff_t lines[] = { linesizes[0]
-                              , linesizes[1]
-                              , linesizes[2]
-                              , linesizes[3] };
+        ptrdiff_t lines[max_planes] = {};
+
+        for (std::size_t i = 0; i < max_planes; i++)
+        {
+            // same linesize rounding as av_image_fill_arrays
+            lines[i] = (linesizes[i] + align - 1) / align * align;
+        }
+
         return av_image_fill_black(*(reinterpret_cast<uint8_t***>(&slices))
                             , lines
                             , static_cast<AVPixelFormat>(pixel_format)
@@ -497,20 +503,24 @@ bool video_info_t::blackout(pixel_format_t pixel_format
 video_info_t::video_info_t(int32_t width
                            , int32_t height
                            , uint32_t fps
-                           , pixel_format_t pixel_format)
+                           , pixel_format_t pixel_format
+                           , int32_t align)
     : video_info_t({ width, height}
                    , fps
-                   , pixel_format)
+                   , pixel_format
+                   , align)
 {
 
 }
 
 video_info_t::video_info_t(frame_size_t size
                            , uint32_t fps
-                           , pixel_format_t pixel_format)
+                           , pixel_format_t pixel_format
+                           , int32_t align)
     : size(size)
     , fps(fps)
     , pixel_format(pixel_format)
+    , align(align)
 {
 
 }
@@ -536,7 +546,7 @@ std::size_t video_info_t::frame_size(std::int32_t align) const
 {
     return frame_size(pixel_format
                       , size
-                      , align);
+                      , align > 0 ? align : this->align);
 }
 
 std::string video_info_t::format_name() const
@@ -559,7 +569,8 @@ std::size_t video_info_t::plane_width(uint32_t plane_idx) const
 plane_sizes_t video_info_t::plane_sizes() const
 {
     return plane_sizes(pixel_format
-                       , size);
+                       , size
+                       , align);
 }
 
 std::size_t video_info_t::split_slices(void *slices[]
@@ -570,7 +581,7 @@ std::size_t video_info_t::split_slices(void *slices[]
                         , size
                         , slices
                         , data
-                        , align);
+                        , align > 0 ? align : this->align);
 }
 
 plane_list_t video_info_t::split_planes(const void *data
@@ -579,14 +590,15 @@ plane_list_t video_info_t::split_planes(const void *data
     return split_planes(pixel_format
                         , size
                         , data
-                        , align);
+                        , align > 0 ? align : this->align);
 }
 
 bool video_info_t::blackout(void *slices[]) const
 {
     return blackout(pixel_format
                     , size
-                    , slices);
+                    , slices
+                    , align);
 }
 
 bool video_info_t::blackout(void *data
@@ -595,7 +607,7 @@ bool video_info_t::blackout(void *data
     return blackout(pixel_format
                     , size
                     , data
-                    , align);
+                    , align > 0 ? align : this->align);
 }
 
 
@@ -779,42 +791,48 @@ fragment_info_t::fragment_info_t(int32_t x
                                  , int32_t height
                                  , int32_t frame_width
                                  , int32_t frame_height
-                                 , pixel_format_t pixel_format)
+                                 , pixel_format_t pixel_format
+                                 , int32_t align)
     : fragment_info_t({ x, y, width, height }
                       , { frame_width, frame_height }
-                      , pixel_format)
+                      , pixel_format
+                      , align)
 {
 
 }
 
 fragment_info_t::fragment_info_t(const frame_rect_t& frame_rect
                                  , const frame_size_t& frame_size
-                                 , pixel_format_t pixel_format)
+                                 , pixel_format_t pixel_format
+                                 , int32_t align)
     : frame_rect(frame_rect)
     , frame_size(frame_size)
     , pixel_format(pixel_format)
+    , align(align)
 {
 
 }
 
 fragment_info_t::fragment_info_t(const frame_size_t &frame_size
-                                 , pixel_format_t pixel_format)
+                                 , pixel_format_t pixel_format
+                                 , int32_t align)
     : fragment_info_t({ 0, 0, frame_size.width, frame_size.height }
                       , { frame_size.width, frame_size.height }
-                      , pixel_format)
+                      , pixel_format
+                      , align)
 {
 
 }
 
 size_t fragment_info_t::get_fragment_size(std::int32_t align) const
 {
-    return video_info_t::frame_size(pixel_format, frame_rect.size, align);
+    return video_info_t::frame_size(pixel_format, frame_rect.size, align > 0 ? align : this->align);
 }
 
 
 size_t fragment_info_t::get_frame_size(std::int32_t align) const
 {
-    return video_info_t::frame_size(pixel_format, frame_size, align);
+    return video_info_t::frame_size(pixel_format, frame_size, align > 0 ? align : this->align);
 }
 
 void fragment_info_t::adjust_align(const frame_size_t &align)
@@ -851,6 +869,171 @@ bool fragment_info_t::operator !=(const fragment_info_t &fragment_info) const
     return !operator ==(fragment_info);
 }
 
+frame_point_t fragment_view_t::chroma_align(pixel_format_t pixel_format
+                                             , const frame_point_t &offset)
+{
+    frame_point_t aligned_offset = offset;
+
+    if (auto desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(pixel_format)))
+    {
+        aligned_offset.x -= aligned_offset.x % (1 << desc->log2_chroma_w);
+        aligned_offset.y -= aligned_offset.y % (1 << desc->log2_chroma_h);
+    }
+
+    return aligned_offset;
+}
+
+fragment_view_t::fragment_view_t()
+    : size({ 0, 0 })
+    , pixel_format(pixel_format_none)
+    , planes{}
+    , strides{}
+{
+
+}
+
+fragment_view_t::fragment_view_t(const fragment_info_t &fragment_info
+                                 , const void *frame
+                                 , int32_t align)
+    : fragment_view_t()
+{
+    if (align <= 0)
+    {
+        align = fragment_info.align;
+    }
+
+    if (frame != nullptr
+            && fragment_info.is_convertable()
+            && av_image_fill_arrays(planes
+                                    , strides
+                                    , static_cast<const std::uint8_t*>(frame)
+                                    , static_cast<AVPixelFormat>(fragment_info.pixel_format)
+                                    , fragment_info.frame_size.width
+                                    , fragment_info.frame_size.height
+                                    , align) > 0)
+    {
+        size = fragment_info.frame_rect.size;
+        pixel_format = fragment_info.pixel_format;
+
+        apply_offset(fragment_info.frame_rect.offset);
+    }
+}
+
+fragment_view_t::fragment_view_t(const fragment_info_t &fragment_info
+                                 , void * const slices[]
+                                 , int32_t align)
+    : fragment_view_t()
+{
+    if (align <= 0)
+    {
+        align = fragment_info.align;
+    }
+
+    if (slices != nullptr
+            && fragment_info.is_convertable()
+            && av_image_fill_linesizes(strides
+                                       , static_cast<AVPixelFormat>(fragment_info.pixel_format)
+                                       , fragment_info.frame_size.width) >= 0)
+    {
+        auto planes_count = video_info_t::planes(fragment_info.pixel_format);
+
+        for (std::size_t i = 0; i < planes_count; i++)
+        {
+            // same linesize rounding as av_image_fill_arrays
+            strides[i] = (strides[i] + align - 1) / align * align;
+            planes[i] = static_cast<std::uint8_t*>(slices[i]);
+        }
+
+        size = fragment_info.frame_rect.size;
+        pixel_format = fragment_info.pixel_format;
+
+        apply_offset(fragment_info.frame_rect.offset);
+    }
+}
+
+fragment_view_t fragment_view_t::crop(const frame_rect_t &rect) const
+{
+    fragment_view_t view(*this);
+
+    if (!view.is_valid()
+            || !rect.is_join(size)
+            || !view.apply_offset(rect.offset))
+    {
+        return fragment_view_t();
+    }
+
+    view.size = rect.size;
+
+    return view;
+}
+
+bool fragment_view_t::copy_to(const fragment_view_t &view) const
+{
+    if (is_valid()
+            && view.is_valid()
+            && pixel_format == view.pixel_format
+            && size == view.size)
+    {
+        av_image_copy(const_cast<std::uint8_t**>(view.planes)
+                      , view.strides
+                      , const_cast<const std::uint8_t**>(planes)
+                      , strides
+                      , static_cast<AVPixelFormat>(pixel_format)
+                      , size.width
+                      , size.height);
+        return true;
+    }
+
+    return false;
+}
+
+std::size_t fragment_view_t::planes_count() const
+{
+    return pixel_format != pixel_format_none
+            ? video_info_t::planes(pixel_format)
+            : 0;
+}
+
+bool fragment_view_t::is_valid() const
+{
+    return planes[0] != nullptr
+            && !size.is_null();
+}
+
+bool fragment_view_t::apply_offset(const frame_point_t &offset)
+{
+    auto desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(pixel_format));
+    if (desc == nullptr)
+    {
+        return false;
+    }
+
+    auto aligned_offset = chroma_align(pixel_format
+                                       , offset);
+
+    std::int32_t offsets[max_planes] = {};
+
+    // byte offset of x pixels in every plane, chroma planes already subsampled
+    if (aligned_offset.x > 0
+            && av_image_fill_linesizes(offsets
+                                       , static_cast<AVPixelFormat>(pixel_format)
+                                       , aligned_offset.x) < 0)
+    {
+        return false;
+    }
+
+    for (std::size_t i = 0; i < planes_count(); i++)
+    {
+        auto y = i == 1 || i == 2
+                ? aligned_offset.y >> desc->log2_chroma_h
+                : aligned_offset.y;
+
+        planes[i] += y * strides[i] + offsets[i];
+    }
+
+    return true;
+}
+
 std::string codec_info_t::codec_name(codec_id_t id)
 {    
     return avcodec_get_name(static_cast<AVCodecID>(id));
@@ -4,6 +4,7 @@
 #include "tools/base/frame_base.h"
 #include "tools/base/time_base.h"
 #include "tools/base/option_base.h"
+#include "tools/base/aligned_allocator.h"
 
 #include <string>
 #include <vector>
@@ -21,6 +22,9 @@ typedef std::int32_t sample_format_t;
 typedef std::int32_t stream_parse_type_t;
 
 const std::int32_t default_frame_align = 1;
+// row alignment that keeps every plane start and every row on a cache line,
+// lets swscale and the codecs use aligned vector loads without a copy
+const std::int32_t simd_frame_align = 64;
 
 typedef std::vector<pixel_format_t> pixel_formats_t;
 typedef std::vector<sample_format_t> sample_formats_t;
@@ -51,6 +55,7 @@ extern const pixel_format_t pixel_format_nv12;
 extern const pixel_format_t pixel_format_nv21;
 extern const pixel_format_t pixel_format_yuv420p;
 extern const pixel_format_t pixel_format_yuv422p;
+extern const pixel_format_t pixel_format_yuyv422;
 
 
 extern const sample_format_t sample_format_none;
@@ -133,7 +138,9 @@ const std::uint32_t max_fps = 60;
 
 const std::size_t max_planes = 4;
 
-using media_data_t = std::vector<std::uint8_t>;
+// not a std::vector<std::uint8_t>: the allocator is part of the type, plain
+// byte vectors are copied in with assign() or the iterator constructor
+using media_data_t = std::vector<std::uint8_t, base::aligned_allocator_t<std::uint8_t, simd_frame_align>>;
 
 using extra_data_t = std::shared_ptr<media_data_t>;
 
@@ -260,6 +267,7 @@ struct video_info_t
     frame_size_t    size;
     std::uint32_t   fps;
     pixel_format_t  pixel_format;
+    std::int32_t    align;          // row alignment of the frame buffer
 
     static std::uint32_t bpp(pixel_format_t pixel_format);
     static std::size_t frame_size(pixel_format_t pixel_format
@@ -287,7 +295,8 @@ struct video_info_t
 
     static bool blackout(pixel_format_t pixel_format
                                 , const frame_size_t& size
-                                , void *slices[max_planes]);
+                                , void *slices[max_planes]
+                                , std::int32_t align = default_frame_align);
 
     static bool blackout(pixel_format_t pixel_format
                                 , const frame_size_t& size
@@ -301,16 +310,20 @@ struct video_info_t
     video_info_t(std::int32_t width
                  , std::int32_t height
                  , std::uint32_t fps = 1
-                 , pixel_format_t pixel_format = default_pixel_format);
+                 , pixel_format_t pixel_format = default_pixel_format
+                 , std::int32_t align = default_frame_align);
 
     video_info_t(frame_size_t size = { 0, 0 }
                  , std::uint32_t fps = 1
-                 , pixel_format_t pixel_format = default_pixel_format);
+                 , pixel_format_t pixel_format = default_pixel_format
+                 , std::int32_t align = default_frame_align);
 
+    // the format, the row alignment of the buffer is not compared
     bool operator ==(const video_info_t& video_info) const;
     bool operator !=(const video_info_t& video_info) const;
     std::uint32_t bpp() const;
-    std::size_t frame_size(std::int32_t align = default_frame_align) const;
+    // align == 0 in the methods below means the row alignment of this info
+    std::size_t frame_size(std::int32_t align = 0) const;
     std::string format_name() const;
 
     std::size_t planes() const;
@@ -318,13 +331,13 @@ struct video_info_t
     plane_sizes_t plane_sizes() const;
     std::size_t split_slices(void *slices[max_planes]
                              , const void* data
-                             , std::int32_t align = default_frame_align) const;
+                             , std::int32_t align = 0) const;
     plane_list_t split_planes(const void* data = nullptr
-                             , std::int32_t align = default_frame_align);
+                             , std::int32_t align = 0);
 
     bool blackout(void *slices[max_planes]) const;
     bool blackout(void *data
-                  , std::int32_t align = default_frame_align) const;
+                  , std::int32_t align = 0) const;
 };
 
 struct fragment_info_t
@@ -332,6 +345,7 @@ struct fragment_info_t
     frame_rect_t    frame_rect;
     frame_size_t    frame_size;
     pixel_format_t  pixel_format;
+    std::int32_t    align;          // row alignment of the frame buffer
 
     fragment_info_t(std::int32_t x
                     , std::int32_t y
@@ -339,20 +353,25 @@ struct fragment_info_t
                     , std::int32_t height
                     , std::int32_t frame_width
                     , std::int32_t frame_height
-                    , pixel_format_t pixel_format = default_pixel_format);
+                    , pixel_format_t pixel_format = default_pixel_format
+                    , std::int32_t align = default_frame_align);
 
     fragment_info_t(const frame_rect_t& frame_rect = { 0, 0, 0, 0 }
                     , const frame_size_t& frame_size = { 0, 0 }
-                    , pixel_format_t pixel_format = default_pixel_format);
+                    , pixel_format_t pixel_format = default_pixel_format
+                    , std::int32_t align = default_frame_align);
 
     fragment_info_t(const frame_size_t& frame_size
-                    , pixel_format_t pixel_format = default_pixel_format);
+                    , pixel_format_t pixel_format = default_pixel_format
+                    , std::int32_t align = default_frame_align);
 
+    // the format and the area, the row alignment is not compared
     bool operator ==(const fragment_info_t& fragment_info) const;
     bool operator !=(const fragment_info_t& fragment_info) const;
 
-    std::size_t get_fragment_size(std::int32_t align = default_frame_align) const;
-    std::size_t get_frame_size(std::int32_t align = default_frame_align) const;
+    // align == 0 means the row alignment of this fragment
+    std::size_t get_fragment_size(std::int32_t align = 0) const;
+    std::size_t get_frame_size(std::int32_t align = 0) const;
 
     void adjust_align(const frame_size_t& align);
 
@@ -360,6 +379,42 @@ struct fragment_info_t
     bool is_convertable() const;
 };
 
+// Non-owning view of a fragment: per-plane pointers and strides into the
+// original frame buffer, so a crop costs nothing until pixels are converted.
+// The fragment offset is rounded down to the chroma subsampling grid, so
+// every plane starts on a whole chroma sample.
+struct fragment_view_t
+{
+    frame_size_t    size;
+    pixel_format_t  pixel_format;
+    std::uint8_t*   planes[max_planes];
+    std::int32_t    strides[max_planes];
+
+    static frame_point_t chroma_align(pixel_format_t pixel_format
+                                      , const frame_point_t& offset);
+
+    fragment_view_t();
+
+    // align == 0 means the row alignment of the fragment info
+    fragment_view_t(const fragment_info_t& fragment_info
+                    , const void* frame
+                    , std::int32_t align = 0);
+
+    fragment_view_t(const fragment_info_t& fragment_info
+                    , void* const slices[]
+                    , std::int32_t align = 0);
+
+    fragment_view_t crop(const frame_rect_t& rect) const;
+
+    bool copy_to(const fragment_view_t& view) const;
+
+    std::size_t planes_count() const;
+    bool is_valid() const;
+
+private:
+    bool apply_offset(const frame_point_t& offset);
+};
+
 
 struct codec_params_t
 {
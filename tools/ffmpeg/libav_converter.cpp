@@ -1,92 +1,50 @@
 #include "libav_converter.h"
+#include "libav_scaling_cache.h"
+#include "libav_fast_converter.h"
 
 #include <cstring>
 
 extern "C"
 {
 #include <libswscale/swscale.h>
-#include <libavcodec/avcodec.h>
 #include <libavutil/imgutils.h>
 #include <libavutil/pixdesc.h>
 }
 
+#include "tools/base/worker_pool.h"
+
+#include <atomic>
+#include <algorithm>
 #include <iostream>
 
 namespace ffmpeg
 {
 
-namespace utils
-{
-
-bool fill_frame(AVPicture& picture
-               , void* const slice_list[]
-               , pixel_format_t pixel_format
-               , const frame_size_t& frame_size)
-{
-    if (av_image_fill_linesizes(picture.linesize
-                                , static_cast<AVPixelFormat>(pixel_format)
-                                , frame_size.width) >= 0)
-    {
-        std::memcpy(picture.data
-                    , slice_list
-                    , sizeof(void*) * video_info_t::planes(pixel_format));
-        return true;
-    }
-
-    return false;
-}
-
-bool crop_frame(AVPicture& picture
-               , pixel_format_t pixel_format
-               , const frame_point_t& frame_point)
-{
-    return av_picture_crop((AVPicture*)&picture
-                          , (AVPicture*)&picture
-                          , static_cast<AVPixelFormat>(pixel_format)
-                          , frame_point.y
-                          , frame_point.x) >= 0;
-}
-
-std::size_t prepare_frame(AVPicture& picture
-                         , const frame_rect_t& frame_rect
-                         , pixel_format_t pixel_format
-                         , void * const slice_list[]
-                         , std::int32_t align = default_frame_align)
-{
-
-    if (fill_frame(picture
-                   , slice_list
-                   , pixel_format
-                   , frame_rect.size)
-            && crop_frame(picture
-                          , pixel_format
-                          , frame_rect.offset))
-    {
-        return video_info_t::frame_size(pixel_format
-                                        , frame_rect.size
-                                        , align);
-    }
-
-    return 0;
-}
-
-}
+const std::int32_t min_band_height = 64;
+// bands start on the period of the swscale ordered dither
+const std::int32_t band_row_align = 8;
 
 struct libav_converter_context_t
 { 
+    using band_t = std::pair<std::int32_t, std::int32_t>;   // first row, rows
+    using band_list_t = std::vector<band_t>;
+    using band_context_t = std::pair<scaling_plan_key_t, SwsContext*>;
+    using band_context_list_t = std::vector<band_context_t>;
+
     struct SwsContext*  m_sws_context;
-    frame_size_t        m_input_frame_size;
-    pixel_format_t      m_input_pixel_format;
-    frame_size_t        m_output_frame_size;
-    pixel_format_t      m_output_pixel_format;
+    scaling_plan_key_t  m_plan_key;
     scaling_method_t    m_scaling_method;
     std::int32_t        m_linesize_align;
+    std::size_t         m_thread_count;
+    band_context_list_t m_band_contexts;
 
     libav_converter_context_t(scaling_method_t scaling_method
-                              , std::int32_t linesize_align)
+                              , std::int32_t linesize_align
+                              , std::size_t thread_count)
         : m_sws_context(nullptr)
         , m_scaling_method(scaling_method)
         , m_linesize_align(linesize_align)
+        , m_thread_count(thread_count)
     {
 
     }
@@ -96,118 +54,355 @@ struct libav_converter_context_t
         reset();
     }   
 
+    // an explicit fragment align wins over the converter default
+    std::int32_t frame_align(const fragment_info_t& fragment_info) const
+    {
+        return fragment_info.align > default_frame_align
+                ? fragment_info.align
+                : m_linesize_align;
+    }
+
+    // the format equality leaves the padding out, a plain copy needs both
+    bool is_same_layout(const fragment_info_t& input_fragment_info
+                        , const fragment_info_t& output_fragment_info) const
+    {
+        return input_fragment_info == output_fragment_info
+                && frame_align(input_fragment_info) == frame_align(output_fragment_info);
+    }
+
     bool check_or_create_context(const frame_size_t& input_frame_size
                                  , pixel_format_t input_pixel_format
                                  , const frame_size_t& output_frame_size
                                  , pixel_format_t output_pixel_format)
     {
+        scaling_plan_key_t plan_key(input_frame_size
+                                    , input_pixel_format
+                                    , output_frame_size
+                                    , output_pixel_format
+                                    , m_scaling_method);
+
         if (m_sws_context == nullptr
-                || m_input_pixel_format != input_pixel_format
-                || m_input_frame_size != input_frame_size
-                || m_output_pixel_format != output_pixel_format
-                || m_output_frame_size != output_frame_size)
+                || m_plan_key != plan_key)
         {
-            m_sws_context = sws_getCachedContext(m_sws_context
-                                                 , input_frame_size.width
-                                                 , input_frame_size.height
-                                                 , static_cast<AVPixelFormat>(input_pixel_format)
-                                                 , output_frame_size.width
-                                                 , output_frame_size.height
-                                                 , static_cast<AVPixelFormat>(output_pixel_format)
-                                                 , static_cast<std::uint32_t>(m_scaling_method)
-                                                 , nullptr
-                                                 , nullptr
-                                                 , nullptr);
+            // return the current plan to the shared cache, other converters
+            // (or this one, a few frames later) will pick it up again
+            reset();
+
+            m_sws_context = libav_scaling_cache::instance().acquire(plan_key);
 
             if (m_sws_context != nullptr)
             {
-                m_input_pixel_format = input_pixel_format;
-                m_input_frame_size = input_frame_size;
-                m_output_pixel_format = output_pixel_format;
-                m_output_frame_size = output_frame_size;
+                m_plan_key = plan_key;
             }
         }
 
         return m_sws_context != nullptr;
     }   
 
-    std::size_t scale(const fragment_info_t& input_fragment_info
-                      , void* const input_slices[]
-                      , const fragment_info_t& output_fragment_info
-                      , void* output_slices[])
+    bool check_or_create_band_contexts(const frame_size_t& input_frame_size
+                                       , pixel_format_t input_pixel_format
+                                       , const frame_size_t& output_frame_size
+                                       , pixel_format_t output_pixel_format
+                                       , const band_list_t& bands)
     {
-        std::size_t result = 0;
+        m_band_contexts.resize(bands.size());
 
-        if (check_or_create_context(input_fragment_info.frame_rect.size
-                                                 , input_fragment_info.pixel_format
-                                                 , output_fragment_info.frame_rect.size
-                                                 , output_fragment_info.pixel_format))
+        for (std::size_t i = 0; i < bands.size(); i++)
         {
+            auto& band_context = m_band_contexts[i];
 
+            scaling_plan_key_t plan_key({ input_frame_size.width, bands[i].second }
+                                        , input_pixel_format
+                                        , { output_frame_size.width, bands[i].second }
+                                        , output_pixel_format
+                                        , m_scaling_method);
 
+            if (band_context.second == nullptr
+                    || band_context.first != plan_key)
+            {
+                libav_scaling_cache::instance().release(band_context.first
+                                                        , band_context.second);
 
-            frame_size_t input_frame_size = input_fragment_info.frame_size;
-            frame_size_t output_frame_size = output_fragment_info.frame_size;
+                band_context.second = libav_scaling_cache::instance().acquire(plan_key);
+                band_context.first = plan_key;
 
+                if (band_context.second == nullptr)
+                {
+                    return false;
+                }
+            }
+        }
 
-            /*input_frame_size.width -= input_frame_size.width % default_frame_align;
-            output_frame_size.width -= output_frame_size.width % default_frame_align;*/
+        return true;
+    }
 
-            /*
-            if (input_frame_size.width % default_frame_align != 0)
-            {
-                input_frame_size.width += (default_frame_align - input_frame_size.width % default_frame_align);
-            }
+    void reset_band_contexts()
+    {
+        for (auto& band_context : m_band_contexts)
+        {
+            libav_scaling_cache::instance().release(band_context.first
+                                                    , band_context.second);
+        }
 
-            if (output_frame_size.width % default_frame_align != 0)
-            {
-                output_frame_size.width += (default_frame_align - output_frame_size.width % default_frame_align);
-            }*/
+        m_band_contexts.clear();
+    }
 
+    std::size_t band_count(const fragment_view_t& input_view
+                           , const fragment_view_t& output_view) const
+    {
+        if (m_thread_count != 1
+                && input_view.size.height == output_view.size.height)
+        {
+            auto threads = m_thread_count == 0
+                    ? base::worker_pool::shared_pool().size() + 1
+                    : m_thread_count;
 
-            AVPicture src_frame = {};
-            AVPicture dst_frame = {};
+            auto max_bands = static_cast<std::size_t>(output_view.size.height) / min_band_height;
 
-            auto sz_input = utils::prepare_frame(src_frame
-                                                 , { input_fragment_info.frame_rect.offset, input_frame_size }
-                                                 , input_fragment_info.pixel_format
-                                                 , input_slices
-                                                 , m_linesize_align);
+            return std::min(threads, max_bands);
+        }
+
+        return 1;
+    }
+
+    static band_list_t split_bands(const fragment_view_t& input_view
+                                   , const fragment_view_t& output_view
+                                   , std::size_t band_count)
+    {
+        band_list_t bands;
 
-            auto sz_output = utils::prepare_frame(dst_frame
-                                                 , { output_fragment_info.frame_rect.offset, output_frame_size }
-                                                 , output_fragment_info.pixel_format
-                                                 , output_slices
-                                                 , m_linesize_align);
+        auto band_align = std::max({ chroma_align(input_view.pixel_format)
+                                     , chroma_align(output_view.pixel_format)
+                                     , band_row_align });
 
+        auto height = output_view.size.height;
 
-            if (sz_input != 0
-                    && sz_output != 0)
-            {
+        std::int32_t band_height = height / band_count;
+        band_height -= band_height % band_align;
 
-                auto h_corr = sz_input == sz_output
-                        && input_fragment_info.frame_rect.size == output_fragment_info.frame_rect.size
-                            ? 2
-                            : 0;
+        std::int32_t y = 0;
+        for (std::size_t i = 0; i < band_count && band_height > 0; i++)
+        {
+            auto h = i + 1 == band_count
+                    ? height - y
+                    : band_height;
+
+            bands.emplace_back(y, h);
+            y += h;
+        }
+
+        return bands;
+    }
 
-                auto sws_result = sws_scale(m_sws_context
-                                            , src_frame.data
-                                            , src_frame.linesize
-                                            , h_corr
-                                            , input_fragment_info.frame_rect.size.height - h_corr
-                                            , dst_frame.data
-                                            , dst_frame.linesize);
+    static std::int32_t chroma_align(pixel_format_t pixel_format)
+    {
+        auto desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(pixel_format));
+        return desc != nullptr
+                ? 1 << desc->log2_chroma_h
+                : 1;
+    }
 
-                if (sws_result > 0)
+    static fragment_view_t band_view(const fragment_view_t& view
+                                     , const band_t& band)
+    {
+        return view.crop({ 0, band.first, view.size.width, band.second });
+    }
+
+    bool scale_bands(const fragment_view_t& input_view
+                     , const fragment_view_t& output_view
+                     , std::size_t bands_count)
+    {
+        auto bands = split_bands(input_view
+                                 , output_view
+                                 , bands_count);
+
+        if (bands.size() > 1
+                && check_or_create_band_contexts(input_view.size
+                                                 , input_view.pixel_format
+                                                 , output_view.size
+                                                 , output_view.pixel_format
+                                                 , bands))
+        {
+            std::atomic_bool success(true);
+
+            base::worker_pool::shared_pool().run(bands.size()
+                                                 , [&](std::size_t i)
+            {
+                auto src_band = band_view(input_view, bands[i]);
+                auto dst_band = band_view(output_view, bands[i]);
+
+                if (sws_scale(m_band_contexts[i].second
+                              , src_band.planes
+                              , src_band.strides
+                              , 0
+                              , bands[i].second
+                              , dst_band.planes
+                              , dst_band.strides) <= 0)
                 {
-                    // std::cout << "src_stride = " << src_stride[0] << ", dst_stride = " << dst_stride[0] << std::endl;
-                    result = sz_output;
+                    success = false;
                 }
+            });
+
+            return success;
+        }
+
+        return false;
+    }
+
+    bool fast_convert(const fragment_view_t& input_view
+                      , const fragment_view_t& output_view)
+    {
+        auto bands = split_bands(input_view
+                                 , output_view
+                                 , band_count(input_view
+                                              , output_view));
+
+        if (bands.size() <= 1)
+        {
+            return libav_fast_converter::convert(output_view.size
+                                                 , input_view.pixel_format
+                                                 , input_view.planes
+                                                 , input_view.strides
+                                                 , output_view.pixel_format
+                                                 , output_view.planes
+                                                 , output_view.strides);
+        }
+
+        std::atomic_bool success(true);
+
+        base::worker_pool::shared_pool().run(bands.size()
+                                             , [&](std::size_t i)
+        {
+            auto src_band = band_view(input_view, bands[i]);
+            auto dst_band = band_view(output_view, bands[i]);
+
+            if (!libav_fast_converter::convert(dst_band.size
+                                               , src_band.pixel_format
+                                               , src_band.planes
+                                               , src_band.strides
+                                               , dst_band.pixel_format
+                                               , dst_band.planes
+                                               , dst_band.strides))
+            {
+                success = false;
             }
+        });
+
+        return success;
+    }
 
+    bool scale_views(const fragment_view_t& input_view
+                     , const fragment_view_t& output_view
+                     , std::int32_t h_corr = 0)
+    {
+        // same format and size is a plain crop, copy the fragment rows
+        if (input_view.pixel_format == output_view.pixel_format
+                && input_view.size == output_view.size)
+        {
+            return input_view.copy_to(output_view);
         }
 
-        return result;
+        // unscaled conversions of the common pairs bypass swscale
+        if (input_view.size == output_view.size
+                && libav_fast_converter::is_enabled()
+                && libav_fast_converter::is_supported(input_view.pixel_format
+                                                      , output_view.pixel_format)
+                && fast_convert(input_view
+                                , output_view))
+        {
+            return true;
+        }
+
+        // swscale interpolates a vertical chroma resampling (yuv420p -> bgr24)
+        // across the band edges, such conversions stay single-pass
+        auto bands = h_corr == 0
+                && chroma_align(input_view.pixel_format) == chroma_align(output_view.pixel_format)
+                ? band_count(input_view
+                             , output_view)
+                : 1;
+
+        if (bands > 1
+                && scale_bands(input_view
+                               , output_view
+                               , bands))
+        {
+            return true;
+        }
+
+        if (check_or_create_context(input_view.size
+                                    , input_view.pixel_format
+                                    , output_view.size
+                                    , output_view.pixel_format))
+        {
+            auto sws_result = sws_scale(m_sws_context
+                                        , input_view.planes
+                                        , input_view.strides
+                                        , h_corr
+                                        , input_view.size.height - h_corr
+                                        , output_view.planes
+                                        , output_view.strides);
+
+            // std::cout << "src_stride = " << src_stride[0] << ", dst_stride = " << dst_stride[0] << std::endl;
+            return sws_result > 0;
+        }
+
+        return false;
+    }
+
+    std::size_t scale(const fragment_info_t& input_fragment_info
+                      , void* const input_slices[]
+                      , const fragment_info_t& output_fragment_info
+                      , void* output_slices[])
+    {
+        fragment_view_t input_view(input_fragment_info
+                                   , input_slices
+                                   , frame_align(input_fragment_info));
+
+        fragment_view_t output_view(output_fragment_info
+                                    , output_slices
+                                    , frame_align(output_fragment_info));
+
+        if (input_view.is_valid()
+                && output_view.is_valid())
+        {
+            auto sz_input = video_info_t::frame_size(input_fragment_info.pixel_format
+                                                     , input_fragment_info.frame_size
+                                                     , frame_align(input_fragment_info));
+
+            auto sz_output = video_info_t::frame_size(output_fragment_info.pixel_format
+                                                      , output_fragment_info.frame_size
+                                                      , frame_align(output_fragment_info));
+
+            auto h_corr = sz_input == sz_output
+                    && input_view.size == output_view.size
+                        ? 2
+                        : 0;
+
+            if (scale_views(input_view
+                            , output_view
+                            , h_corr))
+            {
+                return sz_output;
+            }
+        }
+
+        return 0;
+    }
+
+    std::size_t convert_views(const fragment_view_t& input_view
+                              , const fragment_view_t& output_view)
+    {
+        if (input_view.is_valid()
+                && output_view.is_valid()
+                && scale_views(input_view
+                               , output_view))
+        {
+            return video_info_t::frame_size(output_view.pixel_format
+                                            , output_view.size
+                                            , m_linesize_align);
+        }
+
+        return 0;
     }
 
     std::size_t convert_frames(const fragment_info_t& input_fragment_info
@@ -219,9 +414,9 @@ struct libav_converter_context_t
         std::size_t result = 0;
 
         if (input_fragment_info.is_full()
-                && input_fragment_info == output_fragment_info)
+                && is_same_layout(input_fragment_info, output_fragment_info))
         {
-            result = input_fragment_info.get_frame_size();
+            result = input_fragment_info.get_frame_size(frame_align(input_fragment_info));
             if (output_frame != input_frame)
             {
                 std::memcpy(output_frame
@@ -239,13 +434,15 @@ struct libav_converter_context_t
             video_info_t::split_slices(input_fragment_info.pixel_format
                                        , input_fragment_info.frame_size
                                        , input_slices
-                                       , input_frame);
+                                       , input_frame
+                                       , frame_align(input_fragment_info));
 
 
             video_info_t::split_slices(output_fragment_info.pixel_format
                                        , output_fragment_info.frame_size
                                        , output_slices
-                                       , output_frame);
+                                       , output_frame
+                                       , frame_align(output_fragment_info));
 
 
             result = scale(input_fragment_info
@@ -267,15 +464,16 @@ struct libav_converter_context_t
         std::size_t result = 0;
 
         if (input_fragment_info.is_full()
-                && input_fragment_info == output_fragment_info)
+                && is_same_layout(input_fragment_info, output_fragment_info))
         {
-            result = input_fragment_info.get_frame_size();
+            result = input_fragment_info.get_frame_size(frame_align(input_fragment_info));
 
             if (input_slices != output_slices)
             {
                 auto i = 0;
                 for (const auto& sz : video_info_t::plane_sizes(input_fragment_info.pixel_format
-                                                                , input_fragment_info.frame_size))
+                                                                , input_fragment_info.frame_size
+                                                                , frame_align(input_fragment_info)))
                 {
                     if (input_slices[i] != output_slices[i])
                     {
@@ -307,14 +505,15 @@ struct libav_converter_context_t
         std::size_t result = 0;
 
         if (input_fragment_info.is_full()
-                && input_fragment_info == output_fragment_info)
+                && is_same_layout(input_fragment_info, output_fragment_info))
         {
-            result = input_fragment_info.get_frame_size();
+            result = input_fragment_info.get_frame_size(frame_align(input_fragment_info));
 
             auto i = 0;
             std::size_t offset = 0;
             for (const auto& sz : video_info_t::plane_sizes(input_fragment_info.pixel_format
-                                                            , input_fragment_info.frame_size))
+                                                            , input_fragment_info.frame_size
+                                                            , frame_align(input_fragment_info)))
             {
                 std::memcpy(output_slices[i]
                             , static_cast<const std::uint8_t*>(input_frame) + offset
@@ -332,7 +531,8 @@ struct libav_converter_context_t
             video_info_t::split_slices(input_fragment_info.pixel_format
                                        , input_fragment_info.frame_size
                                        , input_slices
-                                       , input_frame);
+                                       , input_frame
+                                       , frame_align(input_fragment_info));
 
             result = scale(input_fragment_info
                            , input_slices
@@ -353,14 +553,15 @@ struct libav_converter_context_t
         std::size_t result = 0;
 
         if (input_fragment_info.is_full()
-                && input_fragment_info == output_fragment_info)
+                && is_same_layout(input_fragment_info, output_fragment_info))
         {
-            result = input_fragment_info.get_frame_size();
+            result = input_fragment_info.get_frame_size(frame_align(input_fragment_info));
 
             auto i = 0;
             std::size_t offset = 0;
             for (const auto& sz : video_info_t::plane_sizes(input_fragment_info.pixel_format
-                                                            , input_fragment_info.frame_size))
+                                                            , input_fragment_info.frame_size
+                                                            , frame_align(input_fragment_info)))
             {
                 std::memcpy(static_cast<std::uint8_t*>(output_frame) + offset
                             , input_slices[i]
@@ -377,7 +578,8 @@ struct libav_converter_context_t
             video_info_t::split_slices(output_fragment_info.pixel_format
                                        , output_fragment_info.frame_size
                                        , output_slices
-                                       , output_frame);
+                                       , output_frame
+                                       , frame_align(output_fragment_info));
 
             result = scale(input_fragment_info
                            , input_slices
@@ -391,9 +593,12 @@ struct libav_converter_context_t
 
     void reset()
     {
+        reset_band_contexts();
+
         if (m_sws_context != nullptr)
         {
-            sws_freeContext(m_sws_context);
+            libav_scaling_cache::instance().release(m_plan_key
+                                                    , m_sws_context);
             m_sws_context = nullptr;
         }
     }
@@ -416,9 +621,11 @@ void libav_converter_context_deleter_t::operator()(libav_converter_context_t *li
 #define CHECK_FORMATS if (!input_fragment_info.is_convertable() || !output_fragment_info.is_convertable()) return 0
 
 libav_converter::libav_converter(scaling_method_t scaling_method
-                                 , std::int32_t linesize_align)
+                                 , std::int32_t linesize_align
+                                 , std::size_t thread_count)
     : m_converter_context(new libav_converter_context_t(scaling_method
-                                                        , linesize_align))
+                                                        , linesize_align
+                                                        , thread_count))
 {
 
 }
@@ -470,6 +677,13 @@ std::size_t libav_converter::convert_to_frame(const fragment_info_t &input_fragm
                                                  , output_frame);
 }
 
+std::size_t libav_converter::convert_views(const fragment_view_t &input_view
+                                           , const fragment_view_t &output_view)
+{
+    return m_converter_context->convert_views(input_view
+                                              , output_view);
+}
+
 void libav_converter::reset(scaling_method_t scaling_method)
 {
     m_converter_context->reset(scaling_method);
@@ -485,5 +699,19 @@ scaling_method_t libav_converter::scaling_method() const
     return m_converter_context->m_scaling_method;
 }
 
+void libav_converter::set_thread_count(std::size_t thread_count)
+{
+    if (m_converter_context->m_thread_count != thread_count)
+    {
+        m_converter_context->reset_band_contexts();
+        m_converter_context->m_thread_count = thread_count;
+    }
+}
+
+std::size_t libav_converter::thread_count() const
+{
+    return m_converter_context->m_thread_count;
+}
+
 
 }
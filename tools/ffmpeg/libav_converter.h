@@ -29,6 +29,15 @@ enum class scaling_method_t
 
 const scaling_method_t default_scaling_method = scaling_method_t::fast_bilinear;
 
+// thread_count == 1 keeps the conversion on the caller's thread, 0 uses every
+// worker of the shared pool. Parallel mode splits the output into horizontal
+// bands aligned to the chroma subsampling and converts each band with its own
+// scaling context. It is only used when the picture height is not scaled
+// and, for swscale, when the vertical chroma subsampling of both formats is
+// the same, so every band sees exactly the rows the single-pass conversion
+// would and the output is byte for byte the same.
+const std::size_t default_converter_threads = 1;
+
 class libav_converter
 {
     libav_converter_context_ptr_t   m_converter_context;
@@ -36,7 +45,8 @@ class libav_converter
 
 public:
     libav_converter(scaling_method_t scaling_method = default_scaling_method
-                    , std::int32_t linesize_align = default_frame_align);
+                    , std::int32_t linesize_align = default_frame_align
+                    , std::size_t thread_count = default_converter_threads);
 
     std::size_t convert_frames(const fragment_info_t& input_fragment_info
                                , const void* input_frame
@@ -58,10 +68,18 @@ public:
                                  , const fragment_info_t& output_fragment_info
                                  , void* output_frame);
 
+    // converts between views into existing buffers, a crop into the same
+    // format and size is a row copy without swscale
+    std::size_t convert_views(const fragment_view_t& input_view
+                              , const fragment_view_t& output_view);
+
     void reset(scaling_method_t scaling_method);
     void reset();
 
     scaling_method_t scaling_method() const;
+
+    void set_thread_count(std::size_t thread_count);
+    std::size_t thread_count() const;
 };
 
 }
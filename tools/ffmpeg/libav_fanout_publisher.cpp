@@ -0,0 +1,426 @@
+#include "libav_fanout_publisher.h"
+
+#define WBS_MODULE_NAME "ff:fanout"
+#include "tools/base/logger_base.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <map>
+#include <vector>
+
+namespace ffmpeg
+{
+
+const std::size_t supervisor_period_ms = 100;
+
+static std::uint64_t now_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct libav_fanout_publisher_context_t
+{
+    struct output_t
+    {
+        using pointer_t = std::shared_ptr<output_t>;
+        using publisher_ptr_t = std::shared_ptr<libav_stream_publisher>;
+
+        fanout_output_id_t  output_id;
+        std::string         uri;
+        publisher_ptr_t     publisher;          // null while disconnected
+        std::uint64_t       last_attempt;
+        std::size_t         reconnections;
+        bool                wait_key_frame;
+        bool                is_connecting;
+
+        output_t(fanout_output_id_t output_id
+                 , const std::string& uri)
+            : output_id(output_id)
+            , uri(uri)
+            , last_attempt(0)
+            , reconnections(0)
+            , wait_key_frame(true)
+            , is_connecting(false)
+        {
+
+        }
+    };
+
+    using output_map_t = std::map<fanout_output_id_t, output_t::pointer_t>;
+
+    stream_info_list_t          m_streams;
+    publisher_config_t          m_config;
+    std::uint32_t               m_reconnect_timeout;
+    std::size_t                 m_max_errors;
+
+    mutable std::mutex          m_mutex;
+    std::condition_variable     m_signal;
+    std::condition_variable     m_release_signal;   // a push dropped its publishers
+    output_map_t                m_outputs;
+    fanout_output_id_t          m_next_output_id;
+    bool                        m_running;
+    std::thread                 m_supervisor_thread;
+
+    libav_fanout_publisher_context_t(const stream_info_list_t& stream_list
+                                     , const publisher_config_t& config
+                                     , std::uint32_t reconnect_timeout
+                                     , std::size_t max_errors)
+        : m_streams(stream_list)
+        , m_config(config)
+        , m_reconnect_timeout(reconnect_timeout)
+        , m_max_errors(max_errors)
+        , m_next_output_id(0)
+        , m_running(true)
+    {
+        // a synchronous or blocking output would stall the push of all
+        // the others
+        m_config.async = true;
+
+        if (m_config.overflow_policy == publisher_overflow_policy_t::block)
+        {
+            m_config.overflow_policy = publisher_overflow_policy_t::drop_until_key;
+        }
+
+        m_supervisor_thread = std::thread(&libav_fanout_publisher_context_t::supervisor_proc
+                                          , this);
+    }
+
+    ~libav_fanout_publisher_context_t()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_running = false;
+            m_signal.notify_all();
+        }
+
+        if (m_supervisor_thread.joinable())
+        {
+            m_supervisor_thread.join();
+        }
+
+        m_outputs.clear();
+    }
+
+    fanout_output_id_t add_output(const std::string& uri)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto output_id = m_next_output_id++;
+        m_outputs.emplace(output_id
+                          , std::make_shared<output_t>(output_id
+                                                       , uri));
+        m_signal.notify_all();
+
+        return output_id;
+    }
+
+    bool remove_output(fanout_output_id_t output_id)
+    {
+        output_t::publisher_ptr_t publisher;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            auto it = m_outputs.find(output_id);
+            if (it == m_outputs.end())
+            {
+                return false;
+            }
+
+            publisher = std::move(it->second->publisher);
+            m_outputs.erase(it);
+        }
+
+        // closes the muxer outside of the lock
+        close_publisher(std::move(publisher));
+
+        return true;
+    }
+
+    void close_publisher(output_t::publisher_ptr_t&& publisher
+                         , bool discard_queue = false)
+    {
+        if (publisher != nullptr)
+        {
+            // a push in flight may still hold the publisher, the references
+            // are taken and dropped under the lock, so the count is stable
+            // here and the muxer is closed after the last push let it go
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_release_signal.wait(lock, [&] { return publisher.use_count() == 1; });
+            }
+
+            publisher->close(discard_queue);
+            publisher.reset();
+        }
+    }
+
+    fanout_output_list_t outputs() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        fanout_output_list_t output_list;
+
+        for (const auto& it : m_outputs)
+        {
+            const auto& output = *it.second;
+
+            output_list.push_back({ output.output_id
+                                    , output.uri
+                                    , output.publisher != nullptr
+                                    , output.reconnections
+                                    , output.publisher != nullptr
+                                      ? output.publisher->stats()
+                                      : publisher_stats_t() });
+        }
+
+        return output_list;
+    }
+
+    bool is_video(const publisher_packet_t& packet) const
+    {
+        return packet.stream_id >= 0
+                && packet.stream_id < static_cast<std::int32_t>(m_streams.size())
+                && m_streams[packet.stream_id].media_info.media_type == media_type_t::video;
+    }
+
+    bool push_packet(const publisher_packet_ptr_t& packet)
+    {
+        if (packet == nullptr)
+        {
+            return false;
+        }
+
+        auto is_video_packet = is_video(*packet);
+        bool result = false;
+
+        // the publishers are pushed outside of the lock, a slow output
+        // holds neither the other outputs nor the supervisor
+        std::vector<output_t::publisher_ptr_t> publishers;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            for (auto& it : m_outputs)
+            {
+                auto& output = *it.second;
+
+                if (output.publisher == nullptr)
+                {
+                    continue;
+                }
+
+                // only video restarts on a key frame, audio goes on
+                if (output.wait_key_frame
+                        && is_video_packet)
+                {
+                    if (!packet->key_frame)
+                    {
+                        continue;
+                    }
+
+                    output.wait_key_frame = false;
+                }
+
+                publishers.push_back(output.publisher);
+            }
+        }
+
+        for (auto& publisher : publishers)
+        {
+            result |= publisher->push_packet(packet);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            publishers.clear();
+            m_release_signal.notify_all();
+        }
+
+        return result;
+    }
+
+    bool push_frame(std::int32_t stream_id
+                    , const void* data
+                    , std::size_t size
+                    , std::int64_t timestamp
+                    , bool key_frame
+                    , std::int64_t dts)
+    {
+        auto packet = std::make_shared<publisher_packet_t>();
+
+        auto bytes = static_cast<const std::uint8_t*>(data);
+
+        packet->stream_id = stream_id;
+        packet->data.assign(bytes, bytes + size);
+        packet->timestamp = timestamp;
+        packet->key_frame = key_frame;
+        packet->dts = dts;
+
+        return push_packet(packet);
+    }
+
+    bool is_failed(const libav_stream_publisher& publisher) const
+    {
+        return !publisher.is_opened()
+                || publisher.stats().write_errors >= m_max_errors;
+    }
+
+    void connect(output_t& output)
+    {
+        output_t::publisher_ptr_t publisher(new libav_stream_publisher(m_config));
+
+        LOG_I << "Fanout output #" << output.output_id << ". Connect to " << output.uri LOG_END;
+
+        auto result = publisher->open(output.uri
+                                      , m_streams);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        output.is_connecting = false;
+        output.last_attempt = now_ms();
+
+        if (result)
+        {
+            output.publisher = std::move(publisher);
+            output.wait_key_frame = true;
+            output.reconnections++;
+        }
+        else
+        {
+            LOG_W << "Fanout output #" << output.output_id << ". Connect to " << output.uri << " failed" LOG_END;
+        }
+    }
+
+    void supervisor_proc()
+    {
+        std::vector<output_t::pointer_t> connect_list;
+        std::vector<output_t::publisher_ptr_t> close_list;
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        while (m_running)
+        {
+            auto now = now_ms();
+
+            for (auto& it : m_outputs)
+            {
+                auto& output = *it.second;
+
+                if (output.publisher != nullptr
+                        && is_failed(*output.publisher))
+                {
+                    LOG_W << "Fanout output #" << output.output_id << ". Output failed, reconnect" LOG_END;
+                    close_list.emplace_back(std::move(output.publisher));
+                    output.last_attempt = now;
+                }
+
+                if (output.publisher == nullptr
+                        && !output.is_connecting
+                        && (output.last_attempt == 0
+                            || now - output.last_attempt >= m_reconnect_timeout))
+                {
+                    output.is_connecting = true;
+                    connect_list.push_back(it.second);
+                }
+            }
+
+            lock.unlock();
+
+            // a detached publisher is no longer seen by push, it is closed
+            // here without writing its queue into the failed output
+            for (auto& publisher : close_list)
+            {
+                close_publisher(std::move(publisher)
+                                , true);
+            }
+
+            close_list.clear();
+
+            for (auto& output : connect_list)
+            {
+                connect(*output);
+            }
+
+            connect_list.clear();
+
+            lock.lock();
+
+            if (m_running)
+            {
+                m_signal.wait_for(lock, std::chrono::milliseconds(supervisor_period_ms));
+            }
+        }
+    }
+};
+//------------------------------------------------------------------------------
+void libav_fanout_publisher_context_deleter_t::operator()(libav_fanout_publisher_context_t *libav_fanout_publisher_context_ptr)
+{
+    delete libav_fanout_publisher_context_ptr;
+}
+//------------------------------------------------------------------------------
+libav_fanout_publisher::libav_fanout_publisher(const stream_info_list_t &stream_list
+                                               , const publisher_config_t &config
+                                               , uint32_t reconnect_timeout
+                                               , std::size_t max_errors)
+    : m_fanout_publisher_context(new libav_fanout_publisher_context_t(stream_list
+                                                                      , config
+                                                                      , reconnect_timeout
+                                                                      , max_errors))
+{
+
+}
+
+fanout_output_id_t libav_fanout_publisher::add_output(const std::string &uri)
+{
+    return m_fanout_publisher_context->add_output(uri);
+}
+
+bool libav_fanout_publisher::remove_output(fanout_output_id_t output_id)
+{
+    return m_fanout_publisher_context->remove_output(output_id);
+}
+
+fanout_output_list_t libav_fanout_publisher::outputs() const
+{
+    return m_fanout_publisher_context->outputs();
+}
+
+const stream_info_list_t &libav_fanout_publisher::streams() const
+{
+    return m_fanout_publisher_context->m_streams;
+}
+
+bool libav_fanout_publisher::push_frame(int32_t stream_id
+                                        , const void *data
+                                        , std::size_t size
+                                        , int64_t timestamp
+                                        , bool key_frame
+                                        , int64_t dts)
+{
+    return m_fanout_publisher_context->push_frame(stream_id
+                                                  , data
+                                                  , size
+                                                  , timestamp
+                                                  , key_frame
+                                                  , dts);
+}
+
+bool libav_fanout_publisher::push_frame(const frame_t &frame)
+{
+    return m_fanout_publisher_context->push_frame(frame.info.id
+                                                  , frame.media_data.data()
+                                                  , frame.media_data.size()
+                                                  , frame.info.pts
+                                                  , frame.info.key_frame
+                                                  , frame.info.dts);
+}
+
+bool libav_fanout_publisher::push_packet(const publisher_packet_ptr_t &packet)
+{
+    return m_fanout_publisher_context->push_packet(packet);
+}
+
+}
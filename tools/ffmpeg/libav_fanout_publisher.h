@@ -0,0 +1,69 @@
+#ifndef FFMPEG_LIBAV_FANOUT_PUBLISHER_H
+#define FFMPEG_LIBAV_FANOUT_PUBLISHER_H
+
+#include "libav_stream_publisher.h"
+
+namespace ffmpeg
+{
+
+struct libav_fanout_publisher_context_t;
+struct libav_fanout_publisher_context_deleter_t { void operator()(libav_fanout_publisher_context_t* libav_fanout_publisher_context_ptr); };
+
+typedef std::unique_ptr<libav_fanout_publisher_context_t, libav_fanout_publisher_context_deleter_t> libav_fanout_publisher_context_ptr_t;
+
+typedef std::int32_t fanout_output_id_t;
+const fanout_output_id_t no_output = -1;
+
+const std::uint32_t default_fanout_reconnect_timeout = 2000;   // ms
+const std::size_t default_fanout_max_errors = 10;
+
+struct fanout_output_info_t
+{
+    fanout_output_id_t  output_id;
+    std::string         uri;
+    bool                is_established;
+    std::size_t         reconnections;
+    publisher_stats_t   stats;
+};
+
+typedef std::vector<fanout_output_info_t> fanout_output_list_t;
+
+// Publishes one set of encoded streams to many outputs. A pushed packet is
+// copied once and shared by the async publishers of all outputs. Every
+// output is opened, checked and reopened on a supervisor thread, so a slow
+// or broken destination never blocks the others or the pushing thread;
+// after a reconnect the video of the output waits for the next key frame,
+// audio is forwarded at once. The outputs are always async, a blocking
+// overflow policy becomes drop_until_key.
+class libav_fanout_publisher
+{
+    libav_fanout_publisher_context_ptr_t    m_fanout_publisher_context;
+
+public:
+    libav_fanout_publisher(const stream_info_list_t& stream_list
+                           , const publisher_config_t& config = publisher_config_t(true)
+                           , std::uint32_t reconnect_timeout = default_fanout_reconnect_timeout
+                           , std::size_t max_errors = default_fanout_max_errors);
+
+    fanout_output_id_t add_output(const std::string& uri);
+    bool remove_output(fanout_output_id_t output_id);
+    fanout_output_list_t outputs() const;
+
+    const stream_info_list_t& streams() const;
+
+    // true if at least one output took the packet
+    bool push_frame(std::int32_t stream_id
+                    , const void* data
+                    , std::size_t size
+                    , std::int64_t timestamp
+                    , bool key_frame = false
+                    , std::int64_t dts = no_timestamp);
+
+    bool push_frame(const frame_t& frame);
+
+    bool push_packet(const publisher_packet_ptr_t& packet);
+};
+
+}
+
+#endif // FFMPEG_LIBAV_FANOUT_PUBLISHER_H
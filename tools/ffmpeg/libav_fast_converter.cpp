@@ -0,0 +1,761 @@
+#include "libav_fast_converter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FAST_CONVERTER_X86
+#include <immintrin.h>
+#endif
+
+namespace ffmpeg
+{
+
+namespace
+{
+
+// BT.601 limited range in Q6: 1.164, 2.018, 0.391, 0.813, 1.596
+const std::int32_t coef_y = 18997;  // 1.164 * 64 * 65536 / (255 * 257)
+const std::int32_t coef_ub = 129;
+const std::int32_t coef_ug = 25;
+const std::int32_t coef_vg = 52;
+const std::int32_t coef_vr = 102;
+
+using yuv_to_rgb_row_t = std::int32_t (*)(const std::uint8_t* y_row
+                                          , const std::uint8_t* u_row
+                                          , const std::uint8_t* v_row
+                                          , std::uint8_t* dst_row
+                                          , std::int32_t width);
+
+using deinterleave_row_t = std::int32_t (*)(const std::uint8_t* uv_row
+                                            , std::uint8_t* u_row
+                                            , std::uint8_t* v_row
+                                            , std::int32_t width);
+
+using pack_row_t = std::int32_t (*)(const std::uint8_t* src_row
+                                    , std::uint8_t* dst_row
+                                    , std::int32_t width);
+
+using yuyv_rows_t = std::int32_t (*)(const std::uint8_t* src_row0
+                                     , const std::uint8_t* src_row1
+                                     , std::uint8_t* y_row0
+                                     , std::uint8_t* y_row1
+                                     , std::uint8_t* u_row
+                                     , std::uint8_t* v_row
+                                     , std::int32_t width);
+
+// every vectorized row kernel returns the number of processed pixels,
+// the scalar kernels finish the tail starting from that position
+
+inline std::int32_t sat16(std::int32_t value)
+{
+    return value < -32768
+            ? -32768
+            : (value > 32767 ? 32767 : value);
+}
+
+inline std::uint8_t clamp8(std::int32_t value)
+{
+    return value < 0
+            ? 0
+            : (value > 255 ? 255 : value);
+}
+
+inline void yuv_to_bgr(std::int32_t y
+                       , std::int32_t u
+                       , std::int32_t v
+                       , std::uint8_t* bgr)
+{
+    // mirrors the saturating 16-bit arithmetic of the vector kernels
+    y = y > 16 ? y - 16 : 0;
+    y = static_cast<std::int32_t>((static_cast<std::uint32_t>(y * 257) * coef_y) >> 16);
+    u -= 128;
+    v -= 128;
+
+    bgr[0] = clamp8(sat16(sat16(y + u * coef_ub) + 32) >> 6);
+    bgr[1] = clamp8(sat16(sat16(y - (u * coef_ug + v * coef_vg)) + 32) >> 6);
+    bgr[2] = clamp8(sat16(sat16(y + v * coef_vr) + 32) >> 6);
+}
+
+template<std::int32_t Bpp>
+void yuv_to_rgb_row_scalar(const std::uint8_t* y_row
+                           , const std::uint8_t* u_row
+                           , const std::uint8_t* v_row
+                           , std::uint8_t* dst_row
+                           , std::int32_t from
+                           , std::int32_t width)
+{
+    for (std::int32_t x = from; x < width; x++)
+    {
+        auto dst = dst_row + x * Bpp;
+        yuv_to_bgr(y_row[x]
+                   , u_row[x / 2]
+                   , v_row[x / 2]
+                   , dst);
+
+        if (Bpp == 4)
+        {
+            dst[3] = 0xff;
+        }
+    }
+}
+
+void deinterleave_row_scalar(const std::uint8_t* uv_row
+                             , std::uint8_t* u_row
+                             , std::uint8_t* v_row
+                             , std::int32_t from
+                             , std::int32_t width)
+{
+    for (std::int32_t x = from; x < width; x++)
+    {
+        u_row[x] = uv_row[x * 2];
+        v_row[x] = uv_row[x * 2 + 1];
+    }
+}
+
+void bgra_to_bgr_row_scalar(const std::uint8_t* src_row
+                            , std::uint8_t* dst_row
+                            , std::int32_t from
+                            , std::int32_t width)
+{
+    for (std::int32_t x = from; x < width; x++)
+    {
+        dst_row[x * 3] = src_row[x * 4];
+        dst_row[x * 3 + 1] = src_row[x * 4 + 1];
+        dst_row[x * 3 + 2] = src_row[x * 4 + 2];
+    }
+}
+
+void yuyv_rows_scalar(const std::uint8_t* src_row0
+                      , const std::uint8_t* src_row1
+                      , std::uint8_t* y_row0
+                      , std::uint8_t* y_row1
+                      , std::uint8_t* u_row
+                      , std::uint8_t* v_row
+                      , std::int32_t from
+                      , std::int32_t width)
+{
+    for (std::int32_t x = from; x < width; x++)
+    {
+        y_row0[x] = src_row0[x * 2];
+        y_row1[x] = src_row1[x * 2];
+
+        if ((x & 1) == 0)
+        {
+            u_row[x / 2] = (src_row0[x * 2 + 1] + src_row1[x * 2 + 1] + 1) >> 1;
+            v_row[x / 2] = (src_row0[x * 2 + 3] + src_row1[x * 2 + 3] + 1) >> 1;
+        }
+    }
+}
+
+std::int32_t yuv_to_rgb_row_none(const std::uint8_t*
+                                 , const std::uint8_t*
+                                 , const std::uint8_t*
+                                 , std::uint8_t*
+                                 , std::int32_t)
+{
+    return 0;
+}
+
+std::int32_t deinterleave_row_none(const std::uint8_t*
+                                   , std::uint8_t*
+                                   , std::uint8_t*
+                                   , std::int32_t)
+{
+    return 0;
+}
+
+std::int32_t pack_row_none(const std::uint8_t*
+                           , std::uint8_t*
+                           , std::int32_t)
+{
+    return 0;
+}
+
+std::int32_t yuyv_rows_none(const std::uint8_t*
+                            , const std::uint8_t*
+                            , std::uint8_t*
+                            , std::uint8_t*
+                            , std::uint8_t*
+                            , std::uint8_t*
+                            , std::int32_t)
+{
+    return 0;
+}
+
+#ifdef FAST_CONVERTER_X86
+
+//------------------------------------------------------------------------------
+// SSE4.1
+//------------------------------------------------------------------------------
+__attribute__((target("sse4.1")))
+inline void yuv_to_bgr_sse(__m128i y
+                           , __m128i u
+                           , __m128i v
+                           , __m128i& b
+                           , __m128i& g
+                           , __m128i& r)
+{
+    // y - Y * 257, u/v - signed chroma, 8 lanes of 16 bit
+    const __m128i round = _mm_set1_epi16(32);
+
+    y = _mm_mulhi_epu16(y, _mm_set1_epi16(coef_y));
+
+    b = _mm_srai_epi16(_mm_adds_epi16(_mm_adds_epi16(y, _mm_mullo_epi16(u, _mm_set1_epi16(coef_ub))), round), 6);
+    g = _mm_srai_epi16(_mm_adds_epi16(_mm_subs_epi16(y, _mm_add_epi16(_mm_mullo_epi16(u, _mm_set1_epi16(coef_ug))
+                                                                      , _mm_mullo_epi16(v, _mm_set1_epi16(coef_vg)))), round), 6);
+    r = _mm_srai_epi16(_mm_adds_epi16(_mm_adds_epi16(y, _mm_mullo_epi16(v, _mm_set1_epi16(coef_vr))), round), 6);
+}
+
+__attribute__((target("sse4.1")))
+inline void store_bgr_sse(__m128i p0
+                          , __m128i p1
+                          , __m128i p2
+                          , __m128i p3
+                          , std::uint8_t* dst)
+{
+    // 16 BGRA pixels -> 48 bytes of BGR
+    const __m128i mask = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+    p0 = _mm_shuffle_epi8(p0, mask);
+    p1 = _mm_shuffle_epi8(p1, mask);
+    p2 = _mm_shuffle_epi8(p2, mask);
+    p3 = _mm_shuffle_epi8(p3, mask);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_or_si128(p0, _mm_slli_si128(p1, 12)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_or_si128(_mm_srli_si128(p1, 4), _mm_slli_si128(p2, 8)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 32), _mm_or_si128(_mm_srli_si128(p2, 8), _mm_slli_si128(p3, 4)));
+}
+
+template<std::int32_t Bpp>
+__attribute__((target("sse4.1")))
+std::int32_t yuv_to_rgb_row_sse41(const std::uint8_t* y_row
+                                  , const std::uint8_t* u_row
+                                  , const std::uint8_t* v_row
+                                  , std::uint8_t* dst_row
+                                  , std::int32_t width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16(128);
+    const __m128i alpha = _mm_set1_epi8(-1);
+
+    std::int32_t x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        auto ys = _mm_subs_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(y_row + x)), _mm_set1_epi8(16));
+        auto u8 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(u_row + x / 2));
+        auto v8 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(v_row + x / 2));
+
+        auto uu = _mm_unpacklo_epi8(u8, u8);
+        auto vv = _mm_unpacklo_epi8(v8, v8);
+
+        __m128i b_lo, g_lo, r_lo, b_hi, g_hi, r_hi;
+
+        yuv_to_bgr_sse(_mm_unpacklo_epi8(ys, ys)
+                       , _mm_sub_epi16(_mm_unpacklo_epi8(uu, zero), bias)
+                       , _mm_sub_epi16(_mm_unpacklo_epi8(vv, zero), bias)
+                       , b_lo, g_lo, r_lo);
+
+        yuv_to_bgr_sse(_mm_unpackhi_epi8(ys, ys)
+                       , _mm_sub_epi16(_mm_unpackhi_epi8(uu, zero), bias)
+                       , _mm_sub_epi16(_mm_unpackhi_epi8(vv, zero), bias)
+                       , b_hi, g_hi, r_hi);
+
+        auto b = _mm_packus_epi16(b_lo, b_hi);
+        auto g = _mm_packus_epi16(g_lo, g_hi);
+        auto r = _mm_packus_epi16(r_lo, r_hi);
+
+        auto bg_lo = _mm_unpacklo_epi8(b, g);
+        auto bg_hi = _mm_unpackhi_epi8(b, g);
+        auto ra_lo = _mm_unpacklo_epi8(r, alpha);
+        auto ra_hi = _mm_unpackhi_epi8(r, alpha);
+
+        auto p0 = _mm_unpacklo_epi16(bg_lo, ra_lo);
+        auto p1 = _mm_unpackhi_epi16(bg_lo, ra_lo);
+        auto p2 = _mm_unpacklo_epi16(bg_hi, ra_hi);
+        auto p3 = _mm_unpackhi_epi16(bg_hi, ra_hi);
+
+        if (Bpp == 4)
+        {
+            auto dst = reinterpret_cast<__m128i*>(dst_row + x * 4);
+            _mm_storeu_si128(dst, p0);
+            _mm_storeu_si128(dst + 1, p1);
+            _mm_storeu_si128(dst + 2, p2);
+            _mm_storeu_si128(dst + 3, p3);
+        }
+        else
+        {
+            store_bgr_sse(p0, p1, p2, p3, dst_row + x * 3);
+        }
+    }
+
+    return x;
+}
+
+__attribute__((target("sse4.1")))
+std::int32_t deinterleave_row_sse41(const std::uint8_t* uv_row
+                                    , std::uint8_t* u_row
+                                    , std::uint8_t* v_row
+                                    , std::int32_t width)
+{
+    const __m128i mask = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+
+    std::int32_t x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        auto a = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(uv_row + x * 2)), mask);
+        auto b = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(uv_row + x * 2 + 16)), mask);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(u_row + x), _mm_unpacklo_epi64(a, b));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(v_row + x), _mm_unpackhi_epi64(a, b));
+    }
+
+    return x;
+}
+
+__attribute__((target("sse4.1")))
+std::int32_t bgra_to_bgr_row_sse41(const std::uint8_t* src_row
+                                   , std::uint8_t* dst_row
+                                   , std::int32_t width)
+{
+    std::int32_t x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        auto src = reinterpret_cast<const __m128i*>(src_row + x * 4);
+
+        store_bgr_sse(_mm_loadu_si128(src)
+                      , _mm_loadu_si128(src + 1)
+                      , _mm_loadu_si128(src + 2)
+                      , _mm_loadu_si128(src + 3)
+                      , dst_row + x * 3);
+    }
+
+    return x;
+}
+
+__attribute__((target("sse4.1")))
+std::int32_t yuyv_rows_sse41(const std::uint8_t* src_row0
+                             , const std::uint8_t* src_row1
+                             , std::uint8_t* y_row0
+                             , std::uint8_t* y_row1
+                             , std::uint8_t* u_row
+                             , std::uint8_t* v_row
+                             , std::int32_t width)
+{
+    // Y0..Y7 | U0..U3 | V0..V3 out of 8 packed pixels
+    const __m128i mask = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 5, 9, 13, 3, 7, 11, 15);
+    const __m128i chroma_mask = _mm_setr_epi8(0, 1, 2, 3, 8, 9, 10, 11, 4, 5, 6, 7, 12, 13, 14, 15);
+
+    std::int32_t x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        auto a0 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src_row0 + x * 2)), mask);
+        auto b0 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src_row0 + x * 2 + 16)), mask);
+        auto a1 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src_row1 + x * 2)), mask);
+        auto b1 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src_row1 + x * 2 + 16)), mask);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y_row0 + x), _mm_unpacklo_epi64(a0, b0));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y_row1 + x), _mm_unpacklo_epi64(a1, b1));
+
+        auto uv = _mm_shuffle_epi8(_mm_avg_epu8(_mm_unpackhi_epi64(a0, b0)
+                                                , _mm_unpackhi_epi64(a1, b1))
+                                   , chroma_mask);
+
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(u_row + x / 2), uv);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(v_row + x / 2), _mm_srli_si128(uv, 8));
+    }
+
+    return x;
+}
+
+//------------------------------------------------------------------------------
+// AVX2
+//------------------------------------------------------------------------------
+__attribute__((target("avx2")))
+inline void yuv_to_bgr_avx2(__m256i y
+                            , __m256i u
+                            , __m256i v
+                            , __m256i& b
+                            , __m256i& g
+                            , __m256i& r)
+{
+    const __m256i round = _mm256_set1_epi16(32);
+
+    y = _mm256_mulhi_epu16(y, _mm256_set1_epi16(coef_y));
+
+    b = _mm256_srai_epi16(_mm256_adds_epi16(_mm256_adds_epi16(y, _mm256_mullo_epi16(u, _mm256_set1_epi16(coef_ub))), round), 6);
+    g = _mm256_srai_epi16(_mm256_adds_epi16(_mm256_subs_epi16(y, _mm256_add_epi16(_mm256_mullo_epi16(u, _mm256_set1_epi16(coef_ug))
+                                                                                  , _mm256_mullo_epi16(v, _mm256_set1_epi16(coef_vg)))), round), 6);
+    r = _mm256_srai_epi16(_mm256_adds_epi16(_mm256_adds_epi16(y, _mm256_mullo_epi16(v, _mm256_set1_epi16(coef_vr))), round), 6);
+}
+
+__attribute__((target("avx2")))
+inline __m256i duplicate_avx2(__m128i c)
+{
+    // c0 c0 c1 c1 ... in pixel order across both lanes
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi8(c, c))
+                                   , _mm_unpackhi_epi8(c, c)
+                                   , 1);
+}
+
+template<std::int32_t Bpp>
+__attribute__((target("avx2")))
+std::int32_t yuv_to_rgb_row_avx2(const std::uint8_t* y_row
+                                 , const std::uint8_t* u_row
+                                 , const std::uint8_t* v_row
+                                 , std::uint8_t* dst_row
+                                 , std::int32_t width)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i bias = _mm256_set1_epi16(128);
+    const __m256i alpha = _mm256_set1_epi8(-1);
+
+    std::int32_t x = 0;
+    for (; x + 32 <= width; x += 32)
+    {
+        auto ys = _mm256_subs_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(y_row + x)), _mm256_set1_epi8(16));
+        auto uu = duplicate_avx2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(u_row + x / 2)));
+        auto vv = duplicate_avx2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(v_row + x / 2)));
+
+        __m256i b_lo, g_lo, r_lo, b_hi, g_hi, r_hi;
+
+        // in-lane unpacks: lo holds pixels 0-7 / 16-23, hi holds 8-15 / 24-31
+        yuv_to_bgr_avx2(_mm256_unpacklo_epi8(ys, ys)
+                        , _mm256_sub_epi16(_mm256_unpacklo_epi8(uu, zero), bias)
+                        , _mm256_sub_epi16(_mm256_unpacklo_epi8(vv, zero), bias)
+                        , b_lo, g_lo, r_lo);
+
+        yuv_to_bgr_avx2(_mm256_unpackhi_epi8(ys, ys)
+                        , _mm256_sub_epi16(_mm256_unpackhi_epi8(uu, zero), bias)
+                        , _mm256_sub_epi16(_mm256_unpackhi_epi8(vv, zero), bias)
+                        , b_hi, g_hi, r_hi);
+
+        auto b = _mm256_packus_epi16(b_lo, b_hi);
+        auto g = _mm256_packus_epi16(g_lo, g_hi);
+        auto r = _mm256_packus_epi16(r_lo, r_hi);
+
+        auto bg_lo = _mm256_unpacklo_epi8(b, g);
+        auto bg_hi = _mm256_unpackhi_epi8(b, g);
+        auto ra_lo = _mm256_unpacklo_epi8(r, alpha);
+        auto ra_hi = _mm256_unpackhi_epi8(r, alpha);
+
+        auto q0 = _mm256_unpacklo_epi16(bg_lo, ra_lo);
+        auto q1 = _mm256_unpackhi_epi16(bg_lo, ra_lo);
+        auto q2 = _mm256_unpacklo_epi16(bg_hi, ra_hi);
+        auto q3 = _mm256_unpackhi_epi16(bg_hi, ra_hi);
+
+        auto p0 = _mm256_permute2x128_si256(q0, q1, 0x20);
+        auto p1 = _mm256_permute2x128_si256(q2, q3, 0x20);
+        auto p2 = _mm256_permute2x128_si256(q0, q1, 0x31);
+        auto p3 = _mm256_permute2x128_si256(q2, q3, 0x31);
+
+        if (Bpp == 4)
+        {
+            auto dst = reinterpret_cast<__m256i*>(dst_row + x * 4);
+            _mm256_storeu_si256(dst, p0);
+            _mm256_storeu_si256(dst + 1, p1);
+            _mm256_storeu_si256(dst + 2, p2);
+            _mm256_storeu_si256(dst + 3, p3);
+        }
+        else
+        {
+            store_bgr_sse(_mm256_castsi256_si128(p0)
+                          , _mm256_extracti128_si256(p0, 1)
+                          , _mm256_castsi256_si128(p1)
+                          , _mm256_extracti128_si256(p1, 1)
+                          , dst_row + x * 3);
+
+            store_bgr_sse(_mm256_castsi256_si128(p2)
+                          , _mm256_extracti128_si256(p2, 1)
+                          , _mm256_castsi256_si128(p3)
+                          , _mm256_extracti128_si256(p3, 1)
+                          , dst_row + x * 3 + 48);
+        }
+    }
+
+    return x;
+}
+
+__attribute__((target("avx2")))
+std::int32_t deinterleave_row_avx2(const std::uint8_t* uv_row
+                                   , std::uint8_t* u_row
+                                   , std::uint8_t* v_row
+                                   , std::int32_t width)
+{
+    const __m256i mask = _mm256_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15
+                                          , 0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+
+    std::int32_t x = 0;
+    for (; x + 32 <= width; x += 32)
+    {
+        // U0-7 V0-7 | U8-15 V8-15 -> U0-15 | V0-15
+        auto a = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(uv_row + x * 2)), mask), 0xd8);
+        auto b = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(uv_row + x * 2 + 32)), mask), 0xd8);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(u_row + x), _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(v_row + x), _mm256_permute2x128_si256(a, b, 0x31));
+    }
+
+    return x;
+}
+
+#endif
+
+struct kernel_set_t
+{
+    simd_level_t        simd_level;
+    yuv_to_rgb_row_t    yuv_to_bgr_row;
+    yuv_to_rgb_row_t    yuv_to_bgra_row;
+    deinterleave_row_t  deinterleave_row;
+    pack_row_t          bgra_to_bgr_row;
+    yuyv_rows_t         yuyv_rows;
+};
+
+kernel_set_t make_kernel_set(simd_level_t simd_level)
+{
+#ifdef FAST_CONVERTER_X86
+    switch (simd_level)
+    {
+        case simd_level_t::avx2:
+            // packing and yuyv kernels are store bound, the SSE versions are enough
+            return { simd_level_t::avx2
+                     , yuv_to_rgb_row_avx2<3>
+                     , yuv_to_rgb_row_avx2<4>
+                     , deinterleave_row_avx2
+                     , bgra_to_bgr_row_sse41
+                     , yuyv_rows_sse41 };
+        break;
+        case simd_level_t::sse41:
+            return { simd_level_t::sse41
+                     , yuv_to_rgb_row_sse41<3>
+                     , yuv_to_rgb_row_sse41<4>
+                     , deinterleave_row_sse41
+                     , bgra_to_bgr_row_sse41
+                     , yuyv_rows_sse41 };
+        break;
+        default:
+        {}
+    }
+#endif
+
+    return { simd_level_t::none
+             , yuv_to_rgb_row_none
+             , yuv_to_rgb_row_none
+             , deinterleave_row_none
+             , pack_row_none
+             , yuyv_rows_none };
+}
+
+simd_level_t detect_simd_level()
+{
+#ifdef FAST_CONVERTER_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return simd_level_t::avx2;
+    }
+
+    if (__builtin_cpu_supports("sse4.1"))
+    {
+        return simd_level_t::sse41;
+    }
+#endif
+
+    return simd_level_t::none;
+}
+
+const simd_level_t detected_simd_level = detect_simd_level();
+std::atomic<simd_level_t> used_simd_level(detected_simd_level);
+
+const kernel_set_t& kernel_set()
+{
+    static const kernel_set_t kernel_sets[] = { make_kernel_set(simd_level_t::none)
+                                                , make_kernel_set(simd_level_t::sse41)
+                                                , make_kernel_set(simd_level_t::avx2) };
+
+    return kernel_sets[static_cast<std::size_t>(used_simd_level.load())];
+}
+
+std::atomic_bool fast_converter_enabled(true);
+
+//------------------------------------------------------------------------------
+void convert_nv12_to_yuv420p(const frame_size_t& frame_size
+                             , const std::uint8_t* const src[]
+                             , const std::int32_t src_stride[]
+                             , std::uint8_t* const dst[]
+                             , const std::int32_t dst_stride[])
+{
+    auto deinterleave_row = kernel_set().deinterleave_row;
+
+    for (std::int32_t y = 0; y < frame_size.height; y++)
+    {
+        std::memcpy(dst[0] + y * dst_stride[0]
+                    , src[0] + y * src_stride[0]
+                    , frame_size.width);
+    }
+
+    auto chroma_width = (frame_size.width + 1) / 2;
+    auto chroma_height = (frame_size.height + 1) / 2;
+
+    for (std::int32_t y = 0; y < chroma_height; y++)
+    {
+        auto uv_row = src[1] + y * src_stride[1];
+        auto u_row = dst[1] + y * dst_stride[1];
+        auto v_row = dst[2] + y * dst_stride[2];
+
+        auto x = deinterleave_row(uv_row, u_row, v_row, chroma_width);
+        deinterleave_row_scalar(uv_row, u_row, v_row, x, chroma_width);
+    }
+}
+
+template<std::int32_t Bpp>
+void convert_yuv420p_to_rgb(const frame_size_t& frame_size
+                            , const std::uint8_t* const src[]
+                            , const std::int32_t src_stride[]
+                            , std::uint8_t* const dst[]
+                            , const std::int32_t dst_stride[])
+{
+    auto row_kernel = Bpp == 4
+            ? kernel_set().yuv_to_bgra_row
+            : kernel_set().yuv_to_bgr_row;
+
+    for (std::int32_t y = 0; y < frame_size.height; y++)
+    {
+        auto y_row = src[0] + y * src_stride[0];
+        auto u_row = src[1] + (y / 2) * src_stride[1];
+        auto v_row = src[2] + (y / 2) * src_stride[2];
+        auto dst_row = dst[0] + y * dst_stride[0];
+
+        auto x = row_kernel(y_row, u_row, v_row, dst_row, frame_size.width);
+        yuv_to_rgb_row_scalar<Bpp>(y_row, u_row, v_row, dst_row, x, frame_size.width);
+    }
+}
+
+void convert_bgra_to_bgr24(const frame_size_t& frame_size
+                           , const std::uint8_t* const src[]
+                           , const std::int32_t src_stride[]
+                           , std::uint8_t* const dst[]
+                           , const std::int32_t dst_stride[])
+{
+    auto row_kernel = kernel_set().bgra_to_bgr_row;
+
+    for (std::int32_t y = 0; y < frame_size.height; y++)
+    {
+        auto src_row = src[0] + y * src_stride[0];
+        auto dst_row = dst[0] + y * dst_stride[0];
+
+        auto x = row_kernel(src_row, dst_row, frame_size.width);
+        bgra_to_bgr_row_scalar(src_row, dst_row, x, frame_size.width);
+    }
+}
+
+void convert_yuyv422_to_yuv420p(const frame_size_t& frame_size
+                                , const std::uint8_t* const src[]
+                                , const std::int32_t src_stride[]
+                                , std::uint8_t* const dst[]
+                                , const std::int32_t dst_stride[])
+{
+    auto rows_kernel = kernel_set().yuyv_rows;
+
+    for (std::int32_t y = 0; y < frame_size.height; y += 2)
+    {
+        // the last odd row is paired with itself
+        auto y1 = y + 1 < frame_size.height
+                ? y + 1
+                : y;
+
+        auto src_row0 = src[0] + y * src_stride[0];
+        auto src_row1 = src[0] + y1 * src_stride[0];
+        auto y_row0 = dst[0] + y * dst_stride[0];
+        auto y_row1 = dst[0] + y1 * dst_stride[0];
+        auto u_row = dst[1] + (y / 2) * dst_stride[1];
+        auto v_row = dst[2] + (y / 2) * dst_stride[2];
+
+        auto x = rows_kernel(src_row0, src_row1, y_row0, y_row1, u_row, v_row, frame_size.width);
+        yuyv_rows_scalar(src_row0, src_row1, y_row0, y_row1, u_row, v_row, x, frame_size.width);
+    }
+}
+
+}
+
+simd_level_t libav_fast_converter::simd_level()
+{
+    return kernel_set().simd_level;
+}
+
+void libav_fast_converter::set_simd_level(simd_level_t simd_level)
+{
+    used_simd_level.store(std::min(simd_level
+                                   , detected_simd_level));
+}
+
+void libav_fast_converter::set_enabled(bool enabled)
+{
+    fast_converter_enabled.store(enabled);
+}
+
+bool libav_fast_converter::is_enabled()
+{
+    return fast_converter_enabled.load();
+}
+
+bool libav_fast_converter::is_supported(pixel_format_t input_pixel_format
+                                        , pixel_format_t output_pixel_format)
+{
+    return (input_pixel_format == pixel_format_nv12 && output_pixel_format == pixel_format_yuv420p)
+            || (input_pixel_format == pixel_format_yuv420p && output_pixel_format == pixel_format_bgr24)
+            || (input_pixel_format == pixel_format_yuv420p && output_pixel_format == pixel_format_bgra)
+            || (input_pixel_format == pixel_format_bgra && output_pixel_format == pixel_format_bgr24)
+            || (input_pixel_format == pixel_format_yuyv422 && output_pixel_format == pixel_format_yuv420p);
+}
+
+bool libav_fast_converter::convert(const frame_size_t &frame_size
+                                   , pixel_format_t input_pixel_format
+                                   , const std::uint8_t * const input_planes[]
+                                   , const std::int32_t input_strides[]
+                                   , pixel_format_t output_pixel_format
+                                   , std::uint8_t * const output_planes[]
+                                   , const std::int32_t output_strides[])
+{
+    if (frame_size.width <= 0
+            || frame_size.height <= 0)
+    {
+        return false;
+    }
+
+    if (input_pixel_format == pixel_format_nv12
+            && output_pixel_format == pixel_format_yuv420p)
+    {
+        convert_nv12_to_yuv420p(frame_size, input_planes, input_strides, output_planes, output_strides);
+    }
+    else if (input_pixel_format == pixel_format_yuv420p
+             && output_pixel_format == pixel_format_bgr24)
+    {
+        convert_yuv420p_to_rgb<3>(frame_size, input_planes, input_strides, output_planes, output_strides);
+    }
+    else if (input_pixel_format == pixel_format_yuv420p
+             && output_pixel_format == pixel_format_bgra)
+    {
+        convert_yuv420p_to_rgb<4>(frame_size, input_planes, input_strides, output_planes, output_strides);
+    }
+    else if (input_pixel_format == pixel_format_bgra
+             && output_pixel_format == pixel_format_bgr24)
+    {
+        convert_bgra_to_bgr24(frame_size, input_planes, input_strides, output_planes, output_strides);
+    }
+    else if (input_pixel_format == pixel_format_yuyv422
+             && output_pixel_format == pixel_format_yuv420p)
+    {
+        convert_yuyv422_to_yuv420p(frame_size, input_planes, input_strides, output_planes, output_strides);
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+}
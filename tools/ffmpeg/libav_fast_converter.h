@@ -0,0 +1,50 @@
+#ifndef FFMPEG_LIBAV_FAST_CONVERTER_H
+#define FFMPEG_LIBAV_FAST_CONVERTER_H
+
+#include "libav_base.h"
+
+namespace ffmpeg
+{
+
+enum class simd_level_t
+{
+    none,
+    sse41,
+    avx2
+};
+
+// Hand-vectorized same-size colorspace conversions for the pairs we use most:
+// nv12 -> yuv420p, yuv420p -> bgr24/bgra, bgra -> bgr24, yuyv422 -> yuv420p.
+// The instruction set is detected once at runtime, the scalar kernels are
+// used on other platforms and for the row tails. YUV -> RGB uses BT.601
+// limited range in Q6 fixed point: within 1 level of the exact transform
+// and within 3 levels of the unscaled swscale path for luma >= 16, luma
+// footroom is clamped to black. yuyv422 -> yuv420p chroma is the rounded
+// mean of two rows, within 1 level; the plain copies are bit-exact.
+class libav_fast_converter
+{
+public:
+    static simd_level_t simd_level();
+    // caps the kernels at the level, at most the detected one (tests, comparisons)
+    static void set_simd_level(simd_level_t simd_level);
+
+    static void set_enabled(bool enabled);
+    static bool is_enabled();
+
+    static bool is_supported(pixel_format_t input_pixel_format
+                             , pixel_format_t output_pixel_format);
+
+    // planes and strides follow the AVPicture layout, frame_size.height rows
+    // of the input are converted into the same number of output rows
+    static bool convert(const frame_size_t& frame_size
+                        , pixel_format_t input_pixel_format
+                        , const std::uint8_t* const input_planes[]
+                        , const std::int32_t input_strides[]
+                        , pixel_format_t output_pixel_format
+                        , std::uint8_t* const output_planes[]
+                        , const std::int32_t output_strides[]);
+};
+
+}
+
+#endif // FFMPEG_LIBAV_FAST_CONVERTER_H
@@ -0,0 +1,541 @@
+#include "libav_jitter_buffer.h"
+#include "libav_resampler.h"
+
+#define WBS_MODULE_NAME "ff:jitter"
+#include "tools/base/logger_base.h"
+
+#include <mutex>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+
+namespace ffmpeg
+{
+
+namespace
+{
+
+// a timestamp jump beyond this is a restart of the source, not jitter
+const std::int64_t resync_threshold = 10000000;
+// the transit base is the minimum over this window, so a drifting sender
+// clock is followed instead of growing the delay forever
+const std::int64_t base_window = 10000000;
+const double min_quantile_step = 500.0;
+const std::int64_t default_audio_duration = 20000;
+
+}
+
+jitter_buffer_config_t::jitter_buffer_config_t(uint32_t min_delay
+                                               , uint32_t max_delay
+                                               , double target_loss
+                                               , double max_stretch
+                                               , std::size_t max_frames)
+    : min_delay(min_delay)
+    , max_delay(max_delay)
+    , target_loss(target_loss)
+    , max_stretch(max_stretch)
+    , max_frames(max_frames)
+{
+
+}
+
+struct libav_jitter_buffer_context_t
+{
+    using frame_map_t = std::map<std::int64_t, frame_t>;
+
+    media_info_t            m_media_info;
+    jitter_buffer_config_t  m_config;
+    std::int64_t            m_sample_rate;
+    frame_map_t             m_frames;
+    jitter_buffer_stats_t   m_stats;
+
+    // arrival side, times in us
+    bool                    m_has_transit;
+    std::int64_t            m_last_transit;
+    std::int64_t            m_last_pushed;
+    std::int64_t            m_base_transit;
+    std::int64_t            m_window_min;
+    std::int64_t            m_window_start;
+    double                  m_jitter;
+    double                  m_quantile;         // transit above the base
+
+    // playout side, timestamps in stream units
+    bool                    m_has_played;
+    std::int64_t            m_last_played;
+    std::int64_t            m_last_duration;
+    double                  m_playout_delay;    // us
+    frame_info_t            m_last_info;
+    media_data_t            m_last_video;       // raw video only, repeated on gaps
+
+    libav_resampler         m_resampler;
+    media_data_t            m_stretch_buffer;
+
+    mutable std::mutex      m_mutex;
+
+    libav_jitter_buffer_context_t(const media_info_t& media_info
+                                  , const jitter_buffer_config_t& config)
+        : m_media_info(media_info)
+        , m_config(config)
+        , m_sample_rate(media_info.sample_rate())
+    {
+        restart();
+    }
+
+    void restart()
+    {
+        m_frames.clear();
+
+        m_has_transit = false;
+        m_last_transit = 0;
+        m_last_pushed = 0;
+        m_base_transit = 0;
+        m_window_min = 0;
+        m_window_start = 0;
+        m_jitter = 0.0;
+        m_quantile = 0.0;
+
+        m_has_played = false;
+        m_last_played = 0;
+        m_last_duration = 0;
+        m_playout_delay = target_delay();
+        m_last_video.clear();
+
+        m_resampler.close();
+    }
+
+    std::int64_t to_us(std::int64_t timestamp) const
+    {
+        return timestamp * 1000000 / m_sample_rate;
+    }
+
+    std::int64_t to_units(double time) const
+    {
+        return static_cast<std::int64_t>(time * m_sample_rate / 1000000);
+    }
+
+    double target_delay() const
+    {
+        return std::max<double>(m_config.min_delay * 1000
+                                , std::min<double>(m_quantile
+                                                   , m_config.max_delay * 1000));
+    }
+
+    std::int64_t playout_time(std::int64_t timestamp) const
+    {
+        return m_base_transit
+                + to_us(timestamp)
+                + static_cast<std::int64_t>(m_playout_delay);
+    }
+
+    bool is_raw_audio(const frame_info_t& info) const
+    {
+        return m_media_info.media_type == media_type_t::audio
+                && !info.is_encoded()
+                && m_media_info.audio_info.sample_size() > 0;
+    }
+
+    bool is_raw_video(const frame_info_t& info) const
+    {
+        return m_media_info.media_type == media_type_t::video
+                && !info.is_encoded();
+    }
+
+    std::int64_t default_duration() const
+    {
+        return m_media_info.media_type == media_type_t::video
+                && m_media_info.video_info.fps > 0
+                ? m_sample_rate / m_media_info.video_info.fps
+                : to_units(default_audio_duration);
+    }
+
+    std::int64_t frame_duration(const frame_t& frame
+                                , std::int64_t timestamp) const
+    {
+        if (is_raw_audio(frame.info))
+        {
+            return frame.media_data.size() / m_media_info.audio_info.sample_size();
+        }
+
+        return m_has_played
+                && timestamp > m_last_played
+                ? timestamp - m_last_played
+                : m_last_duration > 0
+                  ? m_last_duration
+                  : default_duration();
+    }
+
+    // keeps the absolute playout schedule when the reference moves
+    void rebase(std::int64_t base_transit)
+    {
+        auto delta = base_transit - m_base_transit;
+        m_base_transit = base_transit;
+        m_quantile = std::max(0.0, m_quantile - delta);
+        m_playout_delay = std::max(0.0, m_playout_delay - delta);
+    }
+
+    void update_delay(std::int64_t transit
+                      , std::int64_t arrival_time)
+    {
+        if (transit < m_base_transit)
+        {
+            rebase(transit);
+        }
+
+        m_window_min = std::min(m_window_min, transit);
+
+        if (arrival_time - m_window_start >= base_window)
+        {
+            rebase(m_window_min);
+            m_window_min = transit;
+            m_window_start = arrival_time;
+        }
+
+        // stochastic quantile: stands still when target_loss of the
+        // frames arrive later than the delay
+        auto step = std::max(m_jitter / 2.0, min_quantile_step);
+        auto delay = transit - m_base_transit;
+
+        m_quantile = delay > m_quantile
+                ? m_quantile + step * (1.0 - m_config.target_loss)
+                : std::max(0.0, m_quantile - step * m_config.target_loss);
+    }
+
+    bool push(frame_t&& frame
+              , std::int64_t arrival_time)
+    {
+        if (m_sample_rate <= 0)
+        {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto timestamp = frame.info.is_timestamp()
+                ? frame.info.timestamp()
+                : m_last_pushed + default_duration();
+
+        if (m_has_transit
+                && std::abs(to_us(timestamp - m_last_pushed)) > resync_threshold)
+        {
+            LOG_I << "Timestamp jump " << m_last_pushed << " -> " << timestamp << ", resync" LOG_END;
+            restart();
+        }
+
+        m_stats.pushed++;
+
+        auto transit = arrival_time - to_us(timestamp);
+
+        if (!m_has_transit)
+        {
+            m_has_transit = true;
+            m_base_transit = transit;
+            m_window_min = transit;
+            m_window_start = arrival_time;
+            m_last_transit = transit;
+            m_last_pushed = timestamp;
+        }
+        else if (timestamp > m_last_pushed)
+        {
+            // RFC 3550, A.8
+            m_jitter += (std::abs(transit - m_last_transit) - m_jitter) / 16.0;
+            m_last_transit = transit;
+            m_last_pushed = timestamp;
+        }
+        else
+        {
+            m_stats.reordered++;
+        }
+
+        update_delay(transit
+                     , arrival_time);
+
+        if (m_has_played
+                && timestamp <= m_last_played)
+        {
+            m_stats.late++;
+            return false;
+        }
+
+        if (!m_frames.emplace(timestamp
+                              , std::move(frame)).second)
+        {
+            m_stats.duplicated++;
+            return false;
+        }
+
+        while (m_frames.size() > m_config.max_frames)
+        {
+            m_frames.erase(m_frames.begin());
+            m_stats.overflowed++;
+        }
+
+        return true;
+    }
+
+    // resamples the frame with a compensation of sample_delta, returns the
+    // real change of the length in samples
+    std::int64_t stretch(frame_t& frame
+                         , std::int32_t samples
+                         , std::int32_t sample_delta)
+    {
+        const auto& audio_info = m_media_info.audio_info;
+
+        if (!m_resampler.is_open()
+                && !m_resampler.open(audio_info
+                                     , audio_info))
+        {
+            return 0;
+        }
+
+        if (sample_delta != 0)
+        {
+            m_resampler.set_compensation(sample_delta
+                                         , samples);
+        }
+
+        auto size = m_resampler.resample(frame.media_data.data()
+                                         , frame.media_data.size()
+                                         , m_stretch_buffer);
+
+        std::swap(frame.media_data
+                  , m_stretch_buffer);
+
+        return static_cast<std::int64_t>(size / audio_info.sample_size()) - samples;
+    }
+
+    void slew(frame_t& frame
+              , std::int64_t duration)
+    {
+        auto max_step = to_us(duration) * m_config.max_stretch;
+        auto step = std::max(-max_step
+                             , std::min(max_step
+                                        , target_delay() - m_playout_delay));
+
+        if (is_raw_audio(frame.info))
+        {
+            auto sample_delta = static_cast<std::int32_t>(to_units(step));
+
+            // once started the resampler keeps the stream, its history
+            // must not be cut
+            if (sample_delta != 0
+                    || m_resampler.is_open())
+            {
+                step = static_cast<double>(stretch(frame
+                                                   , duration
+                                                   , sample_delta)) * 1000000 / m_sample_rate;
+            }
+            else
+            {
+                step = 0.0;
+            }
+        }
+
+        m_playout_delay = std::max(0.0, m_playout_delay + step);
+    }
+
+    void played(frame_t& frame
+                , std::int64_t timestamp)
+    {
+        auto duration = frame_duration(frame
+                                       , timestamp);
+        slew(frame
+             , duration);
+
+        if (is_raw_video(frame.info))
+        {
+            m_last_video.assign(frame.media_data.begin()
+                                , frame.media_data.end());
+        }
+
+        m_last_info = frame.info;
+        m_last_played = timestamp;
+        m_last_duration = duration;
+        m_has_played = true;
+        m_stats.played++;
+    }
+
+    // fills the slot at the expected timestamp, false if the gap is skipped
+    bool conceal(frame_t& frame
+                 , std::int64_t expected
+                 , std::int64_t next)
+    {
+        auto gap = std::min(next - expected
+                            , m_last_duration);
+
+        if (is_raw_audio(m_last_info))
+        {
+            const auto& audio_info = m_media_info.audio_info;
+            auto silence = audio_info.sample_format == sample_format_pcm8
+                    || audio_info.sample_format == sample_format_pcm8p
+                    ? 0x80
+                    : 0x00;
+
+            frame.info = m_last_info;
+            frame.media_data.assign(gap * audio_info.sample_size()
+                                    , silence);
+        }
+        else if (is_raw_video(m_last_info)
+                 && !m_last_video.empty())
+        {
+            frame.info = m_last_info;
+            frame.media_data = m_last_video;
+        }
+        else
+        {
+            m_stats.lost += (next - expected) / std::max<std::int64_t>(m_last_duration, 1);
+            m_last_played = next - m_last_duration;
+            return false;
+        }
+
+        frame.info.pts = expected;
+        frame.info.dts = expected;
+
+        m_last_played = expected;
+        m_last_duration = gap;
+        m_stats.lost++;
+        m_stats.concealed++;
+
+        return true;
+    }
+
+    bool pop(frame_t& frame
+             , std::int64_t now)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_frames.empty())
+        {
+            return false;
+        }
+
+        auto it = m_frames.begin();
+
+        if (m_has_played
+                && m_last_duration > 0)
+        {
+            auto expected = m_last_played + m_last_duration;
+
+            if (it->first > expected + m_last_duration / 2
+                    && now >= playout_time(expected)
+                    && conceal(frame
+                               , expected
+                               , it->first))
+            {
+                return true;
+            }
+        }
+
+        if (now < playout_time(it->first))
+        {
+            return false;
+        }
+
+        auto timestamp = it->first;
+        frame = std::move(it->second);
+        m_frames.erase(it);
+
+        played(frame
+               , timestamp);
+
+        return true;
+    }
+
+    std::int64_t next_playout(std::int64_t now) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_frames.empty())
+        {
+            return -1;
+        }
+
+        auto next = playout_time(m_frames.begin()->first);
+
+        if (m_has_played
+                && m_last_duration > 0)
+        {
+            next = std::min(next
+                            , playout_time(m_last_played + m_last_duration));
+        }
+
+        return std::max<std::int64_t>(next - now, 0);
+    }
+
+    jitter_buffer_stats_t stats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto stats = m_stats;
+
+        stats.jitter = static_cast<std::uint64_t>(m_jitter);
+        stats.target_delay = static_cast<std::uint64_t>(target_delay());
+        stats.playout_delay = static_cast<std::uint64_t>(m_playout_delay);
+        stats.queued = m_frames.size();
+
+        return stats;
+    }
+
+    void reset()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        restart();
+        m_stats = jitter_buffer_stats_t();
+    }
+};
+//------------------------------------------------------------------------------
+void libav_jitter_buffer_context_deleter_t::operator()(libav_jitter_buffer_context_t *libav_jitter_buffer_context_ptr)
+{
+    delete libav_jitter_buffer_context_ptr;
+}
+//------------------------------------------------------------------------------
+libav_jitter_buffer::libav_jitter_buffer(const media_info_t &media_info
+                                         , const jitter_buffer_config_t &config)
+    : m_jitter_buffer_context(new libav_jitter_buffer_context_t(media_info
+                                                                , config))
+{
+
+}
+
+bool libav_jitter_buffer::push(frame_t &&frame
+                               , int64_t arrival_time)
+{
+    return m_jitter_buffer_context->push(std::move(frame)
+                                         , arrival_time < 0
+                                         ? now()
+                                         : arrival_time);
+}
+
+bool libav_jitter_buffer::pop(frame_t &frame
+                              , int64_t now)
+{
+    return m_jitter_buffer_context->pop(frame
+                                        , now < 0
+                                        ? libav_jitter_buffer::now()
+                                        : now);
+}
+
+int64_t libav_jitter_buffer::next_playout(int64_t now) const
+{
+    return m_jitter_buffer_context->next_playout(now < 0
+                                                 ? libav_jitter_buffer::now()
+                                                 : now);
+}
+
+jitter_buffer_stats_t libav_jitter_buffer::stats() const
+{
+    return m_jitter_buffer_context->stats();
+}
+
+void libav_jitter_buffer::reset()
+{
+    m_jitter_buffer_context->reset();
+}
+
+int64_t libav_jitter_buffer::now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
@@ -0,0 +1,83 @@
+#ifndef FFMPEG_LIBAV_JITTER_BUFFER_H
+#define FFMPEG_LIBAV_JITTER_BUFFER_H
+
+#include "libav_base.h"
+
+namespace ffmpeg
+{
+
+struct libav_jitter_buffer_context_t;
+struct libav_jitter_buffer_context_deleter_t { void operator()(libav_jitter_buffer_context_t* libav_jitter_buffer_context_ptr); };
+
+typedef std::unique_ptr<libav_jitter_buffer_context_t, libav_jitter_buffer_context_deleter_t> libav_jitter_buffer_context_ptr_t;
+
+const std::uint32_t default_jitter_min_delay = 0;       // ms
+const std::uint32_t default_jitter_max_delay = 1000;    // ms
+const double default_jitter_target_loss = 0.01;
+const double default_jitter_max_stretch = 0.05;
+const std::size_t default_jitter_max_frames = 1000;
+
+struct jitter_buffer_config_t
+{
+    std::uint32_t   min_delay;      // ms
+    std::uint32_t   max_delay;      // ms
+    double          target_loss;    // acceptable share of frames arriving after their playout time
+    double          max_stretch;    // max speed change while the delay follows the target
+    std::size_t     max_frames;
+
+    jitter_buffer_config_t(std::uint32_t min_delay = default_jitter_min_delay
+                           , std::uint32_t max_delay = default_jitter_max_delay
+                           , double target_loss = default_jitter_target_loss
+                           , double max_stretch = default_jitter_max_stretch
+                           , std::size_t max_frames = default_jitter_max_frames);
+};
+
+struct jitter_buffer_stats_t
+{
+    std::uint64_t   jitter = 0;         // us, RFC 3550 interarrival jitter
+    std::uint64_t   target_delay = 0;   // us
+    std::uint64_t   playout_delay = 0;  // us
+    std::size_t     queued = 0;
+    std::size_t     pushed = 0;
+    std::size_t     played = 0;
+    std::size_t     late = 0;
+    std::size_t     lost = 0;
+    std::size_t     reordered = 0;
+    std::size_t     duplicated = 0;
+    std::size_t     concealed = 0;
+    std::size_t     overflowed = 0;
+};
+
+// Playout buffer for one stream of a network source. Frames are ordered by
+// timestamp(), the target delay follows the (1 - target_loss) quantile of
+// the transit delay and the playout delay slews to it by max_stretch. Raw
+// audio is time-stretched by the resampler to move the delay, gaps are
+// concealed by silence (raw audio) or by repeating the last frame (raw
+// video), encoded gaps are skipped. Times are in microseconds, -1 means now.
+class libav_jitter_buffer
+{
+    libav_jitter_buffer_context_ptr_t   m_jitter_buffer_context;
+
+public:
+    libav_jitter_buffer(const media_info_t& media_info
+                        , const jitter_buffer_config_t& config = jitter_buffer_config_t());
+
+    bool push(frame_t&& frame
+              , std::int64_t arrival_time = -1);
+
+    // takes the next frame whose playout time has come
+    bool pop(frame_t& frame
+             , std::int64_t now = -1);
+
+    // time left to the next playout, -1 if the buffer is empty
+    std::int64_t next_playout(std::int64_t now = -1) const;
+
+    jitter_buffer_stats_t stats() const;
+    void reset();
+
+    static std::int64_t now();
+};
+
+}
+
+#endif // FFMPEG_LIBAV_JITTER_BUFFER_H
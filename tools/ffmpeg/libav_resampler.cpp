@@ -32,131 +32,185 @@ struct swr_wrapper
     bool check_or_reopen(const audio_info_t& input_format
                         , const audio_info_t& output_format)
     {
-        if (m_swr_context != nullptr)
+        if (m_swr_context != nullptr
+                && m_input_format == input_format
+                && m_output_format == output_format)
         {
-            if (m_input_format != input_format
-                    || m_output_format != output_format)
-            {
-                return close()
-                        && check_or_reopen(input_format
-                                         , output_format);
-            }
+            return true;
+        }
+
+        // an existing context is reconfigured in place instead of reallocated
+        m_swr_context = swr_alloc_set_opts(m_swr_context
+                                           , av_get_default_channel_layout(output_format.channels)
+                                           , static_cast<AVSampleFormat>(output_format.sample_format)
+                                           , output_format.sample_rate
+                                           , av_get_default_channel_layout(input_format.channels)
+                                           , static_cast<AVSampleFormat>(input_format.sample_format)
+                                           , input_format.sample_rate
+                                           , 0
+                                           , nullptr);
+
+        if (m_swr_context != nullptr
+                && swr_init(m_swr_context) >= 0)
+        {
+            m_input_format = input_format;
+            m_output_format = output_format;
         }
         else
         {
-            m_swr_context = swr_alloc_set_opts(m_swr_context
-                                               , av_get_default_channel_layout(output_format.channels)
-                                               , static_cast<AVSampleFormat>(output_format.sample_format)
-                                               , output_format.sample_rate
-                                               , av_get_default_channel_layout(input_format.channels)
-                                               , static_cast<AVSampleFormat>(input_format.sample_format)
-                                               , input_format.sample_rate
-                                               , 0
-                                               , nullptr);
-
-            if (m_swr_context != nullptr
-                    && swr_init(m_swr_context) >= 0)
-            {
-                m_input_format = input_format;
-                m_output_format = output_format;
-            }
-            else
-            {
-                close();
-            }
-
-            /*
-            if (m_swr_context != nullptr)
-            {
-                bool result =
-                       av_opt_set_int(m_swr_context, "in_channel_layout",       av_get_default_channel_layout(input_format.channels), 0) >= 0
-                    && av_opt_set_int(m_swr_context, "in_sample_rate",          input_format.sample_rate, 0) >= 0
-                    && av_opt_set_sample_fmt(m_swr_context, "in_sample_fmt",    static_cast<AVSampleFormat>(input_format.sample_format), 0) >= 0
-
-                    && av_opt_set_int(m_swr_context, "out_channel_layout",      av_get_default_channel_layout(output_format.channels), 0) >= 0
-                    && av_opt_set_int(m_swr_context, "out_sample_rate",         output_format.sample_rate, 0) >= 0
-                    && av_opt_set_sample_fmt(m_swr_context, "out_sample_fmt",   static_cast<AVSampleFormat>(output_format.sample_format), 0) >= 0;
+            close();
+        }
 
-                result = result && swr_init(m_swr_context) >= 0;
+        return m_swr_context != nullptr;
+    }
 
-                if (result)
-                {
-                    m_input_format = input_format;
-                    m_output_format = output_format;
-                }
-                else
-                {
-                    close();
-                }
-            }*/
+    std::size_t output_samples(std::size_t input_samples) const
+    {
+        if (is_open())
+        {
+            auto samples = swr_get_out_samples(m_swr_context
+                                               , input_samples);
+            return samples > 0
+                    ? samples
+                    : 0;
         }
 
-        return m_swr_context != nullptr;
+        return 0;
     }
 
+    std::size_t output_size(std::size_t input_size) const
+    {
+        auto input_sample_size = m_input_format.sample_size();
+
+        return input_sample_size != 0
+                ? output_samples(input_size / input_sample_size) * m_output_format.sample_size()
+                : 0;
+    }
 
-    media_data_t resample(const void* input_data
-                         , std::size_t input_size)
+    // input_data == nullptr drains the delayed samples
+    std::size_t resample(const void* input_data
+                         , std::size_t input_size
+                         , void* output_data
+                         , std::size_t output_size)
     {
-        if (is_open())
+        if (is_open()
+                && output_data != nullptr)
         {
+            static const auto max_channels = 32;
 
-            auto input_samples = m_input_format.sample_size() != 0 ? input_size / m_input_format.sample_size() : 0;
+            auto input_sample_size = m_input_format.sample_size();
+            auto output_sample_size = m_output_format.sample_size();
 
-            if (input_samples != 0)
+            if (input_sample_size == 0
+                    || output_sample_size == 0
+                    || m_output_format.channels > max_channels
+                    || m_input_format.channels > max_channels)
             {
+                return 0;
+            }
 
-                static const auto max_channels = 32;
-
-                std::uint8_t* input_buffers[max_channels];
-                std::uint8_t* output_buffers[max_channels];
-
-                auto output_samples = av_rescale_rnd(input_samples
-                                                     , m_output_format.sample_rate
-                                                     , m_input_format.sample_rate
-                                                     , AV_ROUND_UP);
-
-                media_data_t output_data(output_samples * m_output_format.sample_size());
-
-                auto ret1 = av_samples_fill_arrays(input_buffers
-                                       , nullptr
-                                       , reinterpret_cast<const std::uint8_t*>(input_data)
-                                       , m_input_format.channels
-                                       , input_samples
-                                       , static_cast<AVSampleFormat>(m_input_format.sample_format)
-                                       , 1);
-
-                auto ret2 = av_samples_fill_arrays(output_buffers
-                                       , nullptr
-                                       , static_cast<const std::uint8_t*>(output_data.data())
-                                       , m_output_format.channels
-                                       , output_samples
-                                       , static_cast<AVSampleFormat>(m_output_format.sample_format)
-                                       , 1);
-                if (ret1 >= 0 && ret2 >= 0)
-                {
-                    auto result = swr_convert(m_swr_context
-                                              , output_buffers
+            std::int32_t input_samples = input_data != nullptr
+                    ? input_size / input_sample_size
+                    : 0;
+
+            std::int32_t output_samples = output_size / output_sample_size;
+
+            std::uint8_t* input_buffers[max_channels] = {};
+            std::uint8_t* output_buffers[max_channels] = {};
+
+            if (output_samples == 0
+                    || av_samples_fill_arrays(output_buffers
+                                              , nullptr
+                                              , static_cast<const std::uint8_t*>(output_data)
+                                              , m_output_format.channels
                                               , output_samples
-                                              , const_cast<const uint8_t**>(input_buffers)
-                                              , input_samples);
+                                              , static_cast<AVSampleFormat>(m_output_format.sample_format)
+                                              , 1) < 0)
+            {
+                return 0;
+            }
 
-                    if (result < 0)
-                    {
-                        return {};
-                    }
+            if (input_samples != 0
+                    && av_samples_fill_arrays(input_buffers
+                                              , nullptr
+                                              , static_cast<const std::uint8_t*>(input_data)
+                                              , m_input_format.channels
+                                              , input_samples
+                                              , static_cast<AVSampleFormat>(m_input_format.sample_format)
+                                              , 1) < 0)
+            {
+                return 0;
+            }
 
-                    if (output_samples != result)
-                    {
-                        output_data.resize(result * m_output_format.sample_size());
-                    }
+            auto result = swr_convert(m_swr_context
+                                      , output_buffers
+                                      , output_samples
+                                      , input_samples != 0
+                                        ? const_cast<const uint8_t**>(input_buffers)
+                                        : nullptr
+                                      , input_samples);
 
-                    return output_data;
+            if (result <= 0)
+            {
+                return 0;
+            }
+
+            if (result < output_samples
+                    && m_output_format.is_planar())
+            {
+                // planes were laid out for output_samples, pack them back to back
+                std::size_t plane_size = result * m_output_format.bps() / 8;
+                auto data = static_cast<std::uint8_t*>(output_data);
+
+                for (std::uint32_t c = 1; c < m_output_format.channels; c++)
+                {
+                    std::memmove(data + c * plane_size
+                                 , output_buffers[c]
+                                 , plane_size);
                 }
             }
+
+            return result * output_sample_size;
         }
 
-        return {};
+        return 0;
+    }
+
+    std::size_t resample(const void* input_data
+                         , std::size_t input_size
+                         , media_data_t& output_data)
+    {
+        // the buffer keeps its capacity between calls, so a steady stream
+        // stops allocating after the first chunks
+        output_data.resize(input_data != nullptr
+                           ? output_size(input_size)
+                           : output_samples(0) * m_output_format.sample_size());
+
+        auto result = resample(input_data
+                               , input_size
+                               , output_data.data()
+                               , output_data.size());
+
+        output_data.resize(result);
+
+        return result;
+    }
+
+    bool set_compensation(std::int32_t sample_delta
+                          , std::int32_t compensation_distance)
+    {
+        return is_open()
+                && swr_set_compensation(m_swr_context
+                                        , sample_delta
+                                        , compensation_distance) >= 0;
+    }
+
+    std::int64_t delay() const
+    {
+        return is_open()
+                ? swr_get_delay(m_swr_context
+                                , m_output_format.sample_rate)
+                : 0;
     }
 
     bool close()
@@ -205,8 +259,13 @@ struct resampler_context_t
             }
             if (m_swr_resampler.check_or_reopen(input_format, output_format))
             {
-                return m_swr_resampler.resample(input_data
-                                                , input_size);
+                media_data_t output_data;
+
+                m_swr_resampler.resample(input_data
+                                         , input_size
+                                         , output_data);
+
+                return output_data;
             }
         }
 
@@ -231,4 +290,92 @@ media_data_t libav_resampler::resample(const audio_info_t &input_format
                                          , output_format);
 }
 
+bool libav_resampler::open(const audio_info_t &input_format
+                           , const audio_info_t &output_format)
+{
+    return m_resampler_context->m_swr_resampler.check_or_reopen(input_format
+                                                                 , output_format);
+}
+
+bool libav_resampler::close()
+{
+    return m_resampler_context->m_swr_resampler.close();
+}
+
+bool libav_resampler::is_open() const
+{
+    return m_resampler_context->m_swr_resampler.is_open();
+}
+
+std::size_t libav_resampler::output_size(std::size_t input_size) const
+{
+    return m_resampler_context->m_swr_resampler.output_size(input_size);
+}
+
+std::size_t libav_resampler::resample(const void *input_data
+                                      , std::size_t input_size
+                                      , void *output_data
+                                      , std::size_t output_size)
+{
+    return input_data != nullptr
+            ? m_resampler_context->m_swr_resampler.resample(input_data
+                                                            , input_size
+                                                            , output_data
+                                                            , output_size)
+            : 0;
+}
+
+std::size_t libav_resampler::resample(const void *input_data
+                                      , std::size_t input_size
+                                      , media_data_t &output_data)
+{
+    if (input_data == nullptr)
+    {
+        output_data.clear();
+        return 0;
+    }
+
+    return m_resampler_context->m_swr_resampler.resample(input_data
+                                                         , input_size
+                                                         , output_data);
+}
+
+std::size_t libav_resampler::flush(void *output_data
+                                   , std::size_t output_size)
+{
+    return m_resampler_context->m_swr_resampler.resample(nullptr
+                                                         , 0
+                                                         , output_data
+                                                         , output_size);
+}
+
+std::size_t libav_resampler::flush(media_data_t &output_data)
+{
+    return m_resampler_context->m_swr_resampler.resample(nullptr
+                                                         , 0
+                                                         , output_data);
+}
+
+bool libav_resampler::set_compensation(std::int32_t sample_delta
+                                       , std::int32_t compensation_distance)
+{
+    return m_resampler_context->m_swr_resampler.set_compensation(sample_delta
+                                                                 , compensation_distance);
+}
+
+std::int64_t libav_resampler::delay() const
+{
+    return m_resampler_context->m_swr_resampler.delay();
+}
+
+const audio_info_t &libav_resampler::input_format() const
+{
+    return m_resampler_context->m_swr_resampler.m_input_format;
+}
+
+const audio_info_t &libav_resampler::output_format() const
+{
+    return m_resampler_context->m_swr_resampler.m_output_format;
+}
+
 }
@@ -14,10 +14,47 @@ class libav_resampler
     resampler_context_ptr_t m_resampler_context;
 public:
     libav_resampler();
+
+    // one-shot conversion, allocates the result on every call
     media_data_t resample(const audio_info_t& input_format
                   , const void* input_data
                   , std::size_t input_size
                   , const audio_info_t& output_format);
+
+    // streaming mode: open once, push chunks, flush at the end of stream.
+    // Reopening with other formats reconfigures the same swr context.
+    bool open(const audio_info_t& input_format
+              , const audio_info_t& output_format);
+    bool close();
+    bool is_open() const;
+
+    // upper bound of the output for the next chunk, delayed samples included
+    std::size_t output_size(std::size_t input_size) const;
+
+    // return the number of bytes written, planar output is packed plane
+    // after plane; the media_data_t overloads reuse the buffer capacity
+    std::size_t resample(const void* input_data
+                         , std::size_t input_size
+                         , void* output_data
+                         , std::size_t output_size);
+    std::size_t resample(const void* input_data
+                         , std::size_t input_size
+                         , media_data_t& output_data);
+
+    std::size_t flush(void* output_data
+                      , std::size_t output_size);
+    std::size_t flush(media_data_t& output_data);
+
+    // stretches or shrinks the output by sample_delta samples over the next
+    // compensation_distance output samples to follow the clock of the sink
+    bool set_compensation(std::int32_t sample_delta
+                          , std::int32_t compensation_distance);
+
+    // buffered samples at the output rate
+    std::int64_t delay() const;
+
+    const audio_info_t& input_format() const;
+    const audio_info_t& output_format() const;
 };
 
 }
@@ -0,0 +1,313 @@
+#include "libav_scaling_cache.h"
+
+extern "C"
+{
+#include <libswscale/swscale.h>
+#include <libavutil/pixfmt.h>
+}
+
+#include <mutex>
+#include <list>
+#include <map>
+#include <tuple>
+#include <iterator>
+
+namespace ffmpeg
+{
+
+scaling_plan_key_t::scaling_plan_key_t(const frame_size_t &input_frame_size
+                                       , pixel_format_t input_pixel_format
+                                       , const frame_size_t &output_frame_size
+                                       , pixel_format_t output_pixel_format
+                                       , scaling_method_t scaling_method)
+    : input_frame_size(input_frame_size)
+    , input_pixel_format(input_pixel_format)
+    , output_frame_size(output_frame_size)
+    , output_pixel_format(output_pixel_format)
+    , scaling_method(scaling_method)
+{
+
+}
+
+bool scaling_plan_key_t::operator ==(const scaling_plan_key_t &key) const
+{
+    return input_frame_size == key.input_frame_size
+            && input_pixel_format == key.input_pixel_format
+            && output_frame_size == key.output_frame_size
+            && output_pixel_format == key.output_pixel_format
+            && scaling_method == key.scaling_method;
+}
+
+bool scaling_plan_key_t::operator !=(const scaling_plan_key_t &key) const
+{
+    return !operator ==(key);
+}
+
+bool scaling_plan_key_t::operator <(const scaling_plan_key_t &key) const
+{
+    return std::tie(input_frame_size.width
+                    , input_frame_size.height
+                    , input_pixel_format
+                    , output_frame_size.width
+                    , output_frame_size.height
+                    , output_pixel_format
+                    , scaling_method)
+            < std::tie(key.input_frame_size.width
+                       , key.input_frame_size.height
+                       , key.input_pixel_format
+                       , key.output_frame_size.width
+                       , key.output_frame_size.height
+                       , key.output_pixel_format
+                       , key.scaling_method);
+}
+
+struct libav_scaling_cache_context_t
+{
+    struct plan_t
+    {
+        scaling_plan_key_t  key;
+        SwsContext*         sws_context;
+    };
+
+    using plan_list_t = std::list<plan_t>;
+    using plan_index_t = std::multimap<scaling_plan_key_t, plan_list_t::iterator>;
+    using sws_context_list_t = std::vector<SwsContext*>;
+
+    mutable std::mutex      m_mutex;
+    plan_list_t             m_idle_plans;   // front - most recently released
+    plan_index_t            m_plan_index;
+    std::size_t             m_capacity;
+    scaling_cache_stats_t   m_stats;
+
+    libav_scaling_cache_context_t(std::size_t capacity)
+        : m_capacity(capacity)
+    {
+
+    }
+
+    ~libav_scaling_cache_context_t()
+    {
+        clear();
+    }
+
+    static SwsContext* create_context(const scaling_plan_key_t& key)
+    {
+        return sws_getContext(key.input_frame_size.width
+                              , key.input_frame_size.height
+                              , static_cast<AVPixelFormat>(key.input_pixel_format)
+                              , key.output_frame_size.width
+                              , key.output_frame_size.height
+                              , static_cast<AVPixelFormat>(key.output_pixel_format)
+                              , static_cast<std::uint32_t>(key.scaling_method)
+                              , nullptr
+                              , nullptr
+                              , nullptr);
+    }
+
+    static void free_contexts(sws_context_list_t& sws_contexts)
+    {
+        for (auto sws_context : sws_contexts)
+        {
+            sws_freeContext(sws_context);
+        }
+
+        sws_contexts.clear();
+    }
+
+    void shrink(std::size_t capacity
+                , sws_context_list_t& evicted)
+    {
+        while (m_idle_plans.size() > capacity)
+        {
+            auto it = std::prev(m_idle_plans.end());
+
+            auto range = m_plan_index.equal_range(it->key);
+            for (auto idx = range.first; idx != range.second; ++idx)
+            {
+                if (idx->second == it)
+                {
+                    m_plan_index.erase(idx);
+                    break;
+                }
+            }
+
+            evicted.push_back(it->sws_context);
+            m_idle_plans.erase(it);
+            m_stats.evictions++;
+        }
+    }
+
+    SwsContext* acquire(const scaling_plan_key_t& key)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            auto idx = m_plan_index.find(key);
+            if (idx != m_plan_index.end())
+            {
+                auto sws_context = idx->second->sws_context;
+                m_idle_plans.erase(idx->second);
+                m_plan_index.erase(idx);
+
+                m_stats.hits++;
+                m_stats.active_plans++;
+
+                return sws_context;
+            }
+
+            m_stats.misses++;
+        }
+
+        // filter initialization is the expensive part, keep it out of the lock
+        auto sws_context = create_context(key);
+
+        if (sws_context != nullptr)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stats.active_plans++;
+        }
+
+        return sws_context;
+    }
+
+    void release(const scaling_plan_key_t& key
+                 , SwsContext* sws_context)
+    {
+        if (sws_context != nullptr)
+        {
+            sws_context_list_t evicted;
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                if (m_stats.active_plans > 0)
+                {
+                    m_stats.active_plans--;
+                }
+
+                m_idle_plans.push_front({ key, sws_context });
+                m_plan_index.emplace(key
+                                     , m_idle_plans.begin());
+
+                shrink(m_capacity
+                       , evicted);
+            }
+
+            free_contexts(evicted);
+        }
+    }
+
+    void set_capacity(std::size_t capacity)
+    {
+        sws_context_list_t evicted;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_capacity = capacity;
+            shrink(m_capacity
+                   , evicted);
+        }
+
+        free_contexts(evicted);
+    }
+
+    std::size_t capacity() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_capacity;
+    }
+
+    scaling_cache_stats_t stats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto stats = m_stats;
+        stats.idle_plans = m_idle_plans.size();
+
+        return stats;
+    }
+
+    void reset_stats()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        m_stats.hits = 0;
+        m_stats.misses = 0;
+        m_stats.evictions = 0;
+    }
+
+    void clear()
+    {
+        sws_context_list_t evicted;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            for (auto& plan : m_idle_plans)
+            {
+                evicted.push_back(plan.sws_context);
+            }
+
+            m_idle_plans.clear();
+            m_plan_index.clear();
+        }
+
+        free_contexts(evicted);
+    }
+};
+//------------------------------------------------------------------------------
+void libav_scaling_cache_context_deleter_t::operator()(libav_scaling_cache_context_t *libav_scaling_cache_context_ptr)
+{
+    delete libav_scaling_cache_context_ptr;
+}
+//------------------------------------------------------------------------------
+libav_scaling_cache::libav_scaling_cache(std::size_t capacity)
+    : m_scaling_cache_context(new libav_scaling_cache_context_t(capacity))
+{
+
+}
+
+libav_scaling_cache &libav_scaling_cache::instance()
+{
+    static libav_scaling_cache scaling_cache(default_scaling_cache_capacity);
+    return scaling_cache;
+}
+
+SwsContext *libav_scaling_cache::acquire(const scaling_plan_key_t &key)
+{
+    return m_scaling_cache_context->acquire(key);
+}
+
+void libav_scaling_cache::release(const scaling_plan_key_t &key
+                                  , SwsContext *sws_context)
+{
+    m_scaling_cache_context->release(key
+                                     , sws_context);
+}
+
+void libav_scaling_cache::set_capacity(std::size_t capacity)
+{
+    m_scaling_cache_context->set_capacity(capacity);
+}
+
+std::size_t libav_scaling_cache::capacity() const
+{
+    return m_scaling_cache_context->capacity();
+}
+
+scaling_cache_stats_t libav_scaling_cache::stats() const
+{
+    return m_scaling_cache_context->stats();
+}
+
+void libav_scaling_cache::reset_stats()
+{
+    m_scaling_cache_context->reset_stats();
+}
+
+void libav_scaling_cache::clear()
+{
+    m_scaling_cache_context->clear();
+}
+
+}
@@ -0,0 +1,73 @@
+#ifndef FFMPEG_LIBAV_SCALING_CACHE_H
+#define FFMPEG_LIBAV_SCALING_CACHE_H
+
+#include "libav_converter.h"
+
+struct SwsContext;
+
+namespace ffmpeg
+{
+
+const std::size_t default_scaling_cache_capacity = 32;
+
+struct scaling_plan_key_t
+{
+    frame_size_t        input_frame_size;
+    pixel_format_t      input_pixel_format;
+    frame_size_t        output_frame_size;
+    pixel_format_t      output_pixel_format;
+    scaling_method_t    scaling_method;
+
+    scaling_plan_key_t(const frame_size_t& input_frame_size = { 0, 0 }
+                       , pixel_format_t input_pixel_format = pixel_format_none
+                       , const frame_size_t& output_frame_size = { 0, 0 }
+                       , pixel_format_t output_pixel_format = pixel_format_none
+                       , scaling_method_t scaling_method = default_scaling_method);
+
+    bool operator ==(const scaling_plan_key_t& key) const;
+    bool operator !=(const scaling_plan_key_t& key) const;
+    bool operator <(const scaling_plan_key_t& key) const;
+};
+
+struct scaling_cache_stats_t
+{
+    std::size_t     hits = 0;
+    std::size_t     misses = 0;
+    std::size_t     evictions = 0;
+    std::size_t     idle_plans = 0;
+    std::size_t     active_plans = 0;
+};
+
+struct libav_scaling_cache_context_t;
+struct libav_scaling_cache_context_deleter_t { void operator()(libav_scaling_cache_context_t* libav_scaling_cache_context_ptr); };
+
+typedef std::unique_ptr<libav_scaling_cache_context_t, libav_scaling_cache_context_deleter_t> libav_scaling_cache_context_ptr_t;
+
+// Process-wide LRU cache of initialized swscale contexts (scaling plans).
+// A plan is owned exclusively between acquire() and release(), because
+// sws_scale keeps per-call state in the context; released plans stay
+// cached and are handed to the next converter with the same key.
+class libav_scaling_cache
+{
+    libav_scaling_cache_context_ptr_t   m_scaling_cache_context;
+
+    libav_scaling_cache(std::size_t capacity);
+
+public:
+    static libav_scaling_cache& instance();
+
+    SwsContext* acquire(const scaling_plan_key_t& key);
+    void release(const scaling_plan_key_t& key
+                 , SwsContext* sws_context);
+
+    void set_capacity(std::size_t capacity);
+    std::size_t capacity() const;
+
+    scaling_cache_stats_t stats() const;
+    void reset_stats();
+    void clear();
+};
+
+}
+
+#endif // FFMPEG_LIBAV_SCALING_CACHE_H
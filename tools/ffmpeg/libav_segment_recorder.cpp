@@ -0,0 +1,727 @@
+#include "libav_segment_recorder.h"
+#include "tools/base/worker_pool.h"
+
+#define WBS_MODULE_NAME "ff:recorder"
+#include "tools/base/logger_base.h"
+
+#include <mutex>
+#include <future>
+#include <deque>
+#include <chrono>
+#include <cmath>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <iomanip>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+extern "C"
+{
+#include <libavutil/avutil.h>
+}
+
+namespace ffmpeg
+{
+
+const std::size_t segment_block_size = 4096;
+
+segment_recorder_config_t::segment_recorder_config_t(const std::string &directory
+                                                     , const std::string &name
+                                                     , segment_format_t format
+                                                     , uint32_t segment_duration
+                                                     , std::size_t playlist_size
+                                                     , std::size_t max_segments
+                                                     , std::size_t preallocate_size
+                                                     , std::size_t buffer_size)
+    : directory(directory)
+    , name(name)
+    , format(format)
+    , segment_duration(segment_duration)
+    , playlist_size(playlist_size)
+    , max_segments(max_segments)
+    , preallocate_size(preallocate_size)
+    , buffer_size(buffer_size)
+{
+
+}
+
+struct libav_segment_recorder_context_t
+{
+    struct segment_file_t
+    {
+        using pointer_t = std::shared_ptr<segment_file_t>;
+
+        std::int32_t    fd = -1;
+        std::string     name;
+        std::uint64_t   sequence = 0;
+        std::size_t     size = 0;
+        double          duration = 0.0;
+    };
+
+    using segment_list_t = std::deque<segment_file_t::pointer_t>;
+
+    segment_recorder_config_t       m_config;
+    libav_stream_publisher          m_publisher;
+
+    std::int32_t                    m_clock_stream;     // segments are measured on its timestamps
+    std::uint32_t                   m_clock_rate;
+    bool                            m_clock_video;
+    std::int64_t                    m_segment_start;
+    std::int64_t                    m_last_timestamp;
+    bool                            m_has_start;
+
+    segment_file_t::pointer_t       m_current;
+    segment_file_t::pointer_t       m_next;
+    bool                            m_preparing;        // a prepare_next() is posted
+    std::uint64_t                   m_sequence;
+    std::string                     m_init_name;
+    std::int32_t                    m_target_duration;  // s, fixed for the whole recording
+
+    // the muxer output is staged here and written in whole blocks, every
+    // segment starts at offset 0, so only the tail of a segment is unaligned
+    std::uint8_t*                   m_stage;
+    std::size_t                     m_stage_capacity;
+    std::size_t                     m_staged;
+
+    // touched by the file worker only
+    segment_list_t                  m_segments;
+
+    mutable std::mutex              m_mutex;
+    segment_recorder_stats_t        m_stats;
+
+    base::worker_pool               m_file_worker;
+
+    libav_segment_recorder_context_t(const segment_recorder_config_t& config)
+        : m_config(config)
+        , m_clock_stream(0)
+        , m_clock_rate(video_sample_rate)
+        , m_clock_video(false)
+        , m_segment_start(0)
+        , m_last_timestamp(0)
+        , m_has_start(false)
+        , m_preparing(false)
+        , m_sequence(0)
+        , m_target_duration(1)
+        , m_stage(nullptr)
+        , m_stage_capacity(0)
+        , m_staged(0)
+        , m_file_worker(1)
+    {
+
+    }
+
+    ~libav_segment_recorder_context_t()
+    {
+        close();
+        std::free(m_stage);
+    }
+
+    bool is_fmp4() const
+    {
+        return m_config.format == segment_format_t::fmp4;
+    }
+
+    std::string path(const std::string& name) const
+    {
+        return m_config.directory + "/" + name;
+    }
+
+    std::string segment_name(std::uint64_t sequence) const
+    {
+        std::ostringstream stream;
+        stream << m_config.name << "_" << std::setw(6) << std::setfill('0') << sequence
+               << (is_fmp4() ? ".m4s" : ".ts");
+        return stream.str();
+    }
+
+    std::string playlist_path() const
+    {
+        return path(m_config.name + ".m3u8");
+    }
+
+    segment_file_t::pointer_t create_file(const std::string& name
+                                          , std::size_t preallocate_size)
+    {
+        auto file = std::make_shared<segment_file_t>();
+
+        file->name = name;
+        file->fd = ::open(path(name).c_str()
+                          , O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC
+                          , 0644);
+
+        if (file->fd < 0)
+        {
+            LOG_E << "Can't create segment " << path(name) << ": errno " << errno LOG_END;
+            return nullptr;
+        }
+
+#if defined(__linux__)
+        // the blocks are reserved without changing the file size, so the
+        // writes do not allocate and a reader never sees zero padding
+        if (preallocate_size > 0
+                && ::fallocate(file->fd, FALLOC_FL_KEEP_SIZE, 0, preallocate_size) != 0)
+        {
+            LOG_D << "Segment preallocation is not supported: errno " << errno LOG_END;
+        }
+#endif
+
+        return file;
+    }
+
+    void finish_file(segment_file_t& file)
+    {
+        if (file.fd >= 0)
+        {
+            // releases the preallocated blocks behind the data
+            if (::ftruncate(file.fd, file.size) != 0)
+            {
+                LOG_W << "Can't truncate segment " << file.name << ": errno " << errno LOG_END;
+            }
+
+            ::close(file.fd);
+            file.fd = -1;
+        }
+    }
+
+    void prepare_next()
+    {
+        std::uint64_t sequence = 0;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            sequence = m_sequence + 1;
+        }
+
+        auto file = create_file(segment_name(sequence)
+                                , m_config.preallocate_size);
+
+        if (file != nullptr)
+        {
+            file->sequence = sequence;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_next = file;
+        m_preparing = false;
+    }
+
+    // called with m_mutex held
+    void post_prepare_next()
+    {
+        m_preparing = true;
+        m_file_worker.post([this] { prepare_next(); });
+    }
+
+    // never waits: a late or failed file is requested again and the caller
+    // keeps writing into the current segment
+    segment_file_t::pointer_t take_next()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_next == nullptr)
+        {
+            m_stats.late_files++;
+
+            if (!m_preparing)
+            {
+                post_prepare_next();
+            }
+
+            return nullptr;
+        }
+
+        auto file = std::move(m_next);
+
+        if (file != nullptr)
+        {
+            m_sequence = file->sequence;
+        }
+
+        return file;
+    }
+
+    void write_playlist(bool is_final)
+    {
+        auto first = m_config.playlist_size > 0
+                && m_segments.size() > m_config.playlist_size
+                ? m_segments.size() - m_config.playlist_size
+                : 0;
+
+        std::ostringstream playlist;
+
+        playlist << "#EXTM3U\n"
+                 << "#EXT-X-VERSION:" << (is_fmp4() ? 7 : 3) << "\n"
+                 << "#EXT-X-TARGETDURATION:" << m_target_duration << "\n"
+                 << "#EXT-X-MEDIA-SEQUENCE:" << (first < m_segments.size() ? m_segments[first]->sequence : m_sequence) << "\n";
+
+        if (m_config.playlist_size == 0)
+        {
+            playlist << "#EXT-X-PLAYLIST-TYPE:EVENT\n";
+        }
+
+        if (is_fmp4())
+        {
+            playlist << "#EXT-X-MAP:URI=\"" << m_init_name << "\"\n";
+        }
+
+        playlist << std::fixed << std::setprecision(3);
+
+        for (auto i = first; i < m_segments.size(); i++)
+        {
+            playlist << "#EXTINF:" << m_segments[i]->duration << ",\n"
+                     << m_segments[i]->name << "\n";
+        }
+
+        if (is_final)
+        {
+            playlist << "#EXT-X-ENDLIST\n";
+        }
+
+        // a reader sees the old or the new playlist, never a partial one
+        auto playlist_name = playlist_path();
+        auto temp_name = playlist_name + ".tmp";
+
+        if (auto file = std::fopen(temp_name.c_str(), "w"))
+        {
+            auto data = playlist.str();
+            auto result = std::fwrite(data.data(), 1, data.size(), file) == data.size();
+            result &= std::fclose(file) == 0;
+
+            if (result)
+            {
+                std::rename(temp_name.c_str()
+                            , playlist_name.c_str());
+            }
+        }
+    }
+
+    // file worker: closes the segment, lists it and removes the old ones
+    // that have left the playlist
+    void complete_segment(segment_file_t::pointer_t file
+                          , bool is_final)
+    {
+        finish_file(*file);
+
+        m_segments.push_back(file);
+
+        // a live playlist must not change the target duration, a longer
+        // segment means the key frame interval exceeds the segment duration
+        if (std::lround(file->duration) > m_target_duration)
+        {
+            LOG_W << "Segment " << file->name << " of " << file->duration << " s exceeds the target duration" LOG_END;
+        }
+
+        write_playlist(is_final);
+
+        while (m_config.max_segments > 0
+               && m_config.playlist_size > 0
+               && m_segments.size() > std::max(m_config.max_segments
+                                               , m_config.playlist_size))
+        {
+            std::remove(path(m_segments.front()->name).c_str());
+            m_segments.pop_front();
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.segments++;
+    }
+
+    std::int32_t write_out(const std::uint8_t* data
+                           , std::size_t size)
+    {
+        if (m_current == nullptr
+                || m_current->fd < 0)
+        {
+            return AVERROR(EIO);
+        }
+
+        std::size_t written = 0;
+        std::size_t calls = 0;
+
+        while (written < size)
+        {
+            auto result = ::write(m_current->fd
+                                  , data + written
+                                  , size - written);
+            calls++;
+
+            if (result < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+
+                auto error = errno;
+
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stats.write_errors++;
+                return AVERROR(error);
+            }
+
+            written += result;
+        }
+
+        m_current->size += written;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.written_bytes += written;
+        m_stats.write_calls += calls;
+
+        return 0;
+    }
+
+    // the tail of the segment, before the writes move to the next file
+    bool write_staged()
+    {
+        auto size = m_staged;
+        m_staged = 0;
+
+        return size == 0
+                || write_out(m_stage, size) >= 0;
+    }
+
+    std::int32_t write_data(const std::uint8_t* data
+                            , std::int32_t size)
+    {
+        for (std::int32_t offset = 0; offset < size; )
+        {
+            auto part = std::min<std::size_t>(m_stage_capacity - m_staged
+                                              , size - offset);
+
+            std::memcpy(m_stage + m_staged, data + offset, part);
+
+            m_staged += part;
+            offset += part;
+
+            if (m_staged == m_stage_capacity)
+            {
+                m_staged = 0;
+
+                auto result = write_out(m_stage, m_stage_capacity);
+
+                if (result < 0)
+                {
+                    return result;
+                }
+            }
+        }
+
+        return size;
+    }
+
+    bool allocate_stage()
+    {
+        auto capacity = (std::max(m_config.buffer_size, segment_block_size) + segment_block_size - 1) / segment_block_size * segment_block_size;
+
+        if (m_stage_capacity != capacity)
+        {
+            std::free(m_stage);
+            m_stage = nullptr;
+            m_stage_capacity = 0;
+
+            void* memory = nullptr;
+
+            if (::posix_memalign(&memory, segment_block_size, capacity) != 0)
+            {
+                return false;
+            }
+
+            m_stage = static_cast<std::uint8_t*>(memory);
+            m_stage_capacity = capacity;
+        }
+
+        m_staged = 0;
+
+        return true;
+    }
+
+    void select_clock(const stream_info_list_t& stream_list)
+    {
+        m_clock_stream = 0;
+        m_clock_video = false;
+
+        for (std::size_t i = 0; i < stream_list.size(); i++)
+        {
+            if (stream_list[i].media_info.media_type == media_type_t::video)
+            {
+                m_clock_stream = i;
+                m_clock_video = true;
+                break;
+            }
+        }
+
+        m_clock_rate = stream_list.empty()
+                ? video_sample_rate
+                : stream_list[m_clock_stream].media_info.sample_rate();
+    }
+
+    bool open(const stream_info_list_t& stream_list)
+    {
+        close();
+
+        select_clock(stream_list);
+
+        m_has_start = false;
+        m_sequence = 0;
+        m_segments.clear();
+        m_target_duration = std::max<std::int32_t>(1, (m_config.segment_duration + 999) / 1000);
+        m_stats = segment_recorder_stats_t();
+
+        if (!allocate_stage())
+        {
+            return false;
+        }
+
+        // fMP4 starts with the init section in a file of its own
+        m_init_name = m_config.name + "_init.mp4";
+        m_current = is_fmp4()
+                ? create_file(m_init_name, 0)
+                : create_file(segment_name(0), m_config.preallocate_size);
+
+        if (m_current == nullptr)
+        {
+            return false;
+        }
+
+        publisher_io_t io;
+        io.write_handler = [this](const std::uint8_t* data, std::int32_t size) { return write_data(data, size); };
+
+        auto result = m_publisher.open(io
+                                       , path(m_config.name + (is_fmp4() ? ".mp4" : ".ts"))
+                                       , stream_list
+                                       , is_fmp4()
+                                         ? "movflags=frag_custom+empty_moov+default_base_moof"
+                                         : "");
+
+        if (!result)
+        {
+            LOG_E << "Can't open the muxer for " << m_config.name LOG_END;
+            finish_file(*m_current);
+            m_current.reset();
+            return false;
+        }
+
+        if (is_fmp4())
+        {
+            m_publisher.flush();
+            write_staged();
+            finish_file(*m_current);
+
+            prepare_next();
+            m_current = take_next();
+
+            if (m_current == nullptr)
+            {
+                m_publisher.close();
+                return false;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            post_prepare_next();
+        }
+
+        LOG_I << "Recording " << m_config.name << " started in " << m_config.directory LOG_END;
+
+        return true;
+    }
+
+    // waits for the tasks posted to the file worker before
+    void sync_worker()
+    {
+        std::promise<void> done;
+        auto future = done.get_future();
+
+        m_file_worker.post([&done] { done.set_value(); });
+        future.wait();
+    }
+
+    bool close()
+    {
+        if (!m_publisher.is_opened())
+        {
+            return false;
+        }
+
+        // the trailer still goes to the current segment
+        m_publisher.close();
+        write_staged();
+
+        if (m_current != nullptr)
+        {
+            m_current->duration = static_cast<double>(m_last_timestamp - m_segment_start) / m_clock_rate;
+
+            auto completed = std::move(m_current);
+
+            m_file_worker.post([this, completed]
+            {
+                complete_segment(completed
+                                 , true);
+            });
+        }
+
+        sync_worker();
+
+        // the spare file was never used
+        if (m_next != nullptr)
+        {
+            finish_file(*m_next);
+            std::remove(path(m_next->name).c_str());
+            m_next.reset();
+        }
+
+        LOG_I << "Recording " << m_config.name << " stopped" LOG_END;
+
+        return true;
+    }
+
+    void rotate(std::int64_t timestamp)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+
+        auto file = take_next();
+        if (file == nullptr)
+        {
+            // keep writing into the current segment, the next key frame
+            // tries again
+            return;
+        }
+
+        m_publisher.flush();
+        write_staged();
+
+        m_current->duration = static_cast<double>(timestamp - m_segment_start) / m_clock_rate;
+        m_segment_start = timestamp;
+
+        auto completed = std::move(m_current);
+        m_current = std::move(file);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_preparing = true;
+        }
+
+        m_file_worker.post([this, completed]
+        {
+            complete_segment(completed
+                             , false);
+            prepare_next();
+        });
+
+        std::uint64_t rotation_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.max_rotation_time = std::max(m_stats.max_rotation_time
+                                             , rotation_time);
+    }
+
+    bool push_frame(std::int32_t stream_id
+                    , const void* data
+                    , std::size_t size
+                    , std::int64_t timestamp
+                    , bool key_frame
+                    , std::int64_t dts = no_timestamp)
+    {
+        if (!m_publisher.is_opened())
+        {
+            return false;
+        }
+
+        if (stream_id == m_clock_stream)
+        {
+            m_last_timestamp = timestamp;
+
+            if (!m_has_start)
+            {
+                m_segment_start = timestamp;
+                m_has_start = true;
+            }
+            else if ((key_frame || !m_clock_video)
+                     && (timestamp - m_segment_start) * 1000 >= static_cast<std::int64_t>(m_config.segment_duration) * m_clock_rate)
+            {
+                rotate(timestamp);
+            }
+        }
+
+        return m_publisher.push_frame(stream_id
+                                      , data
+                                      , size
+                                      , timestamp
+                                      , key_frame
+                                      , dts);
+    }
+
+    segment_recorder_stats_t stats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
+    }
+};
+//------------------------------------------------------------------------------
+void libav_segment_recorder_context_deleter_t::operator()(libav_segment_recorder_context_t *libav_segment_recorder_context_ptr)
+{
+    delete libav_segment_recorder_context_ptr;
+}
+//------------------------------------------------------------------------------
+libav_segment_recorder::libav_segment_recorder(const segment_recorder_config_t &config)
+    : m_segment_recorder_context(new libav_segment_recorder_context_t(config))
+{
+
+}
+
+bool libav_segment_recorder::open(const stream_info_list_t &stream_list)
+{
+    return m_segment_recorder_context->open(stream_list);
+}
+
+bool libav_segment_recorder::close()
+{
+    return m_segment_recorder_context->close();
+}
+
+bool libav_segment_recorder::is_opened() const
+{
+    return m_segment_recorder_context->m_publisher.is_opened();
+}
+
+bool libav_segment_recorder::push_frame(int32_t stream_id
+                                        , const void *data
+                                        , std::size_t size
+                                        , int64_t timestamp
+                                        , bool key_frame)
+{
+    return m_segment_recorder_context->push_frame(stream_id
+                                                  , data
+                                                  , size
+                                                  , timestamp
+                                                  , key_frame);
+}
+
+bool libav_segment_recorder::push_packet(const publisher_packet_ptr_t &packet)
+{
+    return packet != nullptr
+            && m_segment_recorder_context->push_frame(packet->stream_id
+                                                      , packet->data.data()
+                                                      , packet->data.size()
+                                                      , packet->timestamp
+                                                      , packet->key_frame
+                                                      , packet->dts);
+}
+
+std::string libav_segment_recorder::playlist_path() const
+{
+    return m_segment_recorder_context->playlist_path();
+}
+
+segment_recorder_stats_t libav_segment_recorder::stats() const
+{
+    return m_segment_recorder_context->stats();
+}
+
+}
@@ -0,0 +1,88 @@
+#ifndef FFMPEG_LIBAV_SEGMENT_RECORDER_H
+#define FFMPEG_LIBAV_SEGMENT_RECORDER_H
+
+#include "libav_stream_publisher.h"
+
+namespace ffmpeg
+{
+
+struct libav_segment_recorder_context_t;
+struct libav_segment_recorder_context_deleter_t { void operator()(libav_segment_recorder_context_t* libav_segment_recorder_context_ptr); };
+
+typedef std::unique_ptr<libav_segment_recorder_context_t, libav_segment_recorder_context_deleter_t> libav_segment_recorder_context_ptr_t;
+
+enum class segment_format_t
+{
+    mpegts,
+    fmp4
+};
+
+const std::uint32_t default_segment_duration = 6000;                    // ms
+const std::size_t default_segment_playlist_size = 5;
+const std::size_t default_segment_preallocate_size = 64 * 1024 * 1024;
+const std::size_t default_segment_buffer_size = 1024 * 1024;
+
+struct segment_recorder_config_t
+{
+    std::string         directory;
+    std::string         name;               // base name of the segments and the playlist
+    segment_format_t    format;
+    std::uint32_t       segment_duration;   // ms, segments are cut on the next key frame after it, sets the target duration
+    std::size_t         playlist_size;      // segments in the rolling playlist, 0 - all of them
+    std::size_t         max_segments;       // segments kept on disk, 0 - no limit; listed segments are never removed
+    std::size_t         preallocate_size;   // bytes reserved for every new segment file
+    std::size_t         buffer_size;        // staging buffer, written out in whole 4 KiB blocks
+
+    segment_recorder_config_t(const std::string& directory = "."
+                              , const std::string& name = "stream"
+                              , segment_format_t format = segment_format_t::mpegts
+                              , std::uint32_t segment_duration = default_segment_duration
+                              , std::size_t playlist_size = default_segment_playlist_size
+                              , std::size_t max_segments = 0
+                              , std::size_t preallocate_size = default_segment_preallocate_size
+                              , std::size_t buffer_size = default_segment_buffer_size);
+};
+
+struct segment_recorder_stats_t
+{
+    std::size_t     segments = 0;
+    std::size_t     written_bytes = 0;
+    std::size_t     write_calls = 0;
+    std::size_t     write_errors = 0;
+    std::size_t     late_files = 0;         // rotations put off to a later key frame, the next file was not ready
+    std::uint64_t   max_rotation_time = 0;  // us
+};
+
+// Records encoded streams into MPEG-TS or fragmented MP4 segments with a
+// rolling HLS playlist. One muxer runs for the whole recording and writes
+// through a large buffer into the current file in whole blocks, a segment
+// boundary is a flush of the muxer on a key frame. The target duration
+// comes from segment_duration, so the key frame interval must not exceed it. Segment files are created and
+// preallocated ahead of time and closed, listed and removed on a
+// background thread, so the pushing thread only ever calls write().
+class libav_segment_recorder
+{
+    libav_segment_recorder_context_ptr_t    m_segment_recorder_context;
+
+public:
+    libav_segment_recorder(const segment_recorder_config_t& config = segment_recorder_config_t());
+
+    bool open(const stream_info_list_t& stream_list);
+    bool close();
+    bool is_opened() const;
+
+    bool push_frame(std::int32_t stream_id
+                    , const void* data
+                    , std::size_t size
+                    , std::int64_t timestamp
+                    , bool key_frame = false);
+
+    bool push_packet(const publisher_packet_ptr_t& packet);
+
+    std::string playlist_path() const;
+    segment_recorder_stats_t stats() const;
+};
+
+}
+
+#endif // FFMPEG_LIBAV_SEGMENT_RECORDER_H
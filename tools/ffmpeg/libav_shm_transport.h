@@ -0,0 +1,51 @@
+#ifndef FFMPEG_LIBAV_SHM_TRANSPORT_H
+#define FFMPEG_LIBAV_SHM_TRANSPORT_H
+
+#include "libav_base.h"
+#include "tools/base/shm_transport.h"
+
+namespace base
+{
+
+template<>
+struct shm_frame_traits_t<ffmpeg::frame_t>
+{
+    using info_t = ffmpeg::frame_info_t;
+
+    static const info_t& info(const ffmpeg::frame_t& frame)
+    {
+        return frame.info;
+    }
+
+    static const void* data(const ffmpeg::frame_t& frame)
+    {
+        return frame.media_data.data();
+    }
+
+    static std::size_t size(const ffmpeg::frame_t& frame)
+    {
+        return frame.media_data.size();
+    }
+
+    static void assign(ffmpeg::frame_t& frame
+                       , const info_t& info
+                       , const std::uint8_t* data
+                       , std::size_t size)
+    {
+        frame.info = info;
+        frame.media_data.assign(data, data + size);
+    }
+};
+
+}
+
+namespace ffmpeg
+{
+
+// frames of a grabber or a transcoder to another process, see base::shm_sink
+typedef base::shm_frame_sink<frame_t> libav_shm_sink;
+typedef base::shm_frame_source<frame_t> libav_shm_source;
+
+}
+
+#endif // FFMPEG_LIBAV_SHM_TRANSPORT_H
@@ -1,4 +1,5 @@
 #include "libav_stream_grabber.h"
+#include "libav_jitter_buffer.h"
 #include "libav_utils.h"
 
 #include <thread>
@@ -6,6 +7,7 @@
 #include <map>
 #include <atomic>
 #include <chrono>
+#include <algorithm>
 
 extern "C"
 {
@@ -508,6 +510,7 @@ struct libav_stream_grabber_context_t
 
         stream_info_t               stream_info;
         stream_delay_controller     delay_controller;
+        std::unique_ptr<libav_jitter_buffer>    jitter_buffer;
         frame_queue_t               frame_queue;
         std::int32_t                frame_id;
         std::int64_t                start;
@@ -531,7 +534,12 @@ struct libav_stream_grabber_context_t
             , start(start)
             , is_streaming_protocol(is_streaming_protocol)
         {
-
+            // network sources are paced by the arrival jitter instead of
+            // the fixed delay controller
+            if (is_streaming_protocol)
+            {
+                jitter_buffer.reset(new libav_jitter_buffer(this->stream_info.media_info));
+            }
         }
 
         libav_stream_t(libav_stream_t&& other) = default;
@@ -644,14 +652,6 @@ struct libav_stream_grabber_context_t
             return false;
         }
 
-        std::size_t overload_frames() const
-        {
-            std::lock_guard<std::mutex> lock(m_mutex);
-            return m_frames.size() > m_min_queue_size
-                    ? m_frames.size() - m_min_queue_size
-                    : 0;
-        }
-
         bool is_empty()
         {
             std::lock_guard<std::mutex> lock(m_mutex);
@@ -912,12 +912,54 @@ struct libav_stream_grabber_context_t
         push_event(streaming_event_t::stop);
     }
 
+    void deliver_frame(libav_stream_t& stream
+                       , frame_t&& frame)
+    {
+        if (m_frame_handler == nullptr
+                || !m_frame_handler(stream.stream_info
+                                    , std::move(frame))
+                )
+        {
+            stream.push_data(std::move(frame));
+        }
+    }
+
+    // plays out the due frames of the jitter buffers, returns the time to
+    // the next playout in ms
+    std::size_t process_jitter(std::vector<libav_stream_t::pointer_t>& jitter_streams)
+    {
+        std::size_t idle_time = idle_timeout_ms;
+
+        for (auto& stream : jitter_streams)
+        {
+            frame_t frame;
+            while (stream->jitter_buffer->pop(frame))
+            {
+                deliver_frame(*stream
+                              , std::move(frame));
+            }
+
+            auto next_playout = stream->jitter_buffer->next_playout();
+            if (next_playout >= 0)
+            {
+                idle_time = std::min<std::size_t>(idle_time
+                                                  , std::max<std::int64_t>(next_playout / 1000, 1));
+            }
+        }
+
+        return idle_time;
+    }
+
     void frame_processor(frame_manager_t& frame_manager)
     {
+        std::vector<libav_stream_t::pointer_t> jitter_streams;
+
         while(m_is_running.load())
         {
             frame_manager_t::frame_pair_t frame;
             std::int64_t frame_order;
+            auto idle_time = process_jitter(jitter_streams);
+
             if (frame_manager.pop_frame(frame, frame_order))
             {
                 if (frame.second != nullptr)
@@ -933,30 +975,35 @@ struct libav_stream_grabber_context_t
                               << stream.stream_info.stream_id << ", ts: "
                               << frame_order << ", frame ts: " << frame.first.info.timestamp() << std::endl;*/
 
-                    if (m_frame_handler == nullptr
-                            || !m_frame_handler(stream.stream_info
-                                                , std::move(frame.first))
-                            )
+                    if (stream.jitter_buffer != nullptr)
                     {
-                        stream.push_data(std::move(frame.first));
-                    }
+                        stream.jitter_buffer->push(std::move(frame.first));
 
-                    if (stream.stream_info.media_info.media_type == media_type_t::video)
-                    {
-                        auto overload_frames = frame_manager.overload_frames();
-                        if (stream.is_streaming_protocol
-                                && overload_frames > 100)
+                        if (std::find(jitter_streams.begin()
+                                      , jitter_streams.end()
+                                      , frame.second) == jitter_streams.end())
                         {
-                            stream.delay_controller.reset();
+                            jitter_streams.push_back(frame.second);
                         }
+                    }
+                    else
+                    {
+                        deliver_frame(stream
+                                      , std::move(frame.first));
+                    }
 
+                    // network streams are paced by their jitter buffers, which
+                    // also bound the queued frames
+                    if (stream.jitter_buffer == nullptr
+                            && stream.stream_info.media_info.media_type == media_type_t::video)
+                    {
                         stream.delay_controller.wait_pts(frame.first.info.timestamp());
                     }
                 }
             }
             else
             {
-                std::this_thread::sleep_for(std::chrono::milliseconds(idle_timeout_ms));
+                std::this_thread::sleep_for(std::chrono::milliseconds(idle_time));
             }
         }
     }
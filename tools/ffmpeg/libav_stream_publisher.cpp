@@ -1,11 +1,22 @@
 #include "libav_stream_publisher.h"
 #include "libav_utils.h"
 
+#include "tools/base/worker_pool.h"
+
 #include <thread>
-//#include <mutex>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 #include <map>
-#include <atomic>
 #include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <numeric>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 extern "C"
 {
@@ -24,6 +35,45 @@ extern "C"
 namespace ffmpeg
 {
 
+const std::size_t shared_writer_threads = 4;
+const std::size_t shared_writer_batch = 64;
+const std::size_t max_free_buffers = 64;
+const std::size_t direct_io_alignment = 4096;
+const std::int64_t default_stream_clock = 90000;
+
+bool publisher_io_config_t::is_managed() const
+{
+    return buffer_size > 0
+            || direct_io
+            || drop_cache;
+}
+
+bool publisher_io_config_t::is_coalescing() const
+{
+    return coalesce_packets > 0
+            || flush_interval > 0;
+}
+
+publisher_config_t::publisher_config_t(bool async
+                                       , std::size_t max_packets
+                                       , std::size_t max_bytes
+                                       , publisher_overflow_policy_t overflow_policy
+                                       , bool shared_writer
+                                       , double high_watermark
+                                       , double low_watermark)
+    : async(async)
+    , max_packets(max_packets)
+    , max_bytes(max_bytes)
+    , overflow_policy(overflow_policy)
+    , shared_writer(shared_writer)
+    , high_watermark(high_watermark)
+    , low_watermark(low_watermark)
+    , interleave_delay(async ? default_publisher_interleave_delay : 0)
+    , io_config()
+{
+
+}
+
 static const char* fetch_stream_name(device_type_t device_type)
 {
     static const char* format_table[] =
@@ -40,6 +90,362 @@ static const char* fetch_stream_name(device_type_t device_type)
     return format_table[static_cast<std::int32_t>(device_type)];
 }
 
+// a path for uris without a protocol or with file://
+static bool fetch_file_path(const std::string& uri
+                            , std::string& path)
+{
+    static const std::string file_prefix = "file://";
+
+    if (uri.compare(0, file_prefix.size(), file_prefix) == 0)
+    {
+        path = uri.substr(file_prefix.size());
+        return true;
+    }
+
+    if (uri.find("://") == std::string::npos)
+    {
+        path = uri;
+        return true;
+    }
+
+    return false;
+}
+
+// owned by the thread running the muxer, the publisher copies them into
+// its stats under the lock after every muxer call
+struct publisher_io_counters_t
+{
+    std::size_t     writes = 0;
+    std::size_t     bytes = 0;
+    std::size_t     flushes = 0;
+
+    void add_write(std::size_t size)
+    {
+        writes++;
+        bytes += size;
+    }
+};
+
+// file output written with pwrite. With O_DIRECT the data is staged in an
+// aligned buffer and goes out in whole blocks; a seek of the muxer or the
+// close writes the unaligned tail and turns O_DIRECT off for the file.
+struct publisher_file_t
+{
+    publisher_io_counters_t&    counters;
+    std::int32_t                fd;
+    bool                        direct;
+    bool                        drop_cache;
+    std::uint8_t*               buffer;
+    std::size_t                 capacity;
+    std::size_t                 staged;
+    std::int64_t                position;   // file offset of the staged data
+    std::int64_t                end;
+    std::int64_t                cached;     // start of the written range still in the page cache
+
+    publisher_file_t(publisher_io_counters_t& counters
+                     , const publisher_io_config_t& io_config)
+        : counters(counters)
+        , fd(-1)
+        , direct(io_config.direct_io)
+        , drop_cache(io_config.drop_cache)
+        , buffer(nullptr)
+        , capacity(0)
+        , staged(0)
+        , position(0)
+        , end(0)
+        , cached(0)
+    {
+
+    }
+
+    ~publisher_file_t()
+    {
+        close();
+    }
+
+    bool open(const std::string& path
+              , std::size_t buffer_size)
+    {
+        auto flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+
+        if (direct)
+        {
+            fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+
+            if (fd < 0
+                    && errno == EINVAL)
+            {
+                LOG_W << "O_DIRECT is not supported for " << path << ", buffered writes are used" LOG_END;
+                direct = false;
+            }
+        }
+
+        if (!direct)
+        {
+            fd = ::open(path.c_str(), flags, 0644);
+        }
+
+        if (fd < 0)
+        {
+            LOG_E << "Can't open " << path << ": " << std::strerror(errno) LOG_END;
+            return false;
+        }
+
+        if (direct)
+        {
+            capacity = (std::max(buffer_size, direct_io_alignment) + direct_io_alignment - 1) / direct_io_alignment * direct_io_alignment;
+
+            void* memory = nullptr;
+
+            if (::posix_memalign(&memory, direct_io_alignment, capacity) != 0)
+            {
+                return false;
+            }
+
+            buffer = static_cast<std::uint8_t*>(memory);
+        }
+
+        return true;
+    }
+
+    void close()
+    {
+        if (fd >= 0)
+        {
+            write_staged();
+
+            if (drop_cache)
+            {
+                ::posix_fadvise(fd, cached, 0, POSIX_FADV_DONTNEED);
+            }
+
+            ::close(fd);
+            fd = -1;
+        }
+
+        std::free(buffer);
+        buffer = nullptr;
+    }
+
+    // starts the writeback of the new range and drops the one before it,
+    // which is mostly on the disk by now
+    void release_cache(std::int64_t offset)
+    {
+        ::sync_file_range(fd, offset, position - offset, SYNC_FILE_RANGE_WRITE);
+
+        if (offset > cached)
+        {
+            ::posix_fadvise(fd, cached, offset - cached, POSIX_FADV_DONTNEED);
+            cached = offset;
+        }
+    }
+
+    bool write_out(const std::uint8_t* data
+                   , std::size_t size)
+    {
+        auto offset = position;
+
+        while (size > 0)
+        {
+            auto result = ::pwrite(fd, data, size, position);
+
+            if (result < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+
+                LOG_E << "File write failed: " << std::strerror(errno) LOG_END;
+                return false;
+            }
+
+            counters.add_write(result);
+
+            data += result;
+            size -= result;
+            position += result;
+        }
+
+        end = std::max(end, position);
+
+        if (drop_cache)
+        {
+            release_cache(offset);
+        }
+
+        return true;
+    }
+
+    void disable_direct()
+    {
+        if (direct)
+        {
+            ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) & ~O_DIRECT);
+            direct = false;
+        }
+    }
+
+    bool write_staged()
+    {
+        if (staged == 0)
+        {
+            return true;
+        }
+
+        if (staged % direct_io_alignment != 0)
+        {
+            disable_direct();
+        }
+
+        auto size = staged;
+        staged = 0;
+
+        return write_out(buffer, size);
+    }
+
+    std::int32_t write(const std::uint8_t* data
+                       , std::int32_t size)
+    {
+        if (!direct)
+        {
+            return write_out(data, size)
+                    ? size
+                    : AVERROR(EIO);
+        }
+
+        for (std::int32_t offset = 0; offset < size; )
+        {
+            auto part = std::min<std::size_t>(capacity - staged
+                                              , size - offset);
+
+            std::memcpy(buffer + staged, data + offset, part);
+
+            staged += part;
+            offset += part;
+
+            if (staged == capacity
+                    && !write_staged())
+            {
+                return AVERROR(EIO);
+            }
+        }
+
+        return size;
+    }
+
+    std::int64_t seek(std::int64_t offset
+                      , std::int32_t whence)
+    {
+        if (whence == AVSEEK_SIZE)
+        {
+            return std::max<std::int64_t>(end, position + staged);
+        }
+
+        if (!write_staged())
+        {
+            return AVERROR(EIO);
+        }
+
+        // the muxer patches headers at unaligned offsets
+        disable_direct();
+
+        switch(whence & ~AVSEEK_FORCE)
+        {
+            case SEEK_SET:
+                position = offset;
+            break;
+            case SEEK_CUR:
+                position += offset;
+            break;
+            case SEEK_END:
+                position = end + offset;
+            break;
+            default:
+                return AVERROR(EINVAL);
+        }
+
+        return position;
+    }
+};
+
+// integer rescale from an input clock to a time base, reduced once per stream
+struct timestamp_scale_t
+{
+    std::int64_t    mul;
+    std::int64_t    div;
+
+    timestamp_scale_t(std::int64_t rate = 1
+                      , const AVRational& time_base = { 1, 1 })
+        : mul(time_base.den)
+        , div(rate * time_base.num)
+    {
+        auto divisor = std::gcd(mul, div);
+
+        if (divisor > 1)
+        {
+            mul /= divisor;
+            div /= divisor;
+        }
+    }
+
+    // rounds to the nearest like av_rescale
+    std::int64_t operator()(std::int64_t value) const
+    {
+        value *= mul;
+
+        if (div == 1)
+        {
+            return value;
+        }
+
+        return value >= 0
+                ? (value + div / 2) / div
+                : -((div / 2 - value) / div);
+    }
+};
+
+struct queued_packet_t
+{
+    publisher_packet_ptr_t  packet;
+    std::int64_t            pts;
+    std::int64_t            dts;
+    std::int64_t            order;      // dts in us, common for all streams
+    bool                    is_owned;   // a copy of a synchronous push
+};
+
+// the timeline of one stream: input pts/dts in the clock of the stream
+// (sample rate or 90 kHz) are shifted to the common origin, mapped into the
+// time base the muxer chose and kept strictly increasing in dts
+struct stream_timing_t
+{
+    std::int64_t                    rate;
+    timestamp_scale_t               scale;          // to the stream time base
+    timestamp_scale_t               order_scale;    // to us
+    std::int64_t                    offset;         // input ticks taken from pts and dts
+    std::int64_t                    last_input;     // dts, input clock
+    std::int64_t                    last_step;
+    std::int64_t                    last_dts;       // stream time base
+    std::int64_t                    last_order;     // us
+    std::deque<queued_packet_t>     queue;
+
+    stream_timing_t(std::int64_t rate
+                    , const AVRational& time_base)
+        : rate(rate)
+        , scale(rate
+                , time_base)
+        , order_scale(rate
+                      , { 1, 1000000 })
+        , offset(0)
+        , last_input(no_timestamp)
+        , last_step(0)
+        , last_dts(no_timestamp)
+        , last_order(no_timestamp)
+    {
+
+    }
+};
+
 struct libav_output_format_context_t
 {   
     struct AVFormatContext*     context;
@@ -47,34 +453,216 @@ struct libav_output_format_context_t
     bool                        is_init;
     std::string                 uri;
     device_type_t               device_type;
-    std::int64_t                audio_pts;
-    std::int64_t                video_pts;
-    std::int64_t                audio_ts;
-    std::int64_t                video_ts;
+    std::vector<stream_timing_t>    timings;
+    std::int64_t                origin;             // us, the first dts of all streams
+    std::int64_t                newest_order;       // us
+    std::int64_t                interleave_delay;   // us
+    std::size_t                 queued_packets;
+    std::size_t                 timestamp_corrections;
+    std::vector<media_data_t>   free_buffers;
+    std::string                 options;
+    publisher_io_t              io;
+    publisher_io_config_t       io_config;
+    publisher_io_counters_t     io_counters;
+    std::unique_ptr<publisher_file_t>   file;
+    AVIOContext*                target;         // unbuffered protocol output of a managed io
+    std::size_t                 unflushed_packets;
+    std::chrono::steady_clock::time_point   open_time;
+    std::chrono::steady_clock::time_point   flush_time;
 
     libav_output_format_context_t(const std::string& uri
-                                  , const stream_info_list_t& stream_list)
+                                  , const stream_info_list_t& stream_list
+                                  , const std::string& options
+                                  , const publisher_io_t* io
+                                  , const publisher_config_t& config)
         : context(nullptr)
         , is_init(false)
         , uri(uri)
         , device_type(utils::fetch_device_type(uri))
-        , audio_pts(0)
-        , video_pts(0)
-        , audio_ts(0)
-        , video_ts(0)
+        , origin(no_timestamp)
+        , newest_order(no_timestamp)
+        , interleave_delay(static_cast<std::int64_t>(config.interleave_delay) * 1000)
+        , queued_packets(0)
+        , timestamp_corrections(0)
+        , options(options)
+        , io_config(config.io_config)
+        , target(nullptr)
+        , unflushed_packets(0)
+        , open_time(std::chrono::steady_clock::now())
+        , flush_time(open_time)
     {
+        if (io != nullptr)
+        {
+            this->io = *io;
+        }
+
         is_init = init(uri
                        , stream_list);
 
 
     }
 
+    bool is_custom_io() const
+    {
+        return io.write_handler != nullptr;
+    }
+
+    bool is_seekable_io() const
+    {
+        return file != nullptr
+                || (target != nullptr && target->seekable != 0)
+                || io.seek_handler != nullptr;
+    }
+
+    // the output of a managed io, the avio buffer is the only one before the syscall
+    bool open_io()
+    {
+        std::string path;
+
+        if (fetch_file_path(uri
+                            , path))
+        {
+            file.reset(new publisher_file_t(io_counters
+                                            , io_config));
+
+            return file->open(path
+                              , io_config.buffer_size);
+        }
+
+        return avio_open2(&target
+                          , uri.c_str()
+                          , AVIO_FLAG_WRITE | AVIO_FLAG_DIRECT
+                          , nullptr
+                          , nullptr) >= 0;
+    }
+
+    void close_io()
+    {
+        file.reset();
+
+        if (target != nullptr)
+        {
+            avio_closep(&target);
+        }
+    }
+
+    std::int32_t write_io(const std::uint8_t* data
+                          , std::int32_t size)
+    {
+        if (file != nullptr)
+        {
+            return file->write(data
+                               , size);
+        }
+
+        std::int32_t result = size;
+
+        if (target != nullptr)
+        {
+            avio_write(target
+                       , data
+                       , size);
+
+            if (target->error < 0)
+            {
+                result = target->error;
+            }
+        }
+        else
+        {
+            result = io.write_handler(data
+                                      , size);
+        }
+
+        if (result > 0)
+        {
+            io_counters.add_write(result);
+        }
+
+        return result;
+    }
+
+    std::int64_t seek_io(std::int64_t offset
+                         , std::int32_t whence)
+    {
+        if (file != nullptr)
+        {
+            return file->seek(offset
+                              , whence);
+        }
+
+        if (target != nullptr)
+        {
+            return whence == AVSEEK_SIZE
+                    ? avio_size(target)
+                    : avio_seek(target
+                                , offset
+                                , whence);
+        }
+
+        return io.seek_handler(offset
+                               , whence);
+    }
+
+    static std::int32_t io_write(void* opaque
+                                 , std::uint8_t* data
+                                 , std::int32_t size)
+    {
+        return static_cast<libav_output_format_context_t*>(opaque)->write_io(data
+                                                                             , size);
+    }
+
+    static std::int64_t io_seek(void* opaque
+                                , std::int64_t offset
+                                , std::int32_t whence)
+    {
+        return static_cast<libav_output_format_context_t*>(opaque)->seek_io(offset
+                                                                            , whence);
+    }
+
+    void flush_io(const std::chrono::steady_clock::time_point& now)
+    {
+        if (context->pb != nullptr)
+        {
+            avio_flush(context->pb);
+            io_counters.flushes++;
+        }
+
+        unflushed_packets = 0;
+        flush_time = now;
+    }
+
+    // with flush_packets off the muxer writes out full buffers only
+    void coalesce_packet()
+    {
+        auto now = std::chrono::steady_clock::now();
+
+        unflushed_packets++;
+
+        if ((io_config.coalesce_packets > 0
+                && unflushed_packets >= io_config.coalesce_packets)
+                || (io_config.flush_interval > 0
+                    && now - flush_time >= std::chrono::milliseconds(io_config.flush_interval)))
+        {
+            flush_io(now);
+        }
+    }
+
+    void fetch_io_stats(publisher_stats_t& stats) const
+    {
+        stats.io_writes = io_counters.writes;
+        stats.io_bytes = io_counters.bytes;
+        stats.io_flushes = io_counters.flushes;
+        stats.timestamp_corrections = timestamp_corrections;
+    }
+
     ~libav_output_format_context_t()
     {
         if (context != nullptr)
         {
             if (is_init)
             {
+                interleave(true);
                 av_write_trailer(context);
             }
 
@@ -91,7 +679,18 @@ struct libav_output_format_context_t
                 av_freep(&context->streams[i]);
             }
 
-            if ((context->oformat->flags & AVFMT_NOFILE) == 0)
+            if ((context->flags & AVFMT_FLAG_CUSTOM_IO) != 0)
+            {
+                if (context->pb != nullptr)
+                {
+                    avio_flush(context->pb);
+                    av_freep(&context->pb->buffer);
+                    avio_context_free(&context->pb);
+                }
+
+                close_io();
+            }
+            else if ((context->oformat->flags & AVFMT_NOFILE) == 0)
             {
                 avio_close(context->pb);
             }
@@ -231,7 +830,45 @@ struct libav_output_format_context_t
     {
         av_dump_format(context, 0, uri.c_str(), 1);
 
-        if ((context->oformat->flags & AVFMT_NOFILE) == 0)
+        auto is_managed_io = !is_custom_io()
+                && io_config.is_managed()
+                && (context->oformat->flags & AVFMT_NOFILE) == 0;
+
+        if (is_managed_io
+                && !open_io())
+        {
+            close_io();
+            return false;
+        }
+
+        if (is_custom_io()
+                || is_managed_io)
+        {
+            auto buffer_size = is_custom_io()
+                    ? std::max<std::size_t>(io.buffer_size, default_publisher_io_buffer_size)
+                    : std::max<std::size_t>(io_config.buffer_size, default_publisher_io_buffer_size);
+            auto buffer = static_cast<std::uint8_t*>(av_malloc(buffer_size));
+
+            context->pb = avio_alloc_context(buffer
+                                             , buffer_size
+                                             , 1
+                                             , this
+                                             , nullptr
+                                             , &io_write
+                                             , is_seekable_io()
+                                               ? &io_seek
+                                               : nullptr);
+
+            if (context->pb == nullptr)
+            {
+                av_free(buffer);
+                close_io();
+                return false;
+            }
+
+            context->flags |= AVFMT_FLAG_CUSTOM_IO;
+        }
+        else if ((context->oformat->flags & AVFMT_NOFILE) == 0)
         {
             if (avio_open(&context->pb, uri.c_str(), AVIO_FLAG_WRITE) < 0)
             {
@@ -239,121 +876,404 @@ struct libav_output_format_context_t
             }
         }
 
-        auto res = avformat_write_header(context
-                                         , nullptr);
-
-        return res >= 0;
+        if (io_config.is_coalescing())
+        {
+            context->flush_packets = 0;
+        }
+
+        AVDictionary* av_options = nullptr;
+
+        for (const auto& o : parse_option_list(options))
+        {
+            av_dict_set(&av_options, o.first.c_str(), o.second.c_str(), 0);
+        }
+
+        auto res = avformat_write_header(context
+                                         , &av_options);
+
+        av_dict_free(&av_options);
+
+        if (res < 0)
+        {
+            return false;
+        }
+
+        // the muxer may change the time bases in write_header
+        for (const auto& s_info : streams)
+        {
+            auto rate = static_cast<std::int64_t>(s_info.media_info.sample_rate());
+
+            timings.emplace_back(rate > 0 ? rate : default_stream_clock
+                                 , context->streams[timings.size()]->time_base);
+        }
+
+        return true;
     }
 
-    bool push_frame(std::int32_t stream_id
-                    , const void* data
-                    , std::size_t size
-                    , bool key_frame
-                    , std::int64_t timestamp)
+    // ends the current fragment and hands all buffered data to the output,
+    // the next packet starts a new independently decodable part
+    bool flush()
     {
-        if (stream_id >= 0
-                && stream_id < static_cast<std::int32_t>(context->nb_streams))
+        auto result = interleave(true);
+
+        if ((context->oformat->flags & AVFMT_ALLOW_FLUSH) != 0)
         {
-            const stream_info_t& s_info = streams[stream_id];
+            av_write_frame(context
+                           , nullptr);
+        }
 
-            AVPacket av_packet = {};
+        if (std::strcmp(context->oformat->name, "mpegts") == 0)
+        {
+            av_opt_set(context->priv_data
+                       , "mpegts_flags"
+                       , "+resend_headers"
+                       , 0);
+        }
 
-            auto& av_stream = *context->streams[stream_id];
+        flush_io(std::chrono::steady_clock::now());
 
-            if (key_frame)
+        return result;
+    }
+
+    // maps pts/dts of a packet to the stream time base, returns the order
+    // of the packet among all streams in us
+    std::int64_t map_timestamps(stream_timing_t& timing
+                                , std::int64_t& pts
+                                , std::int64_t& dts)
+    {
+        if (dts == no_timestamp)
+        {
+            dts = pts;
+        }
+
+        if (pts == no_timestamp)
+        {
+            pts = dts;
+        }
+
+        if (dts == no_timestamp)
+        {
+            dts = pts = timing.last_input != no_timestamp
+                    ? timing.last_input + timing.last_step
+                    : 0;
+        }
+
+        if (timing.last_input == no_timestamp)
+        {
+            if (origin == no_timestamp)
             {
-                av_packet.flags |= AV_PKT_FLAG_KEY;
+                origin = timing.order_scale(dts);
             }
 
+            timing.offset = av_rescale(origin
+                                       , timing.rate
+                                       , 1000000);
+        }
+        else
+        {
+            auto step = dts - timing.last_input;
+
+            // a jump of the source over a second, the timeline goes on
+            // one step after the last packet
+            if (std::abs(step) > timing.rate)
+            {
+                timing.offset += step - timing.last_step;
+                timestamp_corrections++;
+            }
+            else if (step > 0)
+            {
+                timing.last_step = step;
+            }
+        }
+
+        timing.last_input = dts;
+
+        auto order = timing.order_scale(dts - timing.offset);
 
-            av_packet.stream_index = stream_id;
-            av_packet.data = const_cast<std::uint8_t*>(static_cast<const std::uint8_t*>(data));      
-            av_packet.size = size;
+        pts = timing.scale(pts - timing.offset);
+        dts = timing.scale(dts - timing.offset);
+
+        if (timing.last_dts != no_timestamp
+                && dts <= timing.last_dts)
+        {
+            dts = timing.last_dts + 1;
+            pts = std::max(pts, dts);
+            timestamp_corrections++;
+        }
 
-            switch(av_stream.codecpar->codec_type)
+        timing.last_dts = dts;
+
+        if (timing.last_order != no_timestamp)
+        {
+            order = std::max(order, timing.last_order);
+        }
+
+        timing.last_order = order;
+
+        if (newest_order == no_timestamp
+                || order > newest_order)
+        {
+            newest_order = order;
+        }
+
+        return order;
+    }
+
+    // a packet goes out when no other stream can bring an earlier one or
+    // it has waited for the interleave delay
+    bool is_ready(std::int32_t stream_id
+                  , std::int64_t order) const
+    {
+        if (interleave_delay <= 0
+                || order + interleave_delay <= newest_order)
+        {
+            return true;
+        }
+
+        for (std::int32_t i = 0; i < static_cast<std::int32_t>(timings.size()); i++)
+        {
+            const auto& timing = timings[i];
+
+            if (i != stream_id
+                    && timing.queue.empty()
+                    && (timing.last_order == no_timestamp
+                        || timing.last_order < order))
             {
-                case AVMEDIA_TYPE_AUDIO:
-                {
-                    if (audio_ts == 0)
-                    {
-                        audio_pts = 0;
-                    }
-                    else
-                    {
-                        auto dt = timestamp - audio_ts;
-                        if (std::abs(dt) > s_info.media_info.audio_info.sample_rate)
-                        {
-                            dt = 0;
-                        }
-                        audio_pts += dt;
-                    }
+                return false;
+            }
+        }
 
-                    audio_ts = timestamp;
+        return true;
+    }
 
-                    av_packet.pts = audio_pts;
+    bool write_packet(std::int32_t stream_id
+                      , const void* data
+                      , std::size_t size
+                      , bool key_frame
+                      , std::int64_t pts
+                      , std::int64_t dts)
+    {
+        AVPacket av_packet = {};
 
-                    av_packet_rescale_ts(&av_packet
-                                         , { 1, static_cast<std::int32_t>(s_info.media_info.audio_info.sample_rate) }
-                                         , av_stream.time_base);
-                }
-                break;
-                case AVMEDIA_TYPE_VIDEO:
-                {
-                    if (video_ts == 0)
-                    {
-                        video_pts = 0;
-                    }
-                    else
-                    {
-                        auto dt = timestamp - video_ts;
-                        if (std::abs(dt) > 90000)
-                        {
-                            dt = 0;
-                        }
-                        video_pts += dt;
-                    }
+        if (key_frame)
+        {
+            av_packet.flags |= AV_PKT_FLAG_KEY;
+        }
+
+        av_packet.stream_index = stream_id;
+        av_packet.data = const_cast<std::uint8_t*>(static_cast<const std::uint8_t*>(data));
+        av_packet.size = size;
+        av_packet.pts = pts;
+        av_packet.dts = dts;
+        av_packet.pos = -1;
+
+        LOG_D << "WRITE STREAM [" << stream_id << "] PACKET SIZE: " << size << ". pts = " << pts << ", dts = " << dts << ", flags = " << av_packet.flags LOG_END;
+
+        // the packets are interleaved already
+        auto ret = av_write_frame(context, &av_packet);
+
+        if (ret >= 0
+                && io_config.is_coalescing())
+        {
+            coalesce_packet();
+        }
+
+        return ret >= 0;
+    }
+
+    // writes the queued packets in dts order as far as they are ready
+    bool interleave(bool is_flush)
+    {
+        bool result = true;
 
-                    video_ts = timestamp;
-                    av_packet.pts = video_pts;
-                    av_packet_rescale_ts(&av_packet
-                                         , { 1, 90000 }
-                                         , av_stream.time_base);
+        while (queued_packets > 0)
+        {
+            stream_timing_t* next = nullptr;
+            std::int32_t next_id = no_stream;
+
+            for (std::int32_t i = 0; i < static_cast<std::int32_t>(timings.size()); i++)
+            {
+                auto& timing = timings[i];
+
+                if (!timing.queue.empty()
+                        && (next == nullptr
+                            || timing.queue.front().order < next->queue.front().order))
+                {
+                    next = &timing;
+                    next_id = i;
                 }
+            }
+
+            auto& queued = next->queue.front();
+
+            if (!is_flush
+                    && !is_ready(next_id
+                                 , queued.order))
+            {
                 break;
             }
 
-            av_packet.dts = AV_NOPTS_VALUE;
+            result &= write_packet(next_id
+                                   , queued.packet->data.data()
+                                   , queued.packet->data.size()
+                                   , queued.packet->key_frame
+                                   , queued.pts
+                                   , queued.dts);
 
-            LOG_D << "WRITE STREAM [" << stream_id << "] PACKET SIZE: " << size << ". pts = " << av_packet.pts << ", flags = " << av_packet.flags LOG_END;
+            if (queued.is_owned
+                    && queued.packet.use_count() == 1
+                    && free_buffers.size() < max_free_buffers)
+            {
+                free_buffers.emplace_back(std::move(const_cast<publisher_packet_t&>(*queued.packet).data));
+            }
 
-            auto ret = av_interleaved_write_frame(context, &av_packet);
+            next->queue.pop_front();
+            queued_packets--;
+        }
 
-            return ret >= 0;
+        return result;
+    }
+
+    // packet is null for a synchronous push, the data is copied only if
+    // the packet has to wait for the other streams
+    bool push_packet(std::int32_t stream_id
+                     , const void* data
+                     , std::size_t size
+                     , bool key_frame
+                     , std::int64_t pts
+                     , std::int64_t dts
+                     , const publisher_packet_ptr_t& packet = nullptr)
+    {
+        if (stream_id < 0
+                || stream_id >= static_cast<std::int32_t>(timings.size()))
+        {
+            return false;
         }
 
-        return false;
+        auto& timing = timings[stream_id];
+        auto order = map_timestamps(timing
+                                    , pts
+                                    , dts);
+
+        if (queued_packets == 0
+                && is_ready(stream_id
+                            , order))
+        {
+            return write_packet(stream_id
+                                , data
+                                , size
+                                , key_frame
+                                , pts
+                                , dts);
+        }
+
+        queued_packet_t queued = { packet, pts, dts, order, packet == nullptr };
+
+        if (queued.is_owned)
+        {
+            auto copy = std::make_shared<publisher_packet_t>();
+
+            if (!free_buffers.empty())
+            {
+                copy->data = std::move(free_buffers.back());
+                free_buffers.pop_back();
+            }
+
+            auto bytes = static_cast<const std::uint8_t*>(data);
+
+            copy->stream_id = stream_id;
+            copy->data.assign(bytes, bytes + size);
+            copy->key_frame = key_frame;
+
+            queued.packet = std::move(copy);
+        }
+
+        timing.queue.emplace_back(std::move(queued));
+        queued_packets++;
+
+        return interleave(false);
+    }
+
+    bool push_packet(const publisher_packet_ptr_t& packet)
+    {
+        return push_packet(packet->stream_id
+                           , packet->data.data()
+                           , packet->data.size()
+                           , packet->key_frame
+                           , packet->timestamp
+                           , packet->dts
+                           , packet);
     }
 };
 
 struct libav_stream_publisher_context_t
 {
+    using packet_queue_t = std::deque<publisher_packet_ptr_t>;
 
     std::unique_ptr<libav_output_format_context_t> m_format_context;
 
-    libav_stream_publisher_context_t()
+    publisher_config_t              m_config;
+    publisher_pressure_handler_t    m_pressure_handler;
+
+    mutable std::mutex              m_mutex;
+    std::condition_variable         m_packet_signal;
+    std::condition_variable         m_space_signal;
+    packet_queue_t                  m_queue;
+    std::vector<media_data_t>       m_free_buffers;
+    publisher_stats_t               m_stats;
+    std::chrono::steady_clock::time_point   m_open_time;
+    publisher_pressure_t            m_pressure;
+    std::thread                     m_writer_thread;
+    bool                            m_running;
+    bool                            m_draining;
+    bool                            m_wait_key_frame;
+
+    static base::worker_pool& writer_pool()
+    {
+        static base::worker_pool pool(shared_writer_threads);
+        return pool;
+    }
+
+    libav_stream_publisher_context_t(const publisher_config_t& config
+                                     , publisher_pressure_handler_t pressure_handler)
+        : m_config(config)
+        , m_pressure_handler(pressure_handler)
+        , m_open_time(std::chrono::steady_clock::now())
+        , m_pressure(publisher_pressure_t::normal)
+        , m_running(false)
+        , m_draining(false)
+        , m_wait_key_frame(false)
     {
 
     }
 
+    ~libav_stream_publisher_context_t()
+    {
+        close();
+    }
+
     bool open(const std::string& uri
-              , const stream_info_list_t& stream_list)
+              , const stream_info_list_t& stream_list
+              , const std::string& options
+              , const publisher_io_t* io)
     {
+        close();
 
         m_format_context.reset(new libav_output_format_context_t(uri
-                                                                 , stream_list));
+                                                                 , stream_list
+                                                                 , options
+                                                                 , io
+                                                                 , m_config));
 
         if (m_format_context->is_init)
         {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_open_time = std::chrono::steady_clock::now();
+            }
+
+            update_io_stats();
+            start_writer();
             return true;
         }
 
@@ -362,16 +1282,18 @@ struct libav_stream_publisher_context_t
         return false;
     }
 
-    bool close()
+    bool close(bool discard_queue = false)
     {
         if (m_format_context != nullptr)
         {
+            stop_writer(discard_queue);
             m_format_context.reset(nullptr);
             return true;
         }
 
         return false;
     }
+
     bool is_opened() const
     {
         return m_format_context != nullptr;
@@ -391,17 +1313,512 @@ struct libav_stream_publisher_context_t
         return stream_info_list_t();
     }
 
+    void start_writer()
+    {
+        if (m_config.async)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            m_running = true;
+            m_wait_key_frame = false;
+
+            if (!m_config.shared_writer)
+            {
+                m_writer_thread = std::thread(&libav_stream_publisher_context_t::writer_proc
+                                              , this);
+            }
+        }
+    }
+
+    // the queued packets are written out before the muxer is closed, a
+    // failed output drops them instead of stalling the closing thread
+    void stop_writer(bool discard_queue = false)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            m_running = false;
+
+            if (discard_queue)
+            {
+                m_stats.dropped_packets += m_queue.size();
+                m_queue.clear();
+            }
+
+            m_packet_signal.notify_all();
+            m_space_signal.notify_all();
+
+            m_space_signal.wait(lock, [&] { return !m_draining; });
+        }
+
+        if (m_writer_thread.joinable())
+        {
+            m_writer_thread.join();
+        }
+
+        if (!m_queue.empty())
+        {
+            drain(m_queue.size());
+        }
+
+        m_queue.clear();
+        m_stats.queued_packets = 0;
+        m_stats.queued_bytes = 0;
+    }
+
+    // a packet nobody else holds gives its buffer back for the next push
+    void recycle(publisher_packet_ptr_t&& packet)
+    {
+        if (packet.use_count() == 1
+                && m_free_buffers.size() < max_free_buffers)
+        {
+            m_free_buffers.emplace_back(std::move(const_cast<publisher_packet_t&>(*packet).data));
+        }
+
+        packet.reset();
+    }
+
+    publisher_packet_ptr_t create_packet(std::int32_t stream_id
+                                         , const void* data
+                                         , std::size_t size
+                                         , bool key_frame
+                                         , std::int64_t timestamp
+                                         , std::int64_t dts)
+    {
+        auto packet = std::make_shared<publisher_packet_t>();
+
+        packet->stream_id = stream_id;
+        packet->timestamp = timestamp;
+        packet->dts = dts;
+        packet->key_frame = key_frame;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            if (!m_free_buffers.empty())
+            {
+                packet->data = std::move(m_free_buffers.back());
+                m_free_buffers.pop_back();
+            }
+        }
+
+        auto bytes = static_cast<const std::uint8_t*>(data);
+        packet->data.assign(bytes, bytes + size);
+
+        return packet;
+    }
+
+    bool write_packet(publisher_packet_ptr_t& packet)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+
+        auto result = m_format_context->push_packet(packet);
+
+        std::uint64_t write_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (result)
+        {
+            m_stats.written_packets++;
+            m_stats.written_bytes += packet->data.size();
+        }
+        else
+        {
+            m_stats.write_errors++;
+        }
+
+        m_format_context->fetch_io_stats(m_stats);
+
+        m_stats.max_write_time = std::max(m_stats.max_write_time
+                                          , write_time);
+
+        recycle(std::move(packet));
+
+        return result;
+    }
+
+    bool pop_packet(publisher_packet_ptr_t& packet)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_queue.empty())
+        {
+            return false;
+        }
+
+        packet = std::move(m_queue.front());
+        m_queue.pop_front();
+
+        m_stats.queued_packets--;
+        m_stats.queued_bytes -= packet->data.size();
+
+        return true;
+    }
+
+    // writes up to max_packets, returns false when the queue is empty
+    bool drain(std::size_t max_packets)
+    {
+        publisher_packet_ptr_t packet;
+
+        for (std::size_t i = 0; i < max_packets; i++)
+        {
+            if (!pop_packet(packet))
+            {
+                return false;
+            }
+
+            write_packet(packet);
+            notify_space();
+        }
+
+        return true;
+    }
+
+    void writer_proc()
+    {
+        LOG_I << "Writer started for " << m_format_context->uri LOG_END;
+
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_packet_signal.wait(lock, [&] { return !m_running || !m_queue.empty(); });
+
+                if (!m_running)
+                {
+                    break;
+                }
+            }
+
+            drain(shared_writer_batch);
+        }
+
+        LOG_I << "Writer stopped for " << m_format_context->uri LOG_END;
+    }
+
+    void drain_task()
+    {
+        // a batch per task, so one slow output does not hold a pool thread
+        if (drain(shared_writer_batch))
+        {
+            writer_pool().post([this] { drain_task(); });
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (!m_queue.empty())
+        {
+            writer_pool().post([this] { drain_task(); });
+            return;
+        }
+
+        m_draining = false;
+        m_space_signal.notify_all();
+    }
+
+    double queue_load() const
+    {
+        return std::max(static_cast<double>(m_stats.queued_packets) / std::max<std::size_t>(m_config.max_packets, 1)
+                        , static_cast<double>(m_stats.queued_bytes) / std::max<std::size_t>(m_config.max_bytes, 1));
+    }
+
+    bool update_pressure(publisher_pressure_t& pressure)
+    {
+        auto load = queue_load();
+
+        if (m_pressure == publisher_pressure_t::normal
+                && load >= m_config.high_watermark)
+        {
+            m_pressure = publisher_pressure_t::high;
+        }
+        else if (m_pressure != publisher_pressure_t::normal
+                 && load <= m_config.low_watermark)
+        {
+            m_pressure = publisher_pressure_t::normal;
+        }
+        else
+        {
+            return false;
+        }
+
+        pressure = m_pressure;
+        return true;
+    }
+
+    void notify_pressure(publisher_pressure_t pressure)
+    {
+        if (m_pressure_handler != nullptr)
+        {
+            m_pressure_handler(pressure
+                               , stats());
+        }
+    }
+
+    void notify_space()
+    {
+        auto pressure = publisher_pressure_t::normal;
+        bool is_changed = false;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            is_changed = update_pressure(pressure);
+            m_space_signal.notify_all();
+        }
+
+        if (is_changed)
+        {
+            notify_pressure(pressure);
+        }
+    }
+
+    bool is_full(std::size_t size) const
+    {
+        return m_stats.queued_packets >= m_config.max_packets
+                || m_stats.queued_bytes + size > m_config.max_bytes;
+    }
+
+    void drop_front()
+    {
+        m_stats.queued_packets--;
+        m_stats.queued_bytes -= m_queue.front()->data.size();
+        m_stats.dropped_packets++;
+        recycle(std::move(m_queue.front()));
+        m_queue.pop_front();
+    }
+
+    // returns false if the packet is dropped. Only video restarts on a key
+    // frame, the other streams go on while video waits for one.
+    bool make_room(std::unique_lock<std::mutex>& lock
+                   , std::size_t size
+                   , bool is_video
+                   , bool key_frame)
+    {
+        if (m_wait_key_frame
+                && is_video)
+        {
+            if (!key_frame)
+            {
+                m_stats.dropped_packets++;
+                return false;
+            }
+
+            m_wait_key_frame = false;
+        }
+
+        if (!is_full(size))
+        {
+            return true;
+        }
+
+        switch(m_config.overflow_policy)
+        {
+            case publisher_overflow_policy_t::drop_oldest:
+                while (!m_queue.empty()
+                       && is_full(size))
+                {
+                    drop_front();
+                }
+            break;
+            case publisher_overflow_policy_t::drop_newest:
+                m_stats.dropped_packets++;
+                return false;
+            break;
+            case publisher_overflow_policy_t::drop_until_key:
+                while (!m_queue.empty())
+                {
+                    drop_front();
+                }
+
+                // the dropped queue may have held video
+                m_wait_key_frame = !is_video
+                        || !key_frame;
+
+                if (is_video
+                        && !key_frame)
+                {
+                    m_stats.dropped_packets++;
+                    return false;
+                }
+            break;
+            case publisher_overflow_policy_t::block:
+                m_space_signal.wait(lock, [&] { return !m_running || !is_full(size); });
+                return m_running;
+            break;
+        }
+
+        return !is_full(size);
+    }
+
+    bool push_async(const publisher_packet_ptr_t& packet)
+    {
+        auto stream_id = packet->stream_id;
+        auto size = packet->data.size();
+
+        bool is_pushed = false;
+        bool is_overflow = false;
+        bool is_changed = false;
+        auto pressure = publisher_pressure_t::normal;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            if (!m_running)
+            {
+                return false;
+            }
+
+            auto dropped = m_stats.dropped_packets;
+
+            auto is_video = stream_id >= 0
+                    && stream_id < static_cast<std::int32_t>(m_format_context->streams.size())
+                    && m_format_context->streams[stream_id].media_info.media_type == media_type_t::video;
+
+            if (make_room(lock
+                          , size
+                          , is_video
+                          , packet->key_frame))
+            {
+                m_queue.emplace_back(packet);
+                m_stats.queued_packets++;
+                m_stats.queued_bytes += size;
+
+                is_pushed = true;
+            }
+
+            is_overflow = m_stats.dropped_packets != dropped;
+            is_changed = update_pressure(pressure);
+
+            if (is_pushed)
+            {
+                if (m_config.shared_writer)
+                {
+                    if (!m_draining)
+                    {
+                        m_draining = true;
+                        writer_pool().post([this] { drain_task(); });
+                    }
+                }
+                else
+                {
+                    m_packet_signal.notify_one();
+                }
+            }
+        }
+
+        if (is_overflow)
+        {
+            notify_pressure(publisher_pressure_t::overflow);
+        }
+
+        if (is_changed)
+        {
+            notify_pressure(pressure);
+        }
+
+        return is_pushed;
+    }
+
     bool push_frame(std::int32_t stream_id
                     , const void* data
                     , std::size_t size
                     , bool key_frame
-                    , std::int64_t timestamp)
+                    , std::int64_t timestamp
+                    , std::int64_t dts)
     {
-        return m_format_context->push_frame(stream_id
+        if (m_format_context == nullptr)
+        {
+            return false;
+        }
+
+        if (m_config.async)
+        {
+            return push_async(create_packet(stream_id
                                             , data
                                             , size
                                             , key_frame
-                                            , timestamp);
+                                            , timestamp
+                                            , dts));
+        }
+
+        auto result = m_format_context->push_packet(stream_id
+                                                    , data
+                                                    , size
+                                                    , key_frame
+                                                    , timestamp
+                                                    , dts);
+        update_io_stats();
+
+        return result;
+    }
+
+    bool push_packet(const publisher_packet_ptr_t& packet)
+    {
+        if (m_format_context == nullptr
+                || packet == nullptr)
+        {
+            return false;
+        }
+
+        if (m_config.async)
+        {
+            return push_async(packet);
+        }
+
+        auto result = m_format_context->push_packet(packet);
+        update_io_stats();
+
+        return result;
+    }
+
+    bool flush()
+    {
+        // in async mode the writer owns the muxer
+        if (m_format_context == nullptr
+                || m_config.async)
+        {
+            return false;
+        }
+
+        auto result = m_format_context->flush();
+        update_io_stats();
+
+        return result;
+    }
+
+    // the io counters belong to the thread running the muxer, they are
+    // copied into the stats under the lock, so a snapshot is consistent
+    void update_io_stats()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_format_context->fetch_io_stats(m_stats);
+    }
+
+    publisher_stats_t stats() const
+    {
+        publisher_stats_t stats;
+        std::chrono::steady_clock::time_point open_time;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            stats = m_stats;
+            open_time = m_open_time;
+        }
+
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - open_time).count();
+
+        if (elapsed > 0.0)
+        {
+            stats.io_writes_per_second = stats.io_writes / elapsed;
+        }
+
+        if (stats.io_writes > 0)
+        {
+            stats.io_bytes_per_write = static_cast<double>(stats.io_bytes) / stats.io_writes;
+        }
+
+        return stats;
     }
 };
 //--------------------------------------------------------------------------
@@ -410,22 +1827,38 @@ void libav_stream_publisher_context_deleter_t::operator()(libav_stream_publisher
     delete libav_stream_publisher_context_ptr;
 }
 //--------------------------------------------------------------------------
-libav_stream_publisher::libav_stream_publisher()
- : m_libav_stream_publisher_context(new libav_stream_publisher_context_t())
+libav_stream_publisher::libav_stream_publisher(const publisher_config_t &config
+                                               , publisher_pressure_handler_t pressure_handler)
+ : m_libav_stream_publisher_context(new libav_stream_publisher_context_t(config
+                                                                         , pressure_handler))
 {
 
 }
 
 bool libav_stream_publisher::open(const std::string &uri
-                                  , const stream_info_list_t &stream_list)
+                                  , const stream_info_list_t &stream_list
+                                  , const std::string &options)
+{
+    return m_libav_stream_publisher_context->open(uri
+                                                  , stream_list
+                                                  , options
+                                                  , nullptr);
+}
+
+bool libav_stream_publisher::open(const publisher_io_t &io
+                                  , const std::string &uri
+                                  , const stream_info_list_t &stream_list
+                                  , const std::string &options)
 {
     return m_libav_stream_publisher_context->open(uri
-                                                  , stream_list);
+                                                  , stream_list
+                                                  , options
+                                                  , &io);
 }
 
-bool libav_stream_publisher::close()
+bool libav_stream_publisher::close(bool discard_queue)
 {
-    return m_libav_stream_publisher_context->close();
+    return m_libav_stream_publisher_context->close(discard_queue);
 }
 
 bool libav_stream_publisher::is_opened() const
@@ -447,13 +1880,15 @@ bool libav_stream_publisher::push_frame(int32_t stream_id
                                         , const void *data
                                         , std::size_t size
                                         , std::int64_t timestamp
-                                        , bool key_frame)
+                                        , bool key_frame
+                                        , std::int64_t dts)
 {
     return m_libav_stream_publisher_context->push_frame(stream_id
                                                         , data
                                                         , size
                                                         , key_frame
-                                                        , timestamp);
+                                                        , timestamp
+                                                        , dts);
 }
 
 bool libav_stream_publisher::push_frame(const frame_t& frame)
@@ -462,7 +1897,28 @@ bool libav_stream_publisher::push_frame(const frame_t& frame)
                                                         , frame.media_data.data()
                                                         , frame.media_data.size()
                                                         , frame.info.key_frame
-                                                        , -1);
+                                                        , frame.info.pts
+                                                        , frame.info.dts);
+}
+
+bool libav_stream_publisher::push_packet(const publisher_packet_ptr_t &packet)
+{
+    return m_libav_stream_publisher_context->push_packet(packet);
+}
+
+bool libav_stream_publisher::flush()
+{
+    return m_libav_stream_publisher_context->flush();
+}
+
+const publisher_config_t &libav_stream_publisher::config() const
+{
+    return m_libav_stream_publisher_context->m_config;
+}
+
+publisher_stats_t libav_stream_publisher::stats() const
+{
+    return m_libav_stream_publisher_context->stats();
 }
 
 }
@@ -2,6 +2,7 @@
 #define LIBAV_STREAM_PUBLISHER_H
 
 #include "libav_base.h"
+#include <limits>
 
 namespace ffmpeg
 {
@@ -11,17 +12,142 @@ struct libav_stream_publisher_context_deleter_t { void operator()(libav_stream_p
 
 typedef std::unique_ptr<libav_stream_publisher_context_t, libav_stream_publisher_context_deleter_t> libav_stream_publisher_context_ptr_t;
 
+enum class publisher_overflow_policy_t
+{
+    drop_oldest,        // the oldest queued packets make room
+    drop_newest,        // the pushed packet is rejected
+    drop_until_key,     // the queue is dropped, then everything up to the next key frame
+    block               // push waits for room
+};
+
+enum class publisher_pressure_t
+{
+    normal,             // the queue went below the low watermark
+    high,               // the queue went above the high watermark
+    overflow            // packets were dropped
+};
+
+const std::size_t default_publisher_max_packets = 500;
+const std::size_t default_publisher_max_bytes = 16 * 1024 * 1024;
+const std::uint32_t default_publisher_interleave_delay = 500;       // ms, async publishers only
+
+const std::int64_t no_timestamp = std::numeric_limits<std::int64_t>::min();
+
+// output buffering of the muxer. With a buffer size, direct_io or
+// drop_cache set the publisher writes the output itself: files with
+// pwrite, other protocols through an unbuffered avio, and counts the
+// write calls. RTSP and other muxers without a file keep their own output.
+struct publisher_io_config_t
+{
+    std::size_t     buffer_size = 0;        // AVIO buffer, 0 - libavformat default
+    std::size_t     coalesce_packets = 0;   // packets between flushes of the output, 0 - the muxer decides
+    std::uint32_t   flush_interval = 0;     // ms, a coalescing output is flushed at least this often
+    bool            direct_io = false;      // files: O_DIRECT, the last unaligned block is written on close
+    bool            drop_cache = false;     // files: the written data is dropped from the page cache
+
+    bool is_managed() const;
+    bool is_coalescing() const;
+};
+
+struct publisher_config_t
+{
+    bool                            async;          // write on a background thread
+    std::size_t                     max_packets;
+    std::size_t                     max_bytes;
+    publisher_overflow_policy_t     overflow_policy;
+    bool                            shared_writer;  // share the writer threads with other publishers
+    double                          high_watermark; // of the queue limits
+    double                          low_watermark;
+    std::uint32_t                   interleave_delay;   // ms a packet may wait for the other streams, 0 - written as pushed (the synchronous default)
+    publisher_io_config_t           io_config;
+
+    publisher_config_t(bool async = false
+                       , std::size_t max_packets = default_publisher_max_packets
+                       , std::size_t max_bytes = default_publisher_max_bytes
+                       , publisher_overflow_policy_t overflow_policy = publisher_overflow_policy_t::drop_until_key
+                       , bool shared_writer = false
+                       , double high_watermark = 0.75
+                       , double low_watermark = 0.25);
+};
+
+// taken under one lock, the io counters are as of the last packet written
+struct publisher_stats_t
+{
+    std::size_t     queued_packets = 0;
+    std::size_t     queued_bytes = 0;
+    std::size_t     written_packets = 0;
+    std::size_t     written_bytes = 0;
+    std::size_t     dropped_packets = 0;
+    std::size_t     write_errors = 0;
+    std::uint64_t   max_write_time = 0;     // us
+    std::size_t     io_writes = 0;          // write calls of a managed or custom output
+    std::size_t     io_bytes = 0;
+    std::size_t     io_flushes = 0;
+    double          io_writes_per_second = 0.0;
+    double          io_bytes_per_write = 0.0;
+    std::size_t     timestamp_corrections = 0;  // discontinuities and non increasing dts
+};
+
+const std::size_t default_publisher_io_buffer_size = 32 * 1024;
+
+// custom output of the muxer instead of avio_open of the uri, the uri still
+// selects the container. Without a seek handler the output is not seekable.
+struct publisher_io_t
+{
+    using write_handler_t = std::function<std::int32_t(const std::uint8_t* data
+                                                       , std::int32_t size)>;
+    using seek_handler_t = std::function<std::int64_t(std::int64_t offset
+                                                      , std::int32_t whence)>;
+
+    write_handler_t     write_handler;
+    seek_handler_t      seek_handler;
+    std::size_t         buffer_size = default_publisher_io_buffer_size;
+};
+
+// an encoded packet, shared by all outputs it is published to
+struct publisher_packet_t
+{
+    std::int32_t    stream_id = 0;
+    media_data_t    data;
+    std::int64_t    timestamp = 0;              // pts
+    bool            key_frame = false;
+    std::int64_t    dts = no_timestamp;         // no_timestamp - same as pts
+};
+
+using publisher_packet_ptr_t = std::shared_ptr<const publisher_packet_t>;
+
+typedef std::function<void(publisher_pressure_t pressure
+                           , const publisher_stats_t& stats)> publisher_pressure_handler_t;
+
+// Timestamps are in the clock of the stream (sample rate for audio, 90 kHz
+// for video), as the grabber and the encoder of libav_transcoder stamp
+// their frames. All streams start at the first pushed dts, pts and dts are
+// kept and each stream is rescaled with precomputed factors; packets are
+// interleaved by dts here, the muxer gets them with av_write_frame.
+//
+// In async mode push_frame copies the packet into a bounded queue and
+// returns, the muxer runs on an own writer thread or on the shared writer
+// pool. Pressure changes are reported from the pushing or the writer thread.
 class libav_stream_publisher
 {
     libav_stream_publisher_context_ptr_t m_libav_stream_publisher_context;
 
 public:
-    libav_stream_publisher();
+    libav_stream_publisher(const publisher_config_t& config = publisher_config_t()
+                           , publisher_pressure_handler_t pressure_handler = nullptr);
 
+    // options are muxer options "key=value;key=value", e.g. "movflags=+faststart"
     bool open(const std::string& uri
-              , const stream_info_list_t& stream_list);
+              , const stream_info_list_t& stream_list
+              , const std::string& options = {});
+    bool open(const publisher_io_t& io
+              , const std::string& uri
+              , const stream_info_list_t& stream_list
+              , const std::string& options = {});
 
-    bool close();
+    // discard_queue: the queued packets are dropped instead of written,
+    // for an output that already failed
+    bool close(bool discard_queue = false);
     bool is_opened() const;
     bool is_established() const;
 
@@ -31,10 +157,21 @@ public:
                     , const void* data
                     , std::size_t size
                     , std::int64_t timestamp
-                    , bool key_frame = false);
+                    , bool key_frame = false
+                    , std::int64_t dts = no_timestamp);
 
     bool push_frame(const frame_t& frame);
 
+    // async mode queues the packet itself, no copy is made
+    bool push_packet(const publisher_packet_ptr_t& packet);
+
+    // cuts a fragment (fMP4) or re-emits the headers (MPEG-TS) and writes
+    // out the buffered data, the next packet may start a new file; only in
+    // synchronous mode
+    bool flush();
+
+    const publisher_config_t& config() const;
+    publisher_stats_t stats() const;
 };
 
 }
@@ -16,6 +16,7 @@ extern "C"
 
 #include <map>
 #include <limits>
+#include <algorithm>
 
 #include <iostream>
 #include "tools/base/string_base.h"
@@ -211,6 +212,7 @@ struct libav_codec_context_t
     bool                        is_encoder;
     bool                        is_init;
     media_data_t                audio_buffer;
+    std::int32_t                frame_align;
 
     libav_codec_context_t(stream_info_t& stream_info
                           , bool is_encoder
@@ -222,6 +224,8 @@ struct libav_codec_context_t
         , frame_counter(0)
         , is_encoder(is_encoder)
         , is_init(false)
+        , frame_align(std::max(stream_info.media_info.video_info.align
+                               , default_frame_align))
     {
         is_init = init(stream_info
                        , options);
@@ -377,6 +381,12 @@ struct libav_codec_context_t
                                                , stream_info
                                                , av_frame);
 
+                    // the encoder counts the pts of the input frames itself
+                    if (is_encoder)
+                    {
+                        av_frame.pts = 0;
+                    }
+
                     LOG_I << "Transcoder #" << context_id << ". Codec " << stream_info.codec_info.to_string() << " initialized success" LOG_END;
                 }
                 else
@@ -599,6 +609,31 @@ struct libav_codec_context_t
         return frame_size > 0;
     }
 
+    // the encoder reads the planes in place, no copy into a packed buffer
+    bool set_video_view(const fragment_view_t& view)
+    {
+        if (av_context->codec_type == AVMEDIA_TYPE_VIDEO
+                && view.is_valid()
+                && view.pixel_format == av_frame.format
+                && view.size.width == av_frame.width
+                && view.size.height == av_frame.height)
+        {
+            for (std::size_t i = 0; i < max_planes; i++)
+            {
+                av_frame.data[i] = view.planes[i];
+                av_frame.linesize[i] = view.strides[i];
+            }
+
+            LOG_T << "Transcoder #" << context_id << ". Put video view " << view.size.width << "x" << view.size.height LOG_END;
+
+            av_frame.pts ++;
+
+            return true;
+        }
+
+        return false;
+    }
+
     media_data_t get_media_data()
     {
         media_data_t media_data;
@@ -609,7 +644,7 @@ struct libav_codec_context_t
                 media_data = std::move(get_audio_data());
             break;
             case AVMEDIA_TYPE_VIDEO:
-                media_data = std::move(get_video_data());
+                media_data = std::move(get_video_data(frame_align));
             break;
         }
 
@@ -627,7 +662,8 @@ struct libav_codec_context_t
             break;
             case AVMEDIA_TYPE_VIDEO:
                 return set_video_data(data
-                                      , size);
+                                      , size
+                                      , frame_align);
             break;
             default:
                 av_frame.data[0] = const_cast<std::uint8_t*>(static_cast<const std::uint8_t*>(data));
@@ -667,13 +703,25 @@ struct libav_codec_context_t
                     av_frame.format = AV_PIX_FMT_YUV420P;
                 }
                 frame.info.media_info.video_info.pixel_format = av_frame.format;
+                frame.info.media_info.video_info.align = is_encoder
+                        ? default_frame_align
+                        : frame_align;
 
             }
 
             if (is_encoder)
             {
-                frame.info.pts = av_packet.pts;
-                frame.info.dts = av_packet.dts;
+                // the packets are in the codec time base (1/fps for video),
+                // the frames carry the clock of the stream like the grabber
+                // frames: the sample rate or 90 kHz
+                const AVRational stream_clock = { 1, static_cast<std::int32_t>(frame.info.media_info.sample_rate()) };
+
+                frame.info.pts = av_packet.pts != AV_NOPTS_VALUE
+                        ? av_rescale_q(av_packet.pts, av_context->time_base, stream_clock)
+                        : AV_NOPTS_VALUE;
+                frame.info.dts = av_packet.dts != AV_NOPTS_VALUE
+                        ? av_rescale_q(av_packet.dts, av_context->time_base, stream_clock)
+                        : AV_NOPTS_VALUE;
                 frame.info.codec_id = av_context->codec_id;
                 frame.info.key_frame = (av_packet.flags & AV_PKT_FLAG_KEY) != 0;
                 frame.media_data = media_data_t(av_packet.data
@@ -769,82 +817,99 @@ struct libav_codec_context_t
                 , frame_queue_t& encoded_frames
                 , bool is_key_frame
                 , std::int64_t timestamp)
+    {
+        return set_media_data(data
+                              , size)
+                && encode_frame(encoded_frames
+                                , is_key_frame
+                                , timestamp);
+    }
+
+    bool encode(const fragment_view_t& view
+                , frame_queue_t& encoded_frames
+                , bool is_key_frame
+                , std::int64_t timestamp)
+    {
+        return set_video_view(view)
+                && encode_frame(encoded_frames
+                                , is_key_frame
+                                , timestamp);
+    }
+
+    bool encode_frame(frame_queue_t& encoded_frames
+                      , bool is_key_frame
+                      , std::int64_t timestamp)
     {
         std::int32_t result = -1;
 
-        if (set_media_data(data
-                           , size))
-        {
-            av_frame.key_frame = static_cast<std::int32_t>(is_key_frame);
+        av_frame.key_frame = static_cast<std::int32_t>(is_key_frame);
 
-            av_frame.pict_type = is_key_frame
-                    ? AV_PICTURE_TYPE_I
-                    : AV_PICTURE_TYPE_NONE;
+        av_frame.pict_type = is_key_frame
+                ? AV_PICTURE_TYPE_I
+                : AV_PICTURE_TYPE_NONE;
 
-            av_frame.extended_data = av_frame.data;
+        av_frame.extended_data = av_frame.data;
 
-            if (timestamp != 0)
-            {
-                av_frame.pkt_dts = AV_NOPTS_VALUE;
-                av_frame.pkt_pts = timestamp;
-            }
+        if (timestamp != 0)
+        {
+            av_frame.pkt_dts = AV_NOPTS_VALUE;
+            av_frame.pkt_pts = timestamp;
+        }
 
-            result = avcodec_send_frame(av_context, &av_frame);
+        result = avcodec_send_frame(av_context, &av_frame);
 
-            bool is_push_picture = false;
+        bool is_push_picture = false;
 
-            if (result >= 0)
+        if (result >= 0)
+        {
+            while (result >= 0)
             {
-                while (result >= 0)
+                result = avcodec_receive_packet(av_context, &av_packet);
+
+                if (result >= 0)
                 {
-                    result = avcodec_receive_packet(av_context, &av_packet);
+                    frame_t encoded_frame;
 
-                    if (result >= 0)
+                    if (fill_frame_info(encoded_frame
+                                        , true))
                     {
-                        frame_t encoded_frame;
+                        is_push_picture = true;
+                        frame_counter++;
 
-                        if (fill_frame_info(encoded_frame
-                                            , true))
-                        {
-                            is_push_picture = true;
-                            frame_counter++;
-
-                            /*
-                            if (av_context->codec_type == AVMEDIA_TYPE_VIDEO)
-                            {
-
-                                std::cout << "Encoder Video frame #" << frame_counter
-                                          << ", size: " << encoded_frame.media_data.size()
-                                          << ", data: " << base::hex_dump(encoded_frame.media_data.data()
-                                                                          , encoded_frame.media_data.size())
-                                          << std::endl;
-                            }*/
-
-                            encoded_frames.push(std::move(encoded_frame));
-                        }
-                        else
+                        /*
+                        if (av_context->codec_type == AVMEDIA_TYPE_VIDEO)
                         {
-                            LOG_W << "Transcoder #" << context_id << " encode null size frame" LOG_END;
-                        }
-                    }
-                    else if (result != AVERROR(EAGAIN)
-                              && result != AVERROR_EOF)
-                    {
-                        LOG_E << "Transcoder #" << context_id << ". Error call avcodec_receive_frame, err = " << result LOG_END;
+
+                            std::cout << "Encoder Video frame #" << frame_counter
+                                      << ", size: " << encoded_frame.media_data.size()
+                                      << ", data: " << base::hex_dump(encoded_frame.media_data.data()
+                                                                      , encoded_frame.media_data.size())
+                                      << std::endl;
+                        }*/
+
+                        encoded_frames.push(std::move(encoded_frame));
                     }
                     else
                     {
-                        return is_push_picture;
+                        LOG_W << "Transcoder #" << context_id << " encode null size frame" LOG_END;
                     }
                 }
-
-            }
-            else
-            {
-                LOG_E << "Transcoder #" << context_id << ". Error avcodec_send_packet, err = " << result LOG_END;
+                else if (result != AVERROR(EAGAIN)
+                          && result != AVERROR_EOF)
+                {
+                    LOG_E << "Transcoder #" << context_id << ". Error call avcodec_receive_frame, err = " << result LOG_END;
+                }
+                else
+                {
+                    return is_push_picture;
+                }
             }
 
         }
+        else
+        {
+            LOG_E << "Transcoder #" << context_id << ". Error avcodec_send_packet, err = " << result LOG_END;
+        }
 
         return false;
     }
@@ -938,6 +1003,23 @@ struct libav_transcoder_context_t
 
         return false;
     }
+
+    bool transcode(const fragment_view_t& view
+                   , frame_queue_t& frame_queue
+                   , transcode_flag_t transcode_flags
+                   , std::int64_t timestamp)
+    {
+        if (m_codec_context != nullptr
+                && m_transcoder_type == transcoder_type_t::encoder)
+        {
+            return m_codec_context->encode(view
+                                           , frame_queue
+                                           , transcode_flags & transcode_flag_t::key_frame
+                                           , timestamp);
+        }
+
+        return false;
+    }
 };
 //------------------------------------------------------------------------------
 void libav_transcoder_context_deleter_t::operator()(libav_transcoder_context_t *libav_transcoder_context_ptr)
@@ -1015,4 +1097,17 @@ bool libav_transcoder::transcode(const void *data
                                            , timestamp);
 }
 
+bool libav_transcoder::transcode(const fragment_view_t &view
+                                 , frame_queue_t &frame_queue
+                                 , transcode_flag_t transcode_flags
+                                 , std::int64_t timestamp)
+{
+    LOG_D << "Transcode frame view " << view.size.width << "x" << view.size.height LOG_END;
+
+    return m_transcoder_context->transcode(view
+                                           , frame_queue
+                                           , transcode_flags
+                                           , timestamp);
+}
+
 }
@@ -41,6 +41,8 @@ public:
 
     const stream_info_t& config() const;
 
+    // encoded frames are stamped in the clock of the stream, the sample
+    // rate for audio and 90 kHz for video
     frame_queue_t transcode(const void* data
                             , std::size_t size
                             , transcode_flag_t transcode_flags = transcode_flag_t::none
@@ -52,6 +54,11 @@ public:
                    , transcode_flag_t transcode_flags = transcode_flag_t::none
                    , std::int64_t timestamp = -1);
 
+    // encoder only: the view planes are passed to the codec without copying
+    bool transcode(const fragment_view_t& view
+                   , frame_queue_t& frame_queue
+                   , transcode_flag_t transcode_flags = transcode_flag_t::none
+                   , std::int64_t timestamp = -1);
 
 };
 
@@ -1,6 +1,1462 @@
 #include "test.h"
+#include "libav_audio_analyzer.h"
+#include "libav_audio_mixer.h"
+#include "libav_converter.h"
+#include "libav_fast_converter.h"
+#include "libav_jitter_buffer.h"
+#include "libav_resampler.h"
+#include "libav_scaling_cache.h"
+#include "libav_segment_recorder.h"
+#include "libav_stream_publisher.h"
+#include "libav_transcoder.h"
 
-void ffmpeg::test()
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <unistd.h>
+
+namespace ffmpeg
+{
+
+static bool check(bool result
+                  , const std::string& name)
+{
+    if (!result)
+    {
+        std::cout << name << " failed" << std::endl;
+    }
+
+    return result;
+}
+
+// Plans of one key are reused after release and never shared while
+// acquired, the least recently released plan is evicted first and every
+// acquire counts as a hit or a miss. The shared cache is left empty.
+void test_scaling_cache()
+{
+    auto& cache = libav_scaling_cache::instance();
+    auto capacity = cache.capacity();
+
+    const scaling_plan_key_t key_a({ 321, 241 }, pixel_format_yuv420p, { 321, 241 }, pixel_format_bgr24);
+    const scaling_plan_key_t key_b({ 321, 241 }, pixel_format_yuv420p, { 160, 120 }, pixel_format_bgr24);
+    const scaling_plan_key_t key_c({ 639, 479 }, pixel_format_bgr24, { 639, 479 }, pixel_format_yuv420p);
+
+    cache.clear();
+    cache.reset_stats();
+    cache.set_capacity(2);
+
+    auto plan_a = cache.acquire(key_a);
+    auto plan_a2 = cache.acquire(key_a);
+    check(plan_a != nullptr
+          && plan_a2 != nullptr
+          && plan_a != plan_a2, "scaling cache: exclusive plans");
+    cache.release(key_a, plan_a2);
+
+    auto stats = cache.stats();
+    check(stats.misses == 2
+          && stats.hits == 0
+          && stats.active_plans == 1
+          && stats.idle_plans == 1, "scaling cache: stats after release");
+
+    check(cache.acquire(key_a) == plan_a2, "scaling cache: reuse of a released plan");
+    cache.release(key_a, plan_a2);
+    cache.release(key_a, plan_a);
+
+    // a, a, then b and c push both plans of a out, the oldest first
+    auto plan_b = cache.acquire(key_b);
+    auto plan_c = cache.acquire(key_c);
+    cache.release(key_b, plan_b);
+    cache.release(key_c, plan_c);
+
+    stats = cache.stats();
+    check(stats.evictions == 2
+          && stats.idle_plans == 2
+          && stats.active_plans == 0, "scaling cache: eviction at capacity");
+
+    check(cache.acquire(key_b) == plan_b, "scaling cache: plan b kept");
+    check(cache.acquire(key_c) == plan_c, "scaling cache: plan c kept");
+    cache.release(key_b, plan_b);
+    cache.release(key_c, plan_c);
+
+    plan_a = cache.acquire(key_a);
+    cache.release(key_a, plan_a);
+
+    stats = cache.stats();
+    check(stats.hits == 3
+          && stats.misses == 5
+          && stats.evictions == 3
+          && stats.idle_plans == 2, "scaling cache: counters "
+          + std::to_string(stats.hits) + "/" + std::to_string(stats.misses) + "/" + std::to_string(stats.evictions));
+
+    cache.set_capacity(capacity);
+    cache.clear();
+    cache.reset_stats();
+}
+
+double benchmark_conversion(pixel_format_t input_pixel_format
+                            , pixel_format_t output_pixel_format
+                            , const frame_size_t& frame_size
+                            , std::size_t iterations
+                            , std::int32_t align = default_frame_align)
+{
+    fragment_info_t input_fragment_info(frame_size
+                                        , input_pixel_format
+                                        , align);
+    fragment_info_t output_fragment_info(frame_size
+                                         , output_pixel_format
+                                         , align);
+
+    media_data_t input_frame(input_fragment_info.get_frame_size(), 0x80);
+    media_data_t output_frame(output_fragment_info.get_frame_size());
+
+    libav_converter converter;
+
+    // warm up: scaling plans and page faults
+    converter.convert_frames(input_fragment_info
+                             , input_frame.data()
+                             , output_fragment_info
+                             , output_frame.data());
+
+    auto t0 = std::chrono::steady_clock::now();
+
+    for (std::size_t i = 0; i < iterations; i++)
+    {
+        converter.convert_frames(input_fragment_info
+                                 , input_frame.data()
+                                 , output_fragment_info
+                                 , output_frame.data());
+    }
+
+    auto t1 = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::milli>(t1 - t0).count() / iterations;
+}
+
+// the banded conversion must write the same bytes as the single pass
+bool check_banded_conversion(pixel_format_t input_pixel_format
+                             , pixel_format_t output_pixel_format
+                             , const frame_size_t& frame_size)
+{
+    fragment_info_t input_fragment_info(frame_size
+                                        , input_pixel_format);
+    fragment_info_t output_fragment_info(frame_size
+                                         , output_pixel_format);
+
+    media_data_t input_frame(input_fragment_info.get_frame_size());
+    for (std::size_t i = 0; i < input_frame.size(); i++)
+    {
+        input_frame[i] = static_cast<std::uint8_t>((i * 7919) >> 3);
+    }
+
+    media_data_t single_frame(output_fragment_info.get_frame_size());
+    media_data_t banded_frame(output_fragment_info.get_frame_size());
+
+    libav_converter single_converter(default_scaling_method
+                                     , default_frame_align
+                                     , 1);
+    libav_converter banded_converter(default_scaling_method
+                                     , default_frame_align
+                                     , 4);
+
+    return single_converter.convert_frames(input_fragment_info
+                                           , input_frame.data()
+                                           , output_fragment_info
+                                           , single_frame.data()) > 0
+            && banded_converter.convert_frames(input_fragment_info
+                                               , input_frame.data()
+                                               , output_fragment_info
+                                               , banded_frame.data()) > 0
+            && single_frame == banded_frame;
+}
+
+void test_banded_conversion()
+{
+    // odd sizes: the last band is shorter and the rows are not vector aligned
+    const frame_size_t frame_sizes[] = { { 1918, 722 }, { 637, 479 } };
+
+    const std::pair<pixel_format_t, pixel_format_t> pairs[] =
+    {
+        { pixel_format_yuv420p, pixel_format_bgr24 },
+        { pixel_format_bgr24, pixel_format_yuv420p },
+        { pixel_format_nv12, pixel_format_yuv420p },
+        { pixel_format_yuv420p, pixel_format_nv12 },
+        { pixel_format_yuv422p, pixel_format_yuyv422 },
+        { pixel_format_bgr24, pixel_format_bgra },
+        { pixel_format_bgr24, pixel_format_bgr16 },
+    };
+
+    for (auto fast : { false, true })
+    {
+        libav_fast_converter::set_enabled(fast);
+
+        for (const auto& frame_size : frame_sizes)
+        {
+            for (const auto& p : pairs)
+            {
+                if (!check_banded_conversion(p.first, p.second, frame_size))
+                {
+                    std::cout << "banded conversion " << p.first << " -> " << p.second
+                              << " " << frame_size.width << "x" << frame_size.height
+                              << (fast ? " (fast)" : "") << ": mismatch" << std::endl;
+                }
+            }
+        }
+    }
+
+    libav_fast_converter::set_enabled(true);
+}
+
+static media_data_t convert_frame(pixel_format_t input_pixel_format
+                                  , pixel_format_t output_pixel_format
+                                  , const frame_size_t& frame_size
+                                  , const media_data_t& input_frame)
+{
+    fragment_info_t input_fragment_info(frame_size
+                                        , input_pixel_format);
+    fragment_info_t output_fragment_info(frame_size
+                                         , output_pixel_format);
+
+    media_data_t output_frame(output_fragment_info.get_frame_size());
+
+    libav_converter converter(default_scaling_method
+                              , default_frame_align
+                              , 1);
+
+    if (converter.convert_frames(input_fragment_info
+                                 , input_frame.data()
+                                 , output_fragment_info
+                                 , output_frame.data()) <= 0)
+    {
+        output_frame.clear();
+    }
+
+    return output_frame;
+}
+
+static std::int32_t max_difference(const media_data_t& left
+                                   , const media_data_t& right)
+{
+    if (left.size() != right.size()
+            || left.empty())
+    {
+        return 256;
+    }
+
+    std::int32_t difference = 0;
+    for (std::size_t i = 0; i < left.size(); i++)
+    {
+        difference = std::max(difference, std::abs(left[i] - right[i]));
+    }
+
+    return difference;
+}
+
+// The fast paths against swscale within the tolerances of the header, on
+// even sizes: swscale leaves its unscaled converters for odd heights. The
+// vector kernels against the scalar ones on odd sizes, rows of any tail.
+void test_fast_converter()
+{
+    struct pair_t
+    {
+        pixel_format_t  input_pixel_format;
+        pixel_format_t  output_pixel_format;
+        std::int32_t    tolerance;
+    };
+
+    const pair_t pairs[] =
+    {
+        { pixel_format_nv12, pixel_format_yuv420p, 0 },
+        { pixel_format_yuv420p, pixel_format_bgr24, 3 },
+        { pixel_format_yuv420p, pixel_format_bgra, 3 },
+        { pixel_format_bgra, pixel_format_bgr24, 0 },
+        { pixel_format_yuyv422, pixel_format_yuv420p, 1 },
+    };
+
+    const frame_size_t swscale_sizes[] = { { 642, 362 }, { 98, 34 } };
+    const frame_size_t odd_sizes[] = { { 1, 1 }, { 3, 3 }, { 17, 5 }, { 33, 7 }, { 71, 3 }, { 641, 361 } };
+    const simd_level_t simd_levels[] = { simd_level_t::sse41, simd_level_t::avx2 };
+
+    auto detected_simd_level = libav_fast_converter::simd_level();
+
+    auto make_input = [](const pair_t& pair
+                         , const frame_size_t& frame_size)
+    {
+        media_data_t input_frame(fragment_info_t(frame_size
+                                                 , pair.input_pixel_format).get_frame_size());
+
+        // luma of the YUV inputs in [16, 235], the range the tolerance covers
+        auto yuv = pair.input_pixel_format != pixel_format_bgra;
+        for (std::size_t i = 0; i < input_frame.size(); i++)
+        {
+            auto value = (i * 7919 + (i >> 7) * 104729) >> 2;
+            input_frame[i] = yuv
+                    ? static_cast<std::uint8_t>(16 + value % 220)
+                    : static_cast<std::uint8_t>(value);
+        }
+
+        return input_frame;
+    };
+
+    for (const auto& pair : pairs)
+    {
+        auto name = std::string(video_info_t::format_name(pair.input_pixel_format))
+                + " -> " + video_info_t::format_name(pair.output_pixel_format);
+
+        for (const auto& frame_size : swscale_sizes)
+        {
+            auto input_frame = make_input(pair, frame_size);
+
+            libav_fast_converter::set_enabled(false);
+            auto swscale_frame = convert_frame(pair.input_pixel_format, pair.output_pixel_format, frame_size, input_frame);
+
+            libav_fast_converter::set_enabled(true);
+            auto fast_frame = convert_frame(pair.input_pixel_format, pair.output_pixel_format, frame_size, input_frame);
+
+            auto difference = max_difference(fast_frame, swscale_frame);
+            check(difference <= pair.tolerance
+                  , "fast converter " + name + " " + std::to_string(frame_size.width) + "x" + std::to_string(frame_size.height)
+                    + " against swscale, difference " + std::to_string(difference));
+        }
+
+        for (const auto& frame_size : odd_sizes)
+        {
+            auto input_frame = make_input(pair, frame_size);
+
+            libav_fast_converter::set_simd_level(simd_level_t::none);
+            auto scalar_frame = convert_frame(pair.input_pixel_format, pair.output_pixel_format, frame_size, input_frame);
+
+            for (auto simd_level : simd_levels)
+            {
+                libav_fast_converter::set_simd_level(simd_level);
+                if (libav_fast_converter::simd_level() != simd_level)
+                {
+                    continue;
+                }
+
+                auto simd_frame = convert_frame(pair.input_pixel_format, pair.output_pixel_format, frame_size, input_frame);
+                check(!scalar_frame.empty()
+                      && simd_frame == scalar_frame
+                      , "fast converter " + name + " " + std::to_string(frame_size.width) + "x" + std::to_string(frame_size.height)
+                        + " simd level " + std::to_string(static_cast<std::int32_t>(simd_level)) + " against scalar");
+            }
+        }
+    }
+
+    libav_fast_converter::set_simd_level(detected_simd_level);
+}
+
+void benchmark_fast_converter()
+{
+    const frame_size_t frame_size = { 1920, 1080 };
+    const std::size_t iterations = 200;
+
+    const std::pair<pixel_format_t, pixel_format_t> pairs[] =
+    {
+        { pixel_format_nv12, pixel_format_yuv420p },
+        { pixel_format_yuv420p, pixel_format_bgr24 },
+        { pixel_format_yuv420p, pixel_format_bgra },
+        { pixel_format_bgra, pixel_format_bgr24 },
+        { pixel_format_yuyv422, pixel_format_yuv420p }
+    };
+
+    std::cout << "simd level: " << static_cast<std::int32_t>(libav_fast_converter::simd_level()) << std::endl;
+
+    for (const auto& p : pairs)
+    {
+        libav_fast_converter::set_enabled(false);
+        auto swscale_ms = benchmark_conversion(p.first, p.second, frame_size, iterations);
+
+        libav_fast_converter::set_enabled(true);
+        auto native_ms = benchmark_conversion(p.first, p.second, frame_size, iterations);
+
+        std::cout << video_info_t::format_name(p.first)
+                  << " -> " << video_info_t::format_name(p.second)
+                  << ": swscale " << swscale_ms << " ms"
+                  << ", native " << native_ms << " ms"
+                  << ", x" << swscale_ms / native_ms
+                  << std::endl;
+    }
+}
+
+double benchmark_encoding(const frame_size_t& frame_size
+                          , std::size_t iterations
+                          , std::int32_t align = default_frame_align)
+{
+    stream_info_t stream_info(0
+                              , codec_info_t(codec_id_h264)
+                              , media_info_t(video_info_t(frame_size
+                                                          , 30
+                                                          , pixel_format_yuv420p
+                                                          , align)));
+
+    libav_transcoder encoder;
+
+    if (!encoder.open(stream_info
+                      , transcoder_type_t::encoder))
+    {
+        return 0.0;
+    }
+
+    media_data_t frame(stream_info.media_info.video_info.frame_size(), 0x80);
+    frame_queue_t frame_queue;
+
+    auto t0 = std::chrono::steady_clock::now();
+
+    for (std::size_t i = 0; i < iterations; i++)
+    {
+        encoder.transcode(frame.data()
+                          , frame.size()
+                          , frame_queue);
+    }
+
+    auto t1 = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::milli>(t1 - t0).count() / iterations;
+}
+
+void benchmark_frame_align()
+{
+    // a width that is not a multiple of the vector size in any plane
+    const frame_size_t frame_size = { 1910, 1080 };
+    const std::size_t iterations = 200;
+
+    libav_fast_converter::set_enabled(false);
+
+    for (auto align : { default_frame_align, simd_frame_align })
+    {
+        std::cout << "align " << align
+                  << ": yuv420p -> bgra " << benchmark_conversion(pixel_format_yuv420p, pixel_format_bgra, frame_size, iterations, align) << " ms"
+                  << ", bgr24 -> yuv420p " << benchmark_conversion(pixel_format_bgr24, pixel_format_yuv420p, frame_size, iterations, align) << " ms"
+                  << ", h264 encode " << benchmark_encoding(frame_size, iterations / 4, align) << " ms"
+                  << std::endl;
+    }
+
+    libav_fast_converter::set_enabled(true);
+}
+
+// a 1 kHz tone of 16-bit samples, the channels interleaved
+static media_data_t make_tone(const audio_info_t& audio_info
+                              , std::size_t samples
+                              , double amplitude)
+{
+    const double pi = 3.14159265358979323846;
+
+    media_data_t frame(audio_info.sample_size() * samples);
+    auto data = reinterpret_cast<std::int16_t*>(frame.data());
+
+    for (std::size_t i = 0; i < samples; i++)
+    {
+        auto value = static_cast<std::int16_t>(amplitude * 32767.0 * std::sin(2.0 * pi * 1000.0 * i / audio_info.sample_rate));
+        for (std::uint32_t c = 0; c < audio_info.channels; c++)
+        {
+            data[i * audio_info.channels + c] = value;
+        }
+    }
+
+    return frame;
+}
+
+// pushes the frame in 10 ms chunks and drains the delay, returns the output
+// samples of every chunk and of the flush
+static std::vector<std::size_t> resample_stream(libav_resampler& resampler
+                                                , const media_data_t& input_frame
+                                                , media_data_t& output_frame)
+{
+    const auto& input_format = resampler.input_format();
+    const auto& output_format = resampler.output_format();
+    auto chunk_size = input_format.sample_size() * input_format.sample_rate / 100;
+
+    std::vector<std::size_t> output_samples;
+    media_data_t chunk;
+    output_frame.clear();
+
+    for (std::size_t offset = 0; offset < input_frame.size(); offset += chunk_size)
+    {
+        resampler.resample(input_frame.data() + offset
+                           , std::min(chunk_size, input_frame.size() - offset)
+                           , chunk);
+        output_samples.push_back(chunk.size() / output_format.sample_size());
+        output_frame.insert(output_frame.end(), chunk.begin(), chunk.end());
+    }
+
+    resampler.flush(chunk);
+    output_samples.push_back(chunk.size() / output_format.sample_size());
+    output_frame.insert(output_frame.end(), chunk.begin(), chunk.end());
+
+    return output_samples;
+}
+
+// Streaming 48 -> 44.1 kHz: the flush drains the filter delay, so the total
+// output matches the rate ratio. Planar output into a larger buffer is packed
+// plane after plane. A compensation adds its delta to the output samples.
+void test_resampler()
+{
+    const audio_info_t input_format(48000, 2, sample_format_pcm16);
+    const audio_info_t output_format(44100, 2, sample_format_pcm16);
+    const std::size_t input_samples = 48000;
+    const auto expected_samples = input_samples * output_format.sample_rate / input_format.sample_rate;
+
+    auto input_frame = make_tone(input_format, input_samples, 0.5);
+    media_data_t output_frame;
+
+    libav_resampler resampler;
+    if (!check(resampler.open(input_format, output_format), "resampler: open"))
+    {
+        return;
+    }
+
+    auto output_samples = resample_stream(resampler, input_frame, output_frame);
+    std::size_t total_samples = 0;
+    for (auto samples : output_samples)
+    {
+        total_samples += samples;
+    }
+
+    check(output_samples.back() > 0
+          && resampler.delay() <= 1, "resampler: flush drains the delay");
+    check(std::abs(static_cast<std::int64_t>(total_samples) - static_cast<std::int64_t>(expected_samples)) <= 2
+          , "resampler: " + std::to_string(total_samples) + " samples out of " + std::to_string(expected_samples));
+
+    // drift compensation of 100 samples over the first 4410 output samples
+    libav_resampler compensated;
+    compensated.open(input_format, output_format);
+    check(compensated.set_compensation(100, 4410), "resampler: set_compensation");
+
+    media_data_t compensated_frame;
+    std::size_t compensated_samples = 0;
+    for (auto samples : resample_stream(compensated, input_frame, compensated_frame))
+    {
+        compensated_samples += samples;
+    }
+
+    check(std::abs(static_cast<std::int64_t>(compensated_samples) - static_cast<std::int64_t>(total_samples + 100)) <= 3
+          , "resampler: compensation, " + std::to_string(compensated_samples) + " samples out of " + std::to_string(total_samples + 100));
+
+    // DC channels to planar float through a buffer twice the bound: the
+    // second plane must follow the written samples, not the buffer size
+    const audio_info_t planar_format(44100, 2, sample_format_float32p);
+    media_data_t dc_frame(input_format.sample_size() * input_format.sample_rate / 100);
+    auto dc = reinterpret_cast<std::int16_t*>(dc_frame.data());
+    for (std::size_t i = 0; i < dc_frame.size() / input_format.sample_size(); i++)
+    {
+        dc[i * 2] = 8192;
+        dc[i * 2 + 1] = -16384;
+    }
+
+    libav_resampler planar;
+    planar.open(input_format, planar_format);
+
+    std::vector<std::uint8_t> planar_frame;
+    std::size_t planar_size = 0;
+    for (std::size_t i = 0; i < 4; i++)
+    {
+        planar_frame.assign(planar.output_size(dc_frame.size()) * 2, 0);
+        planar_size = planar.resample(dc_frame.data()
+                                      , dc_frame.size()
+                                      , planar_frame.data()
+                                      , planar_frame.size());
+    }
+
+    // the fourth chunk is past the filter startup, both planes are flat
+    auto samples = planar_size / planar_format.sample_size();
+    auto planes = reinterpret_cast<const float*>(planar_frame.data());
+    auto flat = samples > 0;
+    for (std::size_t i = 0; i < samples; i++)
+    {
+        flat &= std::abs(planes[i] - 0.25f) < 0.01f
+                && std::abs(planes[samples + i] + 0.5f) < 0.01f;
+    }
+
+    check(flat, "resampler: planar output packed plane after plane");
+}
+
+// Known DC and tone inputs in the mix format, the resampler only copies
+// them: the mix is the sum with the gains, a mix-minus output lacks its own
+// input, and an appended input running past max_delay keeps the samples
+// already buffered. The pcm16 output saturates.
+void test_audio_mixer()
+{
+    const double pi = 3.14159265358979323846;
+    const audio_info_t format(48000, 1, sample_format_float32);
+
+    libav_audio_mixer mixer(format, 20, 100);
+    auto frame_samples = mixer.frame_samples();
+
+    auto make_frame = [&](float dc
+                          , float amplitude)
+    {
+        media_data_t frame(frame_samples * sizeof(float));
+        auto samples = reinterpret_cast<float*>(frame.data());
+        for (std::size_t i = 0; i < frame_samples; i++)
+        {
+            samples[i] = dc + amplitude * static_cast<float>(std::sin(2.0 * pi * 1000.0 * i / format.sample_rate));
+        }
+
+        return frame;
+    };
+
+    auto max_error = [&](const media_data_t& frame
+                         , float dc
+                         , float amplitude)
+    {
+        auto expected = make_frame(dc, amplitude);
+        if (frame.size() != expected.size())
+        {
+            return 1.0f;
+        }
+
+        auto samples = reinterpret_cast<const float*>(frame.data());
+        auto expected_samples = reinterpret_cast<const float*>(expected.data());
+        float error = 0.0f;
+        for (std::size_t i = 0; i < frame_samples; i++)
+        {
+            error = std::max(error, std::abs(samples[i] - expected_samples[i]));
+        }
+
+        return error;
+    };
+
+    const float tolerance = 1e-5f;
+    const auto dc_a = make_frame(0.25f, 0.0f);
+    const auto dc_b = make_frame(0.125f, 0.0f);
+    const auto tone = make_frame(0.0f, 0.2f);
+
+    check(mixer.add_input(1, format, 1.0f)
+          && mixer.add_input(2, format, 2.0f)
+          && mixer.add_input(3, format, 0.5f), "audio mixer: add inputs");
+
+    media_data_t mix_data;
+    mix_minus_list_t mix_minus;
+
+    mixer.push(1, dc_a.data(), dc_a.size());
+    mixer.push(2, dc_b.data(), dc_b.size());
+    mixer.push(3, tone.data(), tone.size());
+    check(mixer.mix(mix_data, &mix_minus), "audio mixer: mix");
+
+    check(max_error(mix_data, 0.5f, 0.1f) < tolerance, "audio mixer: sum with gains");
+    check(max_error(mix_minus[1], 0.25f, 0.1f) < tolerance
+          && max_error(mix_minus[2], 0.25f, 0.1f) < tolerance
+          && max_error(mix_minus[3], 0.5f, 0.0f) < tolerance, "audio mixer: mix-minus");
+
+    mixer.set_gain(2, 0.0f);
+    mixer.push(1, dc_a.data(), dc_a.size());
+    mixer.push(2, dc_b.data(), dc_b.size());
+    mixer.push(3, tone.data(), tone.size());
+    mixer.mix(mix_data);
+    check(max_error(mix_data, 0.25f, 0.1f) < tolerance, "audio mixer: gain change");
+
+    // 120 ms of buffer: the first frame and five more are kept, the rest
+    // of the appended frames is dropped instead of overwriting the first
+    libav_audio_mixer overrun_mixer(format, 20, 100);
+    overrun_mixer.add_input(1, format);
+
+    const auto first = make_frame(0.5f, 0.0f);
+    overrun_mixer.push(1, first.data(), first.size());
+    for (std::size_t i = 0; i < 10; i++)
+    {
+        check(overrun_mixer.push(1, dc_a.data(), dc_a.size()), "audio mixer: push past max_delay");
+    }
+
+    overrun_mixer.mix(mix_data);
+    check(max_error(mix_data, 0.5f, 0.0f) < tolerance, "audio mixer: buffered samples kept on overrun");
+
+    for (std::size_t i = 0; i < 5; i++)
+    {
+        overrun_mixer.mix(mix_data);
+        check(max_error(mix_data, 0.25f, 0.0f) < tolerance, "audio mixer: appended frame " + std::to_string(i));
+    }
+
+    overrun_mixer.mix(mix_data);
+    check(max_error(mix_data, 0.0f, 0.0f) < tolerance, "audio mixer: underrun plays silence");
+
+    const audio_info_t pcm16_format(48000, 1, sample_format_pcm16);
+    libav_audio_mixer pcm16_mixer(pcm16_format, 20, 100);
+    pcm16_mixer.add_input(1, format);
+    pcm16_mixer.add_input(2, format);
+
+    const auto loud = make_frame(0.75f, 0.0f);
+    pcm16_mixer.push(1, loud.data(), loud.size());
+    pcm16_mixer.push(2, loud.data(), loud.size());
+    pcm16_mixer.mix(mix_data);
+
+    auto pcm16 = reinterpret_cast<const std::int16_t*>(mix_data.data());
+    auto saturated = mix_data.size() == frame_samples * sizeof(std::int16_t);
+    for (std::size_t i = 0; saturated && i < frame_samples; i++)
+    {
+        saturated = pcm16[i] == 32767;
+    }
+
+    check(saturated, "audio mixer: pcm16 saturation");
+}
+
+static frame_t make_frame(const media_info_t& media_info
+                          , std::int64_t timestamp
+                          , codec_id_t codec_id
+                          , std::size_t size
+                          , std::uint8_t value)
+{
+    frame_t frame;
+    frame.info = frame_info_t(media_info
+                              , timestamp
+                              , timestamp
+                              , 0
+                              , codec_id);
+    frame.media_data.assign(size, value);
+
+    return frame;
+}
+
+// Arrival and playout times are given explicitly, 25 fps video of 40 ms
+// frames. A fixed 100 ms delay plays reordered frames in order and not
+// before their time, drops late and duplicated frames, conceals a lost raw
+// frame (the last video frame, silence for audio) and skips a lost encoded
+// one. Without a minimum the delay grows to cover frames arriving 60 ms late.
+void test_jitter_buffer()
+{
+    const media_info_t video_info(video_info_t(frame_size_t{ 64, 48 }, 25, pixel_format_yuv420p));
+    const std::int64_t frame_units = video_sample_rate / 25;
+    const std::int64_t frame_time = 40000;
+    const std::int64_t t0 = 1000000;
+    const jitter_buffer_config_t fixed_delay(100, 1000);
+
+    {
+        libav_jitter_buffer jitter_buffer(video_info, fixed_delay);
+
+        // frame 2 arrives after frame 3, frame 6 is lost
+        const std::int64_t order[] = { 0, 1, 3, 2, 4, 5, 7 };
+        for (auto i : order)
+        {
+            jitter_buffer.push(make_frame(video_info, i * frame_units, codec_id_raw_video, 16, static_cast<std::uint8_t>(i))
+                               , t0 + i * frame_time + (i == 2 ? 50000 : 0));
+        }
+
+        frame_t frame;
+        check(!jitter_buffer.pop(frame, t0 + 100000 - 1), "jitter buffer: no playout before the delay");
+        check(jitter_buffer.pop(frame, t0 + 100000)
+              && frame.info.pts == 0, "jitter buffer: playout after the delay");
+
+        std::vector<std::int64_t> played;
+        while (jitter_buffer.pop(frame, t0 + 1000000))
+        {
+            played.push_back(frame.info.pts / frame_units);
+            check(frame.media_data == media_data_t(16, static_cast<std::uint8_t>(frame.info.pts == 6 * frame_units ? 5 : played.back()))
+                  , "jitter buffer: frame " + std::to_string(played.back()) + " data");
+        }
+
+        check(played == std::vector<std::int64_t>{ 1, 2, 3, 4, 5, 6, 7 }, "jitter buffer: reorder and concealment order");
+
+        auto stats = jitter_buffer.stats();
+        check(stats.reordered == 1
+              && stats.concealed == 1
+              && stats.lost == 1
+              && stats.played == 7, "jitter buffer: stats");
+
+        check(!jitter_buffer.push(make_frame(video_info, 3 * frame_units, codec_id_raw_video, 16, 3), t0 + 1000000)
+              , "jitter buffer: late frame dropped");
+        check(jitter_buffer.push(make_frame(video_info, 8 * frame_units, codec_id_raw_video, 16, 8), t0 + 1000000)
+              && !jitter_buffer.push(make_frame(video_info, 8 * frame_units, codec_id_raw_video, 16, 8), t0 + 1000000)
+              , "jitter buffer: duplicate dropped");
+
+        stats = jitter_buffer.stats();
+        check(stats.late == 1
+              && stats.duplicated == 1, "jitter buffer: late and duplicate stats");
+    }
+
+    {
+        libav_jitter_buffer jitter_buffer(video_info, fixed_delay);
+
+        for (auto i : { 0, 1, 3 })
+        {
+            jitter_buffer.push(make_frame(video_info, i * frame_units, codec_id_h264, 16, static_cast<std::uint8_t>(i))
+                               , t0 + i * frame_time);
+        }
+
+        frame_t frame;
+        std::vector<std::int64_t> played;
+        while (jitter_buffer.pop(frame, t0 + 1000000))
+        {
+            played.push_back(frame.info.pts / frame_units);
+        }
+
+        auto stats = jitter_buffer.stats();
+        check(played == std::vector<std::int64_t>{ 0, 1, 3 }
+              && stats.lost == 1
+              && stats.concealed == 0, "jitter buffer: encoded gap skipped");
+    }
+
+    {
+        // 8 kHz mono, 20 ms frames, the second one is lost
+        const media_info_t audio_info(audio_info_t(8000, 1, sample_format_pcm16));
+        libav_jitter_buffer jitter_buffer(audio_info, fixed_delay);
+
+        for (auto i : { 0, 2 })
+        {
+            jitter_buffer.push(make_frame(audio_info, i * 160, codec_id_none, 320, 0x11)
+                               , t0 + i * 20000);
+        }
+
+        frame_t frame;
+        jitter_buffer.pop(frame, t0 + 1000000);
+        check(jitter_buffer.pop(frame, t0 + 1000000)
+              && frame.info.pts == 160
+              && frame.media_data == media_data_t(320, 0x00), "jitter buffer: audio gap concealed by silence");
+        check(jitter_buffer.pop(frame, t0 + 1000000)
+              && frame.info.pts == 320, "jitter buffer: audio after the gap");
+    }
+
+    {
+        // every odd frame is 60 ms late, each arrival is followed by the due
+        // playouts. The delay must grow to stop the late frames within the
+        // first half, a buffer held at zero delay keeps losing them
+        auto run = [&](const jitter_buffer_config_t& config
+                       , jitter_buffer_stats_t& half)
+        {
+            libav_jitter_buffer jitter_buffer(video_info, config);
+            const std::int64_t frames = 500;
+
+            // arrival time and frame number, in the order of arrival
+            std::vector<std::pair<std::int64_t, std::int64_t>> arrivals;
+            for (std::int64_t i = 0; i < frames; i++)
+            {
+                arrivals.emplace_back(t0 + i * frame_time + (i % 2 != 0 ? 60000 : 0), i);
+            }
+            std::sort(arrivals.begin(), arrivals.end());
+
+            for (const auto& arrival : arrivals)
+            {
+                jitter_buffer.push(make_frame(video_info, arrival.second * frame_units, codec_id_raw_video, 16, 0)
+                                   , arrival.first);
+
+                frame_t frame;
+                while (jitter_buffer.pop(frame, arrival.first))
+                {
+
+                }
+
+                if (arrival.second == frames / 2)
+                {
+                    half = jitter_buffer.stats();
+                }
+            }
+
+            return jitter_buffer.stats();
+        };
+
+        jitter_buffer_stats_t fixed_half;
+        jitter_buffer_stats_t adaptive_half;
+        auto fixed = run(jitter_buffer_config_t(0, 0), fixed_half);
+        auto adaptive = run(jitter_buffer_config_t(0, 1000), adaptive_half);
+
+        check(fixed.late > fixed_half.late, "jitter buffer: late frames without a delay");
+        check(adaptive.late == adaptive_half.late
+              && adaptive.concealed == adaptive_half.concealed
+              && adaptive.target_delay >= 50000
+              && adaptive.target_delay <= 100000
+              && adaptive.playout_delay >= 50000
+              && adaptive.playout_delay <= 100000
+              , "jitter buffer: delay adaptation, target " + std::to_string(adaptive.target_delay)
+                + " us, playout " + std::to_string(adaptive.playout_delay) + " us");
+    }
+}
+
+// the level of a known tone in pcm16 and float32, digital silence, the zero
+// crossings of the SSE2 paths against the scalar float64 path with signed
+// zeros, and the voice hangover after the last voice frame
+void test_audio_analyzer()
+{
+    const audio_info_t audio_info(48000, 1, sample_format_pcm16);
+    const std::size_t samples = 480;
+
+    // 10 full periods of 1 kHz at half scale, rms 0.5 / sqrt(2), -9.03 dBFS
+    auto tone = make_tone(audio_info, samples, 0.5);
+    audio_level_t audio_level;
+
+    check(libav_audio_analyzer::measure(audio_info, tone.data(), tone.size(), audio_level)
+          && std::abs(audio_level.peak - 0.5f) < 0.001f
+          && std::abs(audio_level.rms - 0.35355f) < 0.001f
+          && std::abs(audio_level.dbfs + 9.03f) < 0.02f
+          && audio_level.level == 9
+          && audio_level.zcr > 19.0f / samples
+          && audio_level.zcr < 21.0f / samples
+          , "audio analyzer: pcm16 tone level, " + std::to_string(audio_level.dbfs) + " dBFS");
+
+    const audio_info_t float_info(48000, 1, sample_format_float32);
+    std::vector<float> float_tone(samples);
+    auto pcm16 = reinterpret_cast<const std::int16_t*>(tone.data());
+    for (std::size_t i = 0; i < samples; i++)
+    {
+        float_tone[i] = pcm16[i] / 32768.0f;
+    }
+
+    audio_level_t float_level;
+    check(libav_audio_analyzer::measure(float_info, float_tone.data(), samples * sizeof(float), float_level)
+          && std::abs(float_level.rms - audio_level.rms) < 0.0001f
+          && std::abs(float_level.dbfs - audio_level.dbfs) < 0.01f
+          && float_level.level == audio_level.level
+          && float_level.zcr == audio_level.zcr
+          , "audio analyzer: float32 tone level");
+
+    media_data_t silence(audio_info.sample_size() * samples);
+    check(libav_audio_analyzer::measure(audio_info, silence.data(), silence.size(), audio_level)
+          && audio_level.peak == 0.0f
+          && audio_level.dbfs == min_audio_level
+          && audio_level.level == 127
+          && audio_level.zcr == 0.0f
+          , "audio analyzer: silence level");
+
+    // signed zeros do not cross, interleaved stereo with a stride of 2
+    {
+        const audio_info_t stereo_info(48000, 2, sample_format_float32);
+        const audio_info_t double_info(48000, 2, sample_format_float64);
+        const float values[] = { 0.0f, -0.0f, 0.25f, -0.0f, -0.25f, 0.0f, -0.0f, 0.5f };
+
+        std::vector<float> float_data(2 * 101);
+        std::vector<double> double_data(float_data.size());
+        for (std::size_t i = 0; i < float_data.size(); i++)
+        {
+            float_data[i] = values[(i * i + i / 2) % 8];
+            double_data[i] = float_data[i];
+        }
+
+        audio_level_t double_level;
+        libav_audio_analyzer::measure(stereo_info, float_data.data(), float_data.size() * sizeof(float), float_level);
+        libav_audio_analyzer::measure(double_info, double_data.data(), double_data.size() * sizeof(double), double_level);
+
+        std::vector<float> zeros(64);
+        for (std::size_t i = 0; i < zeros.size(); i++)
+        {
+            zeros[i] = i % 3 == 0 ? -0.0f : 0.0f;
+        }
+
+        libav_audio_analyzer::measure(float_info, zeros.data(), zeros.size() * sizeof(float), audio_level);
+
+        check(float_level.zcr == double_level.zcr
+              && float_level.zcr > 0.0f
+              && audio_level.zcr == 0.0f
+              , "audio analyzer: signed zero crossings, " + std::to_string(float_level.zcr)
+                + " vs " + std::to_string(double_level.zcr));
+    }
+
+    // 10 ms windows, the default 200 ms hangover holds 19 silent windows
+    {
+        libav_audio_analyzer analyzer(audio_info);
+
+        analyzer.analyze(silence.data(), silence.size(), audio_level);
+        check(!audio_level.voice, "audio analyzer: silence is not voice");
+
+        for (std::size_t i = 0; i < 5; i++)
+        {
+            analyzer.analyze(tone.data(), tone.size(), audio_level);
+        }
+        check(audio_level.voice, "audio analyzer: tone is voice");
+
+        std::size_t held = 0;
+        for (std::size_t i = 0; i < 30; i++)
+        {
+            analyzer.analyze(silence.data(), silence.size(), audio_level);
+            if (!audio_level.voice)
+            {
+                break;
+            }
+            held++;
+        }
+
+        check(held == 19, "audio analyzer: hangover of " + std::to_string(held) + " windows");
+    }
+}
+
+// mjpeg 320x240 at 25 fps and 8 kHz mu-law, both have native encoders, so
+// the muxer accepts the streams in every build; the payload is not parsed
+static stream_info_list_t make_publisher_streams()
+{
+    return
+    {
+        stream_info_t(0, codec_info_t(codec_id_mjpeg), media_info_t(video_info_t(320, 240, 25)))
+        , stream_info_t(1, codec_info_t(codec_id_pcmu), media_info_t(audio_info_t(8000, 1, sample_format_pcm16)))
+    };
+}
+
+// the writer is held in the output, so the queue fills deterministically:
+// the overflow drops the queue, audio still goes through while video waits,
+// and the P-frame after the audio is dropped until the next key frame
+void test_publisher_overflow()
+{
+    std::mutex gate_mutex;
+    std::condition_variable gate_signal;
+    bool is_armed = false;
+    bool is_blocked = false;
+    bool is_released = false;
+
+    publisher_io_t io;
+    io.write_handler = [&](const std::uint8_t*
+                           , std::int32_t size)
+    {
+        std::unique_lock<std::mutex> lock(gate_mutex);
+
+        if (is_armed
+                && !is_released)
+        {
+            is_blocked = true;
+            gate_signal.notify_all();
+            gate_signal.wait(lock, [&] { return is_released; });
+        }
+
+        return size;
+    };
+
+    publisher_config_t config(true, 4);
+    config.interleave_delay = 0;
+
+    libav_stream_publisher publisher(config);
+    if (!check(publisher.open(io, "overflow.avi", make_publisher_streams()), "publisher overflow: open"))
+    {
+        return;
+    }
+
+    // larger than the avio buffer, the writer blocks in its first packet
+    media_data_t video(64 * 1024, 0x55);
+    media_data_t audio(160, 0x7f);
+
+    auto push_video = [&](std::int64_t index
+                          , bool key_frame)
+    {
+        return publisher.push_frame(0, video.data(), video.size(), index * 3600, key_frame);
+    };
+
+    {
+        std::unique_lock<std::mutex> lock(gate_mutex);
+        is_armed = true;
+    }
+
+    push_video(0, true);
+
+    bool is_held = false;
+    {
+        std::unique_lock<std::mutex> lock(gate_mutex);
+        is_held = gate_signal.wait_for(lock, std::chrono::seconds(5), [&] { return is_blocked; });
+    }
+
+    if (check(is_held, "publisher overflow: writer held"))
+    {
+        for (std::int64_t i = 1; i <= 4; i++)
+        {
+            push_video(i, false);
+        }
+
+        auto overflow = push_video(5, false);
+        auto audio_pushed = publisher.push_frame(1, audio.data(), audio.size(), 1600);
+        auto p_frame_pushed = push_video(6, false);
+        auto key_frame_pushed = push_video(7, true);
+
+        auto stats = publisher.stats();
+
+        check(!overflow
+              && audio_pushed
+              && !p_frame_pushed
+              && key_frame_pushed
+              && stats.queued_packets == 2
+              && stats.dropped_packets == 6
+              , "publisher overflow: drop until key, dropped " + std::to_string(stats.dropped_packets)
+                + ", queued " + std::to_string(stats.queued_packets));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(gate_mutex);
+        is_released = true;
+        gate_signal.notify_all();
+    }
+
+    publisher.close();
+
+    check(!is_held
+          || publisher.stats().written_packets == 3
+          , "publisher overflow: written packets");
+}
+
+// the same packets through an output flushed per packet, a coalescing
+// custom output and a coalescing file output give the same bytes, the
+// coalescing outputs with fewer write calls
+void test_publisher_coalescing()
 {
+    auto publish = [&](libav_stream_publisher& publisher)
+    {
+        for (std::int64_t i = 0; i < 100; i++)
+        {
+            media_data_t video(1000 + (i * 937) % 6000, static_cast<std::uint8_t>(i));
+            media_data_t audio(320, static_cast<std::uint8_t>(0x80 + i));
+
+            publisher.push_frame(0, video.data(), video.size(), i * 3600, i % 25 == 0);
+            publisher.push_frame(1, audio.data(), audio.size(), i * 320);
+        }
+
+        auto stats = publisher.stats();
+        publisher.close();
+
+        return stats;
+    };
+
+    auto make_io = [](media_data_t& output)
+    {
+        publisher_io_t io;
+        io.write_handler = [&output](const std::uint8_t* data
+                                     , std::int32_t size)
+        {
+            output.insert(output.end(), data, data + size);
+            return size;
+        };
+
+        return io;
+    };
+
+    media_data_t unbuffered;
+    media_data_t coalesced;
+    media_data_t file_output;
+
+    libav_stream_publisher unbuffered_publisher;
+    if (!check(unbuffered_publisher.open(make_io(unbuffered), "unbuffered.ts", make_publisher_streams()), "publisher coalescing: open"))
+    {
+        return;
+    }
+    auto unbuffered_stats = publish(unbuffered_publisher);
+
+    publisher_config_t config;
+    config.io_config.coalesce_packets = 16;
+
+    libav_stream_publisher coalesced_publisher(config);
+    coalesced_publisher.open(make_io(coalesced), "coalesced.ts", make_publisher_streams());
+    auto coalesced_stats = publish(coalesced_publisher);
+
+    char directory[] = "/tmp/publisher_XXXXXX";
+    if (::mkdtemp(directory) != nullptr)
+    {
+        auto path = std::string(directory) + "/coalesced.ts";
+
+        config.io_config.buffer_size = 256 * 1024;
+        config.io_config.drop_cache = true;
+
+        libav_stream_publisher file_publisher(config);
+        file_publisher.open(path, make_publisher_streams());
+        publish(file_publisher);
+
+        std::ifstream file(path, std::ios::binary);
+        file_output.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+        std::remove(path.c_str());
+        ::rmdir(directory);
+    }
+
+    check(!unbuffered.empty()
+          && coalesced == unbuffered
+          && file_output == unbuffered
+          , "publisher coalescing: identical output, " + std::to_string(unbuffered.size()) + " bytes");
+
+    check(coalesced_stats.io_writes > 0
+          && coalesced_stats.io_writes < unbuffered_stats.io_writes
+          && coalesced_stats.io_flushes > 0
+          , "publisher coalescing: " + std::to_string(coalesced_stats.io_writes)
+            + " writes vs " + std::to_string(unbuffered_stats.io_writes));
+}
+
+// presentation timestamps of the PES packets in an MPEG-TS stream, 90 kHz
+static std::vector<std::int64_t> fetch_ts_pts(const media_data_t& ts)
+{
+    std::vector<std::int64_t> pts_list;
+
+    for (std::size_t i = 0; i + 188 <= ts.size(); i += 188)
+    {
+        const auto* packet = ts.data() + i;
+
+        if (packet[0] != 0x47
+                || (packet[1] & 0x40) == 0)
+        {
+            continue;
+        }
+
+        std::size_t offset = 4;
+        if ((packet[3] & 0x20) != 0)
+        {
+            offset += 1 + packet[4];
+        }
+
+        const auto* pes = packet + offset;
+
+        if (offset + 14 <= 188
+                && pes[0] == 0
+                && pes[1] == 0
+                && pes[2] == 1
+                && (pes[7] & 0x80) != 0)
+        {
+            const auto* p = pes + 9;
+            pts_list.push_back((static_cast<std::int64_t>(p[0] >> 1 & 0x07) << 30)
+                               | (static_cast<std::int64_t>(p[1]) << 22)
+                               | (static_cast<std::int64_t>(p[2] >> 1) << 15)
+                               | (static_cast<std::int64_t>(p[3]) << 7)
+                               | (p[4] >> 1));
+        }
+    }
+
+    return pts_list;
+}
+
+// the encoder stamps its frames in 90 kHz, so 25 fps frames muxed as they
+// come out of it are 3600 ticks apart in the MPEG-TS output
+void test_encoder_timestamps()
+{
+    stream_info_t stream_info(0
+                              , codec_info_t(codec_id_raw_video)
+                              , media_info_t(video_info_t(64, 48, 25, pixel_format_yuv420p)));
+
+    libav_transcoder encoder;
+    if (!check(encoder.open(stream_info, transcoder_type_t::encoder), "encoder timestamps: open"))
+    {
+        return;
+    }
+
+    media_data_t output;
+    publisher_io_t io;
+    io.write_handler = [&output](const std::uint8_t* data
+                                 , std::int32_t size)
+    {
+        output.insert(output.end(), data, data + size);
+        return size;
+    };
+
+    libav_stream_publisher publisher;
+    if (!check(publisher.open(io, "encoded.ts", { encoder.config() }), "encoder timestamps: publisher open"))
+    {
+        return;
+    }
+
+    media_data_t picture(encoder.config().media_info.video_info.frame_size(), 0x80);
+    frame_queue_t frame_queue;
+    std::vector<std::int64_t> frame_pts;
+
+    for (std::size_t i = 0; i < 10; i++)
+    {
+        encoder.transcode(picture.data(), picture.size(), frame_queue, transcode_flag_t::key_frame);
+
+        while (!frame_queue.empty())
+        {
+            auto frame = std::move(frame_queue.front());
+            frame_queue.pop();
+
+            // the transcoder numbers its frames in info.id, the publisher
+            // takes the stream from it
+            frame.info.id = 0;
+            frame_pts.push_back(frame.info.pts);
+            publisher.push_frame(frame);
+        }
+    }
+
+    publisher.close();
+
+    auto pts_list = fetch_ts_pts(output);
+
+    auto is_paced = [](const std::vector<std::int64_t>& pts_list)
+    {
+        for (std::size_t i = 1; i < pts_list.size(); i++)
+        {
+            if (pts_list[i] - pts_list[i - 1] != 3600)
+            {
+                return false;
+            }
+        }
+
+        return pts_list.size() == 10;
+    };
+
+    check(is_paced(frame_pts), "encoder timestamps: frames in 90 kHz");
+    check(is_paced(pts_list), "encoder timestamps: muxed pts, " + std::to_string(pts_list.size()) + " packets");
+}
+
+// 10 s of 25 fps video with a key frame every 1.12 s in 1 s segments: the
+// target duration stays at the configured second, the playlist lists the
+// last 3 segments and max_segments 2 removes only the segments before them
+void test_segment_recorder()
+{
+    char directory[] = "/tmp/segment_recorder_XXXXXX";
+    if (!check(::mkdtemp(directory) != nullptr, "segment recorder: directory"))
+    {
+        return;
+    }
+
+    auto list_files = [&]
+    {
+        std::vector<std::string> files;
+
+        if (auto dir = ::opendir(directory))
+        {
+            while (auto entry = ::readdir(dir))
+            {
+                std::string name = entry->d_name;
+                if (name != "."
+                        && name != "..")
+                {
+                    files.push_back(name);
+                }
+            }
+
+            ::closedir(dir);
+        }
+
+        std::sort(files.begin(), files.end());
+        return files;
+    };
+
+    segment_recorder_config_t config(directory, "test", segment_format_t::mpegts, 1000, 3, 2, 1024 * 1024, 64 * 1024);
+    segment_recorder_stats_t stats;
+    bool is_recorded = false;
+
+    {
+        libav_segment_recorder recorder(config);
+
+        if (check(recorder.open(make_publisher_streams()), "segment recorder: open"))
+        {
+            media_data_t video(4096, 0x55);
+            media_data_t audio(320, 0x7f);
+
+            for (std::int64_t i = 0; i < 250; i++)
+            {
+                auto key_frame = i % 28 == 0;
+
+                recorder.push_frame(0, video.data(), video.size(), i * 3600, key_frame);
+                recorder.push_frame(1, audio.data(), audio.size(), i * 320);
+
+                // the next file is prepared on the file worker in time
+                if (key_frame)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                }
+            }
+
+            recorder.close();
+            stats = recorder.stats();
+            is_recorded = true;
+        }
+    }
+
+    if (is_recorded)
+    {
+        std::ifstream playlist(std::string(directory) + "/test.m3u8");
+        std::string line;
+        std::int32_t target_duration = 0;
+        std::int64_t media_sequence = -1;
+        std::vector<double> durations;
+        std::vector<std::string> listed = { "test.m3u8" };
+        bool is_ended = false;
+
+        while (std::getline(playlist, line))
+        {
+            if (line.compare(0, 22, "#EXT-X-TARGETDURATION:") == 0)
+            {
+                target_duration = std::stoi(line.substr(22));
+            }
+            else if (line.compare(0, 22, "#EXT-X-MEDIA-SEQUENCE:") == 0)
+            {
+                media_sequence = std::stoll(line.substr(22));
+            }
+            else if (line.compare(0, 8, "#EXTINF:") == 0)
+            {
+                durations.push_back(std::stod(line.substr(8)));
+            }
+            else if (line == "#EXT-X-ENDLIST")
+            {
+                is_ended = true;
+            }
+            else if (!line.empty()
+                     && line[0] != '#')
+            {
+                listed.push_back(line);
+            }
+        }
+
+        std::sort(listed.begin(), listed.end());
+
+        check(stats.segments == 9
+              && stats.late_files == 0
+              && stats.write_errors == 0
+              , "segment recorder: rotation, " + std::to_string(stats.segments) + " segments");
+
+        check(target_duration == 1
+              && std::all_of(durations.begin(), durations.end(), [&](double d) { return std::lround(d) <= target_duration; })
+              , "segment recorder: target duration " + std::to_string(target_duration));
+
+        check(media_sequence == 6
+              && durations.size() == 3
+              && is_ended
+              , "segment recorder: playlist window");
+
+        check(list_files() == listed
+              , "segment recorder: only the segments out of the playlist are removed");
+    }
+
+    for (const auto& name : list_files())
+    {
+        std::remove((std::string(directory) + "/" + name).c_str());
+    }
+
+    ::rmdir(directory);
+}
+
+void benchmark_audio_analyzer()
+{
+    // 10 ms of 48 kHz stereo, the window of the active speaker switching
+    const audio_info_t audio_info(48000, 2, sample_format_pcm16);
+    const std::size_t iterations = 100000;
+
+    media_data_t frame(audio_info.sample_size() * 480);
+    auto samples = reinterpret_cast<std::int16_t*>(frame.data());
+    for (std::size_t i = 0; i < frame.size() / 2; i++)
+    {
+        samples[i] = static_cast<std::int16_t>((i * 7919) % 65536 - 32768);
+    }
+
+    libav_audio_analyzer analyzer(audio_info);
+    audio_level_t audio_level;
+
+    auto t0 = std::chrono::steady_clock::now();
+
+    for (std::size_t i = 0; i < iterations; i++)
+    {
+        analyzer.analyze(frame.data()
+                         , frame.size()
+                         , audio_level);
+    }
+
+    auto t1 = std::chrono::steady_clock::now();
+
+    std::cout << "audio analyzer: " << std::chrono::duration<double, std::micro>(t1 - t0).count() / iterations
+              << " us per 10 ms window" << std::endl;
+}
+
+void test()
+{
+    test_scaling_cache();
+    test_banded_conversion();
+    test_fast_converter();
+    benchmark_fast_converter();
+    benchmark_frame_align();
+    test_resampler();
+    test_audio_mixer();
+    test_jitter_buffer();
+    test_audio_analyzer();
+    test_publisher_overflow();
+    test_publisher_coalescing();
+    test_encoder_timestamps();
+    test_segment_recorder();
+    benchmark_audio_analyzer();
+}
 
 }
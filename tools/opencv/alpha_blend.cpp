@@ -0,0 +1,975 @@
+#include "alpha_blend.h"
+
+#include <cstring>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ALPHA_BLEND_X86
+#include <immintrin.h>
+#endif
+
+namespace ocv
+{
+
+namespace
+{
+
+// output = (input * a + output * (255 - a)) / 255, a = alpha * mask * opacity;
+// opacity is Q15 so that a = round(am * opacity) is one mulhrs
+
+using blend_row_t = std::int32_t (*)(const std::uint8_t* input_row
+                                     , std::uint8_t* output_row
+                                     , const std::uint8_t* mask_row
+                                     , std::int32_t opacity
+                                     , std::int32_t width);
+
+using fill_row_t = std::int32_t (*)(const std::uint8_t* color
+                                    , std::uint8_t* output_row
+                                    , const std::uint8_t* mask_row
+                                    , std::int32_t opacity
+                                    , std::int32_t width);
+
+// every vectorized row kernel returns the number of processed pixels,
+// the scalar kernel finishes the tail starting from that position
+
+const std::int32_t full_opacity = 32767;
+
+inline std::int32_t div255(std::int32_t value)
+{
+    // exact rounding for 0 .. 65535
+    value += 128;
+    return (value + (value >> 8)) >> 8;
+}
+
+template<std::int32_t InputChannels, std::int32_t OutputChannels>
+void blend_row_scalar(const std::uint8_t* input_row
+                      , std::uint8_t* output_row
+                      , const std::uint8_t* mask_row
+                      , std::int32_t opacity
+                      , std::int32_t x
+                      , std::int32_t width)
+{
+    const auto channels = std::min(InputChannels, OutputChannels);
+
+    for (; x < width; x++)
+    {
+        const auto* input = input_row + x * InputChannels;
+        auto* output = output_row + x * OutputChannels;
+
+        std::int32_t a = InputChannels == 4
+                ? input[3]
+                : 255;
+
+        if (mask_row != nullptr)
+        {
+            a = div255(a * mask_row[x]);
+        }
+
+        a = (a * opacity + 16384) >> 15;
+
+        if (a == 0)
+        {
+            continue;
+        }
+
+        for (std::int32_t c = 0; c < channels; c++)
+        {
+            output[c] = div255(input[c] * a + output[c] * (255 - a));
+        }
+
+        if (OutputChannels == 4
+                && InputChannels == 3)
+        {
+            output[3] = div255(255 * a + output[3] * (255 - a));
+        }
+    }
+}
+
+// premultiplied input: output = input * s + output * (255 - alpha * s),
+// s = mask * opacity; without a mask at full opacity it is one multiply-add
+template<std::int32_t OutputChannels>
+void blend_premultiplied_row_scalar(const std::uint8_t* input_row
+                                    , std::uint8_t* output_row
+                                    , const std::uint8_t* mask_row
+                                    , std::int32_t opacity
+                                    , std::int32_t x
+                                    , std::int32_t width)
+{
+    const auto channels = std::min(4, OutputChannels);
+
+    for (; x < width; x++)
+    {
+        const auto* input = input_row + x * 4;
+        auto* output = output_row + x * OutputChannels;
+
+        std::int32_t s = mask_row != nullptr
+                ? mask_row[x]
+                : 255;
+
+        s = (s * opacity + 16384) >> 15;
+
+        if (s == 0)
+        {
+            continue;
+        }
+
+        if (s == 255)
+        {
+            auto inverse = 255 - input[3];
+
+            for (std::int32_t c = 0; c < channels; c++)
+            {
+                output[c] = std::min(input[c] + div255(output[c] * inverse), 255);
+            }
+        }
+        else
+        {
+            auto inverse = 255 - div255(input[3] * s);
+
+            for (std::int32_t c = 0; c < channels; c++)
+            {
+                output[c] = std::min(div255(input[c] * s) + div255(output[c] * inverse), 255);
+            }
+        }
+    }
+}
+
+template<std::int32_t OutputChannels>
+void fill_row_scalar(const std::uint8_t* color
+                     , std::uint8_t* output_row
+                     , const std::uint8_t* mask_row
+                     , std::int32_t opacity
+                     , std::int32_t x
+                     , std::int32_t width)
+{
+    for (; x < width; x++)
+    {
+        std::int32_t a = mask_row != nullptr
+                ? mask_row[x]
+                : 255;
+
+        a = (a * opacity + 16384) >> 15;
+
+        if (a == 0)
+        {
+            continue;
+        }
+
+        auto* output = output_row + x * OutputChannels;
+
+        for (std::int32_t c = 0; c < OutputChannels; c++)
+        {
+            output[c] = div255(color[c] * a + output[c] * (255 - a));
+        }
+    }
+}
+
+std::int32_t fill_row_none(const std::uint8_t*
+                           , std::uint8_t*
+                           , const std::uint8_t*
+                           , std::int32_t
+                           , std::int32_t)
+{
+    return 0;
+}
+
+std::int32_t blend_row_none(const std::uint8_t*
+                            , std::uint8_t*
+                            , const std::uint8_t*
+                            , std::int32_t
+                            , std::int32_t)
+{
+    return 0;
+}
+
+#ifdef ALPHA_BLEND_X86
+
+//------------------------------------------------------------------------------
+// SSE4.1
+//------------------------------------------------------------------------------
+__attribute__((target("sse4.1")))
+inline __m128i div255_sse(__m128i value)
+{
+    value = _mm_add_epi16(value, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(value, _mm_srli_epi16(value, 8)), 8);
+}
+
+// 4 BGRA pixels over 4 pixels of the output in the BGRA layout
+__attribute__((target("sse4.1")))
+inline __m128i blend_sse(__m128i input
+                         , __m128i output
+                         , __m128i a8)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16(255);
+
+    auto a_lo = _mm_unpacklo_epi8(a8, zero);
+    auto a_hi = _mm_unpackhi_epi8(a8, zero);
+
+    auto lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(input, zero), a_lo)
+                            , _mm_mullo_epi16(_mm_unpacklo_epi8(output, zero), _mm_sub_epi16(full, a_lo)));
+    auto hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(input, zero), a_hi)
+                            , _mm_mullo_epi16(_mm_unpackhi_epi8(output, zero), _mm_sub_epi16(full, a_hi)));
+
+    return _mm_packus_epi16(div255_sse(lo), div255_sse(hi));
+}
+
+// alpha * mask * opacity of 4 pixels, replicated into every channel byte
+__attribute__((target("sse4.1")))
+inline __m128i weight_sse(__m128i input
+                          , const std::uint8_t* mask
+                          , __m128i opacity)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    // alpha of the pixels in 16 bit lanes 0..3
+    auto a = _mm_unpacklo_epi8(_mm_shuffle_epi8(input, _mm_setr_epi8(3, 7, 11, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1))
+                               , zero);
+
+    if (mask != nullptr)
+    {
+        std::int32_t mask_bytes;
+        std::memcpy(&mask_bytes, mask, sizeof(mask_bytes));
+
+        auto m = _mm_unpacklo_epi8(_mm_cvtsi32_si128(mask_bytes), zero);
+        a = div255_sse(_mm_mullo_epi16(a, m));
+    }
+
+    a = _mm_mulhrs_epi16(a, opacity);
+
+    return _mm_shuffle_epi8(_mm_packus_epi16(a, zero)
+                            , _mm_setr_epi8(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3));
+}
+
+__attribute__((target("sse4.1")))
+std::int32_t blend_bgra_to_bgra_sse41(const std::uint8_t* input_row
+                                      , std::uint8_t* output_row
+                                      , const std::uint8_t* mask_row
+                                      , std::int32_t opacity
+                                      , std::int32_t width)
+{
+    const __m128i q15 = _mm_set1_epi16(opacity);
+
+    std::int32_t x = 0;
+
+    for (; x + 4 <= width; x += 4)
+    {
+        auto input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input_row + x * 4));
+        auto a8 = weight_sse(input
+                             , mask_row != nullptr ? mask_row + x : nullptr
+                             , q15);
+
+        // fully transparent pixels are not touched
+        if (_mm_testz_si128(a8, a8))
+        {
+            continue;
+        }
+
+        auto output = _mm_loadu_si128(reinterpret_cast<const __m128i*>(output_row + x * 4));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output_row + x * 4)
+                         , blend_sse(input, output, a8));
+    }
+
+    return x;
+}
+
+__attribute__((target("sse4.1")))
+std::int32_t blend_bgra_to_bgr_sse41(const std::uint8_t* input_row
+                                     , std::uint8_t* output_row
+                                     , const std::uint8_t* mask_row
+                                     , std::int32_t opacity
+                                     , std::int32_t width)
+{
+    const __m128i q15 = _mm_set1_epi16(opacity);
+    const __m128i expand = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+    std::int32_t x = 0;
+
+    // the 16 byte load of 4 BGR pixels reads 4 bytes ahead
+    for (; x + 6 <= width; x += 4)
+    {
+        auto input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input_row + x * 4));
+        auto a8 = weight_sse(input
+                             , mask_row != nullptr ? mask_row + x : nullptr
+                             , q15);
+
+        if (_mm_testz_si128(a8, a8))
+        {
+            continue;
+        }
+
+        auto* output_ptr = output_row + x * 3;
+        auto output = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(output_ptr))
+                                       , expand);
+
+        auto result = _mm_shuffle_epi8(blend_sse(input, output, a8)
+                                       , pack);
+
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(output_ptr), result);
+
+        std::int32_t tail = _mm_cvtsi128_si32(_mm_srli_si128(result, 8));
+        std::memcpy(output_ptr + 8, &tail, sizeof(tail));
+    }
+
+    return x;
+}
+
+// mask * opacity of 4 pixels, replicated into every channel byte
+__attribute__((target("sse4.1")))
+inline __m128i fill_weight_sse(const std::uint8_t* mask
+                               , __m128i opacity)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    auto m = _mm_set1_epi16(255);
+
+    if (mask != nullptr)
+    {
+        std::int32_t mask_bytes;
+        std::memcpy(&mask_bytes, mask, sizeof(mask_bytes));
+
+        m = _mm_unpacklo_epi8(_mm_cvtsi32_si128(mask_bytes), zero);
+    }
+
+    return _mm_shuffle_epi8(_mm_packus_epi16(_mm_mulhrs_epi16(m, opacity), zero)
+                            , _mm_setr_epi8(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3));
+}
+
+__attribute__((target("sse4.1")))
+std::int32_t fill_bgra_sse41(const std::uint8_t* color
+                             , std::uint8_t* output_row
+                             , const std::uint8_t* mask_row
+                             , std::int32_t opacity
+                             , std::int32_t width)
+{
+    const __m128i q15 = _mm_set1_epi16(opacity);
+
+    std::int32_t color_bytes;
+    std::memcpy(&color_bytes, color, sizeof(color_bytes));
+
+    const __m128i input = _mm_set1_epi32(color_bytes);
+
+    std::int32_t x = 0;
+
+    for (; x + 4 <= width; x += 4)
+    {
+        auto a8 = fill_weight_sse(mask_row != nullptr ? mask_row + x : nullptr
+                                  , q15);
+
+        if (_mm_testz_si128(a8, a8))
+        {
+            continue;
+        }
+
+        auto output = _mm_loadu_si128(reinterpret_cast<const __m128i*>(output_row + x * 4));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output_row + x * 4)
+                         , blend_sse(input, output, a8));
+    }
+
+    return x;
+}
+
+__attribute__((target("sse4.1")))
+std::int32_t fill_bgr_sse41(const std::uint8_t* color
+                            , std::uint8_t* output_row
+                            , const std::uint8_t* mask_row
+                            , std::int32_t opacity
+                            , std::int32_t width)
+{
+    const __m128i q15 = _mm_set1_epi16(opacity);
+    const __m128i expand = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    const __m128i input = _mm_set1_epi32(color[0] | (color[1] << 8) | (color[2] << 16));
+
+    std::int32_t x = 0;
+
+    // the 16 byte load of 4 BGR pixels reads 4 bytes ahead
+    for (; x + 6 <= width; x += 4)
+    {
+        auto a8 = fill_weight_sse(mask_row != nullptr ? mask_row + x : nullptr
+                                  , q15);
+
+        if (_mm_testz_si128(a8, a8))
+        {
+            continue;
+        }
+
+        auto* output_ptr = output_row + x * 3;
+        auto output = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(output_ptr))
+                                       , expand);
+
+        auto result = _mm_shuffle_epi8(blend_sse(input, output, a8)
+                                       , pack);
+
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(output_ptr), result);
+
+        std::int32_t tail = _mm_cvtsi128_si32(_mm_srli_si128(result, 8));
+        std::memcpy(output_ptr + 8, &tail, sizeof(tail));
+    }
+
+    return x;
+}
+
+// 4 premultiplied pixels scaled by the weights replicated per channel byte
+__attribute__((target("sse4.1")))
+inline __m128i scale_sse(__m128i input
+                         , __m128i s8)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    auto lo = _mm_mullo_epi16(_mm_unpacklo_epi8(input, zero), _mm_unpacklo_epi8(s8, zero));
+    auto hi = _mm_mullo_epi16(_mm_unpackhi_epi8(input, zero), _mm_unpackhi_epi8(s8, zero));
+
+    return _mm_packus_epi16(div255_sse(lo), div255_sse(hi));
+}
+
+// input + output * (255 - alpha), 4 premultiplied BGRA pixels
+__attribute__((target("sse4.1")))
+inline __m128i blend_premultiplied_sse(__m128i input
+                                       , __m128i output)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    auto inverse = _mm_xor_si128(_mm_shuffle_epi8(input, _mm_setr_epi8(3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15))
+                                 , _mm_set1_epi8(-1));
+
+    auto lo = _mm_mullo_epi16(_mm_unpacklo_epi8(output, zero), _mm_unpacklo_epi8(inverse, zero));
+    auto hi = _mm_mullo_epi16(_mm_unpackhi_epi8(output, zero), _mm_unpackhi_epi8(inverse, zero));
+
+    return _mm_adds_epu8(input
+                         , _mm_packus_epi16(div255_sse(lo), div255_sse(hi)));
+}
+
+__attribute__((target("sse4.1")))
+std::int32_t blend_premultiplied_to_bgra_sse41(const std::uint8_t* input_row
+                                               , std::uint8_t* output_row
+                                               , const std::uint8_t* mask_row
+                                               , std::int32_t opacity
+                                               , std::int32_t width)
+{
+    const __m128i q15 = _mm_set1_epi16(opacity);
+    const bool is_scaled = mask_row != nullptr
+            || opacity != full_opacity;
+
+    std::int32_t x = 0;
+
+    for (; x + 4 <= width; x += 4)
+    {
+        auto input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input_row + x * 4));
+
+        if (is_scaled)
+        {
+            input = scale_sse(input
+                              , fill_weight_sse(mask_row != nullptr ? mask_row + x : nullptr
+                                                , q15));
+        }
+
+        if (_mm_testz_si128(input, input))
+        {
+            continue;
+        }
+
+        auto output = _mm_loadu_si128(reinterpret_cast<const __m128i*>(output_row + x * 4));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output_row + x * 4)
+                         , blend_premultiplied_sse(input, output));
+    }
+
+    return x;
+}
+
+__attribute__((target("sse4.1")))
+std::int32_t blend_premultiplied_to_bgr_sse41(const std::uint8_t* input_row
+                                              , std::uint8_t* output_row
+                                              , const std::uint8_t* mask_row
+                                              , std::int32_t opacity
+                                              , std::int32_t width)
+{
+    const __m128i q15 = _mm_set1_epi16(opacity);
+    const __m128i expand = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    const bool is_scaled = mask_row != nullptr
+            || opacity != full_opacity;
+
+    std::int32_t x = 0;
+
+    // the 16 byte load of 4 BGR pixels reads 4 bytes ahead
+    for (; x + 6 <= width; x += 4)
+    {
+        auto input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input_row + x * 4));
+
+        if (is_scaled)
+        {
+            input = scale_sse(input
+                              , fill_weight_sse(mask_row != nullptr ? mask_row + x : nullptr
+                                                , q15));
+        }
+
+        if (_mm_testz_si128(input, input))
+        {
+            continue;
+        }
+
+        auto* output_ptr = output_row + x * 3;
+        auto output = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(output_ptr))
+                                       , expand);
+
+        auto result = _mm_shuffle_epi8(blend_premultiplied_sse(input, output)
+                                       , pack);
+
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(output_ptr), result);
+
+        std::int32_t tail = _mm_cvtsi128_si32(_mm_srli_si128(result, 8));
+        std::memcpy(output_ptr + 8, &tail, sizeof(tail));
+    }
+
+    return x;
+}
+
+// 16 samples of a single plane (luma)
+__attribute__((target("sse4.1")))
+std::int32_t fill_gray_sse41(const std::uint8_t* color
+                             , std::uint8_t* output_row
+                             , const std::uint8_t* mask_row
+                             , std::int32_t opacity
+                             , std::int32_t width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16(255);
+    const __m128i q15 = _mm_set1_epi16(opacity);
+    const __m128i input = _mm_set1_epi16(color[0]);
+
+    std::int32_t x = 0;
+
+    for (; x + 16 <= width; x += 16)
+    {
+        auto m = mask_row != nullptr
+                ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask_row + x))
+                : _mm_set1_epi8(-1);
+
+        auto a_lo = _mm_mulhrs_epi16(_mm_unpacklo_epi8(m, zero), q15);
+        auto a_hi = _mm_mulhrs_epi16(_mm_unpackhi_epi8(m, zero), q15);
+
+        if (_mm_testz_si128(_mm_or_si128(a_lo, a_hi), _mm_or_si128(a_lo, a_hi)))
+        {
+            continue;
+        }
+
+        auto output = _mm_loadu_si128(reinterpret_cast<const __m128i*>(output_row + x));
+
+        auto lo = _mm_add_epi16(_mm_mullo_epi16(input, a_lo)
+                                , _mm_mullo_epi16(_mm_unpacklo_epi8(output, zero), _mm_sub_epi16(full, a_lo)));
+        auto hi = _mm_add_epi16(_mm_mullo_epi16(input, a_hi)
+                                , _mm_mullo_epi16(_mm_unpackhi_epi8(output, zero), _mm_sub_epi16(full, a_hi)));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output_row + x)
+                         , _mm_packus_epi16(div255_sse(lo), div255_sse(hi)));
+    }
+
+    return x;
+}
+
+//------------------------------------------------------------------------------
+// AVX2
+//------------------------------------------------------------------------------
+__attribute__((target("avx2")))
+inline __m256i div255_avx2(__m256i value)
+{
+    value = _mm256_add_epi16(value, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(value, _mm256_srli_epi16(value, 8)), 8);
+}
+
+__attribute__((target("avx2")))
+std::int32_t blend_bgra_to_bgra_avx2(const std::uint8_t* input_row
+                                     , std::uint8_t* output_row
+                                     , const std::uint8_t* mask_row
+                                     , std::int32_t opacity
+                                     , std::int32_t width)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i full = _mm256_set1_epi16(255);
+    const __m256i q15 = _mm256_set1_epi16(opacity);
+    // per 128 bit lane: alpha bytes to 16 bit lanes and back to all channels
+    const __m256i alpha_shuffle = _mm256_setr_epi8(3, -1, 3, -1, 3, -1, 3, -1, 7, -1, 7, -1, 7, -1, 7, -1
+                                                   , 3, -1, 3, -1, 3, -1, 3, -1, 7, -1, 7, -1, 7, -1, 7, -1);
+    const __m256i alpha_shuffle_hi = _mm256_setr_epi8(11, -1, 11, -1, 11, -1, 11, -1, 15, -1, 15, -1, 15, -1, 15, -1
+                                                      , 11, -1, 11, -1, 11, -1, 11, -1, 15, -1, 15, -1, 15, -1, 15, -1);
+    const __m256i mask_shuffle = _mm256_setr_epi8(0, -1, 0, -1, 0, -1, 0, -1, 1, -1, 1, -1, 1, -1, 1, -1
+                                                  , 4, -1, 4, -1, 4, -1, 4, -1, 5, -1, 5, -1, 5, -1, 5, -1);
+    const __m256i mask_shuffle_hi = _mm256_setr_epi8(2, -1, 2, -1, 2, -1, 2, -1, 3, -1, 3, -1, 3, -1, 3, -1
+                                                     , 6, -1, 6, -1, 6, -1, 6, -1, 7, -1, 7, -1, 7, -1, 7, -1);
+
+    std::int32_t x = 0;
+
+    for (; x + 8 <= width; x += 8)
+    {
+        auto input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input_row + x * 4));
+
+        // the weight is computed per channel, 16 bit lanes, pixels 0,1 | 4,5 and 2,3 | 6,7
+        auto a_lo = _mm256_shuffle_epi8(input, alpha_shuffle);
+        auto a_hi = _mm256_shuffle_epi8(input, alpha_shuffle_hi);
+
+        if (mask_row != nullptr)
+        {
+            auto m = _mm256_broadcastsi128_si256(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(mask_row + x)));
+
+            a_lo = div255_avx2(_mm256_mullo_epi16(a_lo, _mm256_shuffle_epi8(m, mask_shuffle)));
+            a_hi = div255_avx2(_mm256_mullo_epi16(a_hi, _mm256_shuffle_epi8(m, mask_shuffle_hi)));
+        }
+
+        a_lo = _mm256_mulhrs_epi16(a_lo, q15);
+        a_hi = _mm256_mulhrs_epi16(a_hi, q15);
+
+        if (_mm256_testz_si256(_mm256_or_si256(a_lo, a_hi), _mm256_or_si256(a_lo, a_hi)))
+        {
+            continue;
+        }
+
+        auto output = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(output_row + x * 4));
+
+        auto lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(input, zero), a_lo)
+                                   , _mm256_mullo_epi16(_mm256_unpacklo_epi8(output, zero), _mm256_sub_epi16(full, a_lo)));
+        auto hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(input, zero), a_hi)
+                                   , _mm256_mullo_epi16(_mm256_unpackhi_epi8(output, zero), _mm256_sub_epi16(full, a_hi)));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(output_row + x * 4)
+                            , _mm256_packus_epi16(div255_avx2(lo), div255_avx2(hi)));
+    }
+
+    return x;
+}
+
+__attribute__((target("avx2")))
+std::int32_t blend_premultiplied_to_bgra_avx2(const std::uint8_t* input_row
+                                              , std::uint8_t* output_row
+                                              , const std::uint8_t* mask_row
+                                              , std::int32_t opacity
+                                              , std::int32_t width)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m128i q15 = _mm_set1_epi16(opacity);
+    // per 128 bit lane: weights 0..3 | 4..7 and alpha bytes to all channels
+    const __m256i weight_shuffle = _mm256_setr_epi8(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3
+                                                    , 4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7);
+    const __m256i alpha_shuffle = _mm256_setr_epi8(3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15
+                                                   , 3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15);
+    const bool is_scaled = mask_row != nullptr
+            || opacity != full_opacity;
+
+    std::int32_t x = 0;
+
+    for (; x + 8 <= width; x += 8)
+    {
+        auto input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input_row + x * 4));
+
+        if (is_scaled)
+        {
+            auto m = mask_row != nullptr
+                    ? _mm_loadl_epi64(reinterpret_cast<const __m128i*>(mask_row + x))
+                    : _mm_set1_epi8(-1);
+            auto s16 = _mm_mulhrs_epi16(_mm_cvtepu8_epi16(m), q15);
+            auto s = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_packus_epi16(s16, s16))
+                                         , weight_shuffle);
+
+            auto lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(input, zero), _mm256_unpacklo_epi8(s, zero));
+            auto hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(input, zero), _mm256_unpackhi_epi8(s, zero));
+
+            input = _mm256_packus_epi16(div255_avx2(lo), div255_avx2(hi));
+        }
+
+        if (_mm256_testz_si256(input, input))
+        {
+            continue;
+        }
+
+        auto inverse = _mm256_xor_si256(_mm256_shuffle_epi8(input, alpha_shuffle)
+                                        , _mm256_set1_epi8(-1));
+        auto output = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(output_row + x * 4));
+
+        auto lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(output, zero), _mm256_unpacklo_epi8(inverse, zero));
+        auto hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(output, zero), _mm256_unpackhi_epi8(inverse, zero));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(output_row + x * 4)
+                            , _mm256_adds_epu8(input
+                                               , _mm256_packus_epi16(div255_avx2(lo), div255_avx2(hi))));
+    }
+
+    return x;
+}
+
+#endif
+
+struct kernel_set_t
+{
+    std::int32_t    simd_level;
+    blend_row_t     bgra_to_bgra_row;
+    blend_row_t     bgra_to_bgr_row;
+    blend_row_t     premultiplied_to_bgra_row;
+    blend_row_t     premultiplied_to_bgr_row;
+    fill_row_t      fill_bgra_row;
+    fill_row_t      fill_bgr_row;
+    fill_row_t      fill_gray_row;
+};
+
+kernel_set_t detect_kernel_set()
+{
+#ifdef ALPHA_BLEND_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+        // the BGR output is store bound and fills run on short glyph
+        // rows, the SSE versions are enough
+        return { 2
+                 , blend_bgra_to_bgra_avx2
+                 , blend_bgra_to_bgr_sse41
+                 , blend_premultiplied_to_bgra_avx2
+                 , blend_premultiplied_to_bgr_sse41
+                 , fill_bgra_sse41
+                 , fill_bgr_sse41
+                 , fill_gray_sse41 };
+    }
+
+    if (__builtin_cpu_supports("sse4.1"))
+    {
+        return { 1
+                 , blend_bgra_to_bgra_sse41
+                 , blend_bgra_to_bgr_sse41
+                 , blend_premultiplied_to_bgra_sse41
+                 , blend_premultiplied_to_bgr_sse41
+                 , fill_bgra_sse41
+                 , fill_bgr_sse41
+                 , fill_gray_sse41 };
+    }
+#endif
+
+    return { 0
+             , blend_row_none
+             , blend_row_none
+             , blend_row_none
+             , blend_row_none
+             , fill_row_none
+             , fill_row_none
+             , fill_row_none };
+}
+
+const kernel_set_t& kernel_set()
+{
+    static const kernel_set_t kernels = detect_kernel_set();
+    return kernels;
+}
+
+template<std::int32_t InputChannels, std::int32_t OutputChannels>
+void blend_image(const blend_image_t& input
+                 , std::uint8_t* output
+                 , std::int32_t output_stride
+                 , const frame_size_t& size
+                 , std::int32_t opacity
+                 , const blend_mask_t& mask
+                 , blend_row_t row_kernel)
+{
+    for (std::int32_t y = 0; y < size.height; y++)
+    {
+        auto input_row = input.data + y * input.stride;
+        auto output_row = output + y * output_stride;
+        auto mask_row = mask.data != nullptr
+                ? mask.data + y * mask.stride
+                : nullptr;
+
+        auto x = row_kernel(input_row, output_row, mask_row, opacity, size.width);
+        blend_row_scalar<InputChannels, OutputChannels>(input_row, output_row, mask_row, opacity, x, size.width);
+    }
+}
+
+template<std::int32_t OutputChannels>
+void blend_premultiplied_image(const blend_image_t& input
+                               , std::uint8_t* output
+                               , std::int32_t output_stride
+                               , const frame_size_t& size
+                               , std::int32_t opacity
+                               , const blend_mask_t& mask
+                               , blend_row_t row_kernel)
+{
+    for (std::int32_t y = 0; y < size.height; y++)
+    {
+        auto input_row = input.data + y * input.stride;
+        auto output_row = output + y * output_stride;
+        auto mask_row = mask.data != nullptr
+                ? mask.data + y * mask.stride
+                : nullptr;
+
+        auto x = row_kernel(input_row, output_row, mask_row, opacity, size.width);
+        blend_premultiplied_row_scalar<OutputChannels>(input_row, output_row, mask_row, opacity, x, size.width);
+    }
+}
+
+template<std::int32_t OutputChannels>
+void fill_image(const std::uint8_t* color
+                , std::uint8_t* output
+                , std::int32_t output_stride
+                , const frame_size_t& size
+                , std::int32_t opacity
+                , const blend_mask_t& mask
+                , fill_row_t row_kernel)
+{
+    for (std::int32_t y = 0; y < size.height; y++)
+    {
+        auto output_row = output + y * output_stride;
+        auto mask_row = mask.data != nullptr
+                ? mask.data + y * mask.stride
+                : nullptr;
+
+        auto x = row_kernel(color, output_row, mask_row, opacity, size.width);
+        fill_row_scalar<OutputChannels>(color, output_row, mask_row, opacity, x, size.width);
+    }
+}
+
+}
+
+void alpha_blend(const blend_image_t& input
+                 , std::uint8_t* output
+                 , std::int32_t output_stride
+                 , std::int32_t output_channels
+                 , const frame_size_t& size
+                 , double opacity
+                 , const blend_mask_t& mask)
+{
+    if (input.data == nullptr
+            || output == nullptr
+            || opacity <= 0.0)
+    {
+        return;
+    }
+
+    auto q15 = static_cast<std::int32_t>(std::min(opacity, 1.0) * 32767.0 + 0.5);
+
+    if (input.channels == 4
+            && input.premultiplied)
+    {
+        if (output_channels == 4)
+        {
+            blend_premultiplied_image<4>(input, output, output_stride, size, q15, mask, kernel_set().premultiplied_to_bgra_row);
+        }
+        else if (output_channels == 3)
+        {
+            blend_premultiplied_image<3>(input, output, output_stride, size, q15, mask, kernel_set().premultiplied_to_bgr_row);
+        }
+    }
+    else if (input.channels == 4)
+    {
+        if (output_channels == 4)
+        {
+            blend_image<4, 4>(input, output, output_stride, size, q15, mask, kernel_set().bgra_to_bgra_row);
+        }
+        else if (output_channels == 3)
+        {
+            blend_image<4, 3>(input, output, output_stride, size, q15, mask, kernel_set().bgra_to_bgr_row);
+        }
+    }
+    else if (input.channels == 3)
+    {
+        if (output_channels == 4)
+        {
+            blend_image<3, 4>(input, output, output_stride, size, q15, mask, blend_row_none);
+        }
+        else if (output_channels == 3)
+        {
+            blend_image<3, 3>(input, output, output_stride, size, q15, mask, blend_row_none);
+        }
+    }
+}
+
+void alpha_fill(const std::uint8_t* color
+                , std::uint8_t* output
+                , std::int32_t output_stride
+                , std::int32_t output_channels
+                , const frame_size_t& size
+                , double opacity
+                , const blend_mask_t& mask)
+{
+    if (color == nullptr
+            || output == nullptr
+            || opacity <= 0.0)
+    {
+        return;
+    }
+
+    auto q15 = static_cast<std::int32_t>(std::min(opacity, 1.0) * 32767.0 + 0.5);
+
+    if (output_channels == 4)
+    {
+        fill_image<4>(color, output, output_stride, size, q15, mask, kernel_set().fill_bgra_row);
+    }
+    else if (output_channels == 3)
+    {
+        fill_image<3>(color, output, output_stride, size, q15, mask, kernel_set().fill_bgr_row);
+    }
+    else if (output_channels == 2)
+    {
+        fill_image<2>(color, output, output_stride, size, q15, mask, fill_row_none);
+    }
+    else if (output_channels == 1)
+    {
+        fill_image<1>(color, output, output_stride, size, q15, mask, kernel_set().fill_gray_row);
+    }
+}
+
+void premultiply_alpha(const std::uint8_t* input
+                       , std::int32_t input_stride
+                       , std::uint8_t* output
+                       , std::int32_t output_stride
+                       , const frame_size_t& size)
+{
+    for (std::int32_t y = 0; y < size.height; y++)
+    {
+        const auto* input_row = input + y * input_stride;
+        auto* output_row = output + y * output_stride;
+
+        for (std::int32_t x = 0; x < size.width * 4; x += 4)
+        {
+            std::int32_t a = input_row[x + 3];
+
+            output_row[x] = div255(input_row[x] * a);
+            output_row[x + 1] = div255(input_row[x + 1] * a);
+            output_row[x + 2] = div255(input_row[x + 2] * a);
+            output_row[x + 3] = a;
+        }
+    }
+}
+
+void unpremultiply_alpha(const std::uint8_t* input
+                         , std::int32_t input_stride
+                         , std::uint8_t* output
+                         , std::int32_t output_stride
+                         , const frame_size_t& size)
+{
+    for (std::int32_t y = 0; y < size.height; y++)
+    {
+        const auto* input_row = input + y * input_stride;
+        auto* output_row = output + y * output_stride;
+
+        for (std::int32_t x = 0; x < size.width * 4; x += 4)
+        {
+            std::int32_t a = input_row[x + 3];
+
+            for (std::int32_t c = 0; c < 3; c++)
+            {
+                output_row[x + c] = a != 0
+                        ? std::min((input_row[x + c] * 255 + a / 2) / a, 255)
+                        : 0;
+            }
+
+            output_row[x + 3] = a;
+        }
+    }
+}
+
+std::int32_t alpha_blend_simd_level()
+{
+    return kernel_set().simd_level;
+}
+
+}
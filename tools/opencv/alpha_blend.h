@@ -0,0 +1,64 @@
+#ifndef OCV_ALPHA_BLEND_H
+#define OCV_ALPHA_BLEND_H
+
+#include "ocv_types.h"
+
+namespace ocv
+{
+
+struct blend_image_t
+{
+    const std::uint8_t* data;
+    std::int32_t        stride;     // bytes per row
+    std::int32_t        channels;   // 3 - BGR, 4 - BGRA
+    bool                premultiplied = false;  // BGRA with the color multiplied by alpha
+};
+
+struct blend_mask_t
+{
+    const std::uint8_t* data = nullptr;
+    std::int32_t        stride = 0;
+};
+
+// Single pass blend of a BGR/BGRA image over a BGR/BGRA one. The weight of
+// a pixel is alpha * mask * opacity in fixed point, a BGR source is opaque.
+// BGRA sources go through SSE4.1/AVX2 kernels picked at runtime; a
+// premultiplied source needs one multiply-add per channel.
+void alpha_blend(const blend_image_t& input
+                 , std::uint8_t* output
+                 , std::int32_t output_stride
+                 , std::int32_t output_channels
+                 , const frame_size_t& size
+                 , double opacity = 1.0
+                 , const blend_mask_t& mask = {});
+
+// Blend of a solid color through a coverage mask (glyphs, shapes): the
+// color has output_channels bytes (1 - 4, planes of YUV included) and
+// every output channel is blended.
+void alpha_fill(const std::uint8_t* color
+                , std::uint8_t* output
+                , std::int32_t output_stride
+                , std::int32_t output_channels
+                , const frame_size_t& size
+                , double opacity = 1.0
+                , const blend_mask_t& mask = {});
+
+// straight <-> premultiplied alpha of BGRA pixels, the output may be the input
+void premultiply_alpha(const std::uint8_t* input
+                       , std::int32_t input_stride
+                       , std::uint8_t* output
+                       , std::int32_t output_stride
+                       , const frame_size_t& size);
+
+void unpremultiply_alpha(const std::uint8_t* input
+                         , std::int32_t input_stride
+                         , std::uint8_t* output
+                         , std::int32_t output_stride
+                         , const frame_size_t& size);
+
+// the vectorized kernels in use: 0 - none, 1 - SSE4.1, 2 - AVX2
+std::int32_t alpha_blend_simd_level();
+
+}
+
+#endif // OCV_ALPHA_BLEND_H
@@ -0,0 +1,97 @@
+#include "draw_command_list.h"
+
+namespace ocv
+{
+
+draw_command_list::draw_command_list()
+    : m_text_count(0)
+{
+
+}
+
+void draw_command_list::add_rect(const frame_rect_t &rect
+                                 , color_t color
+                                 , std::int32_t line_weight
+                                 , double opacity)
+{
+    m_commands.push_back({ draw_command_type_t::rect
+                           , rect
+                           , color
+                           , line_weight
+                           , opacity
+                           , 0 });
+}
+
+void draw_command_list::add_fill_rect(const frame_rect_t &rect
+                                      , color_t color
+                                      , double opacity)
+{
+    m_commands.push_back({ draw_command_type_t::fill_rect
+                           , rect
+                           , color
+                           , 0
+                           , opacity
+                           , 0 });
+}
+
+void draw_command_list::add_ellipse(const frame_rect_t &rect
+                                    , color_t color
+                                    , std::int32_t line_weight)
+{
+    m_commands.push_back({ draw_command_type_t::ellipse
+                           , rect
+                           , color
+                           , line_weight
+                           , 1.0
+                           , 0 });
+}
+
+void draw_command_list::add_text(const frame_point_t &pos
+                                 , const std::string &text
+                                 , color_t color)
+{
+    // the strings of the previous fill are reused
+    if (m_text_count < m_texts.size())
+    {
+        m_texts[m_text_count] = text;
+    }
+    else
+    {
+        m_texts.push_back(text);
+    }
+
+    m_commands.push_back({ draw_command_type_t::text
+                           , { pos, {} }
+                           , color
+                           , 0
+                           , 1.0
+                           , m_text_count++ });
+}
+
+void draw_command_list::clear()
+{
+    m_commands.clear();
+    m_text_count = 0;
+}
+
+bool draw_command_list::empty() const
+{
+    return m_commands.empty();
+}
+
+std::size_t draw_command_list::size() const
+{
+    return m_commands.size();
+}
+
+const draw_command_array_t &draw_command_list::commands() const
+{
+    return m_commands;
+}
+
+const std::string &draw_command_list::text(const draw_command_t &command) const
+{
+    return m_texts[command.text_index];
+}
+
+}
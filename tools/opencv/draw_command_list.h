@@ -0,0 +1,66 @@
+#ifndef OCV_DRAW_COMMAND_LIST_H
+#define OCV_DRAW_COMMAND_LIST_H
+
+#include "ocv_types.h"
+
+namespace ocv
+{
+
+enum class draw_command_type_t
+{
+    rect,
+    fill_rect,
+    ellipse,
+    text
+};
+
+struct draw_command_t
+{
+    draw_command_type_t type;
+    frame_rect_t        rect;           // text: the offset is the text position
+    color_t             color;
+    std::int32_t        line_weight;    // rect, ellipse; < 0 - filled
+    double              opacity;        // rect, fill_rect
+    std::size_t         text_index;     // text
+};
+
+using draw_command_array_t = std::vector<draw_command_t>;
+
+// Primitives recorded with their own colors, to be drawn by one
+// draw_processor::draw_commands() call. clear() keeps the memory, so a list
+// refilled every frame does not allocate.
+class draw_command_list
+{
+    draw_command_array_t        m_commands;
+    std::vector<std::string>    m_texts;
+    std::size_t                 m_text_count;
+
+public:
+    draw_command_list();
+
+    void add_rect(const frame_rect_t& rect
+                  , color_t color
+                  , std::int32_t line_weight = 1
+                  , double opacity = 1.0);
+    void add_fill_rect(const frame_rect_t& rect
+                       , color_t color
+                       , double opacity = 1.0);
+    void add_ellipse(const frame_rect_t& rect
+                     , color_t color
+                     , std::int32_t line_weight = 1);
+    // drawn with the font format of the draw processor
+    void add_text(const frame_point_t& pos
+                  , const std::string& text
+                  , color_t color);
+
+    void clear();
+    bool empty() const;
+    std::size_t size() const;
+
+    const draw_command_array_t& commands() const;
+    const std::string& text(const draw_command_t& command) const;
+};
+
+}
+
+#endif // OCV_DRAW_COMMAND_LIST_H
@@ -1,9 +1,17 @@
 #include "draw_processor.h"
+#include "alpha_blend.h"
+#include "text_cache.h"
+#include "image_cache.h"
+#include "yuv_overlay.h"
+#include "tools/base/worker_pool.h"
 #include <opencv2/imgproc.hpp>
 #include <opencv2/freetype.hpp>
 #include <opencv2/highgui.hpp>
 
+#include <array>
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <thread>
 
@@ -20,6 +28,7 @@ namespace
                 return CV_8UC3;
             break;
             case frame_format_t::bgra:
+            case frame_format_t::bgra_premultiplied:
                 return CV_8UC4;
             break;
             default:
@@ -38,6 +47,75 @@ namespace
                           );
         //return cv::Scalar(color);
     }
+
+    yuv_color_t yuv_from_color(color_t color)
+    {
+        return yuv_from_bgr((color >> 24) & 0xff
+                            , (color >> 16) & 0xff
+                            , (color >> 8) & 0xff);
+    }
+
+    // rows of the output a batch of commands is split into, even for chroma
+    const std::int32_t command_band_height = 64;
+
+    // a solid area of a batched command, clipped to the output
+    struct draw_span_t
+    {
+        cv::Rect        rect;
+        std::uint8_t    pixel[4];   // B, G, R, A
+        yuv_color_t     yuv;
+        double          opacity;
+    };
+
+    bool is_span_command(const draw_command_t& command)
+    {
+        return command.type == draw_command_type_t::rect
+                || command.type == draw_command_type_t::fill_rect;
+    }
+
+    // pixels cv::rectangle covers before and after the line of a bar of the
+    // thickness, the stroke width depends on its parity, so it is measured
+    // once instead of assumed
+    struct stroke_extent_t
+    {
+        std::int32_t    before;
+        std::int32_t    after;
+    };
+
+    const stroke_extent_t& stroke_extent(std::int32_t thickness)
+    {
+        static const auto extents = []
+        {
+            std::array<stroke_extent_t, 11> extents = {};
+            cv::Mat mask(96, 96, CV_8UC1);
+            const std::int32_t x = 48;
+            const std::int32_t y = 40;
+
+            for (std::int32_t t = 1; t < static_cast<std::int32_t>(extents.size()); t++)
+            {
+                mask.setTo(cv::Scalar(0));
+                cv::rectangle(mask, cv::Rect(24, y, 48, 32), cv::Scalar(255), t);
+
+                // the top bar at the middle column
+                auto top = y;
+                auto bottom = y;
+                while (top > 0 && mask.ptr(top - 1)[x] != 0)
+                {
+                    top--;
+                }
+                while (bottom < mask.rows - 1 && mask.ptr(bottom + 1)[x] != 0)
+                {
+                    bottom++;
+                }
+
+                extents[t] = { y - top, bottom - y };
+            }
+
+            return extents;
+        }();
+
+        return extents[std::max(std::min(thickness, 10), 1)];
+    }
 }
 
 struct ocv_context_t
@@ -45,6 +123,14 @@ struct ocv_context_t
     draw_format_t                       m_draw_format;
     cv::Ptr<cv::freetype::FreeType2>    m_custom_font;
     cv::Mat                             m_output_mat;
+    yuv_image_t                         m_output_yuv;
+    mutable text_cache                  m_text_cache;
+    image_cache                         m_image_cache;
+    std::vector<draw_span_t>            m_spans;
+    std::vector<std::vector<std::size_t>> m_band_spans;
+    frame_data_t                        m_full_coverage;
+    frame_data_t                        m_chroma_coverage;
+    std::vector<frame_data_t>           m_band_coverage;
 
     ocv_context_t(const frame_info_t& format
                   , void *pixels)
@@ -72,11 +158,13 @@ struct ocv_context_t
                 m_custom_font = cv::freetype::createFreeType2();
                 m_custom_font->loadFontData(font_path, 0);
             }
+            m_text_cache.set_custom_font(m_custom_font);
             return true;
         }
         catch(const std::exception& e)
         {
             m_custom_font.reset();
+            m_text_cache.set_custom_font(m_custom_font);
             // TODO: log
         }
 
@@ -86,14 +174,114 @@ struct ocv_context_t
     void set_output_image(const frame_info_t& format
                           , void *pixels)
     {
+        if (format.is_planar())
+        {
+            if (pixels != nullptr)
+            {
+                auto data = static_cast<std::uint8_t*>(pixels);
+
+                void* planes[] = { data + format.plane_offset(0)
+                                   , data + format.plane_offset(1)
+                                   , data + format.plane_offset(2) };
+                const std::int32_t strides[] = { static_cast<std::int32_t>(format.plane_line_size(0))
+                                                 , static_cast<std::int32_t>(format.plane_line_size(1))
+                                                 , static_cast<std::int32_t>(format.plane_line_size(2)) };
+
+                set_output_image(format
+                                 , planes
+                                 , strides);
+            }
+            return;
+        }
+
         auto type = get_image_type(format.format);
         if (type != 0
                 && pixels != nullptr)
         {
+            m_output_yuv = {};
             m_output_mat = cv::Mat(format.size.height
                                    , format.size.width
                                    , type
-                                   , pixels);
+                                   , pixels
+                                   , format.line_size());
+        }
+    }
+
+    void set_output_image(const frame_info_t& format
+                          , void* const planes[]
+                          , const std::int32_t strides[])
+    {
+        if (!format.is_planar())
+        {
+            set_output_image({ format.format, format.size, strides[0] }
+                             , planes[0]);
+            return;
+        }
+
+        if (planes[0] != nullptr
+                && planes[1] != nullptr
+                && (format.format == frame_format_t::nv12 || planes[2] != nullptr))
+        {
+            m_output_mat = cv::Mat();
+            m_output_yuv.y = static_cast<std::uint8_t*>(planes[0]);
+            m_output_yuv.u = static_cast<std::uint8_t*>(planes[1]);
+            m_output_yuv.v = format.format == frame_format_t::yuv420p
+                    ? static_cast<std::uint8_t*>(planes[2])
+                    : nullptr;
+            m_output_yuv.y_stride = strides[0];
+            m_output_yuv.u_stride = strides[1];
+            m_output_yuv.v_stride = format.format == frame_format_t::yuv420p
+                    ? strides[2]
+                    : 0;
+            m_output_yuv.size = format.size;
+        }
+    }
+
+    void fill_coverage(const frame_point_t& offset
+                       , const cv::Mat& coverage
+                       , color_t color)
+    {
+        yuv_fill(m_output_yuv
+                 , offset
+                 , { coverage.cols, coverage.rows }
+                 , yuv_from_color(color)
+                 , { coverage.data, static_cast<std::int32_t>(coverage.step) }
+                 , 1.0
+                 , &m_chroma_coverage);
+    }
+
+    // Packed outputs are drawn on directly. For YUV outputs the shape is drawn
+    // into a coverage of its bounds which is then filled into the planes, so
+    // the cost follows the shape and not the frame.
+    template<typename Draw>
+    void draw_shape(const cv::Rect& bounds
+                    , color_t color
+                    , const Draw& draw)
+    {
+        if (is_yuv())
+        {
+            auto visible = bounds & cv::Rect(0, 0, m_output_yuv.size.width, m_output_yuv.size.height);
+            if (!visible.empty())
+            {
+                cv::Mat coverage(visible.height
+                                 , visible.width
+                                 , CV_8UC1
+                                 , cv::Scalar(0));
+
+                draw(coverage
+                     , cv::Point(-visible.x, -visible.y)
+                     , cv::Scalar(255));
+
+                fill_coverage({ visible.x, visible.y }
+                              , coverage
+                              , color);
+            }
+        }
+        else
+        {
+            draw(m_output_mat
+                 , cv::Point(0, 0)
+                 , scalar_from_color(color));
         }
     }
 
@@ -102,36 +290,39 @@ struct ocv_context_t
     {
         if (is_output_set())
         {
-
-            if (m_custom_font != nullptr
-                    && m_output_mat.channels() == 3)
+            try
             {
-                try
+                if (is_yuv())
                 {
-                    m_custom_font->putText(m_output_mat
-                                           , text
-                                           , { pos.x, pos.y }
-                                           , m_draw_format.font_format.height
-                                           , scalar_from_color(m_draw_format.font_color)
-                                           , m_draw_format.font_format.weight
-                                           , cv::LineTypes::LINE_AA
-                                           , true);
+                    auto bounds = m_text_cache.text_bounds(m_draw_format.font_format
+                                                           , text);
+                    if (!bounds.is_null())
+                    {
+                        draw_shape({ pos.x + bounds.offset.x, pos.y + bounds.offset.y, bounds.size.width, bounds.size.height }
+                                   , m_draw_format.font_color
+                                   , [&](cv::Mat& image, const cv::Point& shift, const cv::Scalar& color)
+                        {
+                            m_text_cache.draw_text(image
+                                                   , { pos.x + shift.x, pos.y + shift.y }
+                                                   , m_draw_format.font_format
+                                                   , text
+                                                   , color);
+                        });
+                    }
                 }
-                catch(const std::exception& e)
+                else
                 {
-                    std::cout << e.what() << std::endl;
-                    // log
+                    m_text_cache.draw_text(m_output_mat
+                                           , pos
+                                           , m_draw_format.font_format
+                                           , text
+                                           , scalar_from_color(m_draw_format.font_color));
                 }
             }
-            else
+            catch(const std::exception& e)
             {
-                cv::putText(m_output_mat
-                            , text
-                            , { pos.x, pos.y }
-                            , m_draw_format.font_format.native_font()
-                            , m_draw_format.font_format.scale_font()
-                            , scalar_from_color(m_draw_format.font_color)
-                            , m_draw_format.font_format.weight);
+                std::cout << e.what() << std::endl;
+                // log
             }
         }
     }
@@ -141,10 +332,17 @@ struct ocv_context_t
         if (is_output_set()
                 && !rect.is_null())
         {
-            cv::rectangle(m_output_mat
-                          , { rect.offset.x, rect.offset.y, rect.size.width, rect.size.height }
-                          , scalar_from_color(m_draw_format.pen_color)
-                          , std::min(m_draw_format.line_weight, 10));
+            auto thickness = std::min(m_draw_format.line_weight, 10);
+
+            draw_shape(shape_bounds(rect, thickness)
+                       , m_draw_format.pen_color
+                       , [&](cv::Mat& image, const cv::Point& shift, const cv::Scalar& color)
+            {
+                cv::rectangle(image
+                              , { rect.offset.x + shift.x, rect.offset.y + shift.y, rect.size.width, rect.size.height }
+                              , color
+                              , thickness);
+            });
         }
     }
 
@@ -153,12 +351,19 @@ struct ocv_context_t
         if (is_output_set()
                 && !rect.is_null())
         {
-            cv::ellipse(m_output_mat
-                          , { rect.offset.x + rect.size.width / 2, rect.offset.y + rect.size.height / 2 }
-                          , { rect.size.width / 2, rect.size.height / 2 }
-                          , 0, 0, 360
-                          , scalar_from_color(m_draw_format.pen_color)
-                          , std::min(m_draw_format.line_weight, 10));
+            auto thickness = std::min(m_draw_format.line_weight, 10);
+
+            draw_shape(shape_bounds(rect, thickness)
+                       , m_draw_format.pen_color
+                       , [&](cv::Mat& image, const cv::Point& shift, const cv::Scalar& color)
+            {
+                cv::ellipse(image
+                              , { rect.offset.x + rect.size.width / 2 + shift.x, rect.offset.y + rect.size.height / 2 + shift.y }
+                              , { rect.size.width / 2, rect.size.height / 2 }
+                              , 0, 0, 360
+                              , color
+                              , thickness);
+            });
         }
     }
 
@@ -195,331 +400,445 @@ struct ocv_context_t
     void transparent_overlay(const cv::Mat& input
                              , cv::Mat& output
                              , double opacity = 1.0
-                             , cv::Mat mask = {})
+                             , const cv::Mat& mask = {}
+                             , bool premultiplied = false)
     {
-
-        if (opacity == 1.0
+        if (opacity >= 1.0
                 && mask.empty()
-                && input.channels() != 4)
+                && input.channels() != 4
+                && input.type() == output.type())
         {
             input.copyTo(output);
+            return;
         }
-        else
-        {
-            if (input.channels() == 4)
-            {
-                std::vector<cv::Mat> mat_channels;
-                cv::split(input, mat_channels);
-                if (!mask.empty())
-                {
-                    cv::bitwise_and(mat_channels[3], mask, mask);
-                }
-                else
-                {
-                    mask = mat_channels[3];
-                }
-            }
 
-            if (opacity == 1.0)
-            {
-                input.copyTo(output, mask);
-            }
-            else
-            {
-                cv::Mat tmp;
-                cv::addWeighted(input
-                                , opacity
-                                , output
-                                , 1.0 - opacity
-                                , 0.0
-                                , tmp);
+        blend_mask_t blend_mask;
 
-                tmp.copyTo(output
-                           , mask);
-            }
+        if (!mask.empty()
+                && mask.type() == CV_8UC1
+                && mask.cols >= input.cols
+                && mask.rows >= input.rows)
+        {
+            blend_mask.data = mask.data;
+            blend_mask.stride = mask.step;
         }
 
+        alpha_blend({ input.data, static_cast<std::int32_t>(input.step), input.channels(), premultiplied }
+                    , output.data
+                    , output.step
+                    , output.channels()
+                    , { std::min(input.cols, output.cols), std::min(input.rows, output.rows) }
+                    , opacity
+                    , blend_mask);
+    }
 
-        /*
+    void draw_matrix(const cv::Mat& input
+                     , const cv::Rect& rect
+                     , double opacity
+                     , draw_figure_t figure = draw_figure_t::rectangle
+                     , bool premultiplied = false)
+    {
+        const auto& mask = m_image_cache.figure_mask({ rect.width, rect.height }
+                                                     , figure);
 
-        auto channels = output.channels();
-        if (channels == 4
-                && input.channels() == channels)
+        if (is_yuv())
         {
-            auto tp = std::chrono::high_resolution_clock::now();
+            blend_mask_t blend_mask;
 
             if (!mask.empty())
             {
-                std::vector<cv::Mat> mat_channels;
-                cv::split(input, mat_channels);
-
-                cv::Mat tmp;
-                cv::bitwise_and(mat_channels[3], mask, mat_channels[3]);
-                cv::addWeighted(input
-                                , opacity
-                                , output
-                                , 1.0 - opacity
-                                , 0.0
-                                , tmp);
-                tmp.copyTo(output
-                           , mat_channels[3]);
+                blend_mask.data = mask.data;
+                blend_mask.stride = mask.step;
             }
-            else
-            {
-                input.copyTo(output);
-            }
-
-            auto dt = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - tp).count();
-
-            std::cout << "Draw image delay: " << dt << std::endl;
 
-            std::int32_t input_step = input.step;
-            std::int32_t output_step = output.step;
+            yuv_blend(m_output_yuv
+                      , { rect.x, rect.y }
+                      , { input.data, static_cast<std::int32_t>(input.step), input.channels(), premultiplied }
+                      , { std::min(input.cols, rect.width), std::min(input.rows, rect.height) }
+                      , opacity
+                      , blend_mask);
+        }
+        else
+        {
+            auto output = m_output_mat(rect);
 
-            std::int32_t mask_step = 0;
+            transparent_overlay(input
+                                , output
+                                , opacity
+                                , mask
+                                , premultiplied);
+        }
+    }
 
-            if (!mask.empty()
-                    && mask.channels() == 1)
-            {
-                mask_step = mask.step;
-            }
+    void draw_image(const frame_point_t& pos
+                    , const frame_info_t& format
+                    , const void *pixels
+                    , draw_figure_t figure = draw_figure_t::rectangle
+                    , std::uint64_t generation = 0)
+    {
+        draw_image({ pos, format.size }
+                   , format
+                   , pixels
+                   , figure
+                   , generation);
+    }
 
-            auto tp = std::chrono::high_resolution_clock::now();
+    void draw_image(const frame_rect_t& rect_to
+                    , const frame_info_t& format
+                    , const void *pixels
+                    , draw_figure_t figure = draw_figure_t::rectangle
+                    , std::uint64_t generation = 0)
+    {
+        draw_image(rect_to
+                   , { 0, 0, format.size.width, format.size.height }
+                   , format
+                   , pixels
+                   , figure
+                   , generation);
+    }
 
-            for (std::int32_t y = 0; y < input.rows; y++)
+    void draw_image(const frame_rect_t& rect_to
+                    , const frame_rect_t& rect_from
+                    , const frame_info_t& format
+                    , const void *pixels
+                    , draw_figure_t figure = draw_figure_t::rectangle
+                    , std::uint64_t generation = 0)
+    {
+        if (is_output_set())
+        {
+            auto type = get_image_type(format.format);
+            if (type != 0
+                    && pixels != nullptr)
             {
-                const auto* overlay_data = input.data + y * input_step;
-                auto src_data = output.data + y * output_step;
-                const std::uint8_t* mask_data = mask_step > 0
-                                                ? mask.data + y * mask_step
-                                                : nullptr;
 
-                for (std::int32_t x = 0; x < input.cols; x++)
-                {
-                    double alpha = opacity * (static_cast<double>(overlay_data[3]) / 255.0);
+                cv::Mat input_matrix(format.size.height
+                                     , format.size.width
+                                     , type
+                                     , const_cast<void*>(pixels)
+                                     , format.line_size());
 
-                    if (mask_data != nullptr)
-                    {
-                        double mask = static_cast<double>(*mask_data) / 255.0;
-                        alpha = mask * alpha;
 
-                        mask_data += 1;
-                    }
+                input_matrix = input_matrix({rect_from.offset.x, rect_from.offset.y, rect_from.size.width, rect_from.size.height});
 
-                    if (alpha > 0.0)
-                    {
-                        for (std::int32_t c = 0; c < channels; c++)
-                        {
-                            src_data[c] = src_data[c] * (1.0 - alpha) + overlay_data[c] * alpha;
-                        }
-                    }
+                auto scaled_image = m_image_cache.scaled_image(input_matrix
+                                                               , { pixels, format, rect_from, generation, rect_to.size });
 
-                    overlay_data += channels;
-                    src_data += channels;
-                }
+                draw_matrix(scaled_image.pixels
+                            , { rect_to.offset.x, rect_to.offset.y, rect_to.size.width, rect_to.size.height }
+                            , m_draw_format.draw_opacity
+                            , figure
+                            , scaled_image.premultiplied);
             }
-
-            auto dt = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - tp).count();
-
-            std::cout << "Draw image delay: " << dt << std::endl;
-
-        }
-        else
-        {
-            input.copyTo(output);
         }
-        */
-
     }
 
-    cv::Mat create_mask(std::int32_t cols
-                        , std::int32_t rows
-                        , draw_figure_t figure = draw_figure_t::rectangle)
+    void draw_poly(const frame_point_list_t& point_list)
     {
-        cv::Mat mask;
-
-        switch(figure)
+        if (is_output_set())
         {
-            case draw_figure_t::ellipse:
+            std::vector<cv::Point> points;
+            for (const auto& p : point_list)
             {
-                mask = cv::Mat(rows, cols, CV_8UC1, cv::Scalar(0));
-                cv::ellipse(mask
-                            , { cols / 2, rows / 2 }
-                            , { cols / 2,  rows / 2}
-                            , 0, 0, 360
-                            , cv::Scalar(255)
-                            , -1);
+                points.emplace_back(p.x, p.y);
             }
-            break;
-            default:
-            {
 
-            }
-        }
+            auto bounds = cv::boundingRect(points);
 
-        return mask;
+            draw_shape({ bounds.x - 1, bounds.y - 1, bounds.width + 2, bounds.height + 2 }
+                       , m_draw_format.fill_color
+                       , [&](cv::Mat& image, const cv::Point& shift, const cv::Scalar& color)
+            {
+                std::vector<cv::Point> shifted_points;
+                for (const auto& p : points)
+                {
+                    shifted_points.emplace_back(p.x + shift.x, p.y + shift.y);
+                }
+                cv::fillConvexPoly(image
+                                   , shifted_points
+                                   , color);
+            });
+        }
     }
 
-    void draw_matrix(const cv::Mat& input
-                     , cv::Mat& output
-                     , double opacity
-                     , draw_figure_t figure = draw_figure_t::rectangle)
+    void draw_commands(const draw_command_list& commands
+                       , bool parallel)
     {
-        transparent_overlay(input
-                            , output
-                            , opacity
-                            , create_mask(output.cols, output.rows, figure));
-        /*
-        if (input.channels() != 4)
+        if (!is_output_set())
         {
-            if (opacity == 1.0)
+            return;
+        }
+
+        const auto& command_array = commands.commands();
+
+        // runs of boxes are filled as spans, the other commands are drawn
+        // one by one in between, so the order of the list is kept
+        std::size_t i = 0;
+        while (i < command_array.size())
+        {
+            if (is_span_command(command_array[i]))
             {
-                input.copyTo(output);
+                m_spans.clear();
+
+                for (; i < command_array.size() && is_span_command(command_array[i]); i++)
+                {
+                    add_spans(command_array[i]);
+                }
+
+                fill_spans(parallel);
             }
-            else if (opacity > 0.0)
+            else
             {
-                cv::addWeighted(input
-                                , opacity
-                                , output
-                                , 1.0 - opacity
-                                , 0.0
-                                , output);
+                draw_command(commands
+                             , command_array[i]);
+                i++;
             }
         }
-        else
-        {
-            transparent_overlay(input
-                                , output
-                                , opacity
-                                , create_mask(output.cols, output.rows, figure));
-        }*/
     }
 
-    void draw_image(const frame_point_t& pos
-                    , const frame_info_t& format
-                    , const void *pixels
-                    , draw_figure_t figure = draw_figure_t::rectangle)
+    void draw_command(const draw_command_list& commands
+                      , const draw_command_t& command)
     {
-        if (is_output_set())
+        auto draw_format = m_draw_format;
+
+        switch(command.type)
         {
-            auto type = get_image_type(format.format);
-            if (type != 0
-                    && pixels != nullptr)
-            {
-                cv::Mat input_matrix(format.size.height
-                                     , format.size.width
-                                     , type
-                                     , const_cast<void*>(pixels));
+            case draw_command_type_t::ellipse:
+                m_draw_format.pen_color = command.color;
+                m_draw_format.line_weight = command.line_weight;
+                draw_ellipse(command.rect);
+            break;
+            case draw_command_type_t::text:
+                m_draw_format.font_color = command.color;
+                draw_text(command.rect.offset
+                          , commands.text(command));
+            break;
+            default:
+            {}
+        }
 
-                auto output = m_output_mat({ pos.x, pos.y, pos.x + input_matrix.rows, pos.y + input_matrix.cols });
+        m_draw_format = draw_format;
+    }
 
-                draw_matrix(input_matrix
-                            , output
-                            , m_draw_format.draw_opacity
-                            , figure);
-            }
+    void add_span(const cv::Rect& rect
+                  , const draw_command_t& command)
+    {
+        auto size = output_size();
+        auto visible = rect & cv::Rect(0, 0, size.width, size.height);
+
+        if (!visible.empty()
+                && command.opacity > 0.0)
+        {
+            draw_span_t span;
+            span.rect = visible;
+            span.pixel[0] = (command.color >> 24) & 0xff;
+            span.pixel[1] = (command.color >> 16) & 0xff;
+            span.pixel[2] = (command.color >> 8) & 0xff;
+            span.pixel[3] = command.color & 0xff;
+            span.yuv = yuv_from_color(command.color);
+            span.opacity = command.opacity;
+
+            m_spans.push_back(span);
         }
     }
 
-    void draw_image(const frame_rect_t& rect_to
-                    , const frame_info_t& format
-                    , const void *pixels
-                    , draw_figure_t figure = draw_figure_t::rectangle)
+    // a stroke as the bars cv::rectangle covers, they do not overlap so a
+    // translucent stroke is even
+    void add_spans(const draw_command_t& command)
     {
-        if (is_output_set())
+        const auto& rect = command.rect;
+
+        if (rect.is_null())
         {
-            auto type = get_image_type(format.format);
-            if (type != 0
-                    && pixels != nullptr)
-            {
-                cv::Mat input_matrix(format.size.height
-                                     , format.size.width
-                                     , type
-                                     , const_cast<void*>(pixels));
+            return;
+        }
 
-                cv::Mat scale_matrix;
+        if (command.type == draw_command_type_t::fill_rect
+                || command.line_weight < 0)
+        {
+            add_span({ rect.offset.x, rect.offset.y, rect.size.width, rect.size.height }
+                     , command);
+            return;
+        }
 
-                cv::resize(input_matrix
-                           , scale_matrix
-                           , { rect_to.size.width, rect_to.size.height });
+        const auto& extent = stroke_extent(command.line_weight);
+        const auto thickness = extent.before + extent.after + 1;
 
-                auto output = m_output_mat({rect_to.offset.x, rect_to.offset.y, rect_to.size.width, rect_to.size.height});
+        const cv::Rect outer(rect.offset.x - extent.before
+                             , rect.offset.y - extent.before
+                             , rect.size.width - 1 + thickness
+                             , rect.size.height - 1 + thickness);
 
-                draw_matrix(scale_matrix
-                            , output
-                            , m_draw_format.draw_opacity
-                            , figure);
-            }
+        if (outer.width <= 2 * thickness
+                || outer.height <= 2 * thickness)
+        {
+            add_span(outer
+                     , command);
+            return;
         }
-    }
 
+        add_span({ outer.x, outer.y, outer.width, thickness }
+                 , command);
+        add_span({ outer.x, outer.y + thickness, thickness, outer.height - 2 * thickness }
+                 , command);
+        add_span({ outer.x + outer.width - thickness, outer.y + thickness, thickness, outer.height - 2 * thickness }
+                 , command);
+        add_span({ outer.x, outer.y + outer.height - thickness, outer.width, thickness }
+                 , command);
+    }
 
-    void draw_image(const frame_rect_t& rect_to
-                    , const frame_rect_t& rect_from
-                    , const frame_info_t& format
-                    , const void *pixels
-                    , draw_figure_t figure = draw_figure_t::rectangle)
+    // the spans are bucketed by row bands in the order of the list, the
+    // bands do not share output rows and are filled in parallel
+    void fill_spans(bool parallel)
     {
-        if (is_output_set())
+        if (m_spans.empty())
         {
-            auto type = get_image_type(format.format);
-            if (type != 0
-                    && pixels != nullptr)
-            {
+            return;
+        }
 
-                cv::Mat input_matrix(format.size.height
-                                     , format.size.width
-                                     , type
-                                     , const_cast<void*>(pixels));
+        auto size = output_size();
+        auto bands = static_cast<std::size_t>((size.height + command_band_height - 1) / command_band_height);
 
+        if (m_band_spans.size() < bands)
+        {
+            m_band_spans.resize(bands);
+            m_band_coverage.resize(bands);
+        }
 
-                input_matrix = input_matrix({rect_from.offset.x, rect_from.offset.y, rect_from.size.width, rect_from.size.height});
+        for (std::size_t b = 0; b < bands; b++)
+        {
+            m_band_spans[b].clear();
+        }
+
+        for (std::size_t s = 0; s < m_spans.size(); s++)
+        {
+            const auto& rect = m_spans[s].rect;
+
+            for (auto b = rect.y / command_band_height; b <= (rect.y + rect.height - 1) / command_band_height; b++)
+            {
+                m_band_spans[b].push_back(s);
+            }
+        }
 
-                cv::Mat scale_matrix;
+        if (is_yuv()
+                && m_full_coverage.size() < static_cast<std::size_t>(size.width))
+        {
+            m_full_coverage.assign(size.width, 0xff);
+        }
 
-                cv::resize(input_matrix
-                           , scale_matrix
-                           , { rect_to.size.width, rect_to.size.height });
+        auto fill_band = [&](std::size_t b)
+        {
+            const auto band_y = static_cast<std::int32_t>(b) * command_band_height;
+            const cv::Rect band_rect(0
+                                     , band_y
+                                     , size.width
+                                     , std::min(command_band_height, size.height - band_y));
 
-                auto output = m_output_mat({rect_to.offset.x, rect_to.offset.y, rect_to.size.width, rect_to.size.height});
+            for (auto s : m_band_spans[b])
+            {
+                fill_span(m_spans[s]
+                          , band_rect
+                          , m_band_coverage[b]);
+            }
+        };
 
-                draw_matrix(scale_matrix
-                            , output
-                            , m_draw_format.draw_opacity
-                            , figure);
+        if (parallel
+                && bands > 1)
+        {
+            base::worker_pool::shared_pool().run(bands
+                                                 , fill_band);
+        }
+        else
+        {
+            for (std::size_t b = 0; b < bands; b++)
+            {
+                fill_band(b);
             }
         }
     }
 
-    void draw_poly(const frame_point_list_t& point_list)
+    // the chroma coverage is built in the scratch of the band, the bands
+    // are filled in parallel
+    void fill_span(const draw_span_t& span
+                   , const cv::Rect& band_rect
+                   , frame_data_t& chroma_coverage) const
     {
-        if (is_output_set())
+        auto rect = span.rect & band_rect;
+
+        if (rect.empty())
         {
-            std::vector<cv::Point> points;
-            for (const auto& p : point_list)
+            return;
+        }
+
+        if (is_yuv())
+        {
+            // a band view of the planes, the band starts on an even row
+            auto band = m_output_yuv;
+            band.y += band_rect.y * band.y_stride;
+            band.u += band_rect.y / 2 * band.u_stride;
+            if (band.v != nullptr)
             {
-                points.emplace_back(p.x, p.y);
+                band.v += band_rect.y / 2 * band.v_stride;
             }
-            cv::fillConvexPoly(m_output_mat
-                               , points
-                               , scalar_from_color(m_draw_format.fill_color));
+            band.size.height = band_rect.height;
+
+            yuv_fill(band
+                     , { rect.x, rect.y - band_rect.y }
+                     , { rect.width, rect.height }
+                     , span.yuv
+                     , { m_full_coverage.data(), 0 }
+                     , span.opacity
+                     , &chroma_coverage);
+            return;
         }
-    }
 
-    frame_size_t get_text_size(const std::string& text) const
-    {
-        std::int32_t lines = 0;
+        auto channels = m_output_mat.channels();
+        auto stride = static_cast<std::int32_t>(m_output_mat.step);
+        auto output = const_cast<std::uint8_t*>(m_output_mat.ptr(rect.y, rect.x));
 
-        if (m_custom_font != nullptr)
+        if (span.opacity < 1.0)
         {
-            auto cv_size = m_custom_font->getTextSize(text
-                                                     , m_draw_format.font_format.height
-                                                     , m_draw_format.font_format.weight
-                                                     , &lines);
-            return { cv_size.width, cv_size.height };
+            alpha_fill(span.pixel
+                       , output
+                       , stride
+                       , channels
+                       , { rect.width, rect.height }
+                       , span.opacity);
+            return;
+        }
 
+        // opaque: one row of the color, copied down
+        for (std::int32_t x = 0; x < rect.width; x++)
+        {
+            std::memcpy(output + x * channels
+                        , span.pixel
+                        , channels);
+        }
+
+        for (std::int32_t y = 1; y < rect.height; y++)
+        {
+            std::memcpy(output + y * stride
+                        , output
+                        , rect.width * channels);
         }
-        return m_draw_format.font_format.text_size(text);
+    }
+
+    frame_size_t output_size() const
+    {
+        return is_yuv()
+                ? m_output_yuv.size
+                : frame_size_t{ m_output_mat.cols, m_output_mat.rows };
+    }
+
+    frame_size_t get_text_size(const std::string& text) const
+    {
+        return m_text_cache.text_size(m_draw_format.font_format
+                                      , text);
+    }
+
+    frame_rect_t get_text_bounds(const std::string& text) const
+    {
+        return m_text_cache.text_bounds(m_draw_format.font_format
+                                        , text);
     }
 
     void display()
@@ -536,7 +855,25 @@ struct ocv_context_t
 
     bool is_output_set() const
     {
-        return m_output_mat.data != nullptr;
+        return m_output_mat.data != nullptr
+                || is_yuv();
+    }
+
+    bool is_yuv() const
+    {
+        return m_output_yuv.y != nullptr;
+    }
+
+    // the pixels a stroke of the thickness may reach around the rect
+    static cv::Rect shape_bounds(const frame_rect_t& rect
+                                 , std::int32_t thickness)
+    {
+        auto margin = std::abs(thickness) / 2 + 1;
+
+        return { rect.offset.x - margin
+                 , rect.offset.y - margin
+                 , rect.size.width + 2 * margin
+                 , rect.size.height + 2 * margin };
     }
 
 };
@@ -565,6 +902,15 @@ void draw_processor::set_output_image(const frame_info_t &format, void *pixels)
                                 , pixels);
 }
 
+void draw_processor::set_output_image(const frame_info_t &format
+                                      , void * const planes[]
+                                      , const std::int32_t strides[])
+{
+    m_context->set_output_image(format
+                                , planes
+                                , strides);
+}
+
 void draw_processor::draw_text(const frame_point_t &pos
                               , const std::string &text)
 {
@@ -595,36 +941,42 @@ void draw_processor::draw_fill_rect(const frame_rect_t &rect)
 void draw_processor::draw_image(const frame_point_t &pos
                                 , const frame_info_t &format
                                 , const void *pixels
-                                , draw_figure_t figure)
+                                , draw_figure_t figure
+                                , std::uint64_t generation)
 {
     m_context->draw_image(pos
                           , format
                           , pixels
-                          , figure);
+                          , figure
+                          , generation);
 }
 
 void draw_processor::draw_image(const frame_rect_t &rect_to
                                 , const frame_info_t &format
                                 , const void *pixels
-                                , draw_figure_t figure)
+                                , draw_figure_t figure
+                                , std::uint64_t generation)
 {
     m_context->draw_image(rect_to
                           , format
                           , pixels
-                          , figure);
+                          , figure
+                          , generation);
 }
 
 void draw_processor::draw_image(const frame_rect_t &rect_to
                                 , const frame_rect_t &rect_from
                                 , const frame_info_t &format
                                 , const void *pixels
-                                , draw_figure_t figure)
+                                , draw_figure_t figure
+                                , std::uint64_t generation)
 {
     m_context->draw_image(rect_to
                           , rect_from
                           , format
                           , pixels
-                          , figure);
+                          , figure
+                          , generation);
 }
 
 void draw_processor::draw_poly(const frame_point_list_t &point_list)
@@ -632,11 +984,23 @@ void draw_processor::draw_poly(const frame_point_list_t &point_list)
     m_context->draw_poly(point_list);
 }
 
+void draw_processor::draw_commands(const draw_command_list &commands
+                                   , bool parallel)
+{
+    m_context->draw_commands(commands
+                             , parallel);
+}
+
 frame_size_t draw_processor::get_text_size(const std::string& text) const
 {
     return m_context->get_text_size(text);
 }
 
+frame_rect_t draw_processor::get_text_bounds(const std::string& text) const
+{
+    return m_context->get_text_bounds(text);
+}
+
 bool draw_processor::is_truefont() const
 {
     return m_context->m_custom_font != nullptr;
@@ -4,6 +4,7 @@
 #include "ocv_types.h"
 #include "draw_format.h"
 #include "frame_info.h"
+#include "draw_command_list.h"
 #include <memory>
 
 
@@ -23,6 +24,10 @@ public:
     bool set_cutom_font(const std::string& font_path);
     void set_output_image(const frame_info_t& format
                           , void *pixels);
+    // planar formats with the planes apart (decoded frames)
+    void set_output_image(const frame_info_t& format
+                          , void* const planes[]
+                          , const std::int32_t strides[]);
     void draw_text(const frame_point_t& pos
                    , const std::string& text);
     void draw_rect(const frame_rect_t& rect);
@@ -30,26 +35,41 @@ public:
     void draw_figure(const frame_rect_t& rect
                      , draw_figure_t figure = draw_figure_t::rectangle);
     void draw_fill_rect(const frame_rect_t& rect);
+    // Images are BGR, BGRA or premultiplied BGRA. A non zero generation
+    // caches the scaled image (BGRA premultiplied) by pixels, format,
+    // rect_from and rect_to size: an image drawn every frame is scaled and
+    // converted once. Change the generation when the pixels change.
     void draw_image(const frame_point_t& pos
                     , const frame_info_t& format
                     , const void *pixels
-                    , draw_figure_t figure = draw_figure_t::rectangle);
+                    , draw_figure_t figure = draw_figure_t::rectangle
+                    , std::uint64_t generation = 0);
     void draw_image(const frame_rect_t& rect_to
                     , const frame_info_t& format
                     , const void *pixels
-                    , draw_figure_t figure = draw_figure_t::rectangle);
+                    , draw_figure_t figure = draw_figure_t::rectangle
+                    , std::uint64_t generation = 0);
 
     void draw_image(const frame_rect_t& rect_to
                     , const frame_rect_t& rect_from
                     , const frame_info_t& format
                     , const void *pixels
-                    , draw_figure_t figure = draw_figure_t::rectangle);
+                    , draw_figure_t figure = draw_figure_t::rectangle
+                    , std::uint64_t generation = 0);
 
     void draw_poly(const frame_point_list_t& point_list);
 
+    // Draws a recorded list in one pass, in the list order. Boxes are split
+    // into row bands of the output, the bands are filled on the shared
+    // worker pool when parallel is set; ellipses and text take the usual path.
+    void draw_commands(const draw_command_list& commands
+                       , bool parallel = false);
+
 
 
     frame_size_t get_text_size(const std::string& text) const;
+    // the drawn pixels of the text relative to its position
+    frame_rect_t get_text_bounds(const std::string& text) const;
     bool is_truefont() const;
 
     void display();
@@ -5,16 +5,37 @@ namespace ocv
 {
 
 frame_info_t::frame_info_t(const frame_format_t &format
-                           , const frame_size_t &size)
+                           , const frame_size_t &size
+                           , std::int32_t stride)
     : format(format)
     , size(size)
+    , stride(stride)
 {
 
 }
 
+std::size_t frame_info_t::line_size() const
+{
+    if (stride > 0)
+    {
+        return stride;
+    }
+
+    return is_planar()
+            ? size.width
+            : utils::get_format_info(format).bits_per_second * size.width / vars::color_depth;
+}
+
 std::size_t frame_info_t::frame_size() const
 {
-    return utils::get_format_info(format).bits_per_second * size.size() / vars::color_depth;
+    if (is_planar())
+    {
+        return plane_offset(planes());
+    }
+
+    return stride > 0
+            ? stride * size.height
+            : utils::get_format_info(format).bits_per_second * size.size() / vars::color_depth;
 }
 
 const std::string &frame_info_t::format_name() const
@@ -28,4 +49,54 @@ bool frame_info_t::is_valid() const
             && !size.is_null();
 }
 
+bool frame_info_t::is_planar() const
+{
+    return format == frame_format_t::yuv420p
+            || format == frame_format_t::nv12;
+}
+
+std::int32_t frame_info_t::planes() const
+{
+    switch(format)
+    {
+        case frame_format_t::yuv420p:
+            return 3;
+        break;
+        case frame_format_t::nv12:
+            return 2;
+        break;
+        default:
+        {}
+    }
+
+    return 1;
+}
+
+std::size_t frame_info_t::plane_line_size(std::int32_t plane) const
+{
+    if (plane == 0
+            || !is_planar())
+    {
+        return line_size();
+    }
+
+    return format == frame_format_t::nv12
+            ? (line_size() + 1) / 2 * 2
+            : (line_size() + 1) / 2;
+}
+
+std::size_t frame_info_t::plane_offset(std::int32_t plane) const
+{
+    std::size_t offset = 0;
+
+    for (std::int32_t p = 0; p < plane && p < planes(); p++)
+    {
+        offset += plane_line_size(p) * (p == 0
+                                        ? size.height
+                                        : (size.height + 1) / 2);
+    }
+
+    return offset;
+}
+
 }
@@ -10,13 +10,23 @@ struct frame_info_t
 {
     frame_format_t  format;
     frame_size_t    size;
+    std::int32_t    stride;     // bytes per row, 0 - packed rows (luma rows of YUV)
 
     frame_info_t(const frame_format_t& format = frame_format_t::undefined
-                 , const frame_size_t& size = {});
+                 , const frame_size_t& size = {}
+                 , std::int32_t stride = 0);
 
+    std::size_t line_size() const;
     std::size_t frame_size() const;
     const std::string& format_name() const;
     bool is_valid() const;
+
+    // YUV 4:2:0 formats keep the planes one after another: luma, then U and V
+    // (YUV420P) of half the rows and row size, or interleaved UV (NV12)
+    bool is_planar() const;
+    std::int32_t planes() const;
+    std::size_t plane_line_size(std::int32_t plane) const;
+    std::size_t plane_offset(std::int32_t plane) const;
 };
 
 }
@@ -0,0 +1,238 @@
+#include "image_cache.h"
+#include "alpha_blend.h"
+#include "tools/base/lru_cache.h"
+#include <opencv2/imgproc.hpp>
+
+#include <tuple>
+
+namespace ocv
+{
+
+namespace
+{
+
+using mask_key_t = std::tuple<std::int32_t, std::int32_t, draw_figure_t>;
+
+// masks are a quarter of the image budget, they are 8 bit
+const std::size_t mask_capacity_ratio = 4;
+
+std::size_t mat_bytes(const cv::Mat& mat)
+{
+    return mat.total() * mat.elemSize();
+}
+
+}
+
+bool image_key_t::operator <(const image_key_t &key) const
+{
+    return std::tie(pixels
+                    , format.format
+                    , format.size.width
+                    , format.size.height
+                    , format.stride
+                    , rect_from.offset.x
+                    , rect_from.offset.y
+                    , rect_from.size.width
+                    , rect_from.size.height
+                    , generation
+                    , size_to.width
+                    , size_to.height)
+            < std::tie(key.pixels
+                       , key.format.format
+                       , key.format.size.width
+                       , key.format.size.height
+                       , key.format.stride
+                       , key.rect_from.offset.x
+                       , key.rect_from.offset.y
+                       , key.rect_from.size.width
+                       , key.rect_from.size.height
+                       , key.generation
+                       , key.size_to.width
+                       , key.size_to.height);
+}
+
+struct image_cache_context_t
+{
+    base::lru_cache<image_key_t, cached_image_t>    m_images;
+    base::lru_cache<mask_key_t, cv::Mat>            m_masks;
+    cv::Mat                                         m_scaled;   // of uncached images
+    cv::Mat                                         m_no_mask;
+    image_cache_stats_t                             m_stats;
+
+    image_cache_context_t(std::size_t capacity)
+        : m_images(capacity)
+        , m_masks(capacity / mask_capacity_ratio)
+    {
+
+    }
+
+    cached_image_t scaled_image(const cv::Mat& input
+                                , const image_key_t& key)
+    {
+        const bool is_scaled = input.cols != key.size_to.width
+                || input.rows != key.size_to.height;
+        const bool is_premultiplied = key.format.format == frame_format_t::bgra_premultiplied;
+
+        if (key.generation == 0)
+        {
+            if (!is_scaled)
+            {
+                return { input, is_premultiplied };
+            }
+
+            cv::resize(input
+                       , m_scaled
+                       , { key.size_to.width, key.size_to.height });
+            return { m_scaled, is_premultiplied };
+        }
+
+        if (auto image = m_images.find(key))
+        {
+            m_stats.image_hits++;
+            return *image;
+        }
+
+        m_stats.image_misses++;
+
+        // the source pixels may go away, the cache keeps its own copy;
+        // straight alpha is premultiplied before the scaling, so that
+        // transparent pixels do not bleed their color into the edges
+        cached_image_t image;
+        cv::Mat source = input;
+
+        if (input.channels() == 4
+                && !is_premultiplied)
+        {
+            source = cv::Mat(input.rows, input.cols, CV_8UC4);
+            premultiply_alpha(input.data
+                              , static_cast<std::int32_t>(input.step)
+                              , source.data
+                              , static_cast<std::int32_t>(source.step)
+                              , { input.cols, input.rows });
+        }
+
+        image.premultiplied = input.channels() == 4;
+
+        if (is_scaled)
+        {
+            cv::resize(source
+                       , image.pixels
+                       , { key.size_to.width, key.size_to.height });
+        }
+        else
+        {
+            image.pixels = source.data == input.data
+                    ? input.clone()
+                    : source;
+        }
+
+        auto cost = mat_bytes(image.pixels);
+
+        return m_images.insert(key
+                               , std::move(image)
+                               , cost);
+    }
+
+    const cv::Mat& figure_mask(const frame_size_t& size
+                               , draw_figure_t figure)
+    {
+        if (figure == draw_figure_t::rectangle
+                || size.is_null())
+        {
+            return m_no_mask;
+        }
+
+        mask_key_t key(size.width, size.height, figure);
+
+        if (auto mask = m_masks.find(key))
+        {
+            m_stats.mask_hits++;
+            return *mask;
+        }
+
+        m_stats.mask_misses++;
+
+        cv::Mat mask(size.height, size.width, CV_8UC1, cv::Scalar(0));
+
+        switch(figure)
+        {
+            case draw_figure_t::ellipse:
+                cv::ellipse(mask
+                            , { size.width / 2, size.height / 2 }
+                            , { size.width / 2, size.height / 2 }
+                            , 0, 0, 360
+                            , cv::Scalar(255)
+                            , -1);
+            break;
+            default:
+            {}
+        }
+
+        return m_masks.insert(key
+                              , mask
+                              , mat_bytes(mask));
+    }
+
+    void set_capacity(std::size_t capacity)
+    {
+        m_images.set_capacity(capacity);
+        m_masks.set_capacity(capacity / mask_capacity_ratio);
+    }
+
+    image_cache_stats_t stats() const
+    {
+        auto stats = m_stats;
+        stats.bytes = m_images.cost() + m_masks.cost();
+        return stats;
+    }
+
+    void clear()
+    {
+        m_images.clear();
+        m_masks.clear();
+        m_scaled = cv::Mat();
+        m_stats = {};
+    }
+};
+//------------------------------------------------------------------------------
+void image_cache_context_deleter_t::operator()(image_cache_context_t *image_cache_context_ptr)
+{
+    delete image_cache_context_ptr;
+}
+//------------------------------------------------------------------------------
+image_cache::image_cache(std::size_t capacity)
+    : m_image_cache_context(new image_cache_context_t(capacity))
+{
+
+}
+
+cached_image_t image_cache::scaled_image(const cv::Mat& input
+                                         , const image_key_t& key)
+{
+    return m_image_cache_context->scaled_image(input
+                                               , key);
+}
+
+const cv::Mat& image_cache::figure_mask(const frame_size_t& size
+                                        , draw_figure_t figure)
+{
+    return m_image_cache_context->figure_mask(size
+                                              , figure);
+}
+
+void image_cache::set_capacity(std::size_t capacity)
+{
+    m_image_cache_context->set_capacity(capacity);
+}
+
+image_cache_stats_t image_cache::stats() const
+{
+    return m_image_cache_context->stats();
+}
+
+void image_cache::clear()
+{
+    m_image_cache_context->clear();
+}
+
+}
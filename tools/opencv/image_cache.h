@@ -0,0 +1,72 @@
+#ifndef OCV_IMAGE_CACHE_H
+#define OCV_IMAGE_CACHE_H
+
+#include "frame_info.h"
+#include <opencv2/core.hpp>
+#include <memory>
+
+namespace ocv
+{
+
+const std::size_t default_image_cache_capacity = 64 * 1024 * 1024;     // bytes of pixels
+
+// identity of a drawn image: the caller changes the generation whenever
+// the pixels behind the same pointer change, generation 0 is never cached
+struct image_key_t
+{
+    const void*     pixels;
+    frame_info_t    format;
+    frame_rect_t    rect_from;
+    std::uint64_t   generation;
+    frame_size_t    size_to;
+
+    bool operator <(const image_key_t& key) const;
+};
+
+// BGRA images kept by the cache are premultiplied, converted once
+struct cached_image_t
+{
+    cv::Mat     pixels;
+    bool        premultiplied = false;
+};
+
+struct image_cache_stats_t
+{
+    std::size_t     image_hits = 0;
+    std::size_t     image_misses = 0;
+    std::size_t     mask_hits = 0;
+    std::size_t     mask_misses = 0;
+    std::size_t     bytes = 0;
+};
+
+struct image_cache_context_t;
+struct image_cache_context_deleter_t { void operator()(image_cache_context_t* image_cache_context_ptr); };
+
+typedef std::unique_ptr<image_cache_context_t, image_cache_context_deleter_t> image_cache_context_ptr_t;
+
+// Bounded LRU of the scaled images and figure masks of the draw processor,
+// a logo drawn at the same size every frame skips the resize and the mask.
+class image_cache
+{
+    image_cache_context_ptr_t   m_image_cache_context;
+
+public:
+    image_cache(std::size_t capacity = default_image_cache_capacity);
+
+    // the input scaled to key.size_to (the input itself if it fits), valid
+    // until the next call
+    cached_image_t scaled_image(const cv::Mat& input
+                                , const image_key_t& key);
+
+    // 8 bit mask of the figure, empty for rectangles
+    const cv::Mat& figure_mask(const frame_size_t& size
+                               , draw_figure_t figure);
+
+    void set_capacity(std::size_t capacity);
+    image_cache_stats_t stats() const;
+    void clear();
+};
+
+}
+
+#endif // OCV_IMAGE_CACHE_H
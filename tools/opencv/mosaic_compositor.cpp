@@ -0,0 +1,631 @@
+#include "mosaic_compositor.h"
+#include "alpha_blend.h"
+#include "yuv_overlay.h"
+#include "image_cache.h"
+#include "tools/base/worker_pool.h"
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+
+namespace ocv
+{
+
+namespace
+{
+
+const std::int32_t min_band_height = 32;
+
+// the frame layout every format shares: up to 3 planes with their strides
+struct mosaic_frame_t
+{
+    frame_format_t  format = frame_format_t::undefined;
+    frame_size_t    size;
+    std::uint8_t*   planes[3] = {};
+    std::int32_t    strides[3] = {};
+
+    bool is_yuv() const
+    {
+        return format == frame_format_t::yuv420p
+                || format == frame_format_t::nv12;
+    }
+
+    std::int32_t channels() const
+    {
+        return format == frame_format_t::bgra
+                || format == frame_format_t::bgra_premultiplied
+                ? 4
+                : 3;
+    }
+
+    cv::Mat plane(std::int32_t p) const
+    {
+        if (p == 0)
+        {
+            return cv::Mat(size.height
+                           , size.width
+                           , is_yuv() ? CV_8UC1 : CV_8UC(channels())
+                           , planes[0]
+                           , strides[0]);
+        }
+
+        return cv::Mat((size.height + 1) / 2
+                       , (size.width + 1) / 2
+                       , format == frame_format_t::nv12 ? CV_8UC2 : CV_8UC1
+                       , planes[p]
+                       , strides[p]);
+    }
+
+    bool is_valid() const
+    {
+        switch(format)
+        {
+            case frame_format_t::bgr:
+            case frame_format_t::bgra:
+            case frame_format_t::bgra_premultiplied:
+                return planes[0] != nullptr;
+            break;
+            case frame_format_t::yuv420p:
+                return planes[0] != nullptr
+                        && planes[1] != nullptr
+                        && planes[2] != nullptr;
+            break;
+            case frame_format_t::nv12:
+                return planes[0] != nullptr
+                        && planes[1] != nullptr;
+            break;
+            default:
+            {}
+        }
+
+        return false;
+    }
+};
+
+mosaic_frame_t frame_from_source(const mosaic_source_t& source)
+{
+    mosaic_frame_t frame;
+    frame.format = source.format.format;
+    frame.size = source.format.size;
+
+    for (std::int32_t p = 0; p < 3; p++)
+    {
+        frame.planes[p] = static_cast<std::uint8_t*>(const_cast<void*>(source.planes[p]));
+        frame.strides[p] = source.strides[p];
+    }
+
+    return frame;
+}
+
+bool is_even(const cv::Rect& rect)
+{
+    return ((rect.x | rect.y | rect.width | rect.height) & 1) == 0;
+}
+
+}
+
+mosaic_cell_t::mosaic_cell_t(const frame_rect_t &rect
+                             , std::int32_t z_order
+                             , draw_figure_t figure
+                             , double opacity)
+    : rect(rect)
+    , z_order(z_order)
+    , figure(figure)
+    , opacity(opacity)
+{
+
+}
+
+mosaic_source_t::mosaic_source_t(const frame_info_t &format
+                                 , const void *pixels)
+    : format(format)
+{
+    if (pixels != nullptr)
+    {
+        for (std::int32_t p = 0; p < format.planes(); p++)
+        {
+            planes[p] = static_cast<const std::uint8_t*>(pixels) + format.plane_offset(p);
+            strides[p] = static_cast<std::int32_t>(format.plane_line_size(p));
+        }
+    }
+}
+
+mosaic_source_t::mosaic_source_t(const frame_info_t &format
+                                 , const void * const planes[]
+                                 , const std::int32_t strides[])
+    : format(format)
+{
+    for (std::int32_t p = 0; p < format.planes(); p++)
+    {
+        this->planes[p] = planes[p];
+        this->strides[p] = strides[p];
+    }
+}
+
+bool mosaic_source_t::is_valid() const
+{
+    return !format.size.is_null()
+            && frame_from_source(*this).is_valid();
+}
+
+struct mosaic_tile_t
+{
+    cv::Rect        rect;           // of the cell, may cross the output edges
+    mosaic_frame_t  source;
+    double          opacity = 1.0;
+    bool            direct = false;
+    cv::Mat         mask;           // shares the cached mask, empty - none
+    cv::Mat         pixels;         // BGR/BGRA, of the blended tiles
+    cv::Mat         yuv;            // scaled YUV source before the conversion
+};
+
+struct mosaic_compositor_context_t
+{
+    std::size_t                 m_thread_count;
+    mosaic_layout_t             m_layout;
+    std::vector<std::size_t>    m_draw_order;
+    std::vector<mosaic_tile_t>  m_tiles;
+    image_cache                 m_masks;
+    mosaic_stats_t              m_stats;
+
+    mosaic_compositor_context_t(std::size_t thread_count)
+        : m_thread_count(thread_count)
+    {
+
+    }
+
+    void set_layout(const mosaic_layout_t& layout)
+    {
+        m_layout = layout;
+        m_tiles.resize(layout.size());
+        m_draw_order.resize(layout.size());
+
+        std::iota(m_draw_order.begin()
+                  , m_draw_order.end()
+                  , 0);
+
+        std::stable_sort(m_draw_order.begin()
+                         , m_draw_order.end()
+                         , [&](std::size_t a, std::size_t b)
+        {
+            return m_layout[a].z_order < m_layout[b].z_order;
+        });
+    }
+
+    template<typename Task>
+    void run(std::size_t tasks
+             , const Task& task)
+    {
+        if (m_thread_count == 1
+                || tasks <= 1)
+        {
+            for (std::size_t i = 0; i < tasks; i++)
+            {
+                task(i);
+            }
+            return;
+        }
+
+        if (m_thread_count == 0
+                || m_thread_count >= tasks)
+        {
+            base::worker_pool::shared_pool().run(tasks
+                                                 , task);
+            return;
+        }
+
+        // m_thread_count runners share the tasks, no more run at once
+        std::atomic<std::size_t> next_task(0);
+
+        base::worker_pool::shared_pool().run(m_thread_count
+                                             , [&](std::size_t)
+        {
+            for (auto i = next_task++; i < tasks; i = next_task++)
+            {
+                task(i);
+            }
+        });
+    }
+
+    bool is_overlapped(std::size_t index) const
+    {
+        const auto& rect = m_tiles[index].rect;
+
+        for (std::size_t i = 0; i < m_tiles.size(); i++)
+        {
+            if (i != index
+                    && m_tiles[i].source.is_valid()
+                    && !(m_tiles[i].rect & rect).empty())
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // the source straight into the output: same format, no alpha, no clip,
+    // nothing else drawn over the cell; chroma needs an even cell
+    bool is_direct(std::size_t index
+                   , const mosaic_frame_t& output) const
+    {
+        const auto& tile = m_tiles[index];
+        const auto& cell = m_layout[index];
+
+        return tile.source.format == output.format
+                && tile.source.channels() != 4
+                && cell.figure == draw_figure_t::rectangle
+                && cell.opacity >= 1.0
+                && (tile.rect & cv::Rect(0, 0, output.size.width, output.size.height)) == tile.rect
+                && (!output.is_yuv() || is_even(tile.rect))
+                && !is_overlapped(index);
+    }
+
+    static void scale_direct(const mosaic_tile_t& tile
+                             , const mosaic_frame_t& output)
+    {
+        const auto& rect = tile.rect;
+
+        auto output_plane = output.plane(0);
+        cv::Mat output_tile = output_plane(rect);
+
+        cv::resize(tile.source.plane(0)
+                   , output_tile
+                   , output_tile.size());
+
+        if (output.is_yuv())
+        {
+            const cv::Rect chroma_rect(rect.x / 2, rect.y / 2, rect.width / 2, rect.height / 2);
+
+            for (std::int32_t p = 1; p < (output.format == frame_format_t::yuv420p ? 3 : 2); p++)
+            {
+                auto output_chroma = output.plane(p);
+                cv::Mat chroma_tile = output_chroma(chroma_rect);
+
+                cv::resize(tile.source.plane(p)
+                           , chroma_tile
+                           , chroma_tile.size());
+            }
+        }
+    }
+
+    // BGR/BGRA pixels of the cell size
+    static void scale_tile(mosaic_tile_t& tile)
+    {
+        const cv::Size size(tile.rect.width, tile.rect.height);
+
+        if (!tile.source.is_yuv())
+        {
+            cv::resize(tile.source.plane(0)
+                       , tile.pixels
+                       , size);
+            return;
+        }
+
+        // the planes are scaled as they are and converted once, at the
+        // even size the conversion needs
+        const cv::Size yuv_size((size.width + 1) & ~1, (size.height + 1) & ~1);
+        const cv::Size chroma_size(yuv_size.width / 2, yuv_size.height / 2);
+
+        tile.yuv.create(yuv_size.height * 3 / 2
+                        , yuv_size.width
+                        , CV_8UC1);
+
+        cv::Mat y_plane(yuv_size, CV_8UC1, tile.yuv.data, yuv_size.width);
+        cv::resize(tile.source.plane(0)
+                   , y_plane
+                   , yuv_size);
+
+        auto chroma = tile.yuv.data + yuv_size.area();
+
+        if (tile.source.format == frame_format_t::nv12)
+        {
+            cv::Mat uv_plane(chroma_size, CV_8UC2, chroma, yuv_size.width);
+            cv::resize(tile.source.plane(1)
+                       , uv_plane
+                       , chroma_size);
+
+            cv::cvtColor(tile.yuv
+                         , tile.pixels
+                         , cv::COLOR_YUV2BGR_NV12);
+        }
+        else
+        {
+            cv::Mat u_plane(chroma_size, CV_8UC1, chroma, chroma_size.width);
+            cv::Mat v_plane(chroma_size, CV_8UC1, chroma + chroma_size.area(), chroma_size.width);
+            cv::resize(tile.source.plane(1)
+                       , u_plane
+                       , chroma_size);
+            cv::resize(tile.source.plane(2)
+                       , v_plane
+                       , chroma_size);
+
+            cv::cvtColor(tile.yuv
+                         , tile.pixels
+                         , cv::COLOR_YUV2BGR_I420);
+        }
+    }
+
+    // the blended tiles over the rows [band_y, band_y + band_height)
+    void blend_band(const mosaic_frame_t& output
+                    , std::int32_t band_y
+                    , std::int32_t band_height) const
+    {
+        const cv::Rect band_rect(0, band_y, output.size.width, band_height);
+
+        for (auto index : m_draw_order)
+        {
+            const auto& tile = m_tiles[index];
+
+            if (tile.direct
+                    || tile.pixels.empty())
+            {
+                continue;
+            }
+
+            auto visible = tile.rect & band_rect;
+            if (visible.empty())
+            {
+                continue;
+            }
+
+            if (output.is_yuv())
+            {
+                // bands start on even rows, a chroma row never spans two
+                yuv_image_t band;
+                band.y = output.planes[0] + band_y * output.strides[0];
+                band.u = output.planes[1] + band_y / 2 * output.strides[1];
+                band.y_stride = output.strides[0];
+                band.u_stride = output.strides[1];
+                band.size = { output.size.width, band_height };
+
+                if (output.format == frame_format_t::yuv420p)
+                {
+                    band.v = output.planes[2] + band_y / 2 * output.strides[2];
+                    band.v_stride = output.strides[2];
+                }
+
+                blend_mask_t mask;
+                if (!tile.mask.empty())
+                {
+                    mask = { tile.mask.data, static_cast<std::int32_t>(tile.mask.step) };
+                }
+
+                yuv_blend(band
+                          , { tile.rect.x, tile.rect.y - band_y }
+                          , { tile.pixels.data
+                              , static_cast<std::int32_t>(tile.pixels.step)
+                              , tile.pixels.channels()
+                              , tile.source.format == frame_format_t::bgra_premultiplied }
+                          , { tile.rect.width, tile.rect.height }
+                          , tile.opacity
+                          , mask);
+            }
+            else
+            {
+                auto channels = output.channels();
+                auto dx = visible.x - tile.rect.x;
+                auto dy = visible.y - tile.rect.y;
+
+                blend_mask_t mask;
+                if (!tile.mask.empty())
+                {
+                    mask = { tile.mask.ptr(dy, dx), static_cast<std::int32_t>(tile.mask.step) };
+                }
+
+                alpha_blend({ tile.pixels.ptr(dy, dx)
+                              , static_cast<std::int32_t>(tile.pixels.step)
+                              , tile.pixels.channels()
+                              , tile.source.format == frame_format_t::bgra_premultiplied }
+                            , output.planes[0] + visible.y * output.strides[0] + visible.x * channels
+                            , output.strides[0]
+                            , channels
+                            , { visible.width, visible.height }
+                            , tile.opacity
+                            , mask);
+            }
+        }
+    }
+
+    std::size_t band_count(const mosaic_frame_t& output) const
+    {
+        auto threads = m_thread_count == 0
+                ? base::worker_pool::shared_pool().size() + 1
+                : m_thread_count;
+
+        auto max_bands = static_cast<std::size_t>(std::max(output.size.height / min_band_height, 1));
+
+        return std::min(threads, max_bands);
+    }
+
+    bool compose(const mosaic_source_list_t& sources
+                 , const mosaic_frame_t& output)
+    {
+        if (!output.is_valid()
+                || output.format == frame_format_t::bgra_premultiplied)
+        {
+            return false;
+        }
+
+        m_stats = {};
+
+        for (std::size_t i = 0; i < m_tiles.size(); i++)
+        {
+            auto& tile = m_tiles[i];
+            const auto& cell = m_layout[i];
+
+            tile.rect = { cell.rect.offset.x, cell.rect.offset.y, cell.rect.size.width, cell.rect.size.height };
+            tile.source = i < sources.size() && sources[i].is_valid()
+                    ? frame_from_source(sources[i])
+                    : mosaic_frame_t();
+            tile.opacity = cell.opacity;
+            tile.mask.release();
+
+            if (!tile.source.is_valid()
+                    || tile.rect.empty())
+            {
+                tile.source = {};
+                tile.pixels.release();
+            }
+        }
+
+        for (std::size_t i = 0; i < m_tiles.size(); i++)
+        {
+            auto& tile = m_tiles[i];
+
+            if (tile.source.is_valid())
+            {
+                tile.direct = is_direct(i, output);
+
+                if (!tile.direct)
+                {
+                    // the mask cache is not shared with the workers
+                    tile.mask = m_masks.figure_mask({ tile.rect.width, tile.rect.height }
+                                                     , m_layout[i].figure);
+                    m_stats.blended++;
+                }
+                else
+                {
+                    tile.pixels.release();
+                    m_stats.direct++;
+                }
+            }
+        }
+
+        run(m_tiles.size()
+            , [&](std::size_t i)
+        {
+            auto& tile = m_tiles[i];
+
+            if (tile.source.is_valid())
+            {
+                if (tile.direct)
+                {
+                    scale_direct(tile
+                                 , output);
+                }
+                else
+                {
+                    scale_tile(tile);
+                }
+            }
+        });
+
+        if (m_stats.blended > 0)
+        {
+            auto bands = band_count(output);
+
+            // even band rows keep chroma rows in one band
+            std::int32_t band_height = (output.size.height / static_cast<std::int32_t>(bands)) & ~1;
+
+            if (band_height == 0)
+            {
+                bands = 1;
+            }
+
+            m_stats.bands = bands;
+
+            run(bands
+                , [&](std::size_t b)
+            {
+                auto band_y = static_cast<std::int32_t>(b) * band_height;
+                auto height = b + 1 == bands
+                        ? output.size.height - band_y
+                        : band_height;
+
+                blend_band(output
+                           , band_y
+                           , height);
+            });
+        }
+
+        return true;
+    }
+
+    bool compose(const mosaic_source_list_t& sources
+                 , const frame_info_t& format
+                 , void* const planes[]
+                 , const std::int32_t strides[])
+    {
+        mosaic_frame_t output;
+        output.format = format.format;
+        output.size = format.size;
+
+        for (std::int32_t p = 0; p < format.planes(); p++)
+        {
+            output.planes[p] = static_cast<std::uint8_t*>(planes[p]);
+            output.strides[p] = strides[p];
+        }
+
+        return compose(sources
+                       , output);
+    }
+
+    bool compose(const mosaic_source_list_t& sources
+                 , const frame_info_t& format
+                 , void *pixels)
+    {
+        if (pixels == nullptr)
+        {
+            return false;
+        }
+
+        void* planes[3] = {};
+        std::int32_t strides[3] = {};
+
+        for (std::int32_t p = 0; p < format.planes(); p++)
+        {
+            planes[p] = static_cast<std::uint8_t*>(pixels) + format.plane_offset(p);
+            strides[p] = static_cast<std::int32_t>(format.plane_line_size(p));
+        }
+
+        return compose(sources
+                       , format
+                       , planes
+                       , strides);
+    }
+};
+
+mosaic_compositor::mosaic_compositor(std::size_t threads)
+    : m_context(std::make_shared<mosaic_compositor_context_t>(threads))
+{
+
+}
+
+void mosaic_compositor::set_layout(const mosaic_layout_t &layout)
+{
+    m_context->set_layout(layout);
+}
+
+const mosaic_layout_t &mosaic_compositor::layout() const
+{
+    return m_context->m_layout;
+}
+
+bool mosaic_compositor::compose(const mosaic_source_list_t &sources
+                                , const frame_info_t &format
+                                , void *pixels)
+{
+    return m_context->compose(sources
+                              , format
+                              , pixels);
+}
+
+bool mosaic_compositor::compose(const mosaic_source_list_t &sources
+                                , const frame_info_t &format
+                                , void * const planes[]
+                                , const std::int32_t strides[])
+{
+    return m_context->compose(sources
+                              , format
+                              , planes
+                              , strides);
+}
+
+mosaic_stats_t mosaic_compositor::stats() const
+{
+    return m_context->m_stats;
+}
+
+}
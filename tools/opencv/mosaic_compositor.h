@@ -0,0 +1,84 @@
+#ifndef OCV_MOSAIC_COMPOSITOR_H
+#define OCV_MOSAIC_COMPOSITOR_H
+
+#include "ocv_types.h"
+#include "frame_info.h"
+#include <memory>
+
+namespace ocv
+{
+
+struct mosaic_cell_t
+{
+    frame_rect_t    rect;       // in the output frame
+    std::int32_t    z_order;    // ties in the layout order
+    draw_figure_t   figure;     // clip of the tile
+    double          opacity;
+
+    mosaic_cell_t(const frame_rect_t& rect = {}
+                  , std::int32_t z_order = 0
+                  , draw_figure_t figure = draw_figure_t::rectangle
+                  , double opacity = 1.0);
+};
+
+using mosaic_layout_t = std::vector<mosaic_cell_t>;
+
+// a BGR/BGRA/premultiplied BGRA/YUV420P/NV12 frame, the planes of packed
+// formats are in planes[0]
+struct mosaic_source_t
+{
+    frame_info_t        format;
+    const void*         planes[3] = {};
+    std::int32_t        strides[3] = {};
+
+    mosaic_source_t(const frame_info_t& format = {}
+                    , const void* pixels = nullptr);
+    mosaic_source_t(const frame_info_t& format
+                    , const void* const planes[]
+                    , const std::int32_t strides[]);
+
+    bool is_valid() const;
+};
+
+using mosaic_source_list_t = std::vector<mosaic_source_t>;
+
+struct mosaic_stats_t
+{
+    std::size_t     direct = 0;     // tiles scaled straight into the output
+    std::size_t     blended = 0;    // tiles scaled aside and blended
+    std::size_t     bands = 0;      // parallel bands of the blending
+};
+
+struct mosaic_compositor_context_t;
+using mosaic_compositor_context_ptr_t = std::shared_ptr<mosaic_compositor_context_t>;
+
+// N-up layouts: cell i shows source i scaled to the cell. All the tiles are
+// scaled in parallel; an opaque rectangular tile that overlaps no other cell
+// and has the output format is scaled straight into the output, the rest
+// are blended in z-order over horizontal bands of the output in parallel.
+// The area outside the cells is left as is.
+class mosaic_compositor
+{
+    mosaic_compositor_context_ptr_t m_context;
+public:
+    // threads: 0 - the whole shared worker pool, 1 - the calling thread
+    // only, N - at most N tasks at once on the shared pool
+    mosaic_compositor(std::size_t threads = 0);
+
+    void set_layout(const mosaic_layout_t& layout);
+    const mosaic_layout_t& layout() const;
+
+    bool compose(const mosaic_source_list_t& sources
+                 , const frame_info_t& format
+                 , void *pixels);
+    bool compose(const mosaic_source_list_t& sources
+                 , const frame_info_t& format
+                 , void* const planes[]
+                 , const std::int32_t strides[]);
+
+    mosaic_stats_t stats() const;
+};
+
+}
+
+#endif // OCV_MOSAIC_COMPOSITOR_H
@@ -26,7 +26,10 @@ enum class frame_format_t
 {
     undefined = -1,
     bgr,
-    bgra
+    bgra,
+    yuv420p,
+    nv12,
+    bgra_premultiplied      // BGRA, the color channels multiplied by alpha
 };
 
 enum class draw_figure_t
@@ -9,7 +9,10 @@ const format_info_t &get_format_info(const frame_format_t& format)
     {
         { "UNK",    0  },
         { "BGR",    24 },
-        { "BGRA",   32 }
+        { "BGRA",   32 },
+        { "YUV420P",12 },
+        { "NV12",   12 },
+        { "BGRA_PM",32 }
     };
 
     return format_table[static_cast<std::int32_t>(format) + 1];
@@ -0,0 +1,687 @@
+#include "overlay_scene.h"
+#include "draw_processor.h"
+#include "alpha_blend.h"
+#include "yuv_overlay.h"
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+
+namespace ocv
+{
+
+namespace
+{
+
+// a drawn shape gets full alpha whatever the alpha byte of the color is
+color_t opaque_color(color_t color)
+{
+    return color | 0xff;
+}
+
+// the sprite background has the shape color and zero alpha, so that the
+// antialiased edges keep the color and only the alpha fades
+cv::Scalar transparent_scalar(color_t color)
+{
+    return cv::Scalar((color >> 24) & 0xff
+                      , (color >> 16) & 0xff
+                      , (color >> 8) & 0xff
+                      , 0);
+}
+
+cv::Rect stroke_bounds(const frame_rect_t& rect
+                       , std::int32_t line_weight)
+{
+    auto margin = std::abs(std::min(line_weight, 10)) / 2 + 1;
+
+    return { rect.offset.x - margin
+             , rect.offset.y - margin
+             , rect.size.width + 2 * margin
+             , rect.size.height + 2 * margin };
+}
+
+std::int32_t get_image_type(const frame_format_t& format)
+{
+    switch(format)
+    {
+        case frame_format_t::bgr:
+            return CV_8UC3;
+        break;
+        case frame_format_t::bgra:
+        case frame_format_t::bgra_premultiplied:
+            return CV_8UC4;
+        break;
+        default:
+        {}
+    }
+
+    return 0;
+}
+
+}
+
+overlay_element_t::overlay_element_t(overlay_element_type_t type
+                                     , const frame_rect_t &rect
+                                     , std::int32_t z_order)
+    : type(type)
+    , rect(rect)
+    , figure(draw_figure_t::rectangle)
+    , z_order(z_order)
+    , visible(true)
+{
+
+}
+
+struct overlay_sprite_t
+{
+    cv::Mat         pixels;     // BGRA, premultiplied alpha
+    frame_point_t   offset;     // in the frame
+};
+
+struct scene_element_t
+{
+    overlay_element_t   element;
+    overlay_sprite_t    sprite;
+    bool                dirty = true;
+};
+
+struct overlay_scene_context_t
+{
+    using element_map_t = std::map<overlay_element_id_t, scene_element_t>;
+
+    element_map_t                   m_elements;
+    std::vector<scene_element_t*>   m_draw_order;
+    bool                            m_order_dirty;
+    overlay_element_id_t            m_next_id;
+    draw_processor                  m_processor;
+    overlay_scene_stats_t           m_stats;
+
+    overlay_scene_context_t()
+        : m_order_dirty(false)
+        , m_next_id(0)
+    {
+
+    }
+
+    scene_element_t* find(overlay_element_id_t id)
+    {
+        auto it = m_elements.find(id);
+        return it != m_elements.end()
+                ? &it->second
+                : nullptr;
+    }
+
+    overlay_element_id_t add_element(const overlay_element_t& element)
+    {
+        auto id = m_next_id++;
+
+        m_elements[id].element = element;
+        m_order_dirty = true;
+
+        return id;
+    }
+
+    bool update_element(overlay_element_id_t id
+                        , const overlay_element_t& element)
+    {
+        if (auto scene_element = find(id))
+        {
+            m_order_dirty |= scene_element->element.z_order != element.z_order;
+            scene_element->element = element;
+            scene_element->dirty = true;
+            return true;
+        }
+
+        return false;
+    }
+
+    bool remove_element(overlay_element_id_t id)
+    {
+        if (m_elements.erase(id) > 0)
+        {
+            m_order_dirty = true;
+            return true;
+        }
+
+        return false;
+    }
+
+    bool set_text(overlay_element_id_t id
+                  , const std::string& text)
+    {
+        if (auto scene_element = find(id))
+        {
+            if (scene_element->element.text != text)
+            {
+                scene_element->element.text = text;
+                scene_element->dirty = true;
+            }
+            return true;
+        }
+
+        return false;
+    }
+
+    bool set_position(overlay_element_id_t id
+                      , const frame_point_t& pos)
+    {
+        if (auto scene_element = find(id))
+        {
+            auto& element = scene_element->element;
+
+            frame_point_t delta(pos.x - element.rect.offset.x
+                                , pos.y - element.rect.offset.y);
+
+            element.rect.offset = pos;
+
+            for (auto& p : element.points)
+            {
+                p += delta;
+            }
+
+            scene_element->sprite.offset += delta;
+            return true;
+        }
+
+        return false;
+    }
+
+    bool set_visible(overlay_element_id_t id
+                     , bool visible)
+    {
+        if (auto scene_element = find(id))
+        {
+            scene_element->element.visible = visible;
+            return true;
+        }
+
+        return false;
+    }
+
+    bool set_z_order(overlay_element_id_t id
+                     , std::int32_t z_order)
+    {
+        if (auto scene_element = find(id))
+        {
+            m_order_dirty |= scene_element->element.z_order != z_order;
+            scene_element->element.z_order = z_order;
+            return true;
+        }
+
+        return false;
+    }
+
+    bool set_custom_font(const std::string& font_path)
+    {
+        for (auto& e : m_elements)
+        {
+            e.second.dirty |= e.second.element.type == overlay_element_type_t::text;
+        }
+
+        return m_processor.set_cutom_font(font_path);
+    }
+
+    void clear()
+    {
+        m_elements.clear();
+        m_draw_order.clear();
+        m_order_dirty = false;
+    }
+
+    // the processor draws on the sprite, a shape is moved by -bounds
+    void begin_sprite(overlay_sprite_t& sprite
+                      , const cv::Rect& bounds
+                      , color_t color
+                      , const draw_format_t& draw_format)
+    {
+        sprite.pixels = cv::Mat(bounds.height
+                                , bounds.width
+                                , CV_8UC4
+                                , transparent_scalar(color));
+        sprite.offset = { bounds.x, bounds.y };
+
+        m_processor.set_output_image({ frame_format_t::bgra, { bounds.width, bounds.height } }
+                                     , sprite.pixels.data);
+
+        auto& format = m_processor.draw_format();
+        format = draw_format;
+        format.font_color = opaque_color(format.font_color);
+        format.pen_color = opaque_color(format.pen_color);
+        format.fill_color = opaque_color(format.fill_color);
+    }
+
+    void rasterize_image(const overlay_element_t& element
+                         , overlay_sprite_t& sprite)
+    {
+        auto type = get_image_type(element.image_info.format);
+
+        if (type == 0
+                || element.rect.is_null()
+                || element.image_data.size() < element.image_info.frame_size())
+        {
+            return;
+        }
+
+        cv::Mat input(element.image_info.size.height
+                      , element.image_info.size.width
+                      , type
+                      , const_cast<std::uint8_t*>(element.image_data.data())
+                      , element.image_info.line_size());
+
+        // premultiplied before the scaling, transparent pixels do not bleed
+        cv::Mat source = input;
+
+        if (element.image_info.format == frame_format_t::bgra)
+        {
+            source = cv::Mat(input.rows, input.cols, CV_8UC4);
+            premultiply_alpha(input.data
+                              , static_cast<std::int32_t>(input.step)
+                              , source.data
+                              , static_cast<std::int32_t>(source.step)
+                              , { input.cols, input.rows });
+        }
+
+        cv::Mat scaled;
+        cv::resize(source
+                   , scaled
+                   , { element.rect.size.width, element.rect.size.height });
+
+        if (scaled.channels() == 3)
+        {
+            cv::cvtColor(scaled
+                         , sprite.pixels
+                         , cv::COLOR_BGR2BGRA);
+        }
+        else
+        {
+            sprite.pixels = scaled;
+        }
+
+        if (element.figure == draw_figure_t::ellipse)
+        {
+            cv::Mat mask(sprite.pixels.rows, sprite.pixels.cols, CV_8UC1, cv::Scalar(0));
+            cv::ellipse(mask
+                        , { mask.cols / 2, mask.rows / 2 }
+                        , { mask.cols / 2, mask.rows / 2 }
+                        , 0, 0, 360
+                        , cv::Scalar(255)
+                        , -1);
+
+            // premultiplied: the color goes with the alpha
+            cv::Mat pixel_mask;
+            cv::merge(std::vector<cv::Mat>(4, mask), pixel_mask);
+            cv::bitwise_and(sprite.pixels, pixel_mask, sprite.pixels);
+        }
+
+        sprite.offset = element.rect.offset;
+    }
+
+    void rasterize(scene_element_t& scene_element)
+    {
+        const auto& element = scene_element.element;
+        auto& sprite = scene_element.sprite;
+        const auto& format = element.draw_format;
+
+        sprite = {};
+
+        switch(element.type)
+        {
+            case overlay_element_type_t::text:
+            {
+                m_processor.draw_format() = format;
+                auto text_bounds = m_processor.get_text_bounds(element.text);
+
+                if (!text_bounds.is_null())
+                {
+                    cv::Rect bounds(element.rect.offset.x + text_bounds.offset.x
+                                    , element.rect.offset.y + text_bounds.offset.y
+                                    , text_bounds.size.width
+                                    , text_bounds.size.height);
+
+                    begin_sprite(sprite, bounds, format.font_color, format);
+                    m_processor.draw_text({ -text_bounds.offset.x, -text_bounds.offset.y }
+                                          , element.text);
+                }
+            }
+            break;
+            case overlay_element_type_t::rectangle:
+            case overlay_element_type_t::fill_rectangle:
+            case overlay_element_type_t::ellipse:
+            {
+                if (!element.rect.is_null())
+                {
+                    auto bounds = stroke_bounds(element.rect, format.line_weight);
+                    frame_rect_t rect({ element.rect.offset.x - bounds.x, element.rect.offset.y - bounds.y }
+                                      , element.rect.size);
+
+                    if (element.type == overlay_element_type_t::fill_rectangle)
+                    {
+                        begin_sprite(sprite, bounds, format.fill_color, format);
+                        m_processor.draw_fill_rect(rect);
+                    }
+                    else
+                    {
+                        begin_sprite(sprite, bounds, format.pen_color, format);
+                        m_processor.draw_figure(rect
+                                                , element.type == overlay_element_type_t::ellipse
+                                                ? draw_figure_t::ellipse
+                                                : draw_figure_t::rectangle);
+                    }
+                }
+            }
+            break;
+            case overlay_element_type_t::polygon:
+            {
+                if (!element.points.empty())
+                {
+                    std::vector<cv::Point> points;
+                    for (const auto& p : element.points)
+                    {
+                        points.emplace_back(p.x, p.y);
+                    }
+
+                    auto bounds = cv::boundingRect(points);
+                    bounds = { bounds.x - 1, bounds.y - 1, bounds.width + 2, bounds.height + 2 };
+
+                    frame_point_list_t shifted_points;
+                    for (const auto& p : element.points)
+                    {
+                        shifted_points.emplace_back(p.x - bounds.x, p.y - bounds.y);
+                    }
+
+                    begin_sprite(sprite, bounds, format.fill_color, format);
+                    m_processor.draw_poly(shifted_points);
+                }
+            }
+            break;
+            case overlay_element_type_t::image:
+                rasterize_image(element, sprite);
+            break;
+        }
+
+        // the processor draws straight alpha, images are premultiplied already
+        if (element.type != overlay_element_type_t::image
+                && !sprite.pixels.empty())
+        {
+            premultiply_alpha(sprite.pixels.data
+                              , static_cast<std::int32_t>(sprite.pixels.step)
+                              , sprite.pixels.data
+                              , static_cast<std::int32_t>(sprite.pixels.step)
+                              , { sprite.pixels.cols, sprite.pixels.rows });
+        }
+
+        scene_element.dirty = false;
+        m_stats.rasterized++;
+    }
+
+    // rasterizes the changed elements and sorts the draw order if needed
+    void prepare()
+    {
+        if (m_order_dirty)
+        {
+            m_draw_order.clear();
+            for (auto& e : m_elements)
+            {
+                m_draw_order.push_back(&e.second);
+            }
+
+            // the map is ordered by id, so ties keep the insertion order
+            std::stable_sort(m_draw_order.begin()
+                             , m_draw_order.end()
+                             , [](const scene_element_t* a, const scene_element_t* b)
+            {
+                return a->element.z_order < b->element.z_order;
+            });
+
+            m_order_dirty = false;
+        }
+
+        m_stats.composited = 0;
+        m_stats.composited_pixels = 0;
+
+        for (auto scene_element : m_draw_order)
+        {
+            if (scene_element->dirty
+                    && scene_element->element.visible)
+            {
+                rasterize(*scene_element);
+            }
+        }
+    }
+
+    template<typename Composite>
+    void composite(const Composite& composite_sprite)
+    {
+        prepare();
+
+        for (auto scene_element : m_draw_order)
+        {
+            const auto& sprite = scene_element->sprite;
+
+            if (scene_element->element.visible
+                    && !sprite.pixels.empty())
+            {
+                m_stats.composited_pixels += composite_sprite(sprite
+                                                              , scene_element->element.draw_format.draw_opacity);
+                m_stats.composited++;
+            }
+        }
+    }
+
+    void render(const frame_info_t& format
+                , void *pixels)
+    {
+        if (format.is_planar())
+        {
+            if (pixels != nullptr)
+            {
+                auto data = static_cast<std::uint8_t*>(pixels);
+
+                void* planes[] = { data + format.plane_offset(0)
+                                   , data + format.plane_offset(1)
+                                   , data + format.plane_offset(2) };
+                const std::int32_t strides[] = { static_cast<std::int32_t>(format.plane_line_size(0))
+                                                 , static_cast<std::int32_t>(format.plane_line_size(1))
+                                                 , static_cast<std::int32_t>(format.plane_line_size(2)) };
+
+                render(format
+                       , planes
+                       , strides);
+            }
+            return;
+        }
+
+        auto type = get_image_type(format.format);
+        if (type == 0
+                || pixels == nullptr)
+        {
+            return;
+        }
+
+        auto channels = type == CV_8UC4 ? 4 : 3;
+        auto stride = static_cast<std::int32_t>(format.line_size());
+        auto frame = static_cast<std::uint8_t*>(pixels);
+        const cv::Rect frame_rect(0, 0, format.size.width, format.size.height);
+
+        composite([&](const overlay_sprite_t& sprite, double opacity)
+        {
+            cv::Rect sprite_rect(sprite.offset.x, sprite.offset.y, sprite.pixels.cols, sprite.pixels.rows);
+            auto visible = sprite_rect & frame_rect;
+
+            if (visible.empty())
+            {
+                return std::size_t(0);
+            }
+
+            alpha_blend({ sprite.pixels.ptr(visible.y - sprite_rect.y, visible.x - sprite_rect.x)
+                          , static_cast<std::int32_t>(sprite.pixels.step)
+                          , 4
+                          , true }
+                        , frame + visible.y * stride + visible.x * channels
+                        , stride
+                        , channels
+                        , { visible.width, visible.height }
+                        , opacity);
+
+            return static_cast<std::size_t>(visible.area());
+        });
+    }
+
+    void render(const frame_info_t& format
+                , void* const planes[]
+                , const std::int32_t strides[])
+    {
+        if (!format.is_planar())
+        {
+            render({ format.format, format.size, strides[0] }
+                   , planes[0]);
+            return;
+        }
+
+        if (planes[0] == nullptr
+                || planes[1] == nullptr
+                || (format.format == frame_format_t::yuv420p && planes[2] == nullptr))
+        {
+            return;
+        }
+
+        yuv_image_t image;
+        image.y = static_cast<std::uint8_t*>(planes[0]);
+        image.u = static_cast<std::uint8_t*>(planes[1]);
+        image.y_stride = strides[0];
+        image.u_stride = strides[1];
+        image.size = format.size;
+
+        if (format.format == frame_format_t::yuv420p)
+        {
+            image.v = static_cast<std::uint8_t*>(planes[2]);
+            image.v_stride = strides[2];
+        }
+
+        const cv::Rect frame_rect(0, 0, format.size.width, format.size.height);
+
+        composite([&](const overlay_sprite_t& sprite, double opacity)
+        {
+            cv::Rect sprite_rect(sprite.offset.x, sprite.offset.y, sprite.pixels.cols, sprite.pixels.rows);
+            auto visible = sprite_rect & frame_rect;
+
+            if (visible.empty())
+            {
+                return std::size_t(0);
+            }
+
+            // yuv_blend clips itself, the count is the same as the packed path
+            yuv_blend(image
+                      , sprite.offset
+                      , { sprite.pixels.data, static_cast<std::int32_t>(sprite.pixels.step), 4, true }
+                      , { sprite.pixels.cols, sprite.pixels.rows }
+                      , opacity);
+
+            return static_cast<std::size_t>(visible.area());
+        });
+    }
+
+    overlay_scene_stats_t stats() const
+    {
+        auto stats = m_stats;
+        stats.elements = m_elements.size();
+        return stats;
+    }
+};
+
+overlay_scene::overlay_scene()
+    : m_context(std::make_shared<overlay_scene_context_t>())
+{
+
+}
+
+overlay_element_id_t overlay_scene::add_element(const overlay_element_t &element)
+{
+    return m_context->add_element(element);
+}
+
+bool overlay_scene::update_element(overlay_element_id_t id
+                                   , const overlay_element_t &element)
+{
+    return m_context->update_element(id
+                                     , element);
+}
+
+bool overlay_scene::remove_element(overlay_element_id_t id)
+{
+    return m_context->remove_element(id);
+}
+
+bool overlay_scene::get_element(overlay_element_id_t id
+                                , overlay_element_t &element) const
+{
+    if (auto scene_element = m_context->find(id))
+    {
+        element = scene_element->element;
+        return true;
+    }
+
+    return false;
+}
+
+bool overlay_scene::set_text(overlay_element_id_t id
+                             , const std::string &text)
+{
+    return m_context->set_text(id
+                               , text);
+}
+
+bool overlay_scene::set_position(overlay_element_id_t id
+                                 , const frame_point_t &pos)
+{
+    return m_context->set_position(id
+                                   , pos);
+}
+
+bool overlay_scene::set_visible(overlay_element_id_t id
+                                , bool visible)
+{
+    return m_context->set_visible(id
+                                  , visible);
+}
+
+bool overlay_scene::set_z_order(overlay_element_id_t id
+                                , std::int32_t z_order)
+{
+    return m_context->set_z_order(id
+                                  , z_order);
+}
+
+bool overlay_scene::set_custom_font(const std::string &font_path)
+{
+    return m_context->set_custom_font(font_path);
+}
+
+void overlay_scene::clear()
+{
+    m_context->clear();
+}
+
+void overlay_scene::render(const frame_info_t &format
+                           , void *pixels)
+{
+    m_context->render(format
+                      , pixels);
+}
+
+void overlay_scene::render(const frame_info_t &format
+                           , void * const planes[]
+                           , const std::int32_t strides[])
+{
+    m_context->render(format
+                      , planes
+                      , strides);
+}
+
+overlay_scene_stats_t overlay_scene::stats() const
+{
+    return m_context->stats();
+}
+
+}
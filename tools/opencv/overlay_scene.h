@@ -0,0 +1,96 @@
+#ifndef OCV_OVERLAY_SCENE_H
+#define OCV_OVERLAY_SCENE_H
+
+#include "ocv_types.h"
+#include "draw_format.h"
+#include "frame_info.h"
+#include <memory>
+
+namespace ocv
+{
+
+using overlay_element_id_t = std::int32_t;
+
+constexpr overlay_element_id_t invalid_element_id = -1;
+
+enum class overlay_element_type_t
+{
+    text,
+    rectangle,
+    fill_rectangle,
+    ellipse,
+    polygon,
+    image
+};
+
+struct overlay_element_t
+{
+    overlay_element_type_t  type;
+    frame_rect_t            rect;           // text: the offset is the text position
+    frame_point_list_t      points;         // polygon
+    std::string             text;
+    frame_info_t            image_info;     // image, the pixels are kept in image_data
+    frame_data_t            image_data;
+    draw_figure_t           figure;         // image clip
+    draw_format_t           draw_format;    // draw_opacity applies to every type
+    std::int32_t            z_order;
+    bool                    visible;
+
+    overlay_element_t(overlay_element_type_t type = overlay_element_type_t::rectangle
+                      , const frame_rect_t& rect = {}
+                      , std::int32_t z_order = 0);
+};
+
+struct overlay_scene_stats_t
+{
+    std::size_t     elements = 0;
+    std::size_t     rasterized = 0;         // element renders since the start
+    std::size_t     composited = 0;         // by the last render
+    std::size_t     composited_pixels = 0;  // sprite pixels inside the frame, by the last render
+};
+
+struct overlay_scene_context_t;
+using overlay_scene_context_ptr_t = std::shared_ptr<overlay_scene_context_t>;
+
+// Retained overlay layer. Elements are rasterized once into premultiplied
+// BGRA sprites and again only when they change; a moved element keeps its
+// sprite. Each render composites the visible sprites in z-order (ties in
+// insertion order) over their own boxes of a BGR/BGRA/YUV420P/NV12 frame.
+class overlay_scene
+{
+    overlay_scene_context_ptr_t m_context;
+public:
+    overlay_scene();
+
+    overlay_element_id_t add_element(const overlay_element_t& element);
+    bool update_element(overlay_element_id_t id
+                        , const overlay_element_t& element);
+    bool remove_element(overlay_element_id_t id);
+    bool get_element(overlay_element_id_t id
+                     , overlay_element_t& element) const;
+
+    // the same text is not rendered again, a clock may be set every frame
+    bool set_text(overlay_element_id_t id
+                  , const std::string& text);
+    bool set_position(overlay_element_id_t id
+                      , const frame_point_t& pos);
+    bool set_visible(overlay_element_id_t id
+                     , bool visible);
+    bool set_z_order(overlay_element_id_t id
+                     , std::int32_t z_order);
+
+    bool set_custom_font(const std::string& font_path);
+    void clear();
+
+    void render(const frame_info_t& format
+                , void *pixels);
+    void render(const frame_info_t& format
+                , void* const planes[]
+                , const std::int32_t strides[]);
+
+    overlay_scene_stats_t stats() const;
+};
+
+}
+
+#endif // OCV_OVERLAY_SCENE_H
@@ -1,9 +1,18 @@
 #include "test.h"
 #include "draw_processor.h"
+#include "alpha_blend.h"
+#include "overlay_scene.h"
+#include "mosaic_compositor.h"
+#include "text_cache.h"
+#include "yuv_overlay.h"
 #include <opencv2/imgproc.hpp>
 #include <opencv2/freetype.hpp>
 #include <opencv2/highgui.hpp>
 #include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
 
 namespace ocv
 {
@@ -165,8 +174,1742 @@ void test3()
     cv::waitKey(0);
 }
 
+// the blend before alpha_blend: split, and, addWeighted and a masked copy
+void legacy_overlay(const cv::Mat& input
+                    , cv::Mat& output
+                    , double opacity
+                    , cv::Mat mask)
+{
+    std::vector<cv::Mat> mat_channels;
+    cv::split(input, mat_channels);
+
+    if (!mask.empty())
+    {
+        cv::bitwise_and(mat_channels[3], mask, mask);
+    }
+    else
+    {
+        mask = mat_channels[3];
+    }
+
+    cv::Mat tmp;
+    cv::addWeighted(input
+                    , opacity
+                    , output
+                    , 1.0 - opacity
+                    , 0.0
+                    , tmp);
+
+    tmp.copyTo(output
+               , mask);
+}
+
+static bool check(bool result
+                  , const std::string& name)
+{
+    if (!result)
+    {
+        std::cout << name << " failed" << std::endl;
+    }
+
+    return result;
+}
+
+static void fill_random(frame_data_t& data
+                        , std::uint32_t seed)
+{
+    std::minstd_rand random(seed);
+
+    for (auto& value : data)
+    {
+        value = static_cast<std::uint8_t>(random() >> 8);
+    }
+}
+
+// round(value / 255), the fixed point kernels must give the same
+static std::int32_t reference_div255(std::int32_t value)
+{
+    return (value * 2 + 255) / 510;
+}
+
+static std::int32_t reference_q15(double opacity)
+{
+    return static_cast<std::int32_t>(std::min(opacity, 1.0) * 32767.0 + 0.5);
+}
+
+// one straight alpha pixel as the scalar kernel blends it, mask < 0 - none
+static void reference_blend(const std::uint8_t* input
+                            , std::int32_t input_channels
+                            , std::uint8_t* output
+                            , std::int32_t output_channels
+                            , std::int32_t mask
+                            , std::int32_t opacity)
+{
+    std::int32_t a = input_channels == 4
+            ? input[3]
+            : 255;
+
+    if (mask >= 0)
+    {
+        a = reference_div255(a * mask);
+    }
+
+    a = (a * opacity + 16384) >> 15;
+
+    if (a == 0)
+    {
+        return;
+    }
+
+    for (std::int32_t c = 0; c < std::min(input_channels, output_channels); c++)
+    {
+        output[c] = reference_div255(input[c] * a + output[c] * (255 - a));
+    }
+
+    if (output_channels == 4
+            && input_channels == 3)
+    {
+        output[3] = reference_div255(255 * a + output[3] * (255 - a));
+    }
+}
+
+// The SSE4.1/AVX2 kernels against the scalar formula: widths around the
+// vector sizes, rows of odd strides at unaligned offsets. The pixels around
+// the blended area must stay as they were.
+void test_alpha_blend_reference()
+{
+    const frame_size_t sizes[] = { { 1, 1 }, { 3, 2 }, { 7, 3 }, { 15, 5 }, { 17, 4 }, { 33, 7 }, { 67, 5 } };
+    const std::int32_t border = 3;
+    std::uint32_t seed = 1;
+
+    for (const auto& size : sizes)
+    {
+        for (std::int32_t input_channels = 3; input_channels <= 4; input_channels++)
+        {
+            for (std::int32_t output_channels = 3; output_channels <= 4; output_channels++)
+            {
+                for (auto masked : { false, true })
+                {
+                    for (auto opacity : { 1.0, 0.61 })
+                    {
+                        auto input_stride = (size.width + 1) * input_channels + 1;
+                        auto output_stride = (size.width + 2 * border) * output_channels + 1;
+                        auto mask_stride = size.width + 5;
+
+                        frame_data_t input(input_stride * size.height + 1);
+                        frame_data_t mask(mask_stride * size.height);
+                        frame_data_t output(output_stride * (size.height + 2 * border));
+                        fill_random(input, seed++);
+                        fill_random(mask, seed++);
+                        fill_random(output, seed++);
+
+                        auto expected = output;
+                        const auto* input_data = input.data() + 1;
+                        auto output_offset = border * output_stride + border * output_channels;
+
+                        for (std::int32_t y = 0; y < size.height; y++)
+                        {
+                            for (std::int32_t x = 0; x < size.width; x++)
+                            {
+                                reference_blend(input_data + y * input_stride + x * input_channels
+                                                , input_channels
+                                                , expected.data() + output_offset + y * output_stride + x * output_channels
+                                                , output_channels
+                                                , masked ? mask[y * mask_stride + x] : -1
+                                                , reference_q15(opacity));
+                            }
+                        }
+
+                        alpha_blend({ input_data, input_stride, input_channels }
+                                    , output.data() + output_offset
+                                    , output_stride
+                                    , output_channels
+                                    , size
+                                    , opacity
+                                    , masked
+                                      ? blend_mask_t{ mask.data(), mask_stride }
+                                      : blend_mask_t{});
+
+                        check(output == expected
+                              , "alpha_blend " + std::to_string(size.width) + "x" + std::to_string(size.height)
+                                + " " + std::to_string(input_channels) + " to " + std::to_string(output_channels) + " channels"
+                                + (masked ? " masked" : "")
+                                + " opacity " + std::to_string(opacity));
+                    }
+                }
+            }
+        }
+    }
+}
+
+// one premultiplied pixel as the scalar kernel blends it, mask < 0 - none
+static void reference_blend_premultiplied(const std::uint8_t* input
+                                          , std::uint8_t* output
+                                          , std::int32_t output_channels
+                                          , std::int32_t mask
+                                          , std::int32_t opacity)
+{
+    auto s = ((mask >= 0 ? mask : 255) * opacity + 16384) >> 15;
+
+    if (s == 0)
+    {
+        return;
+    }
+
+    auto inverse = 255 - reference_div255(input[3] * s);
+
+    for (std::int32_t c = 0; c < std::min(output_channels, 4); c++)
+    {
+        output[c] = std::min(reference_div255(input[c] * s) + reference_div255(output[c] * inverse), 255);
+    }
+}
+
+// The premultiplied kernels against the scalar formula, and the blend of a
+// premultiplied copy against the straight blend of the source: the color
+// channels may differ by the rounding of the premultiply, 2 LSB at most.
+// The output alpha is not compared, a straight blend blends it as a color.
+void test_alpha_blend_premultiplied_reference()
+{
+    const frame_size_t sizes[] = { { 1, 1 }, { 3, 2 }, { 7, 3 }, { 15, 5 }, { 17, 4 }, { 33, 7 }, { 67, 5 } };
+    const std::int32_t border = 3;
+    std::uint32_t seed = 500;
+
+    for (const auto& size : sizes)
+    {
+        for (std::int32_t output_channels = 3; output_channels <= 4; output_channels++)
+        {
+            for (auto masked : { false, true })
+            {
+                for (auto opacity : { 1.0, 0.61 })
+                {
+                    auto input_stride = (size.width + 1) * 4 + 1;
+                    auto output_stride = (size.width + 2 * border) * output_channels + 1;
+                    auto mask_stride = size.width + 5;
+
+                    frame_data_t input(input_stride * size.height + 1);
+                    frame_data_t mask(mask_stride * size.height);
+                    frame_data_t output(output_stride * (size.height + 2 * border));
+                    fill_random(input, seed++);
+                    fill_random(mask, seed++);
+                    fill_random(output, seed++);
+
+                    const auto* input_data = input.data() + 1;
+                    frame_data_t premultiplied(input.size());
+                    premultiply_alpha(input_data
+                                      , input_stride
+                                      , premultiplied.data() + 1
+                                      , input_stride
+                                      , size);
+                    const auto* premultiplied_data = premultiplied.data() + 1;
+
+                    auto expected = output;
+                    auto straight = output;
+                    auto output_offset = border * output_stride + border * output_channels;
+                    const blend_mask_t blend_mask = masked
+                            ? blend_mask_t{ mask.data(), mask_stride }
+                            : blend_mask_t{};
+
+                    for (std::int32_t y = 0; y < size.height; y++)
+                    {
+                        for (std::int32_t x = 0; x < size.width; x++)
+                        {
+                            reference_blend_premultiplied(premultiplied_data + y * input_stride + x * 4
+                                                          , expected.data() + output_offset + y * output_stride + x * output_channels
+                                                          , output_channels
+                                                          , masked ? mask[y * mask_stride + x] : -1
+                                                          , reference_q15(opacity));
+                        }
+                    }
+
+                    alpha_blend({ premultiplied_data, input_stride, 4, true }
+                                , output.data() + output_offset
+                                , output_stride
+                                , output_channels
+                                , size
+                                , opacity
+                                , blend_mask);
+
+                    alpha_blend({ input_data, input_stride, 4 }
+                                , straight.data() + output_offset
+                                , output_stride
+                                , output_channels
+                                , size
+                                , opacity
+                                , blend_mask);
+
+                    std::int32_t difference = 0;
+                    for (std::int32_t y = 0; y < size.height; y++)
+                    {
+                        for (std::int32_t x = 0; x < size.width; x++)
+                        {
+                            auto offset = output_offset + y * output_stride + x * output_channels;
+                            for (std::int32_t c = 0; c < 3; c++)
+                            {
+                                difference = std::max(difference, std::abs(output[offset + c] - straight[offset + c]));
+                            }
+                        }
+                    }
+
+                    auto name = "alpha_blend premultiplied " + std::to_string(size.width) + "x" + std::to_string(size.height)
+                            + " to " + std::to_string(output_channels) + " channels"
+                            + (masked ? " masked" : "")
+                            + " opacity " + std::to_string(opacity);
+
+                    check(output == expected
+                          , name);
+                    check(difference <= 2
+                          , name + " against straight, difference " + std::to_string(difference));
+                }
+            }
+        }
+    }
+}
+
+// one pixel of a solid color fill as the scalar kernel blends it
+static void reference_fill(const std::uint8_t* color
+                           , std::uint8_t* output
+                           , std::int32_t output_channels
+                           , std::int32_t mask
+                           , std::int32_t opacity)
+{
+    auto a = ((mask >= 0 ? mask : 255) * opacity + 16384) >> 15;
+
+    if (a == 0)
+    {
+        return;
+    }
+
+    for (std::int32_t c = 0; c < output_channels; c++)
+    {
+        output[c] = reference_div255(color[c] * a + output[c] * (255 - a));
+    }
+}
+
+// the glyph and shape fills, gray to BGRA, the same way as the blend
+void test_alpha_fill_reference()
+{
+    const frame_size_t sizes[] = { { 1, 1 }, { 5, 2 }, { 15, 3 }, { 17, 5 }, { 33, 4 }, { 71, 3 } };
+    const std::uint8_t color[] = { 23, 181, 240, 97 };
+    const std::int32_t border = 3;
+    std::uint32_t seed = 1000;
+
+    for (const auto& size : sizes)
+    {
+        for (std::int32_t channels = 1; channels <= 4; channels++)
+        {
+            for (auto masked : { false, true })
+            {
+                for (auto opacity : { 1.0, 0.37 })
+                {
+                    auto output_stride = (size.width + 2 * border) * channels + 1;
+                    auto mask_stride = size.width + 3;
+
+                    frame_data_t mask(mask_stride * size.height + 1);
+                    frame_data_t output(output_stride * (size.height + 2 * border));
+                    fill_random(mask, seed++);
+                    fill_random(output, seed++);
+
+                    auto expected = output;
+                    auto output_offset = border * output_stride + border * channels;
+
+                    for (std::int32_t y = 0; y < size.height; y++)
+                    {
+                        for (std::int32_t x = 0; x < size.width; x++)
+                        {
+                            reference_fill(color
+                                           , expected.data() + output_offset + y * output_stride + x * channels
+                                           , channels
+                                           , masked ? mask[1 + y * mask_stride + x] : -1
+                                           , reference_q15(opacity));
+                        }
+                    }
+
+                    alpha_fill(color
+                               , output.data() + output_offset
+                               , output_stride
+                               , channels
+                               , size
+                               , opacity
+                               , masked
+                                 ? blend_mask_t{ mask.data() + 1, mask_stride }
+                                 : blend_mask_t{});
+
+                    check(output == expected
+                          , "alpha_fill " + std::to_string(size.width) + "x" + std::to_string(size.height)
+                            + " " + std::to_string(channels) + " channels"
+                            + (masked ? " masked" : "")
+                            + " opacity " + std::to_string(opacity));
+                }
+            }
+        }
+    }
+}
+
+// a 4:2:0 image of random padded planes, nv12 - interleaved chroma
+struct test_yuv_t
+{
+    frame_data_t    y;
+    frame_data_t    u;
+    frame_data_t    v;
+    yuv_image_t     image;
+
+    test_yuv_t(const frame_size_t& size
+               , bool nv12
+               , std::uint32_t seed)
+    {
+        auto chroma_width = (size.width + 1) / 2;
+        auto chroma_height = (size.height + 1) / 2;
+
+        image.size = size;
+        image.y_stride = size.width + 3;
+        image.u_stride = nv12
+                ? chroma_width * 2 + 2
+                : chroma_width + 1;
+        image.v_stride = nv12
+                ? 0
+                : chroma_width + 5;
+
+        y.resize(image.y_stride * size.height);
+        u.resize(image.u_stride * chroma_height);
+        v.resize(image.v_stride * chroma_height);
+        fill_random(y, seed);
+        fill_random(u, seed + 1);
+        fill_random(v, seed + 2);
+
+        image.y = y.data();
+        image.u = u.data();
+        image.v = nv12
+                ? nullptr
+                : v.data();
+    }
+
+    bool operator==(const test_yuv_t& other) const
+    {
+        return y == other.y
+                && u == other.u
+                && v == other.v;
+    }
+
+    // the u and v samples of a chroma position
+    std::uint8_t* chroma(std::int32_t cx
+                         , std::int32_t cy
+                         , std::int32_t component)
+    {
+        return image.v == nullptr
+                ? image.u + cy * image.u_stride + cx * 2 + component
+                : (component == 0 ? image.u + cy * image.u_stride : image.v + cy * image.v_stride) + cx;
+    }
+};
+
+static bool is_inside(std::int32_t x
+                      , std::int32_t y
+                      , const frame_point_t& offset
+                      , const frame_size_t& size)
+{
+    return x >= offset.x
+            && y >= offset.y
+            && x < offset.x + size.width
+            && y < offset.y + size.height;
+}
+
+// YUV overlays against the sample rules over the whole image: a luma sample
+// is blended as a one channel pixel, a chroma sample with the mean weight of
+// its 2x2 luma samples, the samples out of the overlay and the frame count
+// as not covered. Odd frame and overlay sizes, placed across every edge.
+void test_yuv_overlay_reference()
+{
+    const frame_size_t image_size = { 37, 23 };
+    const frame_point_t offsets[] = { { 3, 5 }, { 0, 0 }, { -4, -3 }, { 30, 18 }, { 33, -1 } };
+    const frame_size_t sizes[] = { { 9, 7 }, { 1, 1 }, { 12, 10 } };
+    const yuv_color_t color = yuv_from_bgr(30, 200, 120);
+    std::uint32_t seed = 2000;
+    frame_data_t scratch;
+
+    for (auto nv12 : { false, true })
+    {
+        for (const auto& offset : offsets)
+        {
+            for (const auto& size : sizes)
+            {
+                for (auto opacity : { 1.0, 0.55 })
+                {
+                    auto q15 = reference_q15(opacity);
+                    auto name = std::string(nv12 ? "nv12 " : "yuv420p ")
+                            + std::to_string(size.width) + "x" + std::to_string(size.height)
+                            + " at " + std::to_string(offset.x) + "," + std::to_string(offset.y)
+                            + " opacity " + std::to_string(opacity);
+
+                    // a solid color through a coverage
+                    auto coverage_stride = size.width + 3;
+                    frame_data_t coverage(coverage_stride * size.height);
+                    fill_random(coverage, seed++);
+
+                    auto coverage_at = [&](std::int32_t x, std::int32_t y)
+                    {
+                        return coverage[(y - offset.y) * coverage_stride + x - offset.x];
+                    };
+
+                    test_yuv_t filled(image_size, nv12, seed);
+                    test_yuv_t expected(image_size, nv12, seed);
+                    seed += 3;
+
+                    for (std::int32_t y = 0; y < image_size.height; y++)
+                    {
+                        for (std::int32_t x = 0; x < image_size.width; x++)
+                        {
+                            if (is_inside(x, y, offset, size))
+                            {
+                                reference_fill(&color.y
+                                               , expected.image.y + y * expected.image.y_stride + x
+                                               , 1
+                                               , coverage_at(x, y)
+                                               , q15);
+                            }
+                        }
+                    }
+
+                    for (std::int32_t cy = 0; cy < (image_size.height + 1) / 2; cy++)
+                    {
+                        for (std::int32_t cx = 0; cx < (image_size.width + 1) / 2; cx++)
+                        {
+                            std::int32_t sum = 0;
+                            bool is_covered = false;
+
+                            for (auto y = cy * 2; y < std::min(cy * 2 + 2, image_size.height); y++)
+                            {
+                                for (auto x = cx * 2; x < std::min(cx * 2 + 2, image_size.width); x++)
+                                {
+                                    if (is_inside(x, y, offset, size))
+                                    {
+                                        sum += coverage_at(x, y);
+                                        is_covered = true;
+                                    }
+                                }
+                            }
+
+                            if (is_covered)
+                            {
+                                reference_fill(&color.u, expected.chroma(cx, cy, 0), 1, (sum + 2) / 4, q15);
+                                reference_fill(&color.v, expected.chroma(cx, cy, 1), 1, (sum + 2) / 4, q15);
+                            }
+                        }
+                    }
+
+                    yuv_fill(filled.image
+                             , offset
+                             , size
+                             , color
+                             , { coverage.data(), coverage_stride }
+                             , opacity
+                             , nv12 ? &scratch : nullptr);
+
+                    check(filled == expected
+                          , "yuv_fill " + name);
+
+                    // a BGRA image, the chroma of the image averaged by the weights
+                    auto input_stride = size.width * 4 + 1;
+                    frame_data_t input(input_stride * size.height);
+                    fill_random(input, seed++);
+
+                    auto pixel_at = [&](std::int32_t x, std::int32_t y)
+                    {
+                        return input.data() + (y - offset.y) * input_stride + (x - offset.x) * 4;
+                    };
+
+                    auto weight_at = [&](std::int32_t x, std::int32_t y)
+                    {
+                        return (pixel_at(x, y)[3] * q15 + 16384) >> 15;
+                    };
+
+                    test_yuv_t blended(image_size, nv12, seed);
+                    test_yuv_t blend_expected(image_size, nv12, seed);
+                    seed += 3;
+
+                    for (std::int32_t y = 0; y < image_size.height; y++)
+                    {
+                        for (std::int32_t x = 0; x < image_size.width; x++)
+                        {
+                            if (is_inside(x, y, offset, size))
+                            {
+                                const auto* pixel = pixel_at(x, y);
+                                auto sample = yuv_from_bgr(pixel[0], pixel[1], pixel[2]);
+
+                                reference_fill(&sample.y
+                                               , blend_expected.image.y + y * blend_expected.image.y_stride + x
+                                               , 1
+                                               , weight_at(x, y)
+                                               , 32767);
+                            }
+                        }
+                    }
+
+                    for (std::int32_t cy = 0; cy < (image_size.height + 1) / 2; cy++)
+                    {
+                        for (std::int32_t cx = 0; cx < (image_size.width + 1) / 2; cx++)
+                        {
+                            std::int32_t weight = 0;
+                            std::int32_t u = 0;
+                            std::int32_t v = 0;
+
+                            for (auto y = cy * 2; y < std::min(cy * 2 + 2, image_size.height); y++)
+                            {
+                                for (auto x = cx * 2; x < std::min(cx * 2 + 2, image_size.width); x++)
+                                {
+                                    if (is_inside(x, y, offset, size))
+                                    {
+                                        const auto* pixel = pixel_at(x, y);
+                                        auto sample = yuv_from_bgr(pixel[0], pixel[1], pixel[2]);
+                                        auto a = weight_at(x, y);
+
+                                        weight += a;
+                                        u += a * sample.u;
+                                        v += a * sample.v;
+                                    }
+                                }
+                            }
+
+                            if (weight > 0)
+                            {
+                                const std::uint8_t mean[] = { static_cast<std::uint8_t>((u + weight / 2) / weight)
+                                                              , static_cast<std::uint8_t>((v + weight / 2) / weight) };
+
+                                reference_fill(&mean[0], blend_expected.chroma(cx, cy, 0), 1, (weight + 2) / 4, 32767);
+                                reference_fill(&mean[1], blend_expected.chroma(cx, cy, 1), 1, (weight + 2) / 4, 32767);
+                            }
+                        }
+                    }
+
+                    yuv_blend(blended.image
+                              , offset
+                              , { input.data(), input_stride, 4 }
+                              , size
+                              , opacity);
+
+                    check(blended == blend_expected
+                          , "yuv_blend " + name);
+                }
+            }
+        }
+    }
+}
+
+void benchmark_alpha_blend()
+{
+    const std::int32_t iterations = 200;
+    const cv::Size sizes[] = { { 200, 80 }, { 320, 180 }, { 480, 270 }, { 960, 540 } };
+
+    std::cout << "alpha_blend simd level: " << alpha_blend_simd_level() << std::endl;
+
+    for (const auto& size : sizes)
+    {
+        // a logo with hard edges, partial alpha is thresholded by the legacy path
+        cv::Mat overlay(size, CV_8UC4);
+        cv::randu(overlay, cv::Scalar::all(0), cv::Scalar::all(256));
+
+        std::vector<cv::Mat> overlay_channels;
+        cv::split(overlay, overlay_channels);
+        cv::threshold(overlay_channels[3], overlay_channels[3], 127, 255, cv::THRESH_BINARY);
+        cv::merge(overlay_channels, overlay);
+
+        cv::Mat mask(size, CV_8UC1, cv::Scalar(0));
+        cv::ellipse(mask
+                    , { size.width / 2, size.height / 2 }
+                    , { size.width / 2, size.height / 2 }
+                    , 0, 0, 360
+                    , cv::Scalar(255)
+                    , -1);
+
+        cv::Mat background(1080, 1920, CV_8UC4);
+        cv::randu(background, cv::Scalar::all(0), cv::Scalar::all(256));
+
+        cv::Mat background_bgr;
+        cv::cvtColor(background, background_bgr, cv::COLOR_BGRA2BGR);
+
+        auto legacy_frame = background.clone();
+        auto blend_frame = background.clone();
+
+        auto legacy_roi = legacy_frame({ 0, 0, size.width, size.height });
+        auto blend_roi = blend_frame({ 0, 0, size.width, size.height });
+        auto bgr_roi = background_bgr({ 0, 0, size.width, size.height });
+
+        auto tp = std::chrono::high_resolution_clock::now();
+
+        for (std::int32_t i = 0; i < iterations; i++)
+        {
+            background({ 0, 0, size.width, size.height }).copyTo(legacy_roi);
+            legacy_overlay(overlay, legacy_roi, 0.7, mask.clone());
+        }
+
+        auto legacy_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - tp).count();
+
+        tp = std::chrono::high_resolution_clock::now();
+
+        for (std::int32_t i = 0; i < iterations; i++)
+        {
+            background({ 0, 0, size.width, size.height }).copyTo(blend_roi);
+            alpha_blend({ overlay.data, static_cast<std::int32_t>(overlay.step), 4 }
+                        , blend_roi.data
+                        , blend_roi.step
+                        , 4
+                        , { size.width, size.height }
+                        , 0.7
+                        , { mask.data, static_cast<std::int32_t>(mask.step) });
+        }
+
+        auto blend_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - tp).count();
+
+        tp = std::chrono::high_resolution_clock::now();
+
+        for (std::int32_t i = 0; i < iterations; i++)
+        {
+            alpha_blend({ overlay.data, static_cast<std::int32_t>(overlay.step), 4 }
+                        , bgr_roi.data
+                        , bgr_roi.step
+                        , 3
+                        , { size.width, size.height }
+                        , 0.7
+                        , { mask.data, static_cast<std::int32_t>(mask.step) });
+        }
+
+        auto bgr_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - tp).count();
+
+        // a cached logo is premultiplied once, unmasked at full opacity
+        cv::Mat premultiplied(size, CV_8UC4);
+        premultiply_alpha(overlay.data
+                          , static_cast<std::int32_t>(overlay.step)
+                          , premultiplied.data
+                          , static_cast<std::int32_t>(premultiplied.step)
+                          , { size.width, size.height });
+
+        blend_image_t straight_image{ overlay.data, static_cast<std::int32_t>(overlay.step), 4 };
+        blend_image_t premultiplied_image{ premultiplied.data, static_cast<std::int32_t>(premultiplied.step), 4, true };
+
+        auto opaque_blend = [&](const blend_image_t& image)
+        {
+            auto tp = std::chrono::high_resolution_clock::now();
+
+            for (std::int32_t i = 0; i < iterations; i++)
+            {
+                alpha_blend(image
+                            , blend_roi.data
+                            , blend_roi.step
+                            , 4
+                            , { size.width, size.height });
+            }
+
+            return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - tp).count();
+        };
+
+        auto straight_time = opaque_blend(straight_image);
+        auto premultiplied_time = opaque_blend(premultiplied_image);
+
+        cv::Mat diff;
+        cv::absdiff(legacy_roi, blend_roi, diff);
+
+        double max_diff = 0.0;
+        cv::minMaxLoc(diff.reshape(1), nullptr, &max_diff);
+
+        std::cout << "overlay " << size.width << "x" << size.height
+                  << ": legacy " << legacy_time / iterations << " us"
+                  << ", bgra " << blend_time / iterations << " us"
+                  << ", bgr " << bgr_time / iterations << " us"
+                  << ", straight " << straight_time / iterations << " us"
+                  << ", premultiplied " << premultiplied_time / iterations << " us"
+                  << ", max diff " << max_diff << std::endl;
+    }
+}
+
+// Cached text against cv::putText of the same font. A glyph is the same
+// stroke pixels wherever it is placed, across the frame edges too; the
+// glyphs of a string are placed on whole pixels and a stroke may move by
+// one, so a string has to cover the same box within a pixel.
+void test_text_cache_reference()
+{
+    const frame_point_t positions[] = { { 11, 37 }, { -6, 9 }, { 296, 90 }, { 305, 4 } };
+    const cv::Scalar color(40, 200, 90);
+    const font_format_t font_format(font_t::simplex, 24, 2);
+
+    text_cache cache;
+    cv::Mat cached(93, 317, CV_8UC3);
+    cv::Mat reference(93, 317, CV_8UC3);
+
+    auto draw = [&](const std::string& text
+                    , const frame_point_t& pos)
+    {
+        cached.setTo(cv::Scalar::all(0));
+        reference.setTo(cv::Scalar::all(0));
+
+        cache.draw_text(cached
+                        , pos
+                        , font_format
+                        , text
+                        , color);
+
+        cv::putText(reference
+                    , text
+                    , { pos.x, pos.y }
+                    , font_format.native_font()
+                    , font_format.scale_font()
+                    , color
+                    , font_format.weight);
+    };
+
+    auto drawn_pixels = [](const cv::Mat& image)
+    {
+        cv::Mat gray;
+        cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+        return gray;
+    };
+
+    for (const auto& symbol : { "A", "g", "7", "%" })
+    {
+        for (const auto& pos : positions)
+        {
+            draw(symbol, pos);
+
+            cv::Mat diff;
+            cv::absdiff(cached, reference, diff);
+
+            check(cv::countNonZero(drawn_pixels(diff)) == 0
+                  , std::string("glyph ") + symbol + " at " + std::to_string(pos.x) + "," + std::to_string(pos.y));
+        }
+    }
+
+    for (const auto& text : { std::string("12:00:59"), std::string("Studio A - Evening news") })
+    {
+        std::int32_t baseline = 0;
+        auto size = cv::getTextSize(text
+                                    , font_format.native_font()
+                                    , font_format.scale_font()
+                                    , font_format.weight
+                                    , &baseline);
+
+        auto cached_size = cache.text_size(font_format, text);
+
+        check(cached_size.width == size.width
+                && cached_size.height == size.height
+              , "text size of " + text);
+
+        const frame_point_t pos = { 7, 61 };
+
+        draw(text, pos);
+
+        auto cached_box = cv::boundingRect(drawn_pixels(cached));
+        auto reference_box = cv::boundingRect(drawn_pixels(reference));
+        auto bounds = cache.text_bounds(font_format, text);
+
+        check(cached_box == cv::Rect(pos.x + bounds.offset.x, pos.y + bounds.offset.y, bounds.size.width, bounds.size.height)
+              , "text bounds of " + text);
+
+        check(std::abs(cached_box.x - reference_box.x) <= 1
+                && std::abs(cached_box.y - reference_box.y) <= 1
+                && std::abs(cached_box.br().x - reference_box.br().x) <= 1
+                && std::abs(cached_box.br().y - reference_box.br().y) <= 1
+              , "text box of " + text);
+    }
+}
+
+void benchmark_draw_text()
+{
+    const std::int32_t iterations = 1000;
+
+    frame_info_t frame_info(frame_format_t::bgr
+                            , { 1920, 1080 });
+    frame_data_t frame_data(frame_info.frame_size(), 0);
+
+    draw_processor processor;
+    processor.set_output_image(frame_info
+                               , frame_data.data());
+    processor.draw_format().font_color = 0xffffff00;
+    processor.draw_format().font_format.height = 32;
+    processor.draw_format().font_format.weight = 2;
+
+    const auto& font_format = processor.draw_format().font_format;
+
+    cv::Mat legacy_frame(1080, 1920, CV_8UC3, cv::Scalar::all(0));
+    cv::Mat cached_frame(1080, 1920, CV_8UC3, frame_data.data());
+
+    // a timestamp caption, every frame draws a new string
+    auto timestamp = [](std::int32_t i)
+    {
+        char text[64];
+        std::snprintf(text, sizeof(text), "2024-05-17 12:%02d:%02d.%03d", (i / 60000) % 60, (i / 1000) % 60, i % 1000);
+        return std::string(text);
+    };
+
+    auto tp = std::chrono::high_resolution_clock::now();
+
+    for (std::int32_t i = 0; i < iterations; i++)
+    {
+        cv::putText(legacy_frame
+                    , timestamp(i * 40)
+                    , { 40, 80 }
+                    , font_format.native_font()
+                    , font_format.scale_font()
+                    , cv::Scalar(255, 255, 255)
+                    , font_format.weight);
+    }
+
+    auto legacy_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - tp).count();
+
+    tp = std::chrono::high_resolution_clock::now();
+
+    for (std::int32_t i = 0; i < iterations; i++)
+    {
+        processor.draw_text({ 40, 80 }
+                            , timestamp(i * 40));
+    }
+
+    auto cached_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - tp).count();
+
+    tp = std::chrono::high_resolution_clock::now();
+
+    for (std::int32_t i = 0; i < iterations; i++)
+    {
+        processor.get_text_size(timestamp(0));
+    }
+
+    auto size_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - tp).count();
+
+    // glyphs are placed on whole pixels, Hershey strokes may move by one
+    cv::Mat diff;
+    cv::absdiff(legacy_frame, cached_frame, diff);
+    cv::cvtColor(diff, diff, cv::COLOR_BGR2GRAY);
+
+    std::cout << "draw_text: legacy " << legacy_time * 1000 / iterations << " ns"
+              << ", cached " << cached_time * 1000 / iterations << " ns"
+              << ", text size " << size_time * 1000 / iterations << " ns"
+              << ", pixels off " << cv::countNonZero(diff) << std::endl;
+}
+
+void benchmark_yuv_overlay()
+{
+    const std::int32_t iterations = 200;
+
+    frame_info_t nv12_info(frame_format_t::nv12
+                           , { 1920, 1080 });
+    frame_info_t bgr_info(frame_format_t::bgr
+                          , { 1920, 1080 });
+
+    frame_data_t nv12_frame(nv12_info.frame_size(), 128);
+    frame_data_t bgr_frame(bgr_info.frame_size(), 0);
+
+    cv::Mat nv12_mat(1080 * 3 / 2, 1920, CV_8UC1, nv12_frame.data());
+    cv::Mat bgr_mat(1080, 1920, CV_8UC3, bgr_frame.data());
+    cv::Mat i420_mat;
+
+    draw_processor processor;
+    processor.draw_format().font_color = 0xffffff00;
+    processor.draw_format().pen_color = 0x00ff0000;
+    processor.draw_format().font_format.height = 32;
+
+    auto draw = [&]()
+    {
+        processor.draw_rect({ 32, 32, 640, 96 });
+        processor.draw_text({ 48, 96 }
+                            , "CAM 01  2024-05-17 12:00:00");
+    };
+
+    // before: to BGR, draw, back to YUV
+    auto tp = std::chrono::high_resolution_clock::now();
+
+    for (std::int32_t i = 0; i < iterations; i++)
+    {
+        cv::cvtColor(nv12_mat, bgr_mat, cv::COLOR_YUV2BGR_NV12);
+        processor.set_output_image(bgr_info
+                                   , bgr_frame.data());
+        draw();
+        cv::cvtColor(bgr_mat, i420_mat, cv::COLOR_BGR2YUV_I420);
+    }
+
+    auto convert_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - tp).count();
+
+    tp = std::chrono::high_resolution_clock::now();
+
+    for (std::int32_t i = 0; i < iterations; i++)
+    {
+        processor.set_output_image(nv12_info
+                                   , nv12_frame.data());
+        draw();
+    }
+
+    auto native_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - tp).count();
+
+    std::cout << "yuv overlay: convert and draw " << convert_time / iterations << " us"
+              << ", native nv12 " << native_time / iterations << " us" << std::endl;
+}
+
+static double max_difference(const cv::Mat& left
+                             , const cv::Mat& right)
+{
+    cv::Mat diff;
+    cv::absdiff(left, right, diff);
+
+    double max_diff = 0.0;
+    cv::minMaxLoc(diff.reshape(1), nullptr, &max_diff);
+
+    return max_diff;
+}
+
+static void draw_element(draw_processor& processor
+                         , const overlay_element_t& element)
+{
+    processor.draw_format() = element.draw_format;
+
+    switch(element.type)
+    {
+        case overlay_element_type_t::text:
+            processor.draw_text(element.rect.offset, element.text);
+        break;
+        case overlay_element_type_t::fill_rectangle:
+            processor.draw_fill_rect(element.rect);
+        break;
+        case overlay_element_type_t::rectangle:
+            processor.draw_rect(element.rect);
+        break;
+        case overlay_element_type_t::ellipse:
+            processor.draw_ellipse(element.rect);
+        break;
+        default:
+        break;
+    }
+}
+
+// The retained scene against immediate drawing of the same elements on the
+// same frame, the elements across the frame edges. Sprites are premultiplied,
+// so a pixel may be off by the premultiplied rounding, 2 LSB; with an
+// opacity the immediate pixels are blended over the frame by hand.
+void test_overlay_scene_reference()
+{
+    const frame_info_t frame_info(frame_format_t::bgr
+                                  , { 333, 187 });
+
+    draw_format_t format;
+    format.font_color = 0xffe04000;
+    format.pen_color = 0x20f0a000;
+    format.fill_color = 0x6030c000;
+    format.font_format.height = 24;
+    format.line_weight = 3;
+
+    std::vector<overlay_element_t> elements;
+
+    elements.emplace_back(overlay_element_type_t::fill_rectangle, frame_rect_t{ -10, 150, 121, 61 });
+    elements.emplace_back(overlay_element_type_t::rectangle, frame_rect_t{ 281, -8, 80, 51 });
+    elements.emplace_back(overlay_element_type_t::ellipse, frame_rect_t{ 41, 21, 91, 57 });
+    elements.emplace_back(overlay_element_type_t::text, frame_rect_t{ 201, 101, 0, 0 });
+    elements.emplace_back(overlay_element_type_t::text, frame_rect_t{ -13, 13, 0, 0 });
+    elements.emplace_back(overlay_element_type_t::text, frame_rect_t{ 297, 190, 0, 0 });
+
+    for (std::size_t i = 0; i < elements.size(); i++)
+    {
+        elements[i].draw_format = format;
+        elements[i].z_order = static_cast<std::int32_t>(i);
+        elements[i].text = "CAM " + std::to_string(i);
+    }
+
+    frame_data_t background(frame_info.frame_size());
+    fill_random(background, 3000);
+
+    auto render = [&](const std::vector<overlay_element_t>& scene_elements
+                      , frame_data_t& scene_frame
+                      , frame_data_t& immediate_frame)
+    {
+        scene_frame = background;
+        immediate_frame = background;
+
+        overlay_scene scene;
+        draw_processor processor;
+        processor.set_output_image(frame_info
+                                   , immediate_frame.data());
+
+        for (const auto& element : scene_elements)
+        {
+            scene.add_element(element);
+            draw_element(processor, element);
+        }
+
+        scene.render(frame_info
+                     , scene_frame.data());
+    };
+
+    auto as_mat = [&](frame_data_t& frame)
+    {
+        return cv::Mat(frame_info.size.height, frame_info.size.width, CV_8UC3, frame.data());
+    };
+
+    frame_data_t scene_frame;
+    frame_data_t immediate_frame;
+
+    render(elements, scene_frame, immediate_frame);
+
+    check(max_difference(as_mat(scene_frame), as_mat(immediate_frame)) <= 2.0
+          , "overlay scene of " + std::to_string(elements.size()) + " elements");
+
+    const double opacity = 0.6;
+    auto a = (255 * reference_q15(opacity) + 16384) >> 15;
+
+    for (auto element : elements)
+    {
+        element.draw_format.draw_opacity = opacity;
+
+        render({ element }, scene_frame, immediate_frame);
+
+        // the pixels drawn by the processor blended over the frame
+        auto expected = background;
+
+        for (std::size_t i = 0; i < expected.size(); i++)
+        {
+            if (immediate_frame[i] != background[i])
+            {
+                expected[i] = reference_div255(immediate_frame[i] * a + background[i] * (255 - a));
+            }
+        }
+
+        check(max_difference(as_mat(scene_frame), as_mat(expected)) <= 2.0
+              , "overlay scene element " + element.text + " with opacity");
+    }
+}
+
+void benchmark_overlay_scene()
+{
+    const std::int32_t iterations = 500;
+
+    frame_info_t frame_info(frame_format_t::bgr
+                            , { 1920, 1080 });
+    frame_data_t frame_data(frame_info.frame_size(), 0);
+
+    draw_format_t caption_format;
+    caption_format.font_color = 0xffffff00;
+    caption_format.fill_color = 0x40404000;
+    caption_format.pen_color = 0x00ffff00;
+    caption_format.font_format.height = 32;
+    caption_format.draw_opacity = 0.8;
+
+    draw_processor processor;
+    processor.set_output_image(frame_info
+                               , frame_data.data());
+    processor.draw_format() = caption_format;
+
+    overlay_scene scene;
+
+    overlay_element_t panel(overlay_element_type_t::fill_rectangle
+                            , { 32, 960, 720, 88 });
+    panel.draw_format = caption_format;
+
+    overlay_element_t name(overlay_element_type_t::text
+                           , { 48, 1000, 0, 0 }
+                           , 1);
+    name.text = "Studio A - Evening news";
+    name.draw_format = caption_format;
+
+    overlay_element_t clock(overlay_element_type_t::text
+                            , { 48, 1036, 0, 0 }
+                            , 1);
+    clock.draw_format = caption_format;
+
+    scene.add_element(panel);
+    scene.add_element(name);
+    auto clock_id = scene.add_element(clock);
+
+    auto clock_text = [](std::int32_t i)
+    {
+        // a clock changes once a second, 25 frames
+        return "12:00:" + std::to_string(10 + (i / 25) % 50);
+    };
+
+    auto tp = std::chrono::high_resolution_clock::now();
+
+    for (std::int32_t i = 0; i < iterations; i++)
+    {
+        processor.draw_fill_rect(panel.rect);
+        processor.draw_text(name.rect.offset, name.text);
+        processor.draw_text(clock.rect.offset, clock_text(i));
+    }
+
+    auto immediate_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - tp).count();
+
+    tp = std::chrono::high_resolution_clock::now();
+
+    for (std::int32_t i = 0; i < iterations; i++)
+    {
+        scene.set_text(clock_id, clock_text(i));
+        scene.render(frame_info
+                     , frame_data.data());
+    }
+
+    auto scene_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - tp).count();
+
+    auto stats = scene.stats();
+
+    std::cout << "overlay scene: immediate " << immediate_time / iterations << " us"
+              << ", retained " << scene_time / iterations << " us"
+              << ", rasterized " << stats.rasterized
+              << ", composited pixels " << stats.composited_pixels << std::endl;
+}
+
+// An image drawn from the cache against the same draw without a generation:
+// a hit gives the pixels of the miss, an opaque image the uncached pixels,
+// an unscaled BGRA image the uncached ones within the premultiplied rounding.
+// Odd sizes, scaled and not, across the frame edges, with the figure masks.
+void test_image_cache_reference()
+{
+    const frame_info_t frame_info(frame_format_t::bgr
+                                  , { 301, 163 });
+    const frame_size_t image_size = { 251, 171 };
+    const frame_rect_t rects[] = { { 13, 17, 97, 61 }
+                                   , { -21, -9, 97, 61 }
+                                   , { 250, 120, 97, 61 }
+                                   , { 7, 9, image_size.width, image_size.height } };
+
+    frame_data_t background(frame_info.frame_size());
+    fill_random(background, 4000);
+
+    draw_processor processor;
+    std::uint64_t generation = 1;
+
+    auto draw = [&](const frame_rect_t& rect
+                    , const frame_info_t& image_info
+                    , const frame_data_t& image
+                    , draw_figure_t figure
+                    , std::uint64_t generation)
+    {
+        auto frame = background;
+
+        processor.set_output_image(frame_info
+                                   , frame.data());
+        processor.draw_image(rect
+                             , image_info
+                             , image.data()
+                             , figure
+                             , generation);
+
+        return cv::Mat(frame_info.size.height, frame_info.size.width, CV_8UC3, frame.data()).clone();
+    };
+
+    for (auto format : { frame_format_t::bgr, frame_format_t::bgra })
+    {
+        const frame_info_t image_info(format
+                                      , image_size);
+        frame_data_t image(image_info.frame_size());
+        fill_random(image, 4100 + static_cast<std::uint32_t>(generation));
+
+        for (auto figure : { draw_figure_t::rectangle, draw_figure_t::ellipse })
+        {
+            for (const auto& rect : rects)
+            {
+                auto name = std::string(format == frame_format_t::bgr ? "bgr" : "bgra")
+                        + (figure == draw_figure_t::ellipse ? " ellipse " : " ")
+                        + std::to_string(rect.size.width) + "x" + std::to_string(rect.size.height)
+                        + " at " + std::to_string(rect.offset.x) + "," + std::to_string(rect.offset.y);
+
+                auto uncached = draw(rect, image_info, image, figure, 0);
+                auto miss = draw(rect, image_info, image, figure, generation);
+                auto hit = draw(rect, image_info, image, figure, generation);
+                generation++;
+
+                check(max_difference(hit, miss) == 0.0
+                      , "image cache hit of " + name);
+
+                // straight alpha is premultiplied before the scaling
+                const bool is_scaled = rect.size.width != image_size.width
+                        || rect.size.height != image_size.height;
+
+                if (format == frame_format_t::bgr)
+                {
+                    check(max_difference(miss, uncached) == 0.0
+                          , "cached image " + name);
+                }
+                else if (!is_scaled)
+                {
+                    check(max_difference(miss, uncached) <= 2.0
+                          , "cached image " + name);
+                }
+            }
+        }
+    }
+}
+
+void benchmark_image_cache()
+{
+    const std::int32_t iterations = 500;
+
+    frame_info_t frame_info(frame_format_t::bgr
+                            , { 1920, 1080 });
+    frame_data_t frame_data(frame_info.frame_size(), 0);
+
+    frame_info_t logo_info(frame_format_t::bgra
+                           , { 1024, 1024 });
+    frame_data_t logo_data(logo_info.frame_size(), 0x80);
+
+    const frame_rect_t logo_rect = { 1600, 40, 256, 256 };
+
+    draw_processor processor;
+    processor.set_output_image(frame_info
+                               , frame_data.data());
+
+    auto run = [&](std::uint64_t generation)
+    {
+        auto tp = std::chrono::high_resolution_clock::now();
+
+        for (std::int32_t i = 0; i < iterations; i++)
+        {
+            processor.draw_image(logo_rect
+                                 , logo_info
+                                 , logo_data.data()
+                                 , draw_figure_t::ellipse
+                                 , generation);
+        }
+
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - tp).count();
+    };
+
+    auto uncached_time = run(0);
+    auto cached_time = run(1);
+
+    std::cout << "image cache: uncached " << uncached_time / iterations << " us"
+              << ", cached " << cached_time / iterations << " us" << std::endl;
+}
+
+static cv::Mat plane_mat(const frame_info_t& frame_info
+                         , frame_data_t& frame
+                         , std::int32_t plane)
+{
+    auto height = plane == 0
+            ? frame_info.size.height
+            : (frame_info.size.height + 1) / 2;
+
+    auto width = static_cast<std::int32_t>(frame_info.plane_line_size(plane));
+
+    return cv::Mat(height, width, CV_8UC1, frame.data() + frame_info.plane_offset(plane));
+}
+
+// The mosaic against the tiles placed one by one: cv::resize to the cell,
+// copied for a direct tile, blended in z-order through the figure mask for
+// the rest. Odd cells across the frame edges, on every thread count.
+void test_mosaic_reference()
+{
+    const frame_info_t frame_info(frame_format_t::bgr
+                                  , { 317, 181 });
+    const frame_info_t source_info(frame_format_t::bgr
+                                   , { 203, 117 });
+
+    mosaic_layout_t layout;
+    layout.emplace_back(frame_rect_t{ 0, 0, 97, 61 });
+    layout.emplace_back(frame_rect_t{ 101, 3, 83, 59 });
+    layout.emplace_back(frame_rect_t{ -17, 120, 91, 71 });
+    layout.emplace_back(frame_rect_t{ 260, 90, 77, 55 }, 1, draw_figure_t::ellipse, 0.8);
+    layout.emplace_back(frame_rect_t{ 40, 100, 71, 45 }, 2, draw_figure_t::ellipse, 0.9);
+
+    std::vector<frame_data_t> source_data(layout.size()
+                                          , frame_data_t(source_info.frame_size()));
+    mosaic_source_list_t sources;
+
+    for (std::size_t i = 0; i < layout.size(); i++)
+    {
+        fill_random(source_data[i], 5000 + static_cast<std::uint32_t>(i));
+        sources.emplace_back(source_info
+                             , source_data[i].data());
+    }
+
+    frame_data_t background(frame_info.frame_size());
+    fill_random(background, 5100);
+
+    auto expected = background;
+    cv::Mat expected_mat(frame_info.size.height, frame_info.size.width, CV_8UC3, expected.data());
+    const cv::Rect frame_rect(0, 0, frame_info.size.width, frame_info.size.height);
+
+    // the layout is in z-order already
+    for (std::size_t i = 0; i < layout.size(); i++)
+    {
+        const auto& cell = layout[i];
+        const cv::Rect rect(cell.rect.offset.x, cell.rect.offset.y, cell.rect.size.width, cell.rect.size.height);
+
+        cv::Mat source(source_info.size.height, source_info.size.width, CV_8UC3, source_data[i].data());
+        cv::Mat scaled;
+        cv::resize(source, scaled, rect.size());
+
+        cv::Mat mask;
+        if (cell.figure == draw_figure_t::ellipse)
+        {
+            mask = cv::Mat(rect.height, rect.width, CV_8UC1, cv::Scalar(0));
+            cv::ellipse(mask
+                        , { rect.width / 2, rect.height / 2 }
+                        , { rect.width / 2, rect.height / 2 }
+                        , 0, 0, 360
+                        , cv::Scalar(255)
+                        , -1);
+        }
+
+        auto visible = rect & frame_rect;
+        auto dx = visible.x - rect.x;
+        auto dy = visible.y - rect.y;
+
+        alpha_blend({ scaled.ptr(dy, dx), static_cast<std::int32_t>(scaled.step), 3 }
+                    , expected_mat.ptr(visible.y, visible.x)
+                    , static_cast<std::int32_t>(expected_mat.step)
+                    , 3
+                    , { visible.width, visible.height }
+                    , cell.opacity
+                    , mask.empty()
+                      ? blend_mask_t{}
+                      : blend_mask_t{ mask.ptr(dy, dx), static_cast<std::int32_t>(mask.step) });
+    }
+
+    for (std::size_t threads : { 0, 1, 3 })
+    {
+        auto frame = background;
+
+        mosaic_compositor compositor(threads);
+        compositor.set_layout(layout);
+        compositor.compose(sources
+                           , frame_info
+                           , frame.data());
+
+        auto stats = compositor.stats();
+        auto name = "mosaic bgr, threads " + std::to_string(threads);
+
+        check(stats.direct == 2
+                && stats.blended == 3
+              , name + " tiles");
+        check(frame == expected
+              , name);
+    }
+
+    // direct tiles of planar YUV: every plane scaled into its cell
+    const frame_info_t yuv_info(frame_format_t::yuv420p
+                                , { 318, 182 });
+    const frame_info_t yuv_source_info(frame_format_t::yuv420p
+                                       , { 202, 118 });
+
+    mosaic_layout_t yuv_layout;
+    yuv_layout.emplace_back(frame_rect_t{ 0, 0, 98, 62 });
+    yuv_layout.emplace_back(frame_rect_t{ 110, 20, 120, 80 });
+
+    std::vector<frame_data_t> yuv_source_data(yuv_layout.size()
+                                              , frame_data_t(yuv_source_info.frame_size()));
+    mosaic_source_list_t yuv_sources;
+
+    frame_data_t yuv_background(yuv_info.frame_size());
+    fill_random(yuv_background, 5200);
+
+    auto yuv_expected = yuv_background;
+
+    for (std::size_t i = 0; i < yuv_layout.size(); i++)
+    {
+        fill_random(yuv_source_data[i], 5300 + static_cast<std::uint32_t>(i));
+        yuv_sources.emplace_back(yuv_source_info
+                                 , yuv_source_data[i].data());
+
+        const auto& rect = yuv_layout[i].rect;
+
+        for (std::int32_t p = 0; p < 3; p++)
+        {
+            auto scale = p == 0 ? 1 : 2;
+            auto output_plane = plane_mat(yuv_info, yuv_expected, p);
+            cv::Mat output_tile = output_plane({ rect.offset.x / scale, rect.offset.y / scale, rect.size.width / scale, rect.size.height / scale });
+
+            cv::resize(plane_mat(yuv_source_info, yuv_source_data[i], p)
+                       , output_tile
+                       , output_tile.size());
+        }
+    }
+
+    auto yuv_frame = yuv_background;
+
+    mosaic_compositor yuv_compositor;
+    yuv_compositor.set_layout(yuv_layout);
+    yuv_compositor.compose(yuv_sources
+                           , yuv_info
+                           , yuv_frame.data());
+
+    check(yuv_compositor.stats().direct == 2
+          , "mosaic yuv420p direct tiles");
+    check(yuv_frame == yuv_expected
+          , "mosaic yuv420p");
+}
+
+void benchmark_mosaic()
+{
+    const std::int32_t iterations = 100;
+    const std::int32_t columns = 4;
+    const std::int32_t rows = 4;
+
+    auto run = [&](frame_format_t format)
+    {
+        frame_info_t frame_info(format
+                                , { 1920, 1080 });
+        frame_data_t frame_data(frame_info.frame_size(), 0);
+
+        std::vector<frame_data_t> source_data(columns * rows
+                                              , frame_data_t(frame_info.frame_size(), 0x80));
+
+        mosaic_layout_t layout;
+        mosaic_source_list_t sources;
+
+        for (std::int32_t i = 0; i < columns * rows; i++)
+        {
+            layout.emplace_back(frame_rect_t{ (i % columns) * 480, (i / columns) * 270, 480, 270 });
+            sources.emplace_back(frame_info
+                                 , source_data[i].data());
+        }
+
+        // the speaker picture in picture, an ellipse over the grid
+        layout.emplace_back(frame_rect_t{ 1440, 780, 400, 240 }
+                            , 1
+                            , draw_figure_t::ellipse
+                            , 0.9);
+        sources.emplace_back(frame_info
+                             , source_data[0].data());
+
+        mosaic_compositor compositor;
+        compositor.set_layout(layout);
+
+        auto tp = std::chrono::high_resolution_clock::now();
+
+        for (std::int32_t i = 0; i < iterations; i++)
+        {
+            compositor.compose(sources
+                               , frame_info
+                               , frame_data.data());
+        }
+
+        auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - tp).count();
+        auto stats = compositor.stats();
+
+        std::cout << "mosaic " << frame_info.format_name()
+                  << ": " << time / iterations << " us"
+                  << ", direct " << stats.direct
+                  << ", blended " << stats.blended
+                  << ", bands " << stats.bands << std::endl;
+    };
+
+    run(frame_format_t::bgr);
+    run(frame_format_t::yuv420p);
+}
+
+// Batched boxes against cv::rectangle, in the list order: the strokes are
+// bars of the rectangle, only the round joins of thick lines at the corners
+// differ. Odd boxes across the frame edges, thin and degenerate ones too,
+// in one band and in parallel bands; a translucent fill against the formula.
+void test_draw_commands_reference()
+{
+    struct box_t
+    {
+        frame_rect_t    rect;
+        std::int32_t    line_weight;    // < 0 - filled
+        color_t         color;
+    };
+
+    const box_t boxes[] = { { { 5, 7, 41, 23 }, 1, 0x00ff0000 }
+                            , { { -9, 30, 51, 37 }, 2, 0xff000000 }
+                            , { { 280, -6, 45, 31 }, 3, 0x0000ff00 }
+                            , { { 100, 150, 61, 41 }, 5, 0x80ff4000 }
+                            , { { 30, 40, 51, 31 }, 4, 0x4080ff00 }
+                            , { { 150, 40, 3, 3 }, 3, 0xffff0000 }
+                            , { { 200, 80, 71, 1 }, 2, 0x00ffff00 }
+                            , { { 60, 60, 33, 21 }, -1, 0x20406000 }
+                            , { { 250, 100, 77, 90 }, -1, 0xa0a0a000 } };
+
+    const frame_info_t frame_info(frame_format_t::bgr
+                                  , { 311, 173 });
+
+    frame_data_t background(frame_info.frame_size());
+    fill_random(background, 6000);
+
+    auto as_mat = [&](frame_data_t& frame)
+    {
+        return cv::Mat(frame_info.size.height, frame_info.size.width, CV_8UC3, frame.data());
+    };
+
+    auto color_scalar = [](color_t color)
+    {
+        return cv::Scalar((color >> 24) & 0xff, (color >> 16) & 0xff, (color >> 8) & 0xff);
+    };
+
+    auto expected = background;
+    auto expected_mat = as_mat(expected);
+    cv::Mat corners(frame_info.size.height, frame_info.size.width, CV_8UC1, cv::Scalar(0));
+
+    draw_command_list commands;
+
+    for (const auto& box : boxes)
+    {
+        const cv::Rect rect(box.rect.offset.x, box.rect.offset.y, box.rect.size.width, box.rect.size.height);
+
+        if (box.line_weight < 0)
+        {
+            commands.add_fill_rect(box.rect
+                                   , box.color);
+            cv::rectangle(expected_mat
+                          , rect
+                          , color_scalar(box.color)
+                          , cv::FILLED);
+            continue;
+        }
+
+        commands.add_rect(box.rect
+                          , box.color
+                          , box.line_weight);
+        cv::rectangle(expected_mat
+                      , rect
+                      , color_scalar(box.color)
+                      , box.line_weight);
+
+        if (box.line_weight > 1)
+        {
+            auto t = box.line_weight;
+
+            for (auto x : { rect.x, rect.x + rect.width - 1 })
+            {
+                for (auto y : { rect.y, rect.y + rect.height - 1 })
+                {
+                    cv::rectangle(corners
+                                  , cv::Rect(x - t, y - t, 2 * t + 1, 2 * t + 1)
+                                  , cv::Scalar(255)
+                                  , cv::FILLED);
+                }
+            }
+        }
+    }
+
+    draw_processor processor;
+
+    for (auto parallel : { false, true })
+    {
+        auto frame = background;
+
+        processor.set_output_image(frame_info
+                                   , frame.data());
+        processor.draw_commands(commands
+                                , parallel);
+
+        cv::Mat diff;
+        cv::absdiff(as_mat(frame), expected_mat, diff);
+        cv::cvtColor(diff, diff, cv::COLOR_BGR2GRAY);
+        diff.setTo(cv::Scalar(0), corners);
+
+        check(cv::countNonZero(diff) == 0
+              , std::string("draw commands") + (parallel ? " in parallel" : ""));
+    }
+
+    // a translucent fill across the bottom right corner
+    const frame_rect_t fill_rect = { 271, 141, 57, 45 };
+    const color_t fill_color = 0x3060c000;
+    const double opacity = 0.45;
+
+    auto frame = background;
+    auto fill_expected = background;
+    const std::uint8_t pixel[] = { 0x30, 0x60, 0xc0 };
+
+    for (auto y = fill_rect.offset.y; y < std::min(fill_rect.offset.y + fill_rect.size.height, frame_info.size.height); y++)
+    {
+        for (auto x = fill_rect.offset.x; x < std::min(fill_rect.offset.x + fill_rect.size.width, frame_info.size.width); x++)
+        {
+            reference_fill(pixel
+                           , fill_expected.data() + (y * frame_info.size.width + x) * 3
+                           , 3
+                           , -1
+                           , reference_q15(opacity));
+        }
+    }
+
+    commands.clear();
+    commands.add_fill_rect(fill_rect
+                           , fill_color
+                           , opacity);
+
+    processor.set_output_image(frame_info
+                               , frame.data());
+    processor.draw_commands(commands
+                            , true);
+
+    check(frame == fill_expected
+          , "draw commands translucent fill");
+}
+
+void benchmark_draw_commands()
+{
+    const std::int32_t iterations = 100;
+    const std::int32_t boxes = 300;
+
+    frame_info_t frame_info(frame_format_t::bgr
+                            , { 1920, 1080 });
+    frame_data_t frame_data(frame_info.frame_size(), 0);
+
+    draw_processor processor;
+    processor.set_output_image(frame_info
+                               , frame_data.data());
+    processor.draw_format().pen_color = 0x00ff0000;
+    processor.draw_format().line_weight = 2;
+
+    std::vector<frame_rect_t> rects;
+    for (std::int32_t i = 0; i < boxes; i++)
+    {
+        rects.push_back({ (i * 97) % 1800, (i * 53) % 1000, 40 + i % 80, 60 + i % 40 });
+    }
+
+    draw_command_list commands;
+
+    auto tp = std::chrono::high_resolution_clock::now();
+
+    for (std::int32_t i = 0; i < iterations; i++)
+    {
+        for (const auto& r : rects)
+        {
+            processor.draw_rect(r);
+        }
+    }
+
+    auto immediate_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - tp).count();
+
+    auto batch = [&](bool parallel)
+    {
+        auto tp = std::chrono::high_resolution_clock::now();
+
+        for (std::int32_t i = 0; i < iterations; i++)
+        {
+            commands.clear();
+
+            for (const auto& r : rects)
+            {
+                commands.add_rect(r
+                                  , 0x00ff0000
+                                  , 2);
+            }
+
+            processor.draw_commands(commands
+                                    , parallel);
+        }
+
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - tp).count();
+    };
+
+    auto batch_time = batch(false);
+    auto parallel_time = batch(true);
+
+    std::cout << "draw commands (" << boxes << " boxes): immediate " << immediate_time / iterations << " us"
+              << ", batch " << batch_time / iterations << " us"
+              << ", parallel " << parallel_time / iterations << " us" << std::endl;
+}
+
 void test()
 {
+    test_alpha_blend_reference();
+    test_alpha_blend_premultiplied_reference();
+    test_alpha_fill_reference();
+    test_text_cache_reference();
+    test_yuv_overlay_reference();
+    test_overlay_scene_reference();
+    test_image_cache_reference();
+    test_mosaic_reference();
+    test_draw_commands_reference();
+    benchmark_alpha_blend();
+    benchmark_draw_text();
+    benchmark_yuv_overlay();
+    benchmark_overlay_scene();
+    benchmark_image_cache();
+    benchmark_mosaic();
+    benchmark_draw_commands();
     test3();
 }
 
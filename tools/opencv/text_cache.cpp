@@ -0,0 +1,500 @@
+#include "text_cache.h"
+#include "alpha_blend.h"
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <iterator>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <tuple>
+
+namespace ocv
+{
+
+namespace
+{
+
+const std::int32_t atlas_page_size = 512;
+const std::size_t max_cached_fonts = 16;
+
+struct glyph_t
+{
+    std::int32_t    page = -1;      // -1 - nothing to draw (space)
+    cv::Rect        rect;           // coverage in the atlas page
+    cv::Point       offset;         // of the coverage from the pen position
+    std::int32_t    advance = 0;
+};
+
+struct placed_glyph_t
+{
+    const glyph_t*  glyph;
+    std::int32_t    x;
+};
+
+struct text_layout_t
+{
+    std::vector<placed_glyph_t> glyphs;
+    frame_size_t                size;
+    cv::Rect                    bounds;     // of the glyph coverage, from the pen origin
+};
+
+struct font_key_t
+{
+    std::int32_t    face;           // Hershey font, -1 - custom font
+    std::int32_t    height;
+    std::int32_t    weight;
+
+    bool operator <(const font_key_t& key) const
+    {
+        return std::tie(face, height, weight)
+                < std::tie(key.face, key.height, key.weight);
+    }
+};
+
+// 8 bit coverage pages, glyphs are packed in shelves of the last page
+struct glyph_atlas_t
+{
+    struct page_t
+    {
+        cv::Mat         pixels;
+        std::int32_t    shelf_x = 0;
+        std::int32_t    shelf_y = 0;
+        std::int32_t    shelf_height = 0;
+    };
+
+    std::vector<page_t> pages;
+
+    static bool fit(page_t& page
+                    , const cv::Size& size)
+    {
+        if (page.shelf_x + size.width > page.pixels.cols)
+        {
+            page.shelf_x = 0;
+            page.shelf_y += page.shelf_height;
+            page.shelf_height = 0;
+        }
+
+        return page.shelf_x + size.width <= page.pixels.cols
+                && page.shelf_y + size.height <= page.pixels.rows;
+    }
+
+    void place(const cv::Mat& coverage
+               , glyph_t& glyph)
+    {
+        if (pages.empty()
+                || !fit(pages.back(), coverage.size()))
+        {
+            page_t page;
+            page.pixels = cv::Mat(std::max(atlas_page_size, coverage.rows)
+                                  , std::max(atlas_page_size, coverage.cols)
+                                  , CV_8UC1
+                                  , cv::Scalar(0));
+            pages.push_back(page);
+        }
+
+        auto& page = pages.back();
+
+        glyph.page = static_cast<std::int32_t>(pages.size() - 1);
+        glyph.rect = { page.shelf_x, page.shelf_y, coverage.cols, coverage.rows };
+
+        coverage.copyTo(page.pixels(glyph.rect));
+
+        page.shelf_x += coverage.cols;
+        page.shelf_height = std::max(page.shelf_height, coverage.rows);
+    }
+};
+
+struct font_cache_t
+{
+    using layout_list_t = std::list<std::pair<std::string, text_layout_t>>;
+
+    font_key_t                                                  key;
+    double                                                      scale;
+    glyph_atlas_t                                               atlas;
+    std::unordered_map<std::string, glyph_t>                    glyphs;
+    layout_list_t                                               layouts;    // front - most recently used
+    std::unordered_map<std::string, layout_list_t::iterator>    layout_index;
+
+    font_cache_t(const font_key_t& key)
+        : key(key)
+        , scale(key.face >= 0
+                ? cv::getFontScaleFromHeight(key.face
+                                             , key.height
+                                             , key.weight)
+                : 1.0)
+    {
+
+    }
+};
+
+// Hershey fonts draw bytes, FreeType draws UTF-8 code points
+std::size_t symbol_length(const std::string& text
+                          , std::size_t pos
+                          , bool utf8)
+{
+    std::size_t length = 1;
+
+    if (utf8)
+    {
+        auto lead = static_cast<std::uint8_t>(text[pos]);
+
+        length = lead >= 0xf0
+                ? 4
+                : lead >= 0xe0
+                  ? 3
+                  : lead >= 0xc0
+                    ? 2
+                    : 1;
+    }
+
+    return std::min(length, text.size() - pos);
+}
+
+}
+
+struct text_cache_context_t
+{
+    using font_map_t = std::map<font_key_t, font_cache_t>;
+
+    cv::Ptr<cv::freetype::FreeType2>    m_custom_font;
+    font_map_t                          m_fonts;
+    std::size_t                         m_layout_capacity;
+    text_cache_stats_t                  m_stats;
+    cv::Mat                             m_canvas;
+    cv::Mat                             m_coverage;
+
+    text_cache_context_t(std::size_t layout_capacity)
+        : m_layout_capacity(std::max<std::size_t>(layout_capacity, 1))
+    {
+
+    }
+
+    void set_custom_font(const cv::Ptr<cv::freetype::FreeType2>& custom_font)
+    {
+        if (m_custom_font != custom_font)
+        {
+            for (auto it = m_fonts.begin(); it != m_fonts.end();)
+            {
+                it = it->first.face < 0
+                        ? m_fonts.erase(it)
+                        : std::next(it);
+            }
+
+            m_custom_font = custom_font;
+        }
+    }
+
+    font_cache_t& fetch_font(const font_format_t& font_format)
+    {
+        font_key_t key{ m_custom_font != nullptr
+                        ? -1
+                        : font_format.native_font()
+                        , font_format.height
+                        , font_format.weight };
+
+        auto it = m_fonts.find(key);
+        if (it == m_fonts.end())
+        {
+            // formats rarely change, a full reset is enough
+            if (m_fonts.size() >= max_cached_fonts)
+            {
+                m_fonts.clear();
+            }
+
+            it = m_fonts.emplace(key, key).first;
+        }
+
+        return it->second;
+    }
+
+    cv::Size measure(const font_cache_t& font
+                     , const std::string& text) const
+    {
+        std::int32_t baseline = 0;
+
+        if (font.key.face < 0)
+        {
+            return m_custom_font->getTextSize(text
+                                              , font.key.height
+                                              , font.key.weight
+                                              , &baseline);
+        }
+
+        return cv::getTextSize(text
+                               , font.key.face
+                               , font.scale
+                               , font.key.weight
+                               , &baseline);
+    }
+
+    void render(const font_cache_t& font
+                , const std::string& text
+                , const cv::Point& origin)
+    {
+        if (font.key.face < 0)
+        {
+            m_custom_font->putText(m_canvas
+                                   , text
+                                   , origin
+                                   , font.key.height
+                                   , cv::Scalar::all(255)
+                                   , font.key.weight
+                                   , cv::LineTypes::LINE_AA
+                                   , true);
+        }
+        else
+        {
+            cv::putText(m_canvas
+                        , text
+                        , origin
+                        , font.key.face
+                        , font.scale
+                        , cv::Scalar::all(255)
+                        , font.key.weight);
+        }
+    }
+
+    const glyph_t& fetch_glyph(font_cache_t& font
+                               , const std::string& symbol)
+    {
+        auto it = font.glyphs.find(symbol);
+        if (it != font.glyphs.end())
+        {
+            return it->second;
+        }
+
+        m_stats.glyph_misses++;
+
+        glyph_t glyph;
+
+        auto size = measure(font, symbol);
+        glyph.advance = measure(font, symbol + symbol).width - size.width;
+
+        // the renderers place the origin differently, the symbol is drawn
+        // white on black with room on every side and cut by its bounds;
+        // FreeType draws into 3 channel images only
+        auto margin = size.height + font.key.height + 2 * font.key.weight + 4;
+        cv::Point origin(margin, margin);
+
+        m_canvas.create(2 * margin
+                        , size.width + 2 * margin
+                        , CV_8UC3);
+        m_canvas.setTo(cv::Scalar::all(0));
+
+        render(font
+               , symbol
+               , origin);
+
+        cv::extractChannel(m_canvas
+                           , m_coverage
+                           , 0);
+
+        auto bounds = cv::boundingRect(m_coverage);
+        if (!bounds.empty())
+        {
+            glyph.offset = bounds.tl() - origin;
+            font.atlas.place(m_coverage(bounds)
+                             , glyph);
+        }
+
+        // references to unordered_map elements survive a rehash
+        return font.glyphs.emplace(symbol, glyph).first->second;
+    }
+
+    const text_layout_t& fetch_layout(font_cache_t& font
+                                      , const std::string& text)
+    {
+        auto idx = font.layout_index.find(text);
+        if (idx != font.layout_index.end())
+        {
+            m_stats.layout_hits++;
+            font.layouts.splice(font.layouts.begin()
+                                , font.layouts
+                                , idx->second);
+            return idx->second->second;
+        }
+
+        m_stats.layout_misses++;
+
+        text_layout_t layout;
+
+        auto size = measure(font, text);
+        layout.size = { size.width, size.height };
+
+        std::int32_t x = 0;
+        for (std::size_t pos = 0; pos < text.size();)
+        {
+            auto length = symbol_length(text
+                                        , pos
+                                        , font.key.face < 0);
+
+            const auto& glyph = fetch_glyph(font
+                                            , text.substr(pos, length));
+            if (glyph.page >= 0)
+            {
+                layout.glyphs.push_back({ &glyph, x });
+                layout.bounds |= cv::Rect(x + glyph.offset.x
+                                          , glyph.offset.y
+                                          , glyph.rect.width
+                                          , glyph.rect.height);
+            }
+
+            x += glyph.advance;
+            pos += length;
+        }
+
+        font.layouts.emplace_front(text, std::move(layout));
+        font.layout_index[text] = font.layouts.begin();
+
+        while (font.layouts.size() > m_layout_capacity)
+        {
+            font.layout_index.erase(font.layouts.back().first);
+            font.layouts.pop_back();
+        }
+
+        return font.layouts.front().second;
+    }
+
+    void draw_text(cv::Mat& output
+                   , const frame_point_t& pos
+                   , const font_format_t& font_format
+                   , const std::string& text
+                   , const cv::Scalar& color)
+    {
+        if (text.empty()
+                || output.depth() != CV_8U
+                || output.channels() > 4)
+        {
+            return;
+        }
+
+        auto& font = fetch_font(font_format);
+        const auto& layout = fetch_layout(font, text);
+
+        std::uint8_t color_bytes[4];
+        for (std::int32_t c = 0; c < 4; c++)
+        {
+            color_bytes[c] = cv::saturate_cast<std::uint8_t>(color[c]);
+        }
+
+        const cv::Rect output_rect(0, 0, output.cols, output.rows);
+
+        for (const auto& placed : layout.glyphs)
+        {
+            const auto& glyph = *placed.glyph;
+
+            cv::Rect rect(pos.x + placed.x + glyph.offset.x
+                          , pos.y + glyph.offset.y
+                          , glyph.rect.width
+                          , glyph.rect.height);
+
+            auto visible = rect & output_rect;
+            if (visible.empty())
+            {
+                continue;
+            }
+
+            const auto& page = font.atlas.pages[glyph.page].pixels;
+
+            alpha_fill(color_bytes
+                       , output.ptr(visible.y, visible.x)
+                       , static_cast<std::int32_t>(output.step)
+                       , output.channels()
+                       , { visible.width, visible.height }
+                       , 1.0
+                       , { page.ptr(glyph.rect.y + visible.y - rect.y
+                                    , glyph.rect.x + visible.x - rect.x)
+                           , static_cast<std::int32_t>(page.step) });
+        }
+    }
+
+    frame_size_t text_size(const font_format_t& font_format
+                           , const std::string& text)
+    {
+        auto& font = fetch_font(font_format);
+        return fetch_layout(font, text).size;
+    }
+
+    frame_rect_t text_bounds(const font_format_t& font_format
+                             , const std::string& text)
+    {
+        auto& font = fetch_font(font_format);
+        const auto& bounds = fetch_layout(font, text).bounds;
+        return { bounds.x, bounds.y, bounds.width, bounds.height };
+    }
+
+    text_cache_stats_t stats() const
+    {
+        auto stats = m_stats;
+
+        for (const auto& f : m_fonts)
+        {
+            stats.glyphs += f.second.glyphs.size();
+            stats.layouts += f.second.layouts.size();
+        }
+
+        return stats;
+    }
+
+    void clear()
+    {
+        m_fonts.clear();
+        m_stats = {};
+    }
+};
+//------------------------------------------------------------------------------
+void text_cache_context_deleter_t::operator()(text_cache_context_t *text_cache_context_ptr)
+{
+    delete text_cache_context_ptr;
+}
+//------------------------------------------------------------------------------
+text_cache::text_cache(std::size_t layout_capacity)
+    : m_text_cache_context(new text_cache_context_t(layout_capacity))
+{
+
+}
+
+void text_cache::set_custom_font(const cv::Ptr<cv::freetype::FreeType2>& custom_font)
+{
+    m_text_cache_context->set_custom_font(custom_font);
+}
+
+void text_cache::draw_text(cv::Mat& output
+                           , const frame_point_t& pos
+                           , const font_format_t& font_format
+                           , const std::string& text
+                           , const cv::Scalar& color)
+{
+    m_text_cache_context->draw_text(output
+                                    , pos
+                                    , font_format
+                                    , text
+                                    , color);
+}
+
+frame_size_t text_cache::text_size(const font_format_t& font_format
+                                   , const std::string& text)
+{
+    return m_text_cache_context->text_size(font_format
+                                           , text);
+}
+
+frame_rect_t text_cache::text_bounds(const font_format_t& font_format
+                                     , const std::string& text)
+{
+    return m_text_cache_context->text_bounds(font_format
+                                             , text);
+}
+
+text_cache_stats_t text_cache::stats() const
+{
+    return m_text_cache_context->stats();
+}
+
+void text_cache::clear()
+{
+    m_text_cache_context->clear();
+}
+
+}
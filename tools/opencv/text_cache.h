@@ -0,0 +1,61 @@
+#ifndef OCV_TEXT_CACHE_H
+#define OCV_TEXT_CACHE_H
+
+#include "font_format.h"
+#include <opencv2/core.hpp>
+#include <opencv2/freetype.hpp>
+#include <memory>
+
+namespace ocv
+{
+
+const std::size_t default_text_layout_capacity = 256;
+
+struct text_cache_stats_t
+{
+    std::size_t     glyphs = 0;
+    std::size_t     glyph_misses = 0;
+    std::size_t     layouts = 0;
+    std::size_t     layout_hits = 0;
+    std::size_t     layout_misses = 0;
+};
+
+struct text_cache_context_t;
+struct text_cache_context_deleter_t { void operator()(text_cache_context_t* text_cache_context_ptr); };
+
+typedef std::unique_ptr<text_cache_context_t, text_cache_context_deleter_t> text_cache_context_ptr_t;
+
+// Glyph atlas and text layout cache of the draw processor. Glyphs are
+// rasterized once per font, height and weight into 8 bit coverage pages;
+// a string is laid out once (LRU) and drawn as a coverage blit per glyph.
+// The custom (FreeType) font is used when set, Hershey fonts otherwise.
+class text_cache
+{
+    text_cache_context_ptr_t    m_text_cache_context;
+
+public:
+    text_cache(std::size_t layout_capacity = default_text_layout_capacity);
+
+    // drops the glyphs of the previous custom font
+    void set_custom_font(const cv::Ptr<cv::freetype::FreeType2>& custom_font);
+
+    void draw_text(cv::Mat& output
+                   , const frame_point_t& pos
+                   , const font_format_t& font_format
+                   , const std::string& text
+                   , const cv::Scalar& color);
+
+    frame_size_t text_size(const font_format_t& font_format
+                           , const std::string& text);
+
+    // the drawn pixels relative to the text position
+    frame_rect_t text_bounds(const font_format_t& font_format
+                             , const std::string& text);
+
+    text_cache_stats_t stats() const;
+    void clear();
+};
+
+}
+
+#endif // OCV_TEXT_CACHE_H
@@ -0,0 +1,325 @@
+#include "yuv_overlay.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace ocv
+{
+
+namespace
+{
+
+inline std::int32_t div255(std::int32_t value)
+{
+    // exact rounding for 0 .. 65535
+    value += 128;
+    return (value + (value >> 8)) >> 8;
+}
+
+inline std::uint8_t blend(std::int32_t input
+                          , std::int32_t output
+                          , std::int32_t a)
+{
+    return div255(input * a + output * (255 - a));
+}
+
+// the visible part of an overlay in luma and chroma samples
+struct overlay_area_t
+{
+    std::int32_t    x0;
+    std::int32_t    y0;
+    std::int32_t    x1;
+    std::int32_t    y1;
+    std::int32_t    cx0;
+    std::int32_t    cy0;
+    std::int32_t    cx1;
+    std::int32_t    cy1;
+
+    bool clip(const yuv_image_t& image
+              , const frame_point_t& offset
+              , const frame_size_t& size)
+    {
+        x0 = std::max(offset.x, 0);
+        y0 = std::max(offset.y, 0);
+        x1 = std::min(offset.x + size.width, image.size.width);
+        y1 = std::min(offset.y + size.height, image.size.height);
+
+        cx0 = x0 / 2;
+        cy0 = y0 / 2;
+        cx1 = (x1 + 1) / 2;
+        cy1 = (y1 + 1) / 2;
+
+        return x0 < x1
+                && y0 < y1;
+    }
+
+    frame_size_t size() const
+    {
+        return { x1 - x0, y1 - y0 };
+    }
+
+    frame_size_t chroma_size() const
+    {
+        return { cx1 - cx0, cy1 - cy0 };
+    }
+};
+
+// yuv_from_bgr without the offsets: linear in the color, so it takes
+// premultiplied pixels and gives the values multiplied by alpha
+struct yuv_delta_t
+{
+    std::int32_t    y;
+    std::int32_t    u;
+    std::int32_t    v;
+};
+
+inline yuv_delta_t yuv_delta_from_bgr(std::int32_t b
+                                      , std::int32_t g
+                                      , std::int32_t r)
+{
+    return { (66 * r + 129 * g + 25 * b + 128) >> 8
+             , (-38 * r - 74 * g + 112 * b + 128) >> 8
+             , (112 * r - 94 * g - 18 * b + 128) >> 8 };
+}
+
+struct chroma_sum_t
+{
+    std::int32_t    weight = 0;
+    std::int32_t    u = 0;
+    std::int32_t    v = 0;
+};
+
+}
+
+yuv_color_t yuv_from_bgr(std::uint8_t b
+                         , std::uint8_t g
+                         , std::uint8_t r)
+{
+    return { static_cast<std::uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16)
+             , static_cast<std::uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128)
+             , static_cast<std::uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128) };
+}
+
+void yuv_fill(const yuv_image_t& image
+              , const frame_point_t& offset
+              , const frame_size_t& size
+              , const yuv_color_t& color
+              , const blend_mask_t& coverage
+              , double opacity
+              , frame_data_t* scratch)
+{
+    overlay_area_t area;
+
+    if (image.y == nullptr
+            || image.u == nullptr
+            || coverage.data == nullptr
+            || opacity <= 0.0
+            || !area.clip(image, offset, size))
+    {
+        return;
+    }
+
+    alpha_fill(&color.y
+               , image.y + area.y0 * image.y_stride + area.x0
+               , image.y_stride
+               , 1
+               , area.size()
+               , opacity
+               , { coverage.data + (area.y0 - offset.y) * coverage.stride + (area.x0 - offset.x)
+                   , coverage.stride });
+
+    // samples outside of the overlay count as not covered
+    auto chroma_size = area.chroma_size();
+    frame_data_t local_coverage;
+    auto& chroma_coverage = scratch != nullptr
+            ? *scratch
+            : local_coverage;
+
+    if (chroma_coverage.size() < chroma_size.size())
+    {
+        chroma_coverage.resize(chroma_size.size());
+    }
+
+    for (std::int32_t cy = area.cy0; cy < area.cy1; cy++)
+    {
+        auto* chroma_row = chroma_coverage.data() + (cy - area.cy0) * chroma_size.width;
+
+        for (std::int32_t cx = area.cx0; cx < area.cx1; cx++)
+        {
+            std::int32_t sum = 0;
+
+            for (auto y = std::max(cy * 2, area.y0); y < std::min(cy * 2 + 2, area.y1); y++)
+            {
+                const auto* coverage_row = coverage.data + (y - offset.y) * coverage.stride;
+
+                for (auto x = std::max(cx * 2, area.x0); x < std::min(cx * 2 + 2, area.x1); x++)
+                {
+                    sum += coverage_row[x - offset.x];
+                }
+            }
+
+            chroma_row[cx - area.cx0] = (sum + 2) >> 2;
+        }
+    }
+
+    const blend_mask_t chroma_mask{ chroma_coverage.data(), chroma_size.width };
+
+    if (image.v == nullptr)
+    {
+        const std::uint8_t uv[] = { color.u, color.v };
+
+        alpha_fill(uv
+                   , image.u + area.cy0 * image.u_stride + area.cx0 * 2
+                   , image.u_stride
+                   , 2
+                   , chroma_size
+                   , opacity
+                   , chroma_mask);
+    }
+    else
+    {
+        alpha_fill(&color.u
+                   , image.u + area.cy0 * image.u_stride + area.cx0
+                   , image.u_stride
+                   , 1
+                   , chroma_size
+                   , opacity
+                   , chroma_mask);
+
+        alpha_fill(&color.v
+                   , image.v + area.cy0 * image.v_stride + area.cx0
+                   , image.v_stride
+                   , 1
+                   , chroma_size
+                   , opacity
+                   , chroma_mask);
+    }
+}
+
+void yuv_blend(const yuv_image_t& image
+               , const frame_point_t& offset
+               , const blend_image_t& input
+               , const frame_size_t& size
+               , double opacity
+               , const blend_mask_t& mask)
+{
+    overlay_area_t area;
+
+    if (image.y == nullptr
+            || image.u == nullptr
+            || input.data == nullptr
+            || (input.channels != 3 && input.channels != 4)
+            || opacity <= 0.0
+            || !area.clip(image, offset, size))
+    {
+        return;
+    }
+
+    auto q15 = static_cast<std::int32_t>(std::min(opacity, 1.0) * 32767.0 + 0.5);
+    const bool is_premultiplied = input.premultiplied
+            && input.channels == 4;
+
+    auto chroma_size = area.chroma_size();
+    std::vector<chroma_sum_t> chroma_sums(chroma_size.size());
+
+    for (std::int32_t y = area.y0; y < area.y1; y++)
+    {
+        const auto* input_row = input.data + (y - offset.y) * input.stride;
+        const auto* mask_row = mask.data != nullptr
+                ? mask.data + (y - offset.y) * mask.stride
+                : nullptr;
+        auto* output_row = image.y + y * image.y_stride;
+        auto* sum_row = chroma_sums.data() + (y / 2 - area.cy0) * chroma_size.width;
+
+        for (std::int32_t x = area.x0; x < area.x1; x++)
+        {
+            const auto* pixel = input_row + (x - offset.x) * input.channels;
+            auto& sum = sum_row[x / 2 - area.cx0];
+
+            if (is_premultiplied)
+            {
+                // Y * a = delta * s + 16 * a, s = mask * opacity
+                std::int32_t s = mask_row != nullptr
+                        ? mask_row[x - offset.x]
+                        : 255;
+
+                s = (s * q15 + 16384) >> 15;
+
+                std::int32_t a = div255(pixel[3] * s);
+
+                if (a == 0)
+                {
+                    continue;
+                }
+
+                auto delta = yuv_delta_from_bgr(pixel[0], pixel[1], pixel[2]);
+
+                output_row[x] = div255(delta.y * s + 16 * a + output_row[x] * (255 - a));
+
+                sum.weight += a;
+                sum.u += delta.u * s + 128 * a;
+                sum.v += delta.v * s + 128 * a;
+                continue;
+            }
+
+            std::int32_t a = input.channels == 4
+                    ? pixel[3]
+                    : 255;
+
+            if (mask_row != nullptr)
+            {
+                a = div255(a * mask_row[x - offset.x]);
+            }
+
+            a = (a * q15 + 16384) >> 15;
+
+            if (a == 0)
+            {
+                continue;
+            }
+
+            auto color = yuv_from_bgr(pixel[0], pixel[1], pixel[2]);
+
+            output_row[x] = blend(color.y, output_row[x], a);
+
+            sum.weight += a;
+            sum.u += a * color.u;
+            sum.v += a * color.v;
+        }
+    }
+
+    for (std::int32_t cy = area.cy0; cy < area.cy1; cy++)
+    {
+        const auto* sum_row = chroma_sums.data() + (cy - area.cy0) * chroma_size.width;
+
+        for (std::int32_t cx = area.cx0; cx < area.cx1; cx++)
+        {
+            const auto& sum = sum_row[cx - area.cx0];
+
+            if (sum.weight == 0)
+            {
+                continue;
+            }
+
+            auto a = (sum.weight + 2) >> 2;
+            auto u = (sum.u + sum.weight / 2) / sum.weight;
+            auto v = (sum.v + sum.weight / 2) / sum.weight;
+
+            if (image.v == nullptr)
+            {
+                auto* uv = image.u + cy * image.u_stride + cx * 2;
+                uv[0] = blend(u, uv[0], a);
+                uv[1] = blend(v, uv[1], a);
+            }
+            else
+            {
+                auto* u_ptr = image.u + cy * image.u_stride + cx;
+                auto* v_ptr = image.v + cy * image.v_stride + cx;
+                *u_ptr = blend(u, *u_ptr, a);
+                *v_ptr = blend(v, *v_ptr, a);
+            }
+        }
+    }
+}
+
+}
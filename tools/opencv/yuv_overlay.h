@@ -0,0 +1,59 @@
+#ifndef OCV_YUV_OVERLAY_H
+#define OCV_YUV_OVERLAY_H
+
+#include "alpha_blend.h"
+
+namespace ocv
+{
+
+struct yuv_color_t
+{
+    std::uint8_t    y;
+    std::uint8_t    u;
+    std::uint8_t    v;
+};
+
+// BT.601 limited range, the swscale default
+yuv_color_t yuv_from_bgr(std::uint8_t b
+                         , std::uint8_t g
+                         , std::uint8_t r);
+
+// planes of a YUV 4:2:0 image, v == nullptr - NV12 (interleaved UV in u)
+struct yuv_image_t
+{
+    std::uint8_t*   y = nullptr;
+    std::uint8_t*   u = nullptr;
+    std::uint8_t*   v = nullptr;
+    std::int32_t    y_stride = 0;
+    std::int32_t    u_stride = 0;
+    std::int32_t    v_stride = 0;
+    frame_size_t    size;
+};
+
+// The overlay is placed at a luma offset of any parity and clipped to the
+// image. Luma samples are blended one to one, a chroma sample with the mean
+// weight of the 2x2 luma samples it covers; only the overlay area is touched.
+
+// a solid color through an 8 bit coverage of the given size; the chroma
+// coverage is built in the caller's scratch when given, so repeated fills
+// do not allocate
+void yuv_fill(const yuv_image_t& image
+              , const frame_point_t& offset
+              , const frame_size_t& size
+              , const yuv_color_t& color
+              , const blend_mask_t& coverage
+              , double opacity = 1.0
+              , frame_data_t* scratch = nullptr);
+
+// a BGR/BGRA image (premultiplied too), weighted by alpha * mask * opacity
+// as in alpha_blend; chroma of the image is averaged by the weights
+void yuv_blend(const yuv_image_t& image
+               , const frame_point_t& offset
+               , const blend_image_t& input
+               , const frame_size_t& size
+               , double opacity = 1.0
+               , const blend_mask_t& mask = {});
+
+}
+
+#endif // OCV_YUV_OVERLAY_H
@@ -0,0 +1,196 @@
+#include "test.h"
+#include "v4l2_device.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <glob.h>
+#include <unistd.h>
+
+namespace v4l2
+{
+
+const std::uint32_t test_timeout = 3000;
+const std::size_t test_frames = 10;
+
+static bool check(bool result
+                  , const std::string& device
+                  , const char* name)
+{
+    if (!result)
+    {
+        std::cout << "v4l2 capture " << device << ": " << name << " failed" << std::endl;
+    }
+
+    return result;
+}
+
+static std::vector<std::string> fetch_devices()
+{
+    std::vector<std::string> devices;
+    glob_t result = {};
+
+    if (glob("/dev/video*", 0, nullptr, &result) == 0)
+    {
+        for (std::size_t i = 0; i < result.gl_pathc; i++)
+        {
+            devices.emplace_back(result.gl_pathv[i]);
+        }
+    }
+
+    globfree(&result);
+
+    return devices;
+}
+
+template<typename Predicate>
+static bool wait_for(const Predicate& predicate)
+{
+    auto tp = std::chrono::steady_clock::now();
+
+    while (!predicate())
+    {
+        if (std::chrono::steady_clock::now() - tp > std::chrono::milliseconds(test_timeout))
+        {
+            return false;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    return true;
+}
+
+struct user_allocator_t
+{
+    std::shared_ptr<std::atomic<std::size_t>> allocated = std::make_shared<std::atomic<std::size_t>>(0);
+
+    buffer_allocator_t allocator() const
+    {
+        return [allocated = allocated](std::size_t size)
+        {
+            auto page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+            auto buffer = std::aligned_alloc(page_size
+                                             , (size + page_size - 1) / page_size * page_size);
+            if (buffer == nullptr)
+            {
+                return std::shared_ptr<void>();
+            }
+
+            (*allocated)++;
+
+            return std::shared_ptr<void>(buffer
+                                         , [](void* buffer) { std::free(buffer); });
+        };
+    }
+};
+
+// the default single buffer open: the driver may raise the count, every
+// buffer it takes gets a user buffer
+static void test_userptr_capture(const std::string& device)
+{
+    std::atomic<std::size_t> frames(0);
+    std::atomic_bool opened(false);
+    user_allocator_t user_allocator;
+
+    v4l2_device capture([&](frame_t&&)
+    {
+        frames++;
+        return true;
+    }
+    , [&](const streaming_event_t& streaming_event)
+    {
+        if (streaming_event == streaming_event_t::open)
+        {
+            opened = true;
+        }
+    });
+
+    capture.set_buffer_allocator(user_allocator.allocator());
+    capture.open(device);
+
+    if (wait_for([&] { return opened.load(); }))
+    {
+        check(wait_for([&] { return frames >= test_frames; })
+              , device
+              , "userptr frames");
+
+        auto stats = capture.get_capture_stats();
+
+        check(stats.buffers > 0
+                && stats.buffers == *user_allocator.allocated
+              , device
+              , "userptr buffer count");
+    }
+
+    capture.close();
+}
+
+// a frame held over the close must not keep the device from a reopen
+static void test_lent_frame_reopen(const std::string& device)
+{
+    std::atomic<std::size_t> frames(0);
+    std::atomic<std::size_t> opened(0);
+    std::mutex mutex;
+    frame_ref_t held_frame;
+
+    v4l2_device capture(nullptr
+                        , [&](const streaming_event_t& streaming_event)
+    {
+        if (streaming_event == streaming_event_t::open)
+        {
+            opened++;
+        }
+    });
+
+    capture.set_frame_ref_handler([&](const frame_ref_t& frame)
+    {
+        std::lock_guard<std::mutex> lg(mutex);
+
+        if (held_frame.is_null())
+        {
+            held_frame = frame;
+        }
+
+        frames++;
+        return true;
+    });
+
+    capture.open(device);
+
+    if (!wait_for([&] { return opened >= 1 && frames > 0; }))
+    {
+        capture.close();
+        return;
+    }
+
+    capture.close();
+
+    frames = 0;
+    capture.open(device);
+
+    check(wait_for([&] { return opened >= 2 && frames >= test_frames; })
+          , device
+          , "reopen with a lent frame");
+
+    capture.close();
+
+    std::lock_guard<std::mutex> lg(mutex);
+    held_frame = frame_ref_t();
+}
+
+void test()
+{
+    for (const auto& device : fetch_devices())
+    {
+        test_userptr_capture(device);
+        test_lent_frame_reopen(device);
+    }
+}
+
+}
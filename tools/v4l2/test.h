@@ -0,0 +1,12 @@
+#ifndef V4L2_TEST_H
+#define V4L2_TEST_H
+
+namespace v4l2
+{
+
+// capture checks on the /dev/video* devices present, none - nothing to do
+void test();
+
+}
+
+#endif // V4L2_TEST_H
@@ -334,6 +334,26 @@ bool set_fps(handle_t handle
     return xioctl(handle, VIDIOC_S_PARM, &stream_parm) >= 0;
 }
 
+static v4l2_memory to_memory(memory_type_t memory)
+{
+    return memory == memory_type_t::userptr
+            ? V4L2_MEMORY_USERPTR
+            : V4L2_MEMORY_MMAP;
+}
+
+std::size_t fetch_image_size(handle_t handle)
+{
+    struct v4l2_format format = {};
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+    if (xioctl(handle, VIDIOC_G_FMT, &format) >= 0)
+    {
+        return format.fmt.pix.sizeimage;
+    }
+
+    return 0;
+}
+
 mapped_buffer_t map(handle_t handle, std::size_t buffer_count)
 {
     mapped_buffer_t mapped_buffer;
@@ -387,16 +407,80 @@ mapped_buffer_t map(handle_t handle, std::size_t buffer_count)
     return std::move(mapped_buffer);
 }
 
+std::size_t request_buffers(handle_t handle
+                            , std::size_t buffer_count
+                            , memory_type_t memory)
+{
+    struct v4l2_requestbuffers reqbuf = {};
+    reqbuf.count = buffer_count;
+    reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    reqbuf.memory = to_memory(memory);
+
+    return xioctl(handle, VIDIOC_REQBUFS, &reqbuf) >= 0
+            ? reqbuf.count
+            : 0;
+}
+
+mapped_buffer_t map_userptr(handle_t handle, const buffer_list_t &user_buffers)
+{
+    mapped_buffer_t mapped_buffer;
+
+    mapped_buffer.index = 0;
+    mapped_buffer.memory = memory_type_t::userptr;
+
+    if (!user_buffers.empty())
+    {
+        bool has_error = false;
+
+        for (std::uint32_t idx = 0; idx < user_buffers.size() && !has_error; ++idx)
+        {
+            const auto& user_buffer = user_buffers[idx];
+
+            struct v4l2_buffer buffer = {};
+            buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            buffer.memory = V4L2_MEMORY_USERPTR;
+            buffer.index = idx;
+            buffer.m.userptr = reinterpret_cast<unsigned long>(user_buffer.buffer);
+            buffer.length = user_buffer.size;
+
+            has_error = xioctl(handle, VIDIOC_QBUF, &buffer) < 0;
+
+            if (!has_error)
+            {
+                mapped_buffer.buffers.push_back({ user_buffer.buffer, user_buffer.size });
+            }
+        }
+
+        enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+        if (has_error || xioctl(handle, VIDIOC_STREAMON, &type) < 0)
+        {
+            unmap(handle, mapped_buffer);
+        }
+    }
+
+    return mapped_buffer;
+}
+
 std::size_t unmap(handle_t handle, mapped_buffer_t &mapped_buffer)
 {
     std::size_t result = 0;
 
-    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    xioctl(handle, VIDIOC_STREAMOFF, &type);
+    if (handle >= 0)
+    {
+        stop_capture(handle);
+    }
 
     for (auto& buffer : mapped_buffer.buffers)
     {
-        if (munmap(buffer.buffer, buffer.size) >= 0)
+        if (buffer.dmabuf_fd >= 0)
+        {
+            ::close(buffer.dmabuf_fd);
+        }
+
+        // the user buffers stay with the caller
+        if (mapped_buffer.memory == memory_type_t::userptr
+                || munmap(buffer.buffer, buffer.size) >= 0)
         {
             result++;
         }
@@ -408,6 +492,12 @@ std::size_t unmap(handle_t handle, mapped_buffer_t &mapped_buffer)
     return result;
 }
 
+bool stop_capture(handle_t handle)
+{
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    return xioctl(handle, VIDIOC_STREAMOFF, &type) >= 0;
+}
+
 frame_data_t fetch_frame_data(handle_t handle
                               , mapped_buffer_t& mapped_buffer
                               , std::uint32_t timeout)
@@ -420,7 +510,7 @@ frame_data_t fetch_frame_data(handle_t handle
         struct v4l2_buffer buffer = {0};
 
         buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buffer.memory = V4L2_MEMORY_MMAP;
+        buffer.memory = to_memory(mapped_buffer.memory);
         buffer.index = mapped_buffer.index;
 
         if (xioctl(handle, VIDIOC_DQBUF, &buffer) >= 0)
@@ -444,6 +534,85 @@ frame_data_t fetch_frame_data(handle_t handle
     return std::move(frame_data);
 }
 
+int32_t dequeue_buffer(handle_t handle
+                       , const mapped_buffer_t &mapped_buffer
+                       , uint32_t &bytes_used
+                       , uint32_t timeout)
+{
+    if (timeout == 0
+            || io_wait(handle, timeout))
+    {
+        struct v4l2_buffer buffer = {};
+
+        buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buffer.memory = to_memory(mapped_buffer.memory);
+
+        if (xioctl(handle, VIDIOC_DQBUF, &buffer) >= 0)
+        {
+            bytes_used = buffer.bytesused;
+            return buffer.index;
+        }
+    }
+
+    return -1;
+}
+
+std::size_t export_buffers(handle_t handle, mapped_buffer_t &mapped_buffer)
+{
+    std::size_t result = 0;
+
+    if (mapped_buffer.memory == memory_type_t::mmap)
+    {
+        for (std::uint32_t idx = 0; idx < mapped_buffer.buffers.size(); ++idx)
+        {
+            auto& buffer = mapped_buffer.buffers[idx];
+
+            if (buffer.dmabuf_fd < 0)
+            {
+                struct v4l2_exportbuffer export_buffer = {};
+                export_buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+                export_buffer.index = idx;
+                export_buffer.flags = O_CLOEXEC | O_RDONLY;
+
+                if (xioctl(handle, VIDIOC_EXPBUF, &export_buffer) < 0)
+                {
+                    continue;
+                }
+
+                buffer.dmabuf_fd = export_buffer.fd;
+            }
+
+            result++;
+        }
+    }
+
+    return result;
+}
+
+bool queue_buffer(handle_t handle
+                  , const mapped_buffer_t &mapped_buffer
+                  , uint32_t index)
+{
+    struct v4l2_buffer buffer = {};
+
+    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buffer.memory = to_memory(mapped_buffer.memory);
+    buffer.index = index;
+
+    if (mapped_buffer.memory == memory_type_t::userptr)
+    {
+        if (index >= mapped_buffer.buffers.size())
+        {
+            return false;
+        }
+
+        buffer.m.userptr = reinterpret_cast<unsigned long>(mapped_buffer.buffers[index].buffer);
+        buffer.length = mapped_buffer.buffers[index].size;
+    }
+
+    return xioctl(handle, VIDIOC_QBUF, &buffer) >= 0;
+}
+
 bool set_control(handle_t handle, uint32_t id, int32_t value)
 {
     struct v4l2_control v_control = {};
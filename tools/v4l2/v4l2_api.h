@@ -25,6 +25,8 @@ bool fetch_frame_format(handle_t handle
                         , pixel_format_t& pixel_format);
 bool fetch_fps(handle_t handle
                , std::uint32_t& fps);
+// bytes of a frame of the current format, 0 - unknown
+std::size_t fetch_image_size(handle_t handle);
 
 bool set_frame_format(handle_t handle
                       , const frame_size_t& frame_size
@@ -42,13 +44,38 @@ bool get_control(handle_t handle
                  , std::int32_t& value);
 
 mapped_buffer_t map(handle_t handle, std::size_t buffer_count = 1);
+// VIDIOC_REQBUFS, the count granted by the driver, which may raise or
+// lower the requested one, 0 - failed or released
+std::size_t request_buffers(handle_t handle
+                            , std::size_t buffer_count
+                            , memory_type_t memory);
+// USERPTR capture into the caller buffers (page aligned, of at least
+// fetch_image_size() bytes), they must outlive unmap(). One buffer for each
+// of the request_buffers() count, the driver may not stream with less.
+mapped_buffer_t map_userptr(handle_t handle, const buffer_list_t& user_buffers);
+// the buffers are unmapped, a closed handle (-1) only releases the mappings
 std::size_t unmap(handle_t handle, mapped_buffer_t& mapped_buffer);
+// VIDIOC_STREAMOFF, the driver drops all of its queued buffers
+bool stop_capture(handle_t handle);
+// VIDIOC_EXPBUF of the mmap buffers to DMABUF fds, closed by unmap(),
+// the count of exported buffers
+std::size_t export_buffers(handle_t handle, mapped_buffer_t& mapped_buffer);
 
 control_map_t fetch_control_list(handle_t handle);
 frame_data_t fetch_frame_data(handle_t handle
                               , mapped_buffer_t& mapped_buffer
                               , std::uint32_t timeout = 0);
 
+// zero copy capture: the index of a filled buffer (-1 - none) and its
+// payload, the buffer stays with the caller until queue_buffer()
+std::int32_t dequeue_buffer(handle_t handle
+                            , const mapped_buffer_t& mapped_buffer
+                            , std::uint32_t& bytes_used
+                            , std::uint32_t timeout = 0);
+bool queue_buffer(handle_t handle
+                  , const mapped_buffer_t& mapped_buffer
+                  , std::uint32_t index);
+
 
 }
 
@@ -85,6 +85,33 @@ frame_t::frame_t(const frame_info_t &frame_info
 
 }
 
+frame_ref_t::frame_ref_t(const frame_info_t &frame_info
+                         , const std::shared_ptr<const uint8_t> &data
+                         , std::size_t size
+                         , int32_t dmabuf_fd)
+    : frame_info(frame_info)
+    , data(data)
+    , size(size)
+    , dmabuf_fd(dmabuf_fd)
+{
+
+}
+
+bool frame_ref_t::is_null() const
+{
+    return data == nullptr
+            || size == 0;
+}
+
+frame_t frame_ref_t::copy() const
+{
+    return is_null()
+            ? frame_t(frame_info)
+            : frame_t(frame_info
+                      , frame_data_t(data.get()
+                                     , data.get() + size));
+}
+
 control_menu_item_t::control_menu_item_t(uint32_t id, const std::string &name)
     : id(id)
     , name(name)
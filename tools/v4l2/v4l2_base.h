@@ -81,6 +81,33 @@ struct frame_t
 
 typedef std::queue<frame_t> frame_queue_t;
 
+// a frame left in the driver buffer: the copies share the buffer, it goes
+// back to the driver when the last copy is released
+struct frame_ref_t
+{
+    frame_info_t                            frame_info;
+    std::shared_ptr<const std::uint8_t>     data;
+    std::size_t                             size;
+    std::int32_t                            dmabuf_fd;  // -1 - not exported, valid while held
+
+    frame_ref_t(const frame_info_t& frame_info = frame_info_t()
+                , const std::shared_ptr<const std::uint8_t>& data = nullptr
+                , std::size_t size = 0
+                , std::int32_t dmabuf_fd = -1);
+
+    bool is_null() const;
+    frame_t copy() const;
+};
+
+struct capture_stats_t
+{
+    std::size_t     buffers = 0;            // mapped by the driver
+    std::size_t     lent_buffers = 0;       // held by the consumers now
+    std::size_t     max_lent_buffers = 0;
+    std::size_t     lent_frames = 0;
+    std::size_t     starvations = 0;        // frames copied to leave the driver a buffer
+};
+
 typedef std::int32_t value_type_t;
 
 struct control_range_t
@@ -144,18 +171,31 @@ struct buffer_item_t
 {
     void *buffer;
     std::size_t size;
+    std::int32_t dmabuf_fd = -1;    // exported by export_buffers()
+};
+
+typedef std::vector<buffer_item_t> buffer_list_t;
+
+enum class memory_type_t
+{
+    mmap,       // buffers of the driver mapped to the process
+    userptr     // buffers of the caller, the driver captures into them
 };
 
 struct mapped_buffer_t
 {
-    std::vector<buffer_item_t>  buffers;
+    buffer_list_t               buffers;
     std::uint32_t               index;
+    memory_type_t               memory = memory_type_t::mmap;
 
     buffer_item_t& current();
     void next();
 };
 
 typedef std::function<bool(frame_t&& frame)> frame_handler_t;
+typedef std::function<bool(const frame_ref_t& frame)> frame_ref_handler_t;
+// USERPTR capture: a buffer of the size for the caller pool, nullptr - none
+typedef std::function<std::shared_ptr<void>(std::size_t size)> buffer_allocator_t;
 
 
 typedef std::function<bool(const frame_info_t& frame_info
@@ -7,6 +7,7 @@
 #include <mutex>
 #include <map>
 #include <future>
+#include <cstring>
 
 #define WBS_MODULE_NAME "v4l2:device"
 #include "tools/base/logger_base.h"
@@ -20,6 +21,10 @@ const std::int32_t relative_max = 0x7fffffff;
 
 const std::uint32_t watchdog_timeout = 5000;
 const std::size_t max_frame_queue = 10;
+// lent frames wait in the consumers while the driver fills the rest
+const std::uint32_t min_lending_buffer_count = 4;
+// buffers never lent, so the driver always has one to capture into
+const std::size_t min_queued_buffers = 1;
 
 template<typename T>
 static T scale_value(T input_value, T input_min, T input_max, T output_min, T output_max)
@@ -155,14 +160,25 @@ struct command_controller_t
     }
 };
 
-struct v4l2_object_t
+// shared with the lent frames: close() stops the capture and releases the
+// handle, so the device can be reopened at once, only the mappings live
+// until the last frame is released
+struct v4l2_object_t : public std::enable_shared_from_this<v4l2_object_t>
 {
     std::int32_t handle;
     mapped_buffer_t mapped_buffer;
 
+    std::mutex buffer_mutex;
+    capture_stats_t capture_stats;
+
+    // released after unmap()
+    std::vector<std::shared_ptr<void>> user_buffers;
+
     v4l2_object_t(const std::string& uri
                   , const frame_info_t& frame_info = frame_info_t()
-                  , std::size_t buffer_count = 1)
+                  , std::size_t buffer_count = 1
+                  , const buffer_allocator_t& buffer_allocator = nullptr
+                  , bool dmabuf_export = false)
 
         : handle(v4l2::open_device(uri))
     {
@@ -173,17 +189,89 @@ struct v4l2_object_t
                 set_frame_info(frame_info);
             }
 
-            mapped_buffer = std::move(std::move(v4l2::map(handle
-                                                          , buffer_count)
-                                                ));
+            if (buffer_allocator != nullptr)
+            {
+                map_user_buffers(buffer_allocator
+                                 , buffer_count);
+            }
+            else
+            {
+                mapped_buffer = std::move(std::move(v4l2::map(handle
+                                                              , buffer_count)
+                                                    ));
+                if (dmabuf_export)
+                {
+                    v4l2::export_buffers(handle
+                                         , mapped_buffer);
+                }
+            }
+        }
+    }
+
+    // the driver sets the count of the buffers, each of them gets a user
+    // buffer or the capture fails
+    void map_user_buffers(const buffer_allocator_t& buffer_allocator
+                          , std::size_t buffer_count)
+    {
+        auto image_size = v4l2::fetch_image_size(handle);
+
+        if (image_size == 0)
+        {
+            return;
+        }
+
+        buffer_count = v4l2::request_buffers(handle
+                                             , buffer_count
+                                             , memory_type_t::userptr);
+
+        buffer_list_t buffers;
+
+        while (buffers.size() < buffer_count)
+        {
+            auto user_buffer = buffer_allocator(image_size);
+
+            if (user_buffer == nullptr)
+            {
+                break;
+            }
+
+            buffers.push_back({ user_buffer.get(), image_size });
+            user_buffers.emplace_back(std::move(user_buffer));
+        }
+
+        if (buffer_count == 0
+                || buffers.size() < buffer_count)
+        {
+            v4l2::request_buffers(handle
+                                  , 0
+                                  , memory_type_t::userptr);
+            user_buffers.clear();
+            return;
         }
+
+        mapped_buffer = v4l2::map_userptr(handle
+                                          , buffers);
     }
 
     ~v4l2_object_t()
     {
+        close();
         v4l2::unmap(handle
               , mapped_buffer);
-        v4l2::close_device(handle);
+    }
+
+    // the driver returns the lent buffers with the STREAMOFF, their memory
+    // stays mapped and is not queued again
+    void close()
+    {
+        std::lock_guard<std::mutex> lg(buffer_mutex);
+
+        if (handle >= 0)
+        {
+            v4l2::stop_capture(handle);
+            v4l2::close_device(handle);
+            handle = -1;
+        }
     }
 
 
@@ -249,6 +337,83 @@ struct v4l2_object_t
                                       , timeout);
     }
 
+    frame_ref_t fetch_frame_ref(const frame_info_t& frame_info
+                                , std::uint32_t timeout = 0)
+    {
+        std::uint32_t bytes_used = 0;
+        auto index = v4l2::dequeue_buffer(handle
+                                          , mapped_buffer
+                                          , bytes_used
+                                          , timeout);
+        if (index < 0)
+        {
+            return frame_ref_t(frame_info);
+        }
+
+        if (static_cast<std::size_t>(index) >= mapped_buffer.buffers.size()
+                || bytes_used == 0
+                || bytes_used > mapped_buffer.buffers[index].size)
+        {
+            v4l2::queue_buffer(handle, mapped_buffer, index);
+            return frame_ref_t(frame_info);
+        }
+
+        const auto& buffer = mapped_buffer.buffers[index];
+        auto data = static_cast<const std::uint8_t*>(buffer.buffer);
+
+        std::lock_guard<std::mutex> lg(buffer_mutex);
+
+        if (capture_stats.lent_buffers + min_queued_buffers >= mapped_buffer.buffers.size())
+        {
+            capture_stats.starvations++;
+
+            std::shared_ptr<std::uint8_t> frame_data(new std::uint8_t[bytes_used]
+                                                     , std::default_delete<std::uint8_t[]>());
+            std::memcpy(frame_data.get(), data, bytes_used);
+            v4l2::queue_buffer(handle, mapped_buffer, index);
+
+            return frame_ref_t(frame_info
+                               , frame_data
+                               , bytes_used);
+        }
+
+        capture_stats.lent_buffers++;
+        capture_stats.lent_frames++;
+        capture_stats.max_lent_buffers = std::max(capture_stats.max_lent_buffers
+                                                  , capture_stats.lent_buffers);
+
+        std::shared_ptr<const std::uint8_t> frame_data(data
+                                                       , [object = shared_from_this(), index](const std::uint8_t*)
+        {
+            object->release_buffer(index);
+        });
+
+        return frame_ref_t(frame_info
+                           , frame_data
+                           , bytes_used
+                           , buffer.dmabuf_fd);
+    }
+
+    void release_buffer(std::uint32_t index)
+    {
+        std::lock_guard<std::mutex> lg(buffer_mutex);
+
+        if (handle >= 0)
+        {
+            v4l2::queue_buffer(handle, mapped_buffer, index);
+        }
+
+        capture_stats.lent_buffers--;
+    }
+
+    capture_stats_t get_capture_stats()
+    {
+        std::lock_guard<std::mutex> lg(buffer_mutex);
+        auto stats = capture_stats;
+        stats.buffers = mapped_buffer.buffers.size();
+        return stats;
+    }
+
     bool is_open() const
     {
         return handle >= 0;
@@ -273,6 +438,9 @@ struct v4l2_device_context_t
 
     frame_handler_t                     m_frame_handler;
     stream_event_handler_t              m_stream_event_handler;
+    frame_ref_handler_t                 m_frame_ref_handler;
+    buffer_allocator_t                  m_buffer_allocator;
+    bool                                m_dmabuf_export;
 
     std::thread                         m_stream_thread;
     mutable std::mutex                  m_mutex;
@@ -287,7 +455,7 @@ struct v4l2_device_context_t
 
     std::atomic_bool                    m_running;
     std::size_t                         m_frame_counter;
-    std::unique_ptr<v4l2_object_t>      m_device;
+    std::shared_ptr<v4l2_object_t>      m_device;
 
     bool                                m_control_support;
 
@@ -295,6 +463,7 @@ struct v4l2_device_context_t
                           , stream_event_handler_t stream_event_handler)
         : m_frame_handler(frame_handler)
         , m_stream_event_handler(stream_event_handler)
+        , m_dmabuf_export(false)
         , m_running(false)
         , m_frame_counter(0)
         , m_control_support(false)
@@ -312,6 +481,12 @@ struct v4l2_device_context_t
     {
         close();
 
+        if (m_frame_ref_handler != nullptr)
+        {
+            buffer_count = std::max(buffer_count
+                                    , min_lending_buffer_count);
+        }
+
         m_running = true;
         m_stream_thread = std::thread(&v4l2_device_context_t::stream_proc
                                       , this
@@ -378,10 +553,12 @@ struct v4l2_device_context_t
         }
 
         std::lock_guard<std::mutex> lg(m_mutex);
-        m_device.reset();                
+        close_object();
         m_device.reset(new v4l2_object_t(uri
                                      , frame_info
-                                     , buffer_count));
+                                     , buffer_count
+                                     , m_buffer_allocator
+                                     , m_dmabuf_export));
 
 
         if (m_device->fetch_frame_info(frame_info))
@@ -427,18 +604,12 @@ struct v4l2_device_context_t
                 {        
                     command_process(*m_device);
 
-                    frame_t frame(frame_info
-                                  , std::move(m_device->fetch_frame_data(frame_time * 2)));
-
-                    if (!frame.frame_data.empty())
+                    if (m_frame_ref_handler != nullptr
+                            ? fetch_frame_ref(frame_info, frame_time * 2)
+                            : fetch_frame(frame_info, frame_time * 2))
                     {
                         m_frame_counter++;
                         tp = std::chrono::high_resolution_clock::now();
-                        if (m_frame_handler == nullptr
-                                || m_frame_handler(std::move(frame)) == false)
-                        {                       
-                            push_media_queue(std::move(frame));
-                        }
                     }
                     else
                     {
@@ -466,11 +637,69 @@ struct v4l2_device_context_t
 
         {
             std::lock_guard<std::mutex> lg(m_mutex);
-            m_device.reset();
+            close_object();
         }
         push_event(streaming_event_t::stop);
     }
 
+    // frames still lent out keep the object, not the device
+    void close_object()
+    {
+        if (m_device != nullptr)
+        {
+            m_device->close();
+            m_device.reset();
+        }
+    }
+
+    bool fetch_frame(const frame_info_t& frame_info
+                     , std::uint32_t timeout)
+    {
+        frame_t frame(frame_info
+                      , std::move(m_device->fetch_frame_data(timeout)));
+
+        if (!frame.frame_data.empty())
+        {
+            if (m_frame_handler == nullptr
+                    || m_frame_handler(std::move(frame)) == false)
+            {
+                push_media_queue(std::move(frame));
+            }
+
+            return true;
+        }
+
+        return false;
+    }
+
+    bool fetch_frame_ref(const frame_info_t& frame_info
+                         , std::uint32_t timeout)
+    {
+        auto frame_ref = m_device->fetch_frame_ref(frame_info
+                                                   , timeout);
+
+        if (!frame_ref.is_null())
+        {
+            // the queue owns its frames, so a rejected frame is copied out
+            if (m_frame_ref_handler(frame_ref) == false)
+            {
+                push_media_queue(frame_ref.copy());
+            }
+
+            return true;
+        }
+
+        return false;
+    }
+
+    capture_stats_t get_capture_stats() const
+    {
+        std::lock_guard<std::mutex> lg(m_mutex);
+        return m_device != nullptr
+                ? m_device->get_capture_stats()
+                : capture_stats_t();
+    }
+
     void command_process(v4l2_object_t& v4l2_object)
     {
         auto requests = m_command_controller.fetch_request_queue();
@@ -648,6 +877,26 @@ bool v4l2_device::open(const std::string &uri
                                         , buffer_count);
 }
 
+void v4l2_device::set_frame_ref_handler(frame_ref_handler_t frame_ref_handler)
+{
+    m_v4l2_device_context->m_frame_ref_handler = frame_ref_handler;
+}
+
+void v4l2_device::set_buffer_allocator(buffer_allocator_t buffer_allocator)
+{
+    m_v4l2_device_context->m_buffer_allocator = buffer_allocator;
+}
+
+void v4l2_device::set_dmabuf_export(bool enable)
+{
+    m_v4l2_device_context->m_dmabuf_export = enable;
+}
+
+capture_stats_t v4l2_device::get_capture_stats() const
+{
+    return m_v4l2_device_context->get_capture_stats();
+}
+
 bool v4l2_device::close()
 {
     return m_v4l2_device_context->close();
@@ -20,6 +20,18 @@ public:
     v4l2_device(frame_handler_t frame_handler = nullptr
             , stream_event_handler_t stream_event_handler = nullptr);
 
+    // zero copy capture, set before open(): the handler gets the frames in
+    // the mmap'd driver buffers instead of the frame handler. A frame holds
+    // its buffer until the last copy is released, at least
+    // min_lending_buffer_count buffers are mapped to cover the consumers.
+    void set_frame_ref_handler(frame_ref_handler_t frame_ref_handler);
+    // USERPTR capture into the buffers of the caller pool (page aligned),
+    // set before open(), nullptr - the mmap buffers of the driver
+    void set_buffer_allocator(buffer_allocator_t buffer_allocator);
+    // mmap buffers exported to DMABUF, the fd comes in frame_ref_t::dmabuf_fd,
+    // set before open()
+    void set_dmabuf_export(bool enable);
+
     bool open(const std::string& uri
               , std::uint32_t buffer_count = 1);
     bool close();
@@ -41,6 +53,8 @@ public:
     bool set_ptz(double pan, double tilt, double zoom);
 
     frame_queue_t fetch_media_queue();
+    // of the current connection
+    capture_stats_t get_capture_stats() const;
 };
 
 }
@@ -0,0 +1,50 @@
+#ifndef V4L2_SHM_TRANSPORT_H
+#define V4L2_SHM_TRANSPORT_H
+
+#include "v4l2_base.h"
+#include "../base/shm_transport.h"
+
+namespace base
+{
+
+template<>
+struct shm_frame_traits_t<v4l2::frame_t>
+{
+    using info_t = v4l2::frame_info_t;
+
+    static const info_t& info(const v4l2::frame_t& frame)
+    {
+        return frame.frame_info;
+    }
+
+    static const void* data(const v4l2::frame_t& frame)
+    {
+        return frame.frame_data.data();
+    }
+
+    static std::size_t size(const v4l2::frame_t& frame)
+    {
+        return frame.frame_data.size();
+    }
+
+    static void assign(v4l2::frame_t& frame
+                       , const info_t& info
+                       , const std::uint8_t* data
+                       , std::size_t size)
+    {
+        frame.frame_info = info;
+        frame.frame_data.assign(data, data + size);
+    }
+};
+
+}
+
+namespace v4l2
+{
+
+typedef base::shm_frame_sink<frame_t> shm_sink_t;
+typedef base::shm_frame_source<frame_t> shm_source_t;
+
+}
+
+#endif // V4L2_SHM_TRANSPORT_H
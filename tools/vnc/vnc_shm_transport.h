@@ -0,0 +1,64 @@
+#ifndef VNC_SHM_TRANSPORT_H
+#define VNC_SHM_TRANSPORT_H
+
+#include "vnc_base.h"
+#include "../base/shm_transport.h"
+
+namespace vnc
+{
+
+struct shm_frame_info_t
+{
+    frame_size_t    frame_size;
+    std::uint32_t   fps;
+    std::uint32_t   bpp;
+};
+
+}
+
+namespace base
+{
+
+template<>
+struct shm_frame_traits_t<vnc::frame_t>
+{
+    using info_t = vnc::shm_frame_info_t;
+
+    static info_t info(const vnc::frame_t& frame)
+    {
+        return { frame.frame_size, frame.fps, frame.bpp };
+    }
+
+    static const void* data(const vnc::frame_t& frame)
+    {
+        return frame.frame_data.data();
+    }
+
+    static std::size_t size(const vnc::frame_t& frame)
+    {
+        return frame.frame_data.size();
+    }
+
+    static void assign(vnc::frame_t& frame
+                       , const info_t& info
+                       , const std::uint8_t* data
+                       , std::size_t size)
+    {
+        frame.frame_size = info.frame_size;
+        frame.fps = info.fps;
+        frame.bpp = info.bpp;
+        frame.frame_data.assign(data, data + size);
+    }
+};
+
+}
+
+namespace vnc
+{
+
+typedef base::shm_frame_sink<frame_t> shm_sink_t;
+typedef base::shm_frame_source<frame_t> shm_source_t;
+
+}
+
+#endif // VNC_SHM_TRANSPORT_H